@@ -52,11 +52,12 @@ Material::Material(std::string& name, const Color3f& ambient, const Color3f& dif
 }
 
 Material::~Material() {
+	//textures are shared by materials (see TextureProxy), they are freed by their owner - an arena or the material which created them
 	for (int i = 0; i < NO_TEXTURES; ++i) {
-		if (textures_[i]) {
-			delete[] textures_[i];
-			textures_[i] = nullptr;
-		};
+		if (owned_textures_[i]) {
+			delete textures_[i];
+		}
+		textures_[i] = nullptr;
 	}
 }
 
@@ -68,8 +69,9 @@ std::string Material::name() const {
 	return name_;
 }
 
-void Material::set_texture(const int slot, Texture3u* texture) {
+void Material::set_texture(const int slot, Texture3u* texture, const bool owned) {
 	textures_[slot] = texture;
+	owned_textures_[slot] = owned;
 }
 
 Texture3u* Material::texture(const int slot) const {
@@ -157,7 +159,7 @@ GLMaterial Material::GenerateGLMaterial() {
 	//Diffuse
 	if (texDiffuse) {
 		GLuint id = 0;
-		CreateBindlessTexture(id, mat.texDiffuse, texDiffuse->width(), texDiffuse->height(), texDiffuse->data());
+		texDiffuse->CreateBindless(id, mat.texDiffuse);
 	}
 	else {
 		GLuint id = 0;
@@ -169,13 +171,13 @@ GLMaterial Material::GenerateGLMaterial() {
 	//RMA
 	if (texRMA) {
 		GLuint id = 0;
-		CreateBindlessTexture(id, mat.texRMA, texRMA->width(), texRMA->height(), texRMA->data());
+		texRMA->CreateBindless(id, mat.texRMA);
 	}
 
 	//Normal
 	if (texNormal) {
 		GLuint id = 0;
-		CreateBindlessTexture(id, mat.texNormal, texNormal->width(), texNormal->height(), texNormal->data());
+		texNormal->CreateBindless(id, mat.texNormal);
 	}
 
 	return mat;
@@ -1,6 +1,8 @@
 #ifndef MATERIAL_H_
 #define MATERIAL_H_
 
+#include <atomic>
+
 #include "vector3.h"
 #include "texture.h"
 #include "structs.h"
@@ -84,7 +86,8 @@ public:
 
 	//! Destruktor.
 	/*!
-	Uvoln vechny alokovan zdroje.
+	Uvoln vechny alokovan zdroje. Textures are shared by materials, only the owned ones are freed here (see \a set_texture),
+	the others belong to whoever created them (e.g. the arena of the scene).
 	*/
 	~Material();
 
@@ -106,8 +109,9 @@ public:
 	/*!
 	\param slot slo slotu, do kterho bude textura piazena. Maximln \a NO_TEXTURES - 1.
 	\param texture ukazatel na texturu.
+	\param owned the material frees the texture, for textures created without an arena. Materials sharing it are freed together.
 	*/
-	void set_texture(const int slot, Texture3u* texture);
+	void set_texture(const int slot, Texture3u* texture, const bool owned = false);
 
 	//! Vrt texturu.
 	/*!
@@ -153,6 +157,7 @@ public:
 	int idx = idxCounter++;
 private:
 	Texture3u* textures_[NO_TEXTURES]; /*!< Pole ukazatel na textury. */
+	bool owned_textures_[NO_TEXTURES] = {}; /*!< Textures freed by the destructor. */
 	/*
 	slot 0 - diffuse map + alpha
 	slot 1 - specular map + opaque alpha
@@ -164,7 +169,7 @@ private:
 
 	Shader shader_{ Shader::NORMAL }; /*!< Type of used shader. */
 
-	static inline int idxCounter = 0;
+	static inline std::atomic<int> idxCounter{ 0 };		//materials are created on several threads (cooker jobs)
 };
 
 #endif
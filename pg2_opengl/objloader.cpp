@@ -4,48 +4,97 @@ http://en.wikipedia.org/wiki/Wavefront_.obj_file
 */
 
 #include "pch.h"
+#include "objloader.h"
 #include "material.h"
 #include "utils.h"
 #include "surface.h"
 #include "mymath.h"
+#include "mappedfile.h"
+#include "parallel.h"
+#include "normals.h"
+#include "nametable.h"
+#include "arena.h"
+#include "log.h"
+
+#include <filesystem>
+#include <chrono>
+
+//================================= MaterialIndices =================================
+
+MaterialIndices::MaterialIndices(const std::vector<Material*>& materials) {
+	indices.reserve(materials.size());
+	for (size_t i = 0; i < materials.size(); i++)
+		Insert(materials[i]->name(), static_cast<int>(i));
+}
 
-int MaterialIndex(std::vector<Material*>& materials, const char* material_name) {
-	int index = 0;
-
-	for (Material* material : materials) {
-		if (material->name().compare(material_name) == 0) {
-			return index;
-		}
-
-		index++;
-	}
+int MaterialIndices::Find(const std::string& name) const {
+	auto it = indices.find(name);
+	return (it != indices.end()) ? it->second : -1;
+}
 
-	return -1;
+bool MaterialIndices::Insert(const std::string& name, const int index) {
+	return indices.try_emplace(name, index).second;
 }
 
 Texture3u* TextureProxy(const std::string& full_name, std::map<std::string, Texture3u*>& already_loaded_textures,
-						const int flip = -1, const bool single_channel = false) {
+						const int flip, const bool single_channel, std::vector<Texture3u*>* pending_textures, Arena* arena) {
 	std::map<std::string, Texture3u*>::iterator already_loaded_texture = already_loaded_textures.find(full_name);
 	Texture3u* texture = NULL;
 	if (already_loaded_texture != already_loaded_textures.end()) {
 		texture = already_loaded_texture->second;
 	}
 	else {
-		texture = new Texture3u(full_name.c_str());// , flip, single_channel);
+		texture = ArenaNew<Texture3u>(arena, full_name, pending_textures != NULL);// , flip, single_channel);
 		already_loaded_textures[full_name] = texture;
+		if (pending_textures != NULL) {
+			pending_textures->push_back(texture);
+		}
 	}
 
 	return texture;
 }
 
+void LoadTextures(std::vector<Texture3u*>& pending_textures, const int no_threads) {
+	if (pending_textures.empty())
+		return;
+
+	//biggest files first, so that a single large texture doesn't end up last on one thread
+	std::vector<uintmax_t> file_sizes(pending_textures.size());
+	std::vector<int> order(pending_textures.size());
+	for (size_t i = 0; i < pending_textures.size(); i++) {
+		std::error_code ec;
+		file_sizes[i] = std::filesystem::file_size(pending_textures[i]->file_name(), ec);
+		if (ec)
+			file_sizes[i] = 0;
+		order[i] = static_cast<int>(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return file_sizes[a] > file_sizes[b]; });
+
+	const int threads = ResolveThreadCount(no_threads);
+	printf("Decoding %I64u texture(s) (%d thread(s))...\n", pending_textures.size(), threads);
+
+	ParallelFor(static_cast<int>(order.size()), threads, [&](int i) {
+		pending_textures[order[i]]->Load();
+	});
+
+	pending_textures.clear();
+	printf("Done.\n\n");
+}
+
 /*! \fn LoadMTL( const char * file_name, const char * path, std::vector<Material *> & materials )
 \brief Nate materily z MTL souboru \a file_name.
 Soubor \a file_name se mus nachzet v cest \a path. Naten materily budou vrceny pes pole \a materials.
 \param file_name nzev MTL souboru vetn ppony.
 \param path cesta k zadanmu souboru.
 \param materials pole materil, do kterho se budou ukldat naten materily.
+\param already_loaded_textures textures loaded so far (shared by all MTL files of a model).
+\param pending_textures when not NULL, textures are only recorded here and decoded later by \a LoadTextures.
+\param material_indices index of names of \a materials, kept up to date.
+\param arena when not NULL, owns the created materials and textures.
 */
-int LoadMTL(const char* file_name, const char* path, std::vector<Material*>& materials) {
+int LoadMTL(const char* file_name, const char* path, std::vector<Material*>& materials,
+			std::map<std::string, Texture3u*>& already_loaded_textures, std::vector<Texture3u*>* pending_textures,
+			MaterialIndices& material_indices, Arena* arena) {
 	// oteven soouboru
 	FILE* file = fopen(file_name, "rt");
 	if (file == NULL) {
@@ -90,27 +139,44 @@ int LoadMTL(const char* file_name, const char* path, std::vector<Material*>& mat
 	const char delim[] = "\n";
 	char* line = strtok(buffer, delim);
 
-	std::map<std::string, Texture3u*> already_loaded_textures;
-
 	Material* material = NULL;
+	bool duplicate = false;		//name of the material is already taken, the first definition is kept
+
+	//without an arena, textures are freed by the first material using them
+	auto SetTexture = [&](const int slot, const std::string& full_name, const bool single_channel) {
+		if (duplicate)
+			return;
+		const bool owned = arena == NULL && already_loaded_textures.find(full_name) == already_loaded_textures.end();
+		material->set_texture(slot, TextureProxy(full_name, already_loaded_textures, -1, single_channel, pending_textures, arena), owned);
+	};
+
+	auto FinishMaterial = [&]() {
+		if (material == NULL)
+			return;
+		material->set_name(material_name);
+		if (material_indices.Insert(material_name, static_cast<int>(materials.size()))) {
+			materials.push_back(material);
+			printf("\r%I64u material(s)\t\t", materials.size());
+		}
+		else {
+			warnlog("Material '%s' in '%s' is already defined, the first definition is used.\n", material_name, file_name);
+			if (arena == NULL)
+				delete material;
+		}
+		material = NULL;
+	};
 
 	// --- natn vech materil ---
 	while (line != NULL) {
 		if (line[0] != '#') {
 			if (strstr(line, "newmtl") == line) {
-				if (material != NULL) {
-					material->set_name(material_name);
-					if (MaterialIndex(materials, material_name) < 0) {
-						materials.push_back(material);
-						printf("\r%I64u material(s)\t\t", materials.size());
-					}
-				}
-				material = NULL;
+				FinishMaterial();
 
 				sscanf(line, "%*s %s", &material_name);
 				//printf( "material name=%s\n", material_name );				
 
-				material = new Material();
+				material = ArenaNew<Material>(arena);
+				duplicate = material_indices.Find(material_name) >= 0;
 			}
 			else {
 				char* tmp = Trim(line);
@@ -142,43 +208,43 @@ int LoadMTL(const char* file_name, const char* path, std::vector<Material*>& mat
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kDiffuseMapSlot, TextureProxy(full_name, already_loaded_textures));
+					SetTexture(Material::kDiffuseMapSlot, full_name, false);
 				}
 				else if (strstr(tmp, "map_Ks") == tmp) // specular map
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kSpecularMapSlot, TextureProxy(full_name, already_loaded_textures));
+					SetTexture(Material::kSpecularMapSlot, full_name, false);
 				}
 				else if (strstr(tmp, "map_bump") == tmp) // normal map
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kNormalMapSlot, TextureProxy(full_name, already_loaded_textures));
+					SetTexture(Material::kNormalMapSlot, full_name, false);
 				}
 				else if (strstr(tmp, "map_RMA") == tmp) // normal map
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kRMAMapSlot, TextureProxy(full_name, already_loaded_textures));
+					SetTexture(Material::kRMAMapSlot, full_name, false);
 				}
 				else if (strstr(tmp, "map_D") == tmp) // opacity map
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kOpacityMapSlot, TextureProxy(full_name, already_loaded_textures, -1, true));
+					SetTexture(Material::kOpacityMapSlot, full_name, true);
 				}
 				else if (strstr(tmp, "map_Pr") == tmp) // roughness map
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kRoughnessMapSlot, TextureProxy(full_name, already_loaded_textures, -1, true));
+					SetTexture(Material::kRoughnessMapSlot, full_name, true);
 				}
 				else if (strstr(tmp, "map_Pm") == tmp) // metallicness map
 				{
 					sscanf(tmp, "%*s %s", image_file_name);
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture(Material::kMetallicnessMapSlot, TextureProxy(full_name, already_loaded_textures, -1, true));
+					SetTexture(Material::kMetallicnessMapSlot, full_name, true);
 				}
 				else if (strstr(tmp, "shader") == tmp) // used shader
 				{
@@ -204,12 +270,7 @@ int LoadMTL(const char* file_name, const char* path, std::vector<Material*>& mat
 		line = strtok(NULL, delim); // naten dalho dku
 	}
 
-	if (material != NULL) {
-		material->set_name(material_name);
-		materials.push_back(material);
-		printf("\r%I64u material(s)\t\t", materials.size());
-	}
-	material = NULL;
+	FinishMaterial();
 
 	//memcpy( buffer, buffer_backup, file_size + 1 ); // obnoven bufferu po innosti strtok
 	SAFE_DELETE_ARRAY(buffer_backup);
@@ -220,8 +281,8 @@ int LoadMTL(const char* file_name, const char* path, std::vector<Material*>& mat
 	return 0;
 }
 
-int LoadOBJ(const char* file_name, std::vector<Surface*>& surfaces, std::vector<Material*>& materials,
-			const bool flip_yz, const Vector3 default_color) {
+int LoadOBJLegacy(const char* file_name, std::vector<Surface*>& surfaces, std::vector<Material*>& materials,
+				  const bool flip_yz, const Vector3 default_color) {
 	// oteven soouboru
 	FILE* file = fopen(file_name, "rt");
 	if (file == NULL) {
@@ -291,8 +352,10 @@ int LoadOBJ(const char* file_name, std::vector<Surface*>& surfaces, std::vector<
 
 	memcpy(buffer, buffer_backup, file_size + 1); // obnoven bufferu po innosti strtok
 
+	std::map<std::string, Texture3u*> already_loaded_textures;
+	MaterialIndices material_indices(materials);
 	for (int i = 0; i < static_cast<int>(material_libraries.size()); ++i) {
-		LoadMTL(material_libraries[i].c_str(), path, materials);
+		LoadMTL(material_libraries[i].c_str(), path, materials, already_loaded_textures, NULL, material_indices, NULL);
 	}
 
 	std::vector<Vector3> vertices; // cel jeden soubor
@@ -509,3 +572,938 @@ int LoadOBJ(const char* file_name, std::vector<Surface*>& surfaces, std::vector<
 
 	return no_surfaces;
 }
+
+
+//================================= single-pass loader =================================
+
+static inline bool IsBlank(const char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool IsDigit(const char c) {
+	return c >= '0' && c <= '9';
+}
+
+static inline const char* SkipBlanks(const char* p, const char* end) {
+	while (p < end && IsBlank(*p))
+		++p;
+	return p;
+}
+
+//returns pointer to the first character of the next line
+static inline const char* SkipLine(const char* p, const char* end) {
+	const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+	return (eol != nullptr) ? eol + 1 : end;
+}
+
+//reads whitespace delimited token (equivalent of sscanf "%s")
+static inline const char* ParseName(const char* p, const char* end, std::string& name) {
+	p = SkipBlanks(p, end);
+	const char* start = p;
+	while (p < end && !IsBlank(*p) && *p != '\n')
+		++p;
+	name.assign(start, p);
+	return p;
+}
+
+static inline const char* ParseInt(const char* p, const char* end, int& value) {
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		++p;
+	}
+
+	int result = 0;
+	while (p < end && IsDigit(*p)) {
+		result = result * 10 + (*p - '0');
+		++p;
+	}
+
+	value = negative ? -result : result;
+	return p;
+}
+
+//slow path for numbers the fast path cannot round correctly (or special values like "nan")
+static const char* ParseFloatFallback(const char* p, const char* end, float& value) {
+	char buffer[64];
+	size_t length = 0;
+	while (p + length < end && length < sizeof(buffer) - 1 && !IsBlank(p[length]) && p[length] != '\n' && p[length] != '/') {
+		buffer[length] = p[length];
+		++length;
+	}
+	buffer[length] = 0;
+
+	char* stop = nullptr;
+	value = strtof(buffer, &stop);
+	return p + (stop - buffer);
+}
+
+//Float parser returning the same (correctly rounded) values as strtof/sscanf("%f").
+static inline const char* ParseFloat(const char* p, const char* end, float& value) {
+	static const float pow10f[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+	static const double pow10d[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+									 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	p = SkipBlanks(p, end);
+	const char* start = p;
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		++p;
+	}
+
+	uint64_t mantissa = 0;
+	int digits = 0;			//significant digits stored in mantissa
+	int exponent = 0;
+	bool any = false;
+
+	while (p < end && IsDigit(*p)) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += (mantissa != 0);
+		}
+		else {
+			++exponent;
+		}
+		any = true;
+		++p;
+	}
+	if (p < end && *p == '.') {
+		++p;
+		while (p < end && IsDigit(*p)) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += (mantissa != 0);
+				--exponent;
+			}
+			any = true;
+			++p;
+		}
+	}
+	if (!any || digits >= 19)
+		return ParseFloatFallback(start, end, value);
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		int e = 0;
+		const char* q = p + 1;
+		if (q < end && (*q == '-' || *q == '+'))
+			++q;
+		if (q >= end || !IsDigit(*q))
+			return ParseFloatFallback(start, end, value);
+		p = ParseInt(p + 1, end, e);
+		exponent += e;
+	}
+
+	float result;
+	if (mantissa < (1ull << 24) && exponent >= -10 && exponent <= 10) {
+		//both operands are exact in float -> single correctly rounded operation
+		result = (exponent < 0) ? float(mantissa) / pow10f[-exponent] : float(mantissa) * pow10f[exponent];
+	}
+	else if (mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22) {
+		const double d = (exponent < 0) ? double(mantissa) / pow10d[-exponent] : double(mantissa) * pow10d[exponent];
+
+		//double -> float rounding may only differ from direct rounding when d lies exactly on a float midpoint
+		uint64_t bits;
+		memcpy(&bits, &d, sizeof(bits));
+		if ((bits & 0x1FFFFFFFull) == 0x10000000ull || (d != 0.0 && d < FLT_MIN))
+			return ParseFloatFallback(start, end, value);
+
+		result = float(d);
+	}
+	else {
+		return ParseFloatFallback(start, end, value);
+	}
+
+	value = negative ? -result : result;
+	return p;
+}
+
+//converts 1-based (or negative relative) OBJ index to 0-based index, -1 when missing or invalid
+static inline int ResolveIndex(const int index, const size_t count) {
+	if (index > 0)
+		return (size_t(index) <= count) ? index - 1 : -1;
+	if (index < 0)
+		return (size_t(-index) <= count) ? int(count) + index : -1;
+	return -1;
+}
+
+struct ObjCorner {
+	int v, vt, vn;		//raw indices as written in the file (0 = not present)
+};
+
+struct ObjFace {
+	int first_corner;
+	int no_corners;
+	int no_vertices, no_normals, no_texture_coords;		//chunk-local counts at the time the face was read (for relative indices)
+	int smoothing_group;		//0 = off, -1 = no s record in the chunk yet (continues from the previous chunk)
+};
+
+//smoothing group of faces before the first s record, files without s records are smoothed up to the crease angle
+constexpr int DEFAULT_SMOOTHING_GROUP = 1;
+
+struct ObjEvent {
+	enum Type : char { GROUP, USEMTL, MTLLIB } type;
+	int face;			//number of faces of the chunk read before this record
+	std::string name;
+};
+
+//Group boundary mapping a range of chunk faces to triangles of a surface.
+struct ObjSegment {
+	int face_begin, face_end;
+	Surface* surface;
+	int first_triangle;
+};
+
+//Part of the mapped file (whole lines) parsed independently of the other chunks.
+struct ObjChunk {
+	const char* begin;
+	const char* end;
+
+	std::vector<Vector3> vertices;
+	std::vector<Vector3> per_vertex_normals;
+	std::vector<Coord2f> texture_coords;
+
+	std::vector<ObjCorner> corners;
+	std::vector<ObjFace> faces;
+	std::vector<ObjEvent> events;
+	int last_smoothing_group = -1;		//last s record of the chunk, -1 = none
+
+	//filled after all chunks are parsed
+	size_t vertex_offset = 0, normal_offset = 0, texture_coord_offset = 0;
+	std::vector<int> triangle_prefix;		//number of (valid) triangles before i-th face
+	std::vector<ObjSegment> segments;
+
+	//missing normals, valid faces are the faces with at least one triangle
+	int no_valid_faces = 0, no_valid_corners = 0, no_missing_normals = 0;
+	int mesh_face_offset = 0, mesh_corner_offset = 0;		//position of the first valid face in the PolygonMesh
+	std::vector<int> generated_normal_offsets;		//first generated normal of every valid face (empty when none are generated)
+};
+
+//Parses v/vn/vt/f/s records and g/usemtl/mtllib events of one chunk. Indices are resolved later.
+static void ParseChunk(ObjChunk& chunk, const bool flip_yz) {
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+
+	std::string name;
+	int smoothing_group = -1;
+
+	while (p < end) {
+		p = SkipBlanks(p, end);
+		if (p >= end)
+			break;
+
+		switch (*p) {
+			case 'v':
+			{
+				if (p + 1 >= end)
+					break;
+
+				const char c = p[1];
+				if (c == ' ' || c == '\t') { //position
+					Vector3 vertex;
+					p = ParseFloat(p + 1, end, vertex.x);
+					if (flip_yz) {
+						p = ParseFloat(p, end, vertex.z);
+						p = ParseFloat(p, end, vertex.y);
+						vertex.y *= -1;
+					}
+					else {
+						p = ParseFloat(p, end, vertex.y);
+						p = ParseFloat(p, end, vertex.z);
+					}
+					chunk.vertices.push_back(vertex);
+				}
+				else if (c == 'n') { //normal
+					Vector3 normal;
+					p = ParseFloat(p + 2, end, normal.x);
+					if (flip_yz) {
+						p = ParseFloat(p, end, normal.z);
+						p = ParseFloat(p, end, normal.y);
+						normal.y *= -1;
+					}
+					else {
+						p = ParseFloat(p, end, normal.y);
+						p = ParseFloat(p, end, normal.z);
+					}
+					normal.Normalize();
+					chunk.per_vertex_normals.push_back(normal);
+				}
+				else if (c == 't') { //texture coords
+					Coord2f texture_coord = { 0.0f, 0.0f };
+					p = ParseFloat(p + 2, end, texture_coord.u);
+					p = ParseFloat(p, end, texture_coord.v);
+					chunk.texture_coords.push_back(texture_coord);
+				}
+			}
+			break;
+
+			case 'f': //any convex polygon with v, v/vt, v//vn or v/vt/vn corners
+			{
+				ObjFace face;
+				face.first_corner = static_cast<int>(chunk.corners.size());
+				face.no_vertices = static_cast<int>(chunk.vertices.size());
+				face.no_normals = static_cast<int>(chunk.per_vertex_normals.size());
+				face.no_texture_coords = static_cast<int>(chunk.texture_coords.size());
+				face.smoothing_group = smoothing_group;
+
+				p = SkipBlanks(p + 1, end);
+				while (p < end && *p != '\n' && *p != '#') {
+					ObjCorner corner = { 0, 0, 0 };
+					p = ParseInt(p, end, corner.v);
+					if (p < end && *p == '/') {
+						++p;
+						if (p < end && *p != '/')
+							p = ParseInt(p, end, corner.vt);
+						if (p < end && *p == '/')
+							p = ParseInt(p + 1, end, corner.vn);
+					}
+					chunk.corners.push_back(corner);
+
+					//skip anything unexpected so the loop always advances
+					while (p < end && !IsBlank(*p) && *p != '\n')
+						++p;
+					p = SkipBlanks(p, end);
+				}
+
+				face.no_corners = static_cast<int>(chunk.corners.size()) - face.first_corner;
+				chunk.faces.push_back(face);
+			}
+			break;
+
+			case 'g': // group
+			{
+				if (p + 1 < end && !IsBlank(p[1]) && p[1] != '\n')
+					break;
+
+				p = ParseName(p + 1, end, name);
+				chunk.events.push_back({ ObjEvent::GROUP, static_cast<int>(chunk.faces.size()), name });
+			}
+			break;
+
+			case 's': // smoothing group
+			{
+				if (p + 1 < end && !IsBlank(p[1]) && p[1] != '\n')
+					break;
+
+				p = SkipBlanks(p + 1, end);
+				if (end - p >= 3 && strncmp(p, "off", 3) == 0)
+					smoothing_group = 0;
+				else
+					p = ParseInt(p, end, smoothing_group);
+			}
+			break;
+
+			case 'u': // usemtl
+			{
+				if (end - p > 6 && strncmp(p, "usemtl", 6) == 0) {
+					p = ParseName(p + 6, end, name);
+					chunk.events.push_back({ ObjEvent::USEMTL, static_cast<int>(chunk.faces.size()), name });
+				}
+			}
+			break;
+
+			case 'm': // mtllib
+			{
+				if (end - p > 6 && strncmp(p, "mtllib", 6) == 0) {
+					p = ParseName(p + 6, end, name);
+					chunk.events.push_back({ ObjEvent::MTLLIB, static_cast<int>(chunk.faces.size()), name });
+				}
+			}
+			break;
+		}
+
+		p = SkipLine(p, end);
+	}
+
+	chunk.last_smoothing_group = smoothing_group;
+}
+
+//Global 0-based index of a face corner attribute, -1 when missing or out of range.
+static inline int ResolveCornerIndex(const int index, const int local_count, const size_t chunk_offset) {
+	return ResolveIndex(index, chunk_offset + local_count);
+}
+
+//Number of triangles of a face, 0 when any corner references a non-existing position.
+static int FaceTriangles(const ObjChunk& chunk, const ObjFace& face) {
+	if (face.no_corners < 3)
+		return 0;
+
+	for (int i = 0; i < face.no_corners; i++) {
+		const ObjCorner& c = chunk.corners[face.first_corner + i];
+		if (ResolveCornerIndex(c.v, face.no_vertices, chunk.vertex_offset) < 0)
+			return 0;
+	}
+
+	return face.no_corners - 2;
+}
+
+//Builds vertices of a valid face and fan-triangulates it, quads are split into (0, 1, 2) and (0, 2, 3) as before.
+//Corners without vn take generated_normals (normals of the face corners) when given, the flat face normal otherwise.
+template<typename Vertices, typename Normals, typename TextureCoords>
+static Triangle* TriangulateFace(const ObjChunk& chunk, const ObjFace& face, const Vertices& vertices, const Normals& per_vertex_normals,
+								 const TextureCoords& texture_coords, const Vector3& default_color, Surface* surface,
+								 std::vector<Vertex>& polygon, Triangle* t, const Vector3* generated_normals = nullptr) {
+	polygon.clear();
+	bool missing_normals = false;
+	for (int k = 0; k < face.no_corners; k++) {
+		const ObjCorner& c = chunk.corners[face.first_corner + k];
+
+		const int vertex_index = ResolveCornerIndex(c.v, face.no_vertices, chunk.vertex_offset);
+		const int texture_coord_index = ResolveCornerIndex(c.vt, face.no_texture_coords, chunk.texture_coord_offset);
+		const int per_vertex_normal_index = ResolveCornerIndex(c.vn, face.no_normals, chunk.normal_offset);
+
+		Coord2f texture_coord = (texture_coord_index >= 0) ? texture_coords[texture_coord_index] : Coord2f{ 0.0f, 0.0f };
+		Vector3 normal;
+		if (per_vertex_normal_index >= 0)
+			normal = per_vertex_normals[per_vertex_normal_index];
+		else if (generated_normals)
+			normal = generated_normals[k];
+		else
+			missing_normals = true;
+		polygon.push_back(Vertex(vertices[vertex_index], normal, default_color, &texture_coord));
+	}
+
+	if (missing_normals) {
+		Vector3 normal;
+		for (size_t k = 1; k + 1 < polygon.size(); ++k)
+			normal += (polygon[k].position - polygon[0].position).CrossProduct(polygon[k + 1].position - polygon[0].position);
+		if (normal.SqrL2Norm() > 0.0f)
+			normal.Normalize();
+
+		for (int k = 0; k < face.no_corners; k++) {
+			const ObjCorner& c = chunk.corners[face.first_corner + k];
+			if (ResolveCornerIndex(c.vn, face.no_normals, chunk.normal_offset) < 0)
+				polygon[k].normal = normal;
+		}
+	}
+
+	for (size_t k = 1; k + 1 < polygon.size(); ++k)
+		*t++ = Triangle(polygon[0], polygon[k], polygon[k + 1], surface);
+	return t;
+}
+
+//Splits the file into roughly equal chunks on line boundaries.
+static std::vector<ObjChunk> SplitChunks(const char* begin, const char* end, const int no_chunks) {
+	std::vector<ObjChunk> chunks;
+
+	const size_t chunk_size = (end - begin) / no_chunks + 1;
+	const char* p = begin;
+	while (p < end) {
+		const char* chunk_end = (size_t(end - p) > chunk_size) ? SkipLine(p + chunk_size, end) : end;
+
+		chunks.emplace_back();
+		chunks.back().begin = p;
+		chunks.back().end = chunk_end;
+		p = chunk_end;
+	}
+
+	return chunks;
+}
+
+int LoadOBJ(const char* file_name, std::vector<Surface*>& surfaces, std::vector<Material*>& materials,
+			const bool flip_yz, const Vector3 default_color, const int no_threads, std::vector<std::string>* material_libraries,
+			std::vector<Texture3u*>* pending_textures, OBJLoadTimings* timings, Arena* material_arena, Arena* surface_arena,
+			const std::atomic<bool>* cancel) {
+	auto Cancelled = [cancel]() { return cancel && cancel->load(); };
+	using Clock = std::chrono::high_resolution_clock;
+	auto phase_start = Clock::now();
+	auto EndPhase = [&](double OBJLoadTimings::* phase) {
+		const auto now = Clock::now();
+		if (timings)
+			timings->*phase = std::chrono::duration<double>(now - phase_start).count();
+		phase_start = now;
+	};
+
+	MappedFile file = MappedFile(file_name);
+	if (!file.IsOpen()) {
+		printf("File %s not found.\n", file_name);
+
+		return -1;
+	}
+
+	//directory of the model (material libraries and textures are relative to it)
+	std::string path;
+	const char* tmp = strrchr(file_name, '/');
+	if (tmp != NULL) {
+		path.assign(file_name, tmp + 1);
+	}
+
+	const int threads = ResolveThreadCount(no_threads);
+	printf("Loading model from '%s' (%0.1f MB, %d thread(s))...\n", file_name, file.Size() / sqr(1024.0f), threads);
+
+	//touch every page, otherwise page faults are hidden in the parsing time
+	if (timings) {
+		volatile char sink = 0;
+		for (size_t i = 0; i < file.Size(); i += 4096)
+			sink += file.Data()[i];
+	}
+	EndPhase(&OBJLoadTimings::read);
+
+	// --- parse chunks in parallel, small files are not split at all ---
+	const size_t min_chunk_size = 1 << 20;
+	const int no_chunks = (threads > 1) ? static_cast<int>(std::min(size_t(threads) * 4, file.Size() / min_chunk_size + 1)) : 1;
+	std::vector<ObjChunk> chunks = SplitChunks(file.Data(), file.End(), no_chunks);
+
+	ParallelFor(static_cast<int>(chunks.size()), threads, [&](int i) {
+		if (!Cancelled())
+			ParseChunk(chunks[i], flip_yz);
+	});
+	if (Cancelled())
+		return -1;
+
+	// --- merge: global attribute tables ---
+	size_t no_vertices = 0, no_normals = 0, no_texture_coords = 0;
+	for (ObjChunk& chunk : chunks) {
+		chunk.vertex_offset = no_vertices;
+		chunk.normal_offset = no_normals;
+		chunk.texture_coord_offset = no_texture_coords;
+		no_vertices += chunk.vertices.size();
+		no_normals += chunk.per_vertex_normals.size();
+		no_texture_coords += chunk.texture_coords.size();
+	}
+
+	std::vector<Vector3> vertices(no_vertices);
+	std::vector<Vector3> per_vertex_normals(no_normals);
+	std::vector<Coord2f> texture_coords(no_texture_coords);
+
+	ParallelFor(static_cast<int>(chunks.size()), threads, [&](int i) {
+		ObjChunk& chunk = chunks[i];
+		std::copy(chunk.vertices.begin(), chunk.vertices.end(), vertices.begin() + chunk.vertex_offset);
+		std::copy(chunk.per_vertex_normals.begin(), chunk.per_vertex_normals.end(), per_vertex_normals.begin() + chunk.normal_offset);
+		std::copy(chunk.texture_coords.begin(), chunk.texture_coords.end(), texture_coords.begin() + chunk.texture_coord_offset);
+		chunk.vertices = std::vector<Vector3>();
+		chunk.per_vertex_normals = std::vector<Vector3>();
+		chunk.texture_coords = std::vector<Coord2f>();
+
+		chunk.triangle_prefix.resize(chunk.faces.size() + 1);
+		chunk.triangle_prefix[0] = 0;
+		for (size_t f = 0; f < chunk.faces.size(); f++) {
+			const ObjFace& face = chunk.faces[f];
+			const int no_triangles = FaceTriangles(chunk, face);
+			chunk.triangle_prefix[f + 1] = chunk.triangle_prefix[f] + no_triangles;
+			if (no_triangles == 0)
+				continue;
+
+			chunk.no_valid_faces++;
+			chunk.no_valid_corners += face.no_corners;
+			for (int k = 0; k < face.no_corners; k++) {
+				if (ResolveCornerIndex(chunk.corners[face.first_corner + k].vn, face.no_normals, chunk.normal_offset) < 0)
+					chunk.no_missing_normals++;
+			}
+		}
+	});
+
+	// --- merge: replay groups and materials in file order ---
+	struct PendingSegment { int chunk, face_begin, face_end, first_triangle; };
+	std::vector<PendingSegment> pending;
+	int pending_triangles = 0;
+
+	std::string group_name;
+	NameTable material_names;		//names used by usemtl records
+	int material_name = -1;
+	std::map<std::string, Texture3u*> already_loaded_textures;
+	MaterialIndices material_indices(materials);
+	std::vector<Texture3u*> deferred_textures;		//decoded at once after the geometry is built
+	std::vector<int> surface_materials;		//ids of material_names, resolved after the whole file is read (mtllib may appear anywhere)
+	const size_t first_surface = surfaces.size();
+
+	auto AddFaces = [&](int c, int face_begin, int face_end) {
+		const int n = chunks[c].triangle_prefix[face_end] - chunks[c].triangle_prefix[face_begin];
+		if (n > 0) {
+			pending.push_back({ c, face_begin, face_end, pending_triangles });
+			pending_triangles += n;
+		}
+	};
+
+	auto FinishGroup = [&]() {
+		if (pending_triangles > 0) {
+			Surface* surface = ArenaNew<Surface>(surface_arena, group_name, pending_triangles, surface_arena);
+			for (const PendingSegment& s : pending)
+				chunks[s.chunk].segments.push_back({ s.face_begin, s.face_end, surface, s.first_triangle });
+
+			surfaces.push_back(surface);
+			surface_materials.push_back(material_name);
+			printf("\r%I64u group(s)\t\t", surface_materials.size());
+		}
+		pending.clear();
+		pending_triangles = 0;
+	};
+
+	for (int c = 0; c < static_cast<int>(chunks.size()); c++) {
+		int cursor = 0;
+		for (const ObjEvent& e : chunks[c].events) {
+			AddFaces(c, cursor, e.face);
+			cursor = e.face;
+
+			switch (e.type) {
+				case ObjEvent::GROUP:
+					FinishGroup();
+					if (!e.name.empty())
+						group_name = e.name;
+					break;
+				case ObjEvent::USEMTL:
+					if (!e.name.empty())
+						material_name = material_names.Intern(e.name);
+					break;
+				case ObjEvent::MTLLIB:
+					printf("Material library: %s\n", e.name.c_str());
+					LoadMTL((path + e.name).c_str(), path.c_str(), materials, already_loaded_textures, &deferred_textures, material_indices, material_arena);
+					if (material_libraries)
+						material_libraries->push_back(path + e.name);
+					break;
+			}
+		}
+		AddFaces(c, cursor, static_cast<int>(chunks[c].faces.size()));
+	}
+	FinishGroup();
+	EndPhase(&OBJLoadTimings::parse);
+	if (Cancelled())
+		return -1;
+
+	// --- normals of corners without vn, generated over all faces so they are smoothed with their neighbours ---
+	size_t no_missing_normals = 0;
+	for (const ObjChunk& chunk : chunks)
+		no_missing_normals += chunk.no_missing_normals;
+
+	std::vector<Vector3> generated_normals;
+	if (no_missing_normals > 0) {
+		PolygonMesh mesh;
+		mesh.positions = vertices.data();
+		mesh.no_positions = vertices.size();
+
+		//smoothing groups continue across chunk boundaries
+		int smoothing_group = DEFAULT_SMOOTHING_GROUP;
+		int no_faces = 0, no_corners = 0;
+		for (ObjChunk& chunk : chunks) {
+			for (ObjFace& face : chunk.faces) {
+				if (face.smoothing_group >= 0)
+					break;
+				face.smoothing_group = smoothing_group;
+			}
+			if (chunk.last_smoothing_group >= 0)
+				smoothing_group = chunk.last_smoothing_group;
+
+			chunk.mesh_face_offset = no_faces;
+			chunk.mesh_corner_offset = no_corners;
+			no_faces += chunk.no_valid_faces;
+			no_corners += chunk.no_valid_corners;
+		}
+
+		mesh.corners.resize(no_corners);
+		mesh.face_offsets.resize(no_faces + 1);
+		mesh.smoothing_groups.resize(no_faces);
+		mesh.face_offsets[no_faces] = no_corners;
+
+		ParallelFor(static_cast<int>(chunks.size()), threads, [&](int i) {
+			ObjChunk& chunk = chunks[i];
+			chunk.generated_normal_offsets.assign(chunk.faces.size(), -1);
+
+			int mesh_face = chunk.mesh_face_offset;
+			int mesh_corner = chunk.mesh_corner_offset;
+			for (size_t f = 0; f < chunk.faces.size(); f++) {
+				if (chunk.triangle_prefix[f + 1] == chunk.triangle_prefix[f])
+					continue;
+
+				const ObjFace& face = chunk.faces[f];
+				chunk.generated_normal_offsets[f] = mesh_corner;
+				mesh.face_offsets[mesh_face] = mesh_corner;
+				mesh.smoothing_groups[mesh_face++] = face.smoothing_group;
+				for (int k = 0; k < face.no_corners; k++)
+					mesh.corners[mesh_corner++] = ResolveCornerIndex(chunk.corners[face.first_corner + k].v, face.no_vertices, chunk.vertex_offset);
+			}
+		});
+
+		generated_normals = GenerateNormals(mesh, DEFAULT_CREASE_ANGLE, threads);
+		printf("%I64u missing normals generated.\n", no_missing_normals);
+	}
+	EndPhase(&OBJLoadTimings::normals);
+	if (Cancelled())
+		return -1;
+
+	// --- build triangles directly in the surfaces, every chunk writes its own disjoint ranges ---
+	ParallelFor(static_cast<int>(chunks.size()), threads, [&](int i) {
+		const ObjChunk& chunk = chunks[i];
+		std::vector<Vertex> polygon;
+
+		for (const ObjSegment& s : chunk.segments) {
+			Triangle* triangles = s.surface->get_triangles() + s.first_triangle - chunk.triangle_prefix[s.face_begin];
+
+			for (int f = s.face_begin; f < s.face_end; f++) {
+				if (chunk.triangle_prefix[f + 1] == chunk.triangle_prefix[f])
+					continue;
+
+				const Vector3* face_normals = chunk.generated_normal_offsets.empty() ? nullptr :
+					generated_normals.data() + chunk.generated_normal_offsets[f];
+				TriangulateFace(chunk, chunk.faces[f], vertices, per_vertex_normals, texture_coords, default_color,
+								s.surface, polygon, triangles + chunk.triangle_prefix[f], face_normals);
+			}
+		}
+	});
+
+	if (pending_textures)
+		pending_textures->insert(pending_textures->end(), deferred_textures.begin(), deferred_textures.end());
+	else
+		LoadTextures(deferred_textures, threads);
+
+	//every used name is looked up once
+	std::vector<int> material_name_indices(material_names.size());
+	for (size_t i = 0; i < material_names.size(); ++i)
+		material_name_indices[i] = material_indices.Find(material_names.Name(static_cast<int>(i)));
+
+	for (size_t i = 0; i < surface_materials.size(); ++i) {
+		const int material_index = (surface_materials[i] >= 0) ? material_name_indices[surface_materials[i]] : -1;
+		if (material_index >= 0) {
+			surfaces[first_surface + i]->set_material(materials[material_index]);
+		}
+	}
+	EndPhase(&OBJLoadTimings::build);
+
+	printf("\n%I64u vertices, %I64u normals and %I64u texture coords.\n", no_vertices, no_normals, no_texture_coords);
+
+	printf("Done.\n\n");
+
+	return static_cast<int>(surface_materials.size());
+}
+
+//================================= streaming loader =================================
+
+//Range of faces of a chunk sharing group and material.
+struct ObjRun {
+	int face_begin, face_end;
+	int group;				//id in the table of group names
+	Material* material;
+	int material_index;		//position in materials (= index of the material in GPU buffers)
+};
+
+//Names of all material libraries referenced by the file (mtllib records), read without parsing the geometry.
+static void ScanMaterialLibraries(const char* file_name, std::vector<std::string>& libraries) {
+	MappedFile f(file_name);
+	if (!f.IsOpen())
+		return;
+
+	std::string name;
+	for (const char* p = f.Data(); p < f.End(); p = SkipLine(p, f.End())) {
+		p = SkipBlanks(p, f.End());
+		if (f.End() - p > 6 && strncmp(p, "mtllib", 6) == 0) {
+			ParseName(p + 6, f.End(), name);
+			libraries.push_back(name);
+		}
+	}
+}
+
+int LoadOBJStreaming(const char* file_name, OBJStreamSink& sink, std::vector<Material*>& materials, const size_t memory_limit,
+					 const bool flip_yz, const Vector3 default_color, const int no_threads, std::vector<std::string>* material_libraries,
+					 std::vector<Texture3u*>* pending_textures, Arena* material_arena) {
+	FILE* file = fopen(file_name, "rb");
+	if (file == NULL) {
+		printf("File %s not found.\n", file_name);
+
+		return -1;
+	}
+
+	//directory of the model (material libraries and textures are relative to it)
+	std::string path;
+	const char* tmp = strrchr(file_name, '/');
+	if (tmp != NULL) {
+		path.assign(file_name, tmp + 1);
+	}
+
+	//half of the budget is left for attribute tables, the rest for the window and triangles made from it
+	//(a face record of ~30 bytes expands into a 192 byte triangle)
+	const int threads = ResolveThreadCount(no_threads);
+	const size_t table_limit = memory_limit / 2;
+	const size_t window_size = std::max(memory_limit / 32, size_t(1) << 20);
+	printf("Streaming model from '%s' (%0.1f MB window, %0.1f MB memory limit, %d thread(s))...\n",
+		   file_name, window_size / sqr(1024.0f), memory_limit / sqr(1024.0f), threads);
+
+	SpillArray<Vector3> vertices(table_limit / 2);
+	SpillArray<Vector3> per_vertex_normals(table_limit / 4);
+	SpillArray<Coord2f> texture_coords(table_limit / 4);
+
+	std::vector<char> window(window_size);
+	size_t carry = 0;
+	bool eof = false;
+	bool ok = true;
+
+	NameTable group_names;
+	int group_name = group_names.Intern(std::string());
+	std::string material_name;
+	std::map<std::string, Texture3u*> already_loaded_textures;
+	MaterialIndices material_indices(materials);
+	std::vector<Texture3u*> deferred_textures;		//decoded at once after the geometry is streamed
+	Material* material = NULL;
+	int material_index = 0;
+	int no_runs = 0;
+	std::vector<std::string> loaded_libraries;
+	bool libraries_scanned = false;		//a usemtl preceded the mtllib of its material, all libraries of the file are loaded
+	std::vector<std::string> unknown_materials;		//reported once
+	size_t no_triangles = 0;
+
+	auto AddLibrary = [&](const std::string& name) {
+		if (std::find(loaded_libraries.begin(), loaded_libraries.end(), name) != loaded_libraries.end())
+			return;
+		loaded_libraries.push_back(name);
+		printf("Material library: %s\n", name.c_str());
+		LoadMTL((path + name).c_str(), path.c_str(), materials, already_loaded_textures, &deferred_textures, material_indices, material_arena);
+		if (material_libraries)
+			material_libraries->push_back(path + name);
+	};
+
+	//triangles are handed over before the rest of the file is read, so a material referenced ahead of its library
+	//makes the remaining libraries load right away
+	auto ResolveMaterial = [&](const std::string& name) {
+		int index = material_indices.Find(name);
+		if (index < 0 && !libraries_scanned) {
+			libraries_scanned = true;
+			std::vector<std::string> libraries;
+			ScanMaterialLibraries(file_name, libraries);
+			for (const std::string& library : libraries)
+				AddLibrary(library);
+			index = material_indices.Find(name);
+		}
+		if (index < 0 && std::find(unknown_materials.begin(), unknown_materials.end(), name) == unknown_materials.end()) {
+			unknown_materials.push_back(name);
+			warnlog("Material '%s' used in '%s' is not defined in any material library.\n", name.c_str(), file_name);
+		}
+		return index;
+	};
+
+	while (ok && !eof) {
+		const size_t read = fread(window.data() + carry, 1, window.size() - carry, file);
+		eof = (read < window.size() - carry);
+		const size_t filled = carry + read;
+
+		//only whole lines are parsed, the rest is carried over to the next window
+		size_t parsed = filled;
+		if (!eof) {
+			while (parsed > 0 && window[parsed - 1] != '\n')
+				--parsed;
+			if (parsed == 0) { //line longer than the window
+				window.resize(window.size() * 2);
+				carry = filled;
+				continue;
+			}
+		}
+
+		// --- parse the window in parallel ---
+		const int no_chunks = (threads > 1) ? threads * 4 : 1;
+		std::vector<ObjChunk> chunks = SplitChunks(window.data(), window.data() + parsed, no_chunks);
+
+		ParallelFor(static_cast<int>(chunks.size()), threads, [&](int i) {
+			ParseChunk(chunks[i], flip_yz);
+		});
+
+		// --- append attributes to the global tables ---
+		for (ObjChunk& chunk : chunks) {
+			chunk.vertex_offset = vertices.size();
+			chunk.normal_offset = per_vertex_normals.size();
+			chunk.texture_coord_offset = texture_coords.size();
+			ok &= vertices.Append(chunk.vertices.data(), chunk.vertices.size());
+			ok &= per_vertex_normals.Append(chunk.per_vertex_normals.data(), chunk.per_vertex_normals.size());
+			ok &= texture_coords.Append(chunk.texture_coords.data(), chunk.texture_coords.size());
+			chunk.vertices = std::vector<Vector3>();
+			chunk.per_vertex_normals = std::vector<Vector3>();
+			chunk.texture_coords = std::vector<Coord2f>();
+		}
+		if (!ok) {
+			printf("Failed to grow attribute tables (out of temporary disk space?).\n");
+			break;
+		}
+
+		// --- replay groups and materials in file order ---
+		std::vector<std::vector<ObjRun>> runs(chunks.size());
+		for (size_t c = 0; c < chunks.size(); c++) {
+			int cursor = 0;
+			auto AddRun = [&](int face_end) {
+				if (face_end > cursor)
+					runs[c].push_back({ cursor, face_end, group_name, material, material_index });
+				cursor = face_end;
+			};
+
+			for (const ObjEvent& e : chunks[c].events) {
+				AddRun(e.face);
+
+				switch (e.type) {
+					case ObjEvent::GROUP:
+						if (!e.name.empty())
+							group_name = group_names.Intern(e.name);
+						break;
+					case ObjEvent::USEMTL:
+						if (!e.name.empty() && e.name != material_name) {
+							material_name = e.name;
+							material_index = ResolveMaterial(material_name);
+							material = (material_index >= 0) ? materials[material_index] : NULL;
+							material_index = std::max(material_index, 0);
+						}
+						break;
+					case ObjEvent::MTLLIB:
+						AddLibrary(e.name);
+						break;
+				}
+			}
+			AddRun(static_cast<int>(chunks[c].faces.size()));
+		}
+
+		// --- build triangles of every chunk in parallel ---
+		std::vector<std::vector<Triangle>> triangles(chunks.size());
+		ParallelFor(static_cast<int>(chunks.size()), threads, [&](int i) {
+			ObjChunk& chunk = chunks[i];
+			chunk.triangle_prefix.resize(chunk.faces.size() + 1);
+			chunk.triangle_prefix[0] = 0;
+			for (size_t f = 0; f < chunk.faces.size(); f++)
+				chunk.triangle_prefix[f + 1] = chunk.triangle_prefix[f] + FaceTriangles(chunk, chunk.faces[f]);
+
+			triangles[i].resize(chunk.triangle_prefix.back());
+			std::vector<Vertex> polygon;
+			for (const ObjRun& r : runs[i]) {
+				for (int f = r.face_begin; f < r.face_end; f++) {
+					if (chunk.triangle_prefix[f + 1] == chunk.triangle_prefix[f])
+						continue;
+
+					Triangle* t = triangles[i].data() + chunk.triangle_prefix[f];
+					Triangle* t_end = TriangulateFace(chunk, chunk.faces[f], vertices, per_vertex_normals, texture_coords, default_color,
+													  NULL, polygon, t);
+					for (; t != t_end; ++t)
+						(*t)[0].matIdx = (*t)[1].matIdx = (*t)[2].matIdx = r.material_index;
+				}
+			}
+		});
+
+		// --- hand finished triangles over in file order, window memory is released afterwards ---
+		for (size_t c = 0; c < chunks.size() && ok; c++) {
+			for (const ObjRun& r : runs[c]) {
+				const int first = chunks[c].triangle_prefix[r.face_begin];
+				const int count = chunks[c].triangle_prefix[r.face_end] - first;
+				if (count > 0) {
+					ok &= sink.AddTriangles(group_names.Name(r.group), r.material, triangles[c].data() + first, count);
+					no_triangles += count;
+					no_runs++;
+				}
+			}
+		}
+
+		carry = filled - parsed;
+		memmove(window.data(), window.data() + parsed, carry);
+		printf("\r%I64u triangle(s)\t\t", no_triangles);
+	}
+
+	fclose(file);
+
+	if (pending_textures)
+		pending_textures->insert(pending_textures->end(), deferred_textures.begin(), deferred_textures.end());
+	else
+		LoadTextures(deferred_textures, threads);
+
+	printf("\n%I64u vertices, %I64u normals and %I64u texture coords%s.\n", vertices.size(), per_vertex_normals.size(), texture_coords.size(),
+		   (vertices.Spilled() || per_vertex_normals.Spilled() || texture_coords.Spilled()) ? " (tables spilled to disk)" : "");
+
+	if (!ok) {
+		printf("Streaming of %s failed.\n\n", file_name);
+		return -1;
+	}
+
+	printf("Done.\n\n");
+
+	return no_runs;
+}
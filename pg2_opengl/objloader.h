@@ -1,19 +1,124 @@
 #ifndef OBJ_LOADER_H_
 #define OBJ_LOADER_H_
 
+#include <unordered_map>
+#include <atomic>
+
 #include "vector3.h"
 #include "surface.h"
 
-int MaterialIndex(std::vector<Material*>& materials, const char* material_name);
+class Arena;
+
+/*! \class MaterialIndices
+\brief Hash index of material names used by the loaders.
+Maps a name to the position of the first material of that name in the materials vector it is kept for.
+*/
+class MaterialIndices {
+public:
+	MaterialIndices() {}
+	//! Indexes all \a materials (the first of equally named materials wins).
+	explicit MaterialIndices(const std::vector<Material*>& materials);
+
+	//! Position of material \a name, -1 when there is none.
+	int Find(const std::string& name) const;
+	//! Records \a index as the position of material \a name, names already present keep their position.
+	/*!
+	\return true when the name was not present.
+	*/
+	bool Insert(const std::string& name, const int index);
+private:
+	std::unordered_map<std::string, int> indices;
+};
+
+/*! \fn Texture3u * TextureProxy( const std::string & full_name, std::map<std::string, Texture3u *> & already_loaded_textures )
+\brief Loads texture \a full_name, or returns the already loaded instance from \a already_loaded_textures.
+\param pending_textures when not NULL, a new texture is only created and recorded here, \a LoadTextures decodes it later.
+\param arena when not NULL, the new texture is created in (and owned by) the arena.
+*/
+Texture3u* TextureProxy(const std::string& full_name, std::map<std::string, Texture3u*>& already_loaded_textures,
+						const int flip = -1, const bool single_channel = false, std::vector<Texture3u*>* pending_textures = nullptr,
+						Arena* arena = nullptr);
+
+/*! \fn void LoadTextures( std::vector<Texture3u *> & pending_textures, const int no_threads )
+\brief Decodes all recorded textures in parallel (every file exactly once) and clears \a pending_textures.
+Textures are already assigned to material slots, their data are valid after the call.
+\param no_threads number of decoding threads, 0 = all hardware threads.
+*/
+void LoadTextures(std::vector<Texture3u*>& pending_textures, const int no_threads = 0);
+
+/*! \struct OBJLoadTimings
+\brief Wall-clock time (seconds) spent in the phases of \a LoadOBJ, filled only when requested (benchmarks).
+*/
+struct OBJLoadTimings {
+	double read = 0.0;		//!< mapping the file and paging it in
+	double parse = 0.0;		//!< parsing chunks, merging attribute tables, groups and material libraries
+	double normals = 0.0;	//!< generating normals of corners without vn
+	double build = 0.0;		//!< building triangles of all surfaces (the BuildSurface step of the legacy loader)
+};
 
 /*! \fn int LoadOBJ( const char * file_name, Vector3 & default_color, std::vector<Surface *> & surfaces, std::vector<Material *> & materials )
 \brief Nate geometrii z OBJ souboru \a file_name.
+Normals missing in the file are generated (see \a GenerateNormals), honoring s records and \a DEFAULT_CREASE_ANGLE.
 \param file_name pln cesta k OBJ souboru vetn ppony.
 \param surfaces pole ploch, do kterho se budou ukldat naten plochy.
 \param materials pole materil, do kterho se budou ukldat naten materily.
 \param default_color vchoz barva vertexu.
+\param no_threads number of parsing threads, 0 = all hardware threads. The result does not depend on it.
+\param material_libraries optional output of paths of all loaded MTL files.
+\param pending_textures when not NULL, textures are not decoded but appended here (see \a LoadTextures).
+\param timings when not NULL, receives time spent in the loading phases. The file is paged in before parsing then,
+so reading and parsing can be told apart.
+\param material_arena when not NULL, materials and textures are created in (and owned by) this arena. Otherwise deleting all
+\a materials frees their textures as well.
+\param surface_arena when not NULL, surfaces and their triangles are created in (and owned by) this arena.
+\param cancel when not NULL, loading stops between its phases once it is set (returns -1, the surfaces made so far are left unbuilt).
 */
 int LoadOBJ(const char* file_name, std::vector<Surface*>& surfaces, std::vector<Material*>& materials,
-			const bool flip_yz = false, const Vector3 default_color = Vector3(0.5f, 0.5f, 0.5f));
+			const bool flip_yz = false, const Vector3 default_color = Vector3(0.5f, 0.5f, 0.5f), const int no_threads = 0,
+			std::vector<std::string>* material_libraries = nullptr, std::vector<Texture3u*>* pending_textures = nullptr,
+			OBJLoadTimings* timings = nullptr, Arena* material_arena = nullptr, Arena* surface_arena = nullptr,
+			const std::atomic<bool>* cancel = nullptr);
+
+/*! \fn int LoadOBJLegacy( const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials )
+\brief Original three-pass strtok/sscanf loader, kept only as a reference for benchmarks.
+Produces the same output as \a LoadOBJ.
+*/
+int LoadOBJLegacy(const char* file_name, std::vector<Surface*>& surfaces, std::vector<Material*>& materials,
+				  const bool flip_yz = false, const Vector3 default_color = Vector3(0.5f, 0.5f, 0.5f));
+
+/*! \class OBJStreamSink
+\brief Destination of triangles produced by \a LoadOBJStreaming.
+*/
+class OBJStreamSink {
+public:
+	virtual ~OBJStreamSink() {}
+
+	//! Receives the next triangles of the file (in file order).
+	/*!
+	\param group name of the current group.
+	\param material current material (or NULL), matIdx of all vertices is already set to its position in materials.
+	\param triangles triangles, valid only during the call.
+	\param count number of triangles.
+	\return false aborts loading.
+	*/
+	virtual bool AddTriangles(const std::string& group, Material* material, const Triangle* triangles, size_t count) = 0;
+};
+
+/*! \fn int LoadOBJStreaming( const char * file_name, OBJStreamSink & sink, std::vector<Material *> & materials, const size_t memory_limit )
+\brief Loads geometry of OBJ file \a file_name with bounded memory, finished triangles are handed to \a sink window by window.
+The file is read in windows of whole lines, position/normal/texture coordinate tables are spilled to a temporary file
+once they outgrow their share of \a memory_limit. Unlike \a LoadOBJ, every usemtl starts a new run of triangles.
+A material used before its library is referenced makes all libraries of the file load at once, names that remain unknown are reported.
+Neighbouring faces may lie in different windows, so corners without vn get the flat face normal.
+\param memory_limit approximate upper bound of memory used by the loader in bytes.
+\param pending_textures when not NULL, textures are not decoded but appended here (see \a LoadTextures).
+\param material_arena when not NULL, materials and textures are created in (and owned by) this arena. Otherwise deleting all
+\a materials frees their textures as well.
+\return number of runs handed to the sink, -1 on failure.
+*/
+int LoadOBJStreaming(const char* file_name, OBJStreamSink& sink, std::vector<Material*>& materials, const size_t memory_limit,
+					 const bool flip_yz = false, const Vector3 default_color = Vector3(0.5f, 0.5f, 0.5f), const int no_threads = 0,
+					 std::vector<std::string>* material_libraries = nullptr, std::vector<Texture3u*>* pending_textures = nullptr,
+					 Arena* material_arena = nullptr);
 
 #endif
@@ -2,30 +2,82 @@
 #include "tutorials.h"
 
 #include "rasterizer.h"
+#include "benchmark.h"
+#include "cook.h"
 
 constexpr int width = 640;
 constexpr int height = 480;
 
 #define SCENE_TYPE 2
 #define SHADER_TYPE 1
+#define BENCHMARK 0
+#define ASYNC_LOADING 0
+#define PACKED_VERTICES 0
+#define SPLIT_POSITIONS 0
+#define DEPTH_PREPASS 0
+#define MESHLET_CULLING 0
+#define BACKFACE_CULLING 0
+#define LEVELS_OF_DETAIL 0
+#define IMPOSTORS 0
 
 //scenes = 0= triangle, 1= avenger, 2= piece02
 //shaders = 0= normal, 1= cookTorrance
+//benchmarks = 0= none (run the app), 1= OBJ loader, 2= OBJ loader on synthetic models (10K - 100M triangles),
+//             3= OBJ loader with growing material count, 4= load-time objects on the heap vs. in arenas,
+//             5= compressed mesh assets (size & decode speed)
+//async loading = 0= wait for the whole scene, 1= render while the scene is loading (opt-in)
+//packed vertices = 0= full 64 B vertices, 1= quantized 20 B vertices decoded by the vertex shaders (see PackedVertex)
+//split positions = 0= interleaved vertices, 1= positions in a stream of their own (12 B, 8 B packed) for depth-only passes
+//depth prepass = 0= none, 1= positions are drawn first, the shading pass then runs once per visible fragment
+//meshlet culling = 0= whole scene drawn, 1= meshlets outside of the view frustum culled on the CPU, 2= by a compute shader
+//backface culling = 0= double-sided, 1= back faces culled, meshlets facing away as well (with meshlet culling only)
+//levels of detail = 0= full meshes, 1= simplified levels selected by their projected error (without meshlet culling only)
+//impostors = 0= none, 1= far meshes drawn as octahedral impostors, their atlas is baked by --cook (without meshlet culling only)
+//command line: --cook <source dir> <output dir> [threads] [--force] cooks the assets (see CookAssets) instead of running the app
 
-int main() {
+#if PACKED_VERTICES
+constexpr VertexFormat VERTEX_FORMAT = VertexFormat::PACKED;
+#else
+constexpr VertexFormat VERTEX_FORMAT = VertexFormat::FULL;
+#endif
+#if SPLIT_POSITIONS
+constexpr VertexStreams VERTEX_STREAMS = VertexStreams::SPLIT;
+#else
+constexpr VertexStreams VERTEX_STREAMS = VertexStreams::INTERLEAVED;
+#endif
+
+int main(int argc, char* argv[]) {
 	printf("PG2 OpenGL, (c)2019 Tomas Fabian\n\n");
 
+	if (argc >= 4 && strcmp(argv[1], "--cook") == 0) {
+		const bool force = strcmp(argv[argc - 1], "--force") == 0;
+		const int threads = argc - force > 4 ? atoi(argv[4]) : 0;
+		return CookAssets(argv[2], argv[3], threads, force) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+#if BENCHMARK == 1
+	return BenchmarkOBJLoader("res/models/piece_02/piece_02.obj");
+#elif BENCHMARK == 2
+	return BenchmarkOBJSuite();
+#elif BENCHMARK == 3
+	return BenchmarkMaterialScaling();
+#elif BENCHMARK == 4
+	return BenchmarkArena();
+#elif BENCHMARK == 5
+	return BenchmarkMeshCodec("res/models/piece_02/piece_02.obj");
+#endif
+
 #if SCENE_TYPE == 0
 	Rasterizer rasterizer(width, height, 45.f, vec3f{ 0.f, 0.f, -10.f }, vec3f{ 0.f, 0.f, 0.f }, 0.1f, 100.f);
 	rasterizer.LoadScene("default");
 #elif SCENE_TYPE == 1
 	Rasterizer rasterizer(width, height, 45.f, vec3f{ 100, -200, 100 }, vec3f{ 0.f, 20.f, 20.f }, 1.f, 1000.f);
-	rasterizer.LoadScene("res/models/avenger/6887_allied_avenger_gi2.obj");
+	rasterizer.LoadScene("res/models/avenger/6887_allied_avenger_gi2.obj", ASYNC_LOADING, VERTEX_FORMAT, VERTEX_STREAMS, MESHLET_CULLING != 0, LEVELS_OF_DETAIL);
 	rasterizer.SceneLight().position = vec3f{ 50.f, 50.f, 30.f };
 	rasterizer.SceneLight().attenuation = vec3f{ 1.f, 0.f, 0.f };
 #elif SCENE_TYPE == 2
 	Rasterizer rasterizer(width, height, 45.f, vec3f{ 30.f, -30.f, 15.f }, vec3f{ 0.f, 0.f, 0.f }, 1.f, 1000.f);
-	rasterizer.LoadScene("res/models/piece_02/piece_02.obj");
+	rasterizer.LoadScene("res/models/piece_02/piece_02.obj", ASYNC_LOADING, VERTEX_FORMAT, VERTEX_STREAMS, MESHLET_CULLING != 0, LEVELS_OF_DETAIL);
 	rasterizer.SceneLight().position = vec3f{ 20.f, 20.f, 15.f };
 #endif
 
@@ -36,6 +88,17 @@ int main() {
 #elif SHADER_TYPE == 2
 	rasterizer.LoadShader("res/shaders/phong_shader.vert", "res/shaders/phong_shader.frag");
 #endif
+#if DEPTH_PREPASS
+	rasterizer.LoadDepthShader("res/shaders/depth_shader.vert", "res/shaders/depth_shader.frag");
+#endif
+#if MESHLET_CULLING == 1
+	rasterizer.EnableMeshletCulling(BACKFACE_CULLING);
+#elif MESHLET_CULLING == 2
+	rasterizer.EnableMeshletCulling(BACKFACE_CULLING, "res/shaders/meshlet_cull.comp");
+#endif
+#if IMPOSTORS
+	rasterizer.LoadImpostorShader("res/shaders/impostor.vert", "res/shaders/impostor.frag");
+#endif
 
 	rasterizer.LoadIrradianceMap("res/maps/lebombo_irradiance_map.exr");
 	rasterizer.LoadPrefilteredEnvMap({
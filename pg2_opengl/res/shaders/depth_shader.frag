@@ -0,0 +1,5 @@
+#version 460 core
+
+//depth only, color writes are masked
+void main( void ) {
+}
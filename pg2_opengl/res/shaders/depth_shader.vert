@@ -0,0 +1,33 @@
+#version 460 core
+layout (location = 0) in vec4 in_position;
+layout (location = 5) in int  in_materialIdx;
+
+uniform mat4 MVP;
+
+//packed vertices (see PackedVertex): positions inside the quantization box of their material
+uniform bool packedVertices;
+layout (std430, binding = 1) readonly buffer QuantizationBoxes {
+	vec4 boxes[];		//offset & scale of every material
+};
+
+//copies of instanced meshes (see InstanceTransform) are drawn with gl_BaseInstance = 1 + their first transform
+layout (std430, binding = 5) readonly buffer Instances {
+	vec4 instances[];		//rows of a 3x4 rigid transform per copy
+};
+
+//the same depth as in the shading pass
+invariant gl_Position;
+
+void main( void ) {
+	vec4 position = in_position;
+	if (packedVertices)
+		position = vec4(boxes[2 * in_materialIdx].xyz + in_position.xyz * boxes[2 * in_materialIdx + 1].xyz, 1.f);
+
+	if (gl_BaseInstance > 0) {
+		int i = 3 * (gl_BaseInstance - 1 + gl_InstanceID);
+		mat3x4 T = mat3x4(instances[i], instances[i + 1], instances[i + 2]);
+		position = vec4(position * T, 1.f);
+	}
+
+	gl_Position = MVP * position;
+}
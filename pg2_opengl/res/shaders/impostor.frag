@@ -0,0 +1,193 @@
+#version 460 core
+#extension GL_ARB_bindless_texture : require
+#extension GL_ARB_gpu_shader_int64 : require	//uint64_t
+
+//====== Constants ======
+float PI = 3.14159;
+float _1_PI = (1.0 / PI);
+float _1_2PI = (1.0 / (2*PI));
+//=======================
+
+//depth samples of the ray per view & bisections of the hit
+const int PARALLAX_STEPS = 8;
+const int PARALLAX_REFINEMENTS = 3;
+
+//see ImpostorInstance
+struct Instance {
+	vec4 sphere;
+	vec4 tile;
+};
+
+layout (std430, binding = 4) readonly buffer Instances {
+	Instance instances[];
+};
+
+//see ImpostorAtlas
+layout (binding = 0) uniform sampler2D albedoAtlas;			//albedo & coverage
+layout (binding = 1) uniform sampler2D normalDepthAtlas;	//object space normal & depth towards the view
+uniform int impostorGrid;
+
+uniform mat4 MVP;
+uniform mat4 M;
+uniform mat4 MN;
+uniform vec3 eye;		//object space
+
+uniform vec3 p_light;
+uniform vec3 light_attenuation;
+uniform vec3 light_color;
+uniform uint64_t tex_irradianceMap;
+
+in VS_OUT {
+	flat int instance;
+	vec3 position;
+} data;
+
+out vec4 FragColor;
+
+//====== Functions ======
+vec2 OctEncode(vec3 v);
+vec3 OctDecode(vec2 e);
+ivec2 WrapCell(ivec2 cell);
+void Basis(vec3 direction, out vec3 right, out vec3 up);
+bool Sample(Instance instance, ivec2 cell, vec3 direction, vec3 right, vec3 up, float denominator, float depth, out vec3 hit, out vec4 a, out vec4 nd);
+vec3 IrradianceMap(vec3 n);
+
+//=================================
+
+//the 4 baked views around the direction of the eye are blended bilinearly, each one intersected by the view ray on its own
+void main( void ) {
+	Instance instance = instances[data.instance];
+	vec3 center = instance.sphere.xyz;
+	float radius = instance.sphere.w;
+	vec3 ray = data.position - eye;
+
+	vec2 grid = OctEncode(normalize(eye - center)) * impostorGrid - 0.5f;
+	vec2 base = floor(grid);
+	vec2 f = grid - base;
+
+	float coverage = 0.f;
+	vec3 albedo = vec3(0.f);
+	vec3 normal = vec3(0.f);
+	vec3 surface = vec3(0.f);
+	for (int k = 0; k < 4; k++) {
+		ivec2 cell = WrapCell(ivec2(base) + ivec2(k & 1, k >> 1));
+		float weight = ((k & 1) != 0 ? f.x : 1.f - f.x) * ((k & 2) != 0 ? f.y : 1.f - f.y);
+		vec3 direction = OctDecode((vec2(cell) + 0.5f) / impostorGrid);
+		vec3 right, up;
+		Basis(direction, right, up);
+
+		float denominator = dot(ray, direction);
+		if (weight <= 0.f || abs(denominator) < 1e-6f)
+			continue;
+		//the ray is marched through the depth of the view from the front of the sphere to its back, the baked surfaces are
+		//solid behind their depth, then the hit is refined by bisection
+		vec4 a = vec4(0.f), nd = vec4(0.f);
+		vec3 hit = vec3(0.f);
+		float front = radius, back = radius;
+		bool found = false;
+		for (int step = 0; step <= PARALLAX_STEPS && !found; step++) {
+			front = back;
+			back = radius * (1.f - 2.f * step / PARALLAX_STEPS);
+			found = Sample(instance, cell, direction, right, up, denominator, back, hit, a, nd);
+		}
+		if (!found)
+			continue;
+		for (int i = 0; i < PARALLAX_REFINEMENTS; i++) {
+			float depth = 0.5f * (front + back);
+			vec3 h;
+			vec4 ha, hnd;
+			if (Sample(instance, cell, direction, right, up, denominator, depth, h, ha, hnd)) {
+				back = depth;
+				hit = h;
+				a = ha;
+				nd = hnd;
+			}
+			else
+				front = depth;
+		}
+		weight *= a.a;
+		coverage += weight;
+		albedo += weight * a.rgb;
+		normal += weight * (nd.rgb * 2.f - 1.f);
+		surface += weight * (center + hit - direction * dot(hit, direction) + direction * ((nd.a * 2.f - 1.f) * radius));
+	}
+	if (coverage < 0.5f)
+		discard;
+	albedo /= coverage;
+	surface /= coverage;
+
+	//depth of the baked surface, not of the quad
+	vec4 clip = MVP * vec4(surface, 1.f);
+	gl_FragDepth = clip.z / clip.w * 0.5f + 0.5f;
+
+	//diffuse part of ct_shader
+	vec3 p_pos = (M * vec4(surface, 1.f)).xyz;
+	vec3 n = normalize((MN * vec4(normal, 0.f)).xyz);
+	vec3 v_light = normalize(p_light - p_pos);
+	vec3 at = light_attenuation;
+	float dist = length(p_light - p_pos) / 100;
+	vec3 L_light = light_color / (at.x + at.y * dist + at.z * dist * dist);
+
+	vec3 clr = albedo * _1_PI * max(dot(n, v_light), 0.01) * L_light + albedo * IrradianceMap(n);
+
+	//gamma corection
+	clr = clr / (clr + vec3(1.0));
+	clr = pow(clr, vec3(1.0/2.2));
+
+	FragColor = vec4(clr, 1.f);
+}
+
+//====== Functions ======
+
+//the same map as OctahedronEncode, [0, 1]^2
+vec2 OctEncode(vec3 v) {
+	vec2 e = v.xy / (abs(v.x) + abs(v.y) + abs(v.z));
+	if (v.z < 0.f)
+		e = (1.f - abs(e.yx)) * vec2(e.x >= 0.f ? 1.f : -1.f, e.y >= 0.f ? 1.f : -1.f);
+	return e * 0.5f + 0.5f;
+}
+
+vec3 OctDecode(vec2 e) {
+	e = e * 2.f - 1.f;
+	vec3 v = vec3(e, 1.f - abs(e.x) - abs(e.y));
+	if (v.z < 0.f)
+		v.xy = (1.f - abs(e.yx)) * vec2(e.x >= 0.f ? 1.f : -1.f, e.y >= 0.f ? 1.f : -1.f);
+	return normalize(v);
+}
+
+//Cells next to the grid are the ones across the fold of the octahedron - mirrored along the edge they lie beyond (corners twice).
+ivec2 WrapCell(ivec2 cell) {
+	int last = impostorGrid - 1;
+	if (cell.x < 0 || cell.x > last)
+		cell = ivec2(clamp(cell.x, 0, last), last - cell.y);
+	if (cell.y < 0 || cell.y > last)
+		cell = ivec2(last - cell.x, clamp(cell.y, 0, last));
+	return cell;
+}
+
+void Basis(vec3 direction, out vec3 right, out vec3 up) {
+	vec3 reference = abs(direction.z) < 0.999f ? vec3(0.f, 0.f, 1.f) : vec3(0.f, 1.f, 0.f);
+	right = normalize(cross(reference, direction));
+	up = cross(direction, right);
+}
+
+//Texels of the view where the ray crosses the plane at depth (towards the view), true when the baked surface is in front of it.
+bool Sample(Instance instance, ivec2 cell, vec3 direction, vec3 right, vec3 up, float denominator, float depth, out vec3 hit, out vec4 a, out vec4 nd) {
+	vec3 center = instance.sphere.xyz;
+	float radius = instance.sphere.w;
+	hit = eye + (data.position - eye) * (dot(center + direction * depth - eye, direction) / denominator) - center;
+	vec2 st = vec2(dot(hit, right), dot(hit, up)) / radius * 0.5f + 0.5f;
+	a = vec4(0.f);
+	nd = vec4(0.f);
+	if (any(lessThan(st, vec2(0.f))) || any(greaterThan(st, vec2(1.f))))
+		return false;
+	vec2 uv = instance.tile.xy + (vec2(cell) + st) / impostorGrid * instance.tile.zw;
+	a = texture(albedoAtlas, uv);
+	nd = texture(normalDepthAtlas, uv);
+	return a.a >= 0.5f && (nd.a * 2.f - 1.f) * radius >= depth;
+}
+
+vec3 IrradianceMap(vec3 n) {
+	vec2 coords = vec2((atan(n.y, n.x) + PI) * _1_2PI, acos(n.z) * _1_PI);
+	return texture(sampler2D(tex_irradianceMap), coords).rgb;
+}
@@ -0,0 +1,46 @@
+#version 460 core
+
+//see ImpostorInstance, in object space
+struct Instance {
+	vec4 sphere;		//center & radius
+	vec4 tile;			//origin & size of the tile of the mesh in the atlas (texture coordinates)
+};
+
+layout (std430, binding = 4) readonly buffer Instances {
+	Instance instances[];
+};
+
+uniform mat4 MVP;
+uniform vec3 eye;		//object space
+
+out VS_OUT {
+	flat int instance;
+	vec3 position;		//on the quad, object space
+} data;
+
+//the same axes as ImpostorBasis
+void Basis(vec3 direction, out vec3 right, out vec3 up) {
+	vec3 reference = abs(direction.z) < 0.999f ? vec3(0.f, 0.f, 1.f) : vec3(0.f, 1.f, 0.f);
+	right = normalize(cross(reference, direction));
+	up = cross(direction, right);
+}
+
+//triangle strip of 4 vertices facing the eye
+void main( void ) {
+	Instance instance = instances[gl_InstanceID];
+	vec3 center = instance.sphere.xyz;
+	float radius = instance.sphere.w;
+
+	vec3 toEye = eye - center;
+	float distance = length(toEye);
+	vec3 right, up;
+	Basis(toEye / distance, right, up);
+
+	//the quad through the center covers the silhouette of the sphere in perspective
+	float scale = distance > 1.001f * radius ? distance / sqrt(distance * distance - radius * radius) : 1.f;
+	vec2 corner = vec2((gl_VertexID & 1) != 0 ? 1.f : -1.f, (gl_VertexID & 2) != 0 ? 1.f : -1.f);
+	data.position = center + (right * corner.x + up * corner.y) * radius * scale;
+	data.instance = gl_InstanceID;
+
+	gl_Position = MVP * vec4(data.position, 1.f);
+}
@@ -1,20 +1,56 @@
 #version 460 core
 layout (location = 0) in vec4 in_position;
 layout (location = 1) in vec3 in_normal;
+layout (location = 5) in int  in_materialIdx;
 
 uniform mat4 MVP;
 uniform mat4 MVN;
 uniform mat4 MV;
 
+//packed vertices (see PackedVertex): positions inside the quantization box of their material, octahedron encoded normals & tangents
+uniform bool packedVertices;
+layout (std430, binding = 1) readonly buffer QuantizationBoxes {
+	vec4 boxes[];		//offset & scale of every material
+};
+
+//copies of instanced meshes (see InstanceTransform) are drawn with gl_BaseInstance = 1 + their first transform
+layout (std430, binding = 5) readonly buffer Instances {
+	vec4 instances[];		//rows of a 3x4 rigid transform per copy
+};
+
+//the same depth as in the depth prepass
+invariant gl_Position;
+
+vec3 OctDecode(vec2 e) {
+	vec3 v = vec3(e, 1.f - abs(e.x) - abs(e.y));
+	if (v.z < 0.f)
+		v.xy = (1.f - abs(v.yx)) * vec2(v.x >= 0.f ? 1.f : -1.f, v.y >= 0.f ? 1.f : -1.f);
+	return normalize(v);
+}
+
 out vec3 v_normal;
 
 void main( void ) {
-	gl_Position = MVP * in_position;
+	vec4 position = in_position;
+	vec3 normal = in_normal;
+	if (packedVertices) {
+		position = vec4(boxes[2 * in_materialIdx].xyz + in_position.xyz * boxes[2 * in_materialIdx + 1].xyz, 1.f);
+		normal = OctDecode(in_normal.xy);
+	}
+
+	if (gl_BaseInstance > 0) {
+		int i = 3 * (gl_BaseInstance - 1 + gl_InstanceID);
+		mat3x4 T = mat3x4(instances[i], instances[i + 1], instances[i + 2]);
+		position = vec4(position * T, 1.f);
+		normal = vec4(normal, 0.f) * T;
+	}
+
+	gl_Position = MVP * position;
 
-	v_normal = normalize(MVN * vec4(in_normal, 0.f)).xyz;
+	v_normal = normalize(MVN * vec4(normal, 0.f)).xyz;
 	vec3 pos = gl_Position.xyz / gl_Position.w;
 
-	vec4 hit_es = MV * in_position;
+	vec4 hit_es = MV * position;
 	vec3 omegaI_es = hit_es.xyz / hit_es.w;
 	if(dot(v_normal, omegaI_es) > 0.f)
 		v_normal *= -1.f;
@@ -5,6 +5,7 @@ layout (location = 2) in vec3 in_color;
 layout (location = 3) in vec2 in_texCoords;
 layout (location = 4) in vec3 in_tangent;
 layout (location = 5) in int  in_materialIdx;
+layout (location = 6) in float in_handedness;		//orientation of the bitangent (-1 = mirrored texture mapping)
 
 uniform mat4 MVP;
 uniform mat4 MN;
@@ -15,6 +16,27 @@ uniform vec3 p_eye;
 uniform vec3 light_attenuation;
 uniform vec3 light_color;
 
+//packed vertices (see PackedVertex): positions inside the quantization box of their material, octahedron encoded normals & tangents
+uniform bool packedVertices;
+layout (std430, binding = 1) readonly buffer QuantizationBoxes {
+	vec4 boxes[];		//offset & scale of every material
+};
+
+//copies of instanced meshes (see InstanceTransform) are drawn with gl_BaseInstance = 1 + their first transform
+layout (std430, binding = 5) readonly buffer Instances {
+	vec4 instances[];		//rows of a 3x4 rigid transform per copy
+};
+
+//the same depth as in the depth prepass
+invariant gl_Position;
+
+vec3 OctDecode(vec2 e) {
+	vec3 v = vec3(e, 1.f - abs(e.x) - abs(e.y));
+	if (v.z < 0.f)
+		v.xy = (1.f - abs(v.yx)) * vec2(v.x >= 0.f ? 1.f : -1.f, v.y >= 0.f ? 1.f : -1.f);
+	return normalize(v);
+}
+
 out VS_OUT {
 	flat int matIdx;
 	vec2 texCoords;
@@ -34,14 +56,33 @@ out VS_OUT {
 } data;
 
 void main( void ) {
-	gl_Position = MVP * in_position;
+	vec4 position = in_position;
+	vec3 normal = in_normal;
+	vec3 tangent = in_tangent;
+	float handedness = in_handedness;
+	if (packedVertices) {
+		position = vec4(boxes[2 * in_materialIdx].xyz + in_position.xyz * boxes[2 * in_materialIdx + 1].xyz, 1.f);
+		normal = OctDecode(in_normal.xy);
+		tangent = OctDecode(in_tangent.xy);
+		handedness = ((int(round(in_tangent.y * 32767.f)) & 1) != 0) ? -1.f : 1.f;
+	}
+
+	if (gl_BaseInstance > 0) {
+		int i = 3 * (gl_BaseInstance - 1 + gl_InstanceID);
+		mat3x4 T = mat3x4(instances[i], instances[i + 1], instances[i + 2]);
+		position = vec4(position * T, 1.f);
+		normal = vec4(normal, 0.f) * T;
+		tangent = vec4(tangent, 0.f) * T;
+	}
+
+	gl_Position = MVP * position;
 
-	vec4 pos = M * in_position;
+	vec4 pos = M * position;
 	data.p_pos = pos.xyz / pos.w;
 
-	vec3 T = normalize((MN * vec4(in_tangent, 0.f)).xyz);
-	vec3 N = normalize((MN * vec4(in_normal , 0.f)).xyz);
-	vec3 B = normalize(cross(N, T));
+	vec3 T = normalize((MN * vec4(tangent, 0.f)).xyz);
+	vec3 N = normalize((MN * vec4(normal , 0.f)).xyz);
+	vec3 B = normalize(cross(N, T)) * handedness;
 	data.TBN = mat3(T,B,N);
 
 
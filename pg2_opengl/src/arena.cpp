@@ -0,0 +1,89 @@
+#include "pch.h"
+#include "arena.h"
+
+#include "log.h"
+
+//allocations larger than this part of a block get a block of their own, so they don't waste the rest of the current one
+constexpr size_t LARGE_ALLOCATION_DIVISOR = 4;
+
+Arena::Arena(Arena&& a) noexcept
+	: blockSize(a.blockSize), blocks(std::move(a.blocks)), cursor(a.cursor), end(a.end), destructors(a.destructors), stats_(a.stats_) {
+	a.blocks.clear();
+	a.cursor = a.end = nullptr;
+	a.destructors = nullptr;
+	a.stats_ = Stats();
+}
+
+Arena& Arena::operator=(Arena&& a) noexcept {
+	if (this != &a) {
+		Release();
+		blockSize = a.blockSize;
+		blocks = std::move(a.blocks);
+		cursor = a.cursor;
+		end = a.end;
+		destructors = a.destructors;
+		stats_ = a.stats_;
+
+		a.blocks.clear();
+		a.cursor = a.end = nullptr;
+		a.destructors = nullptr;
+		a.stats_ = Stats();
+	}
+	return *this;
+}
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+	stats_.objects++;
+	stats_.bytesUsed += size;
+
+	if (size > blockSize / LARGE_ALLOCATION_DIVISOR) {
+		//dedicated block, the current one stays open for small objects
+		const size_t reserved = size + alignment;
+		char* block = static_cast<char*>(::operator new(reserved));
+		blocks.push_back(block);
+		stats_.blocks++;
+		stats_.bytesReserved += reserved;
+		return block + (alignment - reinterpret_cast<uintptr_t>(block) % alignment) % alignment;
+	}
+
+	char* p = cursor ? cursor + (alignment - reinterpret_cast<uintptr_t>(cursor) % alignment) % alignment : nullptr;
+	if (p == nullptr || p + size > end) {
+		AllocateBlock(blockSize);
+		p = cursor + (alignment - reinterpret_cast<uintptr_t>(cursor) % alignment) % alignment;
+	}
+	cursor = p + size;
+	return p;
+}
+
+void Arena::Release() {
+	for (DestructorRecord* d = destructors; d != nullptr; d = d->next)
+		d->destroy(d->object, d->count);
+	destructors = nullptr;
+
+	for (void* block : blocks)
+		::operator delete(block);
+	blocks.clear();
+	cursor = end = nullptr;
+	stats_ = Stats();
+}
+
+void Arena::Log(const char* name) const {
+	errlog("Arena '%s': %zu objects in %zu heap blocks, %.1f MB used of %.1f MB reserved (%.1f %% unused).\n", name, stats_.objects,
+		stats_.blocks, stats_.bytesUsed / (1024.0 * 1024.0), stats_.bytesReserved / (1024.0 * 1024.0), stats_.Fragmentation() * 100.0);
+}
+
+void Arena::AddDestructor(void* object, size_t count, Destructor destroy) {
+	//records are not counted as objects, they are bookkeeping of the arena
+	DestructorRecord* record = static_cast<DestructorRecord*>(Allocate(sizeof(DestructorRecord), alignof(DestructorRecord)));
+	stats_.objects--;
+	*record = { destroy, object, count, destructors };
+	destructors = record;
+}
+
+void Arena::AllocateBlock(size_t size) {
+	cursor = static_cast<char*>(::operator new(size));
+	end = cursor + size;
+	blocks.push_back(cursor);
+	stats_.blocks++;
+	stats_.bytesReserved += size;
+}
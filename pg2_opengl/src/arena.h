@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+//Monotonic allocator owning objects created while a scene is loading. Objects are carved out of large blocks, so thousands
+//of small allocations cost only a few heap calls, and all of them are destroyed and freed at once by Release() (or the
+//destructor) in reverse order of creation. Large arrays get a block of their own. Not thread-safe.
+class Arena {
+public:
+	static constexpr size_t DEFAULT_BLOCK_SIZE = size_t(1) << 20;
+
+	//Allocator calls and memory of the arena since the last Release().
+	struct Stats {
+		size_t objects = 0;			//objects & arrays created
+		size_t blocks = 0;			//heap allocations made for them
+		size_t bytesUsed = 0;		//bytes requested by the objects
+		size_t bytesReserved = 0;	//bytes allocated from the heap
+
+		//Part of the reserved memory not used by any object (alignment & unused ends of blocks).
+		inline double Fragmentation() const { return bytesReserved ? 1.0 - double(bytesUsed) / double(bytesReserved) : 0.0; }
+	};
+
+	explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE) : blockSize(blockSize) {}
+	~Arena() { Release(); }
+
+	//copy deleted
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	//move enabled, objects stay where they are
+	Arena(Arena&& a) noexcept;
+	Arena& operator=(Arena&& a) noexcept;
+
+	//Constructs T in the arena, its destructor runs on Release().
+	template<typename T, typename... Args>
+	T* New(Args&&... args) {
+		T* object = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if (!std::is_trivially_destructible<T>::value)
+			AddDestructor(object, 1, [](void* p, size_t) { static_cast<T*>(p)->~T(); });
+		return object;
+	}
+
+	//Array of n default constructed T.
+	template<typename T>
+	T* NewArray(size_t n) {
+		T* array = static_cast<T*>(Allocate(sizeof(T) * n, alignof(T)));
+		for (size_t i = 0; i < n; i++)
+			new (array + i) T();
+		if (!std::is_trivially_destructible<T>::value)
+			AddDestructor(array, n, [](void* p, size_t n) { for (size_t i = n; i-- > 0;) static_cast<T*>(p)[i].~T(); });
+		return array;
+	}
+
+	//Uninitialized memory, freed by Release().
+	void* Allocate(size_t size, size_t alignment);
+
+	//Destroys all objects and frees all blocks.
+	void Release();
+
+	inline const Stats& stats() const { return stats_; }
+	//Prints stats of the arena.
+	void Log(const char* name) const;
+private:
+	using Destructor = void (*)(void*, size_t);
+	//Destructor to run on Release(), kept in the arena itself.
+	struct DestructorRecord {
+		Destructor destroy;
+		void* object;
+		size_t count;
+		DestructorRecord* next;
+	};
+
+	void AddDestructor(void* object, size_t count, Destructor destroy);
+	void AllocateBlock(size_t size);
+private:
+	size_t blockSize;
+	std::vector<void*> blocks;
+	char* cursor = nullptr;			//free part of the current block
+	char* end = nullptr;
+	DestructorRecord* destructors = nullptr;	//latest first
+	Stats stats_;
+};
+
+//Constructs T in arena, or with plain new when arena is nullptr (the caller owns the object then).
+template<typename T, typename... Args>
+T* ArenaNew(Arena* arena, Args&&... args) {
+	return arena ? arena->New<T>(std::forward<Args>(args)...) : new T(std::forward<Args>(args)...);
+}
@@ -0,0 +1,609 @@
+#include "pch.h"
+#include "benchmark.h"
+
+#include <chrono>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "log.h"
+#include "utils.h"
+#include "objloader.h"
+#include "mymath.h"
+#include "parallel.h"
+#include "scene.h"
+#include "geometry.h"
+#include "arena.h"
+#include "geometrycache.h"
+
+using LoaderFn = std::function<int(const char*, std::vector<Surface*>&, std::vector<Material*>&)>;
+
+//Runs the loader n times, returns the best time (seconds), the number of loaded triangles and a hash of all vertex data.
+static double TimeLoader(LoaderFn loader, const char* filepath, int repetitions, int& no_triangles, unsigned long long& hash);
+//Peak resident memory of the process so far (bytes).
+static size_t PeakMemoryUsage();
+//Best time (seconds) of writing all vertices & indices of the cache into given buffers with given number of threads.
+static double TimeDecode(const GeometryCache& cache, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, int threads, int repetitions);
+
+//Results of one model of the suite, phase times are negative when unknown (streamed models).
+struct SuiteRun {
+	size_t triangles = 0;
+	double read = -1.0, parse = -1.0, normals = -1.0, build = -1.0, merge = -1.0;	//merge = MergeSurfaces & WeldVertices
+	double total = 0.0;		//loader only (without merge)
+};
+
+//Only counts triangles of the streaming loader.
+class CountingSink : public OBJStreamSink {
+public:
+	bool AddTriangles(const std::string&, Material*, const Triangle*, size_t count) override {
+		triangles += count;
+		return true;
+	}
+public:
+	size_t triangles = 0;
+};
+
+//================================= Benchmarks =================================
+
+int BenchmarkOBJLoader(const char* filepath, int repetitions) {
+	const double size_mb = GetFileSize64(filepath) / (1024.0 * 1024.0);
+	if (size_mb <= 0.0) {
+		errlog("Benchmark: file '%s' not found.\n", filepath);
+		return EXIT_FAILURE;
+	}
+
+	const int threads = ResolveThreadCount(0);
+
+	int triangles_legacy = 0, triangles_serial = 0, triangles_parallel = 0;
+	unsigned long long hash_legacy = 0, hash_serial = 0, hash_parallel = 0;
+	const double t_legacy = TimeLoader([](const char* f, std::vector<Surface*>& s, std::vector<Material*>& m) {
+		return LoadOBJLegacy(f, s, m);
+	}, filepath, repetitions, triangles_legacy, hash_legacy);
+	const double t_serial = TimeLoader([](const char* f, std::vector<Surface*>& s, std::vector<Material*>& m) {
+		return LoadOBJ(f, s, m, false, Vector3(0.5f, 0.5f, 0.5f), 1);
+	}, filepath, repetitions, triangles_serial, hash_serial);
+	const double t_parallel = TimeLoader([threads](const char* f, std::vector<Surface*>& s, std::vector<Material*>& m) {
+		return LoadOBJ(f, s, m, false, Vector3(0.5f, 0.5f, 0.5f), threads);
+	}, filepath, repetitions, triangles_parallel, hash_parallel);
+
+	errlog("--------------------------------\n");
+	errlog("OBJ loader benchmark: '%s' (%.1f MB, best of %d)\n", filepath, size_mb, repetitions);
+	errlog("  legacy:            %8.3f s  %8.1f MB/s  (%d triangles)\n", t_legacy, size_mb / t_legacy, triangles_legacy);
+	errlog("  current, 1 thread: %8.3f s  %8.1f MB/s  (%d triangles)\n", t_serial, size_mb / t_serial, triangles_serial);
+	errlog("  current, %2d thr.:  %8.3f s  %8.1f MB/s  (%d triangles)\n", threads, t_parallel, size_mb / t_parallel, triangles_parallel);
+	errlog("  speedup: %.2fx (serial), %.2fx (parallel)\n", t_legacy / t_serial, t_legacy / t_parallel);
+
+	if (triangles_legacy != triangles_serial || triangles_serial != triangles_parallel) {
+		errlog("Benchmark: loaders produced different geometry!\n");
+		return EXIT_FAILURE;
+	}
+	if (hash_serial != hash_parallel) {
+		errlog("Benchmark: parallel loader output differs from the serial one!\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+int BenchmarkOBJSuite(size_t maxTriangles, int repetitions, bool keepFiles) {
+	namespace fs = std::filesystem;
+	using Clock = std::chrono::high_resolution_clock;
+
+	const std::string directory = (fs::temp_directory_path() / "pg2_objbench").string();
+	const size_t sizes[] = { 10'000, 100'000, 1'000'000, 10'000'000, 100'000'000 };
+
+	struct Row { SuiteRun run; int groups, materials; double size_mb, generate; size_t peak; bool streamed; };
+	std::vector<Row> rows;
+
+	for (const size_t size : sizes) {
+		if (size > maxTriangles)
+			break;
+
+		Row row = {};
+		row.groups = static_cast<int>(std::clamp<size_t>(size / 5000, 4, 10000));
+		row.materials = std::min(row.groups, 256);
+
+		auto start = Clock::now();
+		const std::string path = GenerateOBJ(directory.c_str(), size, row.groups, row.materials);
+		row.generate = std::chrono::duration<double>(Clock::now() - start).count();
+		if (path.empty()) {
+			errlog("Benchmark: failed to write a synthetic model into '%s'.\n", directory.c_str());
+			return EXIT_FAILURE;
+		}
+
+		//same rule as in Scene - models that don't fit into memory are streamed
+		const long long file_size = GetFileSize64(path.c_str());
+		row.size_mb = file_size / (1024.0 * 1024.0);
+		row.streamed = file_size * 8 > static_cast<long long>(Scene::DEFAULT_MEMORY_LIMIT);
+
+		for (int i = 0; i < repetitions; i++) {
+			SuiteRun run;
+			std::vector<Material*> materials;
+
+			if (row.streamed) {
+				CountingSink sink;
+				start = Clock::now();
+				LoadOBJStreaming(path.c_str(), sink, materials, Scene::DEFAULT_MEMORY_LIMIT);
+				run.total = std::chrono::duration<double>(Clock::now() - start).count();
+				run.triangles = sink.triangles;
+			}
+			else {
+				std::vector<Surface*> surfaces;
+				OBJLoadTimings timings;
+				LoadOBJ(path.c_str(), surfaces, materials, false, Vector3(0.5f, 0.5f, 0.5f), 0, nullptr, nullptr, &timings);
+
+				std::vector<Mesh> meshes;
+				start = Clock::now();
+				const IndexedGeometry geometry = WeldVertices(MergeSurfaces(surfaces, materials, meshes));
+				run.merge = std::chrono::duration<double>(Clock::now() - start).count();
+
+				run.read = timings.read;
+				run.parse = timings.parse;
+				run.normals = timings.normals;
+				run.build = timings.build;
+				run.total = timings.read + timings.parse + timings.normals + timings.build;
+				run.triangles = geometry.indices.size() / 3;
+				SafeDeleteVectorItems(surfaces);
+			}
+			SafeDeleteVectorItems(materials);
+
+			if (i == 0 || run.total < row.run.total)
+				row.run = run;
+		}
+		//sizes are ascending, so the peak of the process is the peak of the largest (= current) model
+		row.peak = PeakMemoryUsage();
+		rows.push_back(row);
+
+		if (!keepFiles) {
+			std::error_code ec;
+			fs::remove(path, ec);
+			fs::remove(fs::path(path).replace_extension(".mtl"), ec);
+		}
+	}
+
+	auto Seconds = [](double t) {
+		char buffer[16];
+		if (t < 0.0)
+			snprintf(buffer, sizeof(buffer), "%8s", "-");
+		else
+			snprintf(buffer, sizeof(buffer), "%8.3f", t);
+		return std::string(buffer);
+	};
+
+	errlog("--------------------------------\n");
+	errlog("OBJ loader suite: synthetic quad models with v//vn faces (%d thread(s), best of %d)\n", ResolveThreadCount(0), repetitions);
+	errlog("   triangles groups mats  file MB  gen s   read s  parse s normal s  build s  merge s  total s    MB/s  Mtri/s  peak MB\n");
+
+	int result = EXIT_SUCCESS;
+	for (size_t i = 0; i < rows.size(); i++) {
+		const Row& row = rows[i];
+		const SuiteRun& run = row.run;
+		errlog("%12zu %6d %4d %8.1f %6.1f %s %s %s %s %s %s %7.1f %7.2f %8.0f%s\n", run.triangles, row.groups, row.materials,
+			row.size_mb, row.generate, Seconds(run.read).c_str(), Seconds(run.parse).c_str(), Seconds(run.normals).c_str(), Seconds(run.build).c_str(),
+			Seconds(run.merge).c_str(), Seconds(run.total).c_str(), row.size_mb / run.total, run.triangles / run.total * 1e-6,
+			row.peak / (1024.0 * 1024.0), row.streamed ? "  (streamed)" : "");
+
+		if (run.triangles != sizes[i]) {
+			errlog("Benchmark: loader returned %zu triangles, %zu were generated!\n", run.triangles, sizes[i]);
+			result = EXIT_FAILURE;
+		}
+	}
+	return result;
+}
+
+int BenchmarkMaterialScaling(size_t triangles, int repetitions, bool keepFiles) {
+	namespace fs = std::filesystem;
+	using Clock = std::chrono::high_resolution_clock;
+
+	const std::string directory = (fs::temp_directory_path() / "pg2_objbench").string();
+	const int counts[] = { 100, 1'000, 10'000, 100'000 };
+
+	errlog("--------------------------------\n");
+	errlog("OBJ loader material scaling: %zu triangles, one group and material per patch (%d thread(s), best of %d)\n",
+		triangles, ResolveThreadCount(0), repetitions);
+	errlog("   mats  parse s  merge s  total s  us/mat\n");
+
+	int result = EXIT_SUCCESS;
+	for (const int count : counts) {
+		const std::string path = GenerateOBJ(directory.c_str(), triangles, count, count);
+		if (path.empty()) {
+			errlog("Benchmark: failed to write a synthetic model into '%s'.\n", directory.c_str());
+			return EXIT_FAILURE;
+		}
+
+		double best_parse = 0.0, best_merge = 0.0, best_total = 1e30;
+		size_t no_materials = 0;
+		for (int i = 0; i < repetitions; i++) {
+			std::vector<Surface*> surfaces;
+			std::vector<Material*> materials;
+			OBJLoadTimings timings;
+			LoadOBJ(path.c_str(), surfaces, materials, false, Vector3(0.5f, 0.5f, 0.5f), 0, nullptr, nullptr, &timings);
+
+			std::vector<Mesh> meshes;
+			const auto start = Clock::now();
+			MergeSurfaces(surfaces, materials, meshes);
+			const double merge = std::chrono::duration<double>(Clock::now() - start).count();
+
+			const double total = timings.read + timings.parse + timings.normals + timings.build + merge;
+			if (total < best_total) {
+				best_parse = timings.parse;
+				best_merge = merge;
+				best_total = total;
+			}
+			no_materials = materials.size();
+			SafeDeleteVectorItems(surfaces);
+			SafeDeleteVectorItems(materials);
+		}
+
+		//the fixed triangle count costs the same in every row, only the per material part may grow
+		errlog("%7d %8.3f %8.3f %8.3f %7.2f\n", count, best_parse, best_merge, best_total, best_total / count * 1e6);
+
+		//materials of the MTL file (+ the default one)
+		if (no_materials < size_t(count)) {
+			errlog("Benchmark: loader returned %zu materials, %d were generated!\n", no_materials, count);
+			result = EXIT_FAILURE;
+		}
+
+		if (!keepFiles) {
+			std::error_code ec;
+			fs::remove(path, ec);
+			fs::remove(fs::path(path).replace_extension(".mtl"), ec);
+		}
+	}
+	return result;
+}
+
+int BenchmarkArena(size_t triangles, int groups, int repetitions, bool keepFiles) {
+	namespace fs = std::filesystem;
+	using Clock = std::chrono::high_resolution_clock;
+
+	const std::string directory = (fs::temp_directory_path() / "pg2_objbench").string();
+	const std::string path = GenerateOBJ(directory.c_str(), triangles, groups, groups);
+	if (path.empty()) {
+		errlog("Benchmark: failed to write a synthetic model into '%s'.\n", directory.c_str());
+		return EXIT_FAILURE;
+	}
+
+	errlog("--------------------------------\n");
+	errlog("Load-time objects on the heap and in arenas: %zu triangles, %d groups & materials (best of %d)\n",
+		triangles, groups, repetitions);
+	errlog("   mode   load s   free s  objects  heap calls  MB used  MB reserved  unused %%\n");
+
+	int result = EXIT_SUCCESS;
+	size_t heap_objects = 0;
+	for (const bool use_arena : { false, true }) {
+		double best_load = 1e30, best_free = 1e30;
+		Arena::Stats stats;
+		for (int i = 0; i < repetitions; i++) {
+			Arena materialArena, surfaceArena;
+			std::vector<Surface*> surfaces;
+			std::vector<Material*> materials;
+
+			const auto start = Clock::now();
+			LoadOBJ(path.c_str(), surfaces, materials, false, Vector3(0.5f, 0.5f, 0.5f), 0, nullptr, nullptr, nullptr,
+				use_arena ? &materialArena : nullptr, use_arena ? &surfaceArena : nullptr);
+			const auto loaded = Clock::now();
+
+			//surface & its triangles, material (the models have no textures)
+			heap_objects = surfaces.size() * 2 + materials.size();
+			stats = materialArena.stats();
+			stats.objects += surfaceArena.stats().objects;
+			stats.blocks += surfaceArena.stats().blocks;
+			stats.bytesUsed += surfaceArena.stats().bytesUsed;
+			stats.bytesReserved += surfaceArena.stats().bytesReserved;
+
+			if (use_arena) {
+				surfaceArena.Release();
+				materialArena.Release();
+			}
+			else {
+				SafeDeleteVectorItems(surfaces);
+				SafeDeleteVectorItems(materials);
+			}
+			const auto freed = Clock::now();
+
+			best_load = std::min(best_load, std::chrono::duration<double>(loaded - start).count());
+			best_free = std::min(best_free, std::chrono::duration<double>(freed - loaded).count());
+		}
+
+		if (use_arena) {
+			errlog("  arena %8.3f %8.3f %8zu %11zu %8.1f %12.1f %9.1f\n", best_load, best_free, stats.objects, stats.blocks,
+				stats.bytesUsed / (1024.0 * 1024.0), stats.bytesReserved / (1024.0 * 1024.0), stats.Fragmentation() * 100.0);
+			if (stats.objects != heap_objects) {
+				errlog("Benchmark: arenas hold %zu objects, %zu were allocated on the heap!\n", stats.objects, heap_objects);
+				result = EXIT_FAILURE;
+			}
+		}
+		else {
+			errlog("   heap %8.3f %8.3f %8zu %11zu %8s %12s %9s\n", best_load, best_free, heap_objects, heap_objects, "-", "-", "-");
+		}
+	}
+
+	if (!keepFiles) {
+		std::error_code ec;
+		fs::remove(path, ec);
+		fs::remove(fs::path(path).replace_extension(".mtl"), ec);
+	}
+	return result;
+}
+
+int BenchmarkMeshCodec(const char* filepath, int repetitions) {
+	namespace fs = std::filesystem;
+	using Clock = std::chrono::high_resolution_clock;
+
+	const long long objBytes = GetFileSize64(filepath);
+	if (objBytes <= 0) {
+		errlog("Benchmark: file '%s' not found.\n", filepath);
+		return EXIT_FAILURE;
+	}
+	const std::string assetPath = (fs::temp_directory_path() / fs::path(filepath).filename()).replace_extension(MESH_ASSET_EXTENSION).string();
+
+	//cold start: parsing, welding & tangents (the same geometry is written to both files)
+	const auto start = Clock::now();
+	std::vector<Surface*> surfaces;
+	std::vector<Material*> materials;
+	std::vector<std::string> materialLibraries;
+	if (LoadOBJ(filepath, surfaces, materials, false, Vector3(0.5f, 0.5f, 0.5f), 0, &materialLibraries) < 0) {
+		errlog("Benchmark: failed to load '%s'.\n", filepath);
+		return EXIT_FAILURE;
+	}
+	std::vector<Mesh> meshes;
+	IndexedGeometry geometry = WeldVertices(MergeSurfaces(surfaces, materials, meshes));
+	GenerateTangents(geometry);
+	const double objTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+	const bool written = GeometryCache::Write(filepath, materialLibraries, geometry, meshes, materials) &&
+		GeometryCache::WriteAsset(assetPath.c_str(), filepath, materialLibraries, geometry, meshes, materials);
+	SafeDeleteVectorItems(surfaces);
+	SafeDeleteVectorItems(materials);
+	geometry = IndexedGeometry();
+
+	GeometryCache raw, asset;
+	if (!written || !raw.Open(filepath) || !asset.OpenAsset(assetPath.c_str())) {
+		errlog("Benchmark: failed to write the cache or the asset of '%s'.\n", filepath);
+		return EXIT_FAILURE;
+	}
+
+	//destinations are touched first, page faults are not measured
+	const int threads = ResolveThreadCount(0);
+	std::vector<Vertex> rawVertices(raw.VertexCount()), vertices(raw.VertexCount());
+	std::vector<uint32_t> rawIndices(raw.IndexCount()), indices(raw.IndexCount());
+	const double rawTime1 = TimeDecode(raw, rawVertices, rawIndices, 1, repetitions);
+	const double rawTimeN = TimeDecode(raw, rawVertices, rawIndices, threads, repetitions);
+	const double assetTime1 = TimeDecode(asset, vertices, indices, 1, repetitions);
+	const double assetTimeN = TimeDecode(asset, vertices, indices, threads, repetitions);
+
+	const long long rawBytes = GetFileSize64(GeometryCache::CachePath(filepath).c_str());
+	const long long assetBytes = GetFileSize64(assetPath.c_str());
+	const double outputGB = (raw.VertexCount() * sizeof(Vertex) + raw.IndexCount() * (raw.IndexType() == GL_UNSIGNED_SHORT ? 2 : 4)) / 1e9;
+
+	errlog("--------------------------------\n");
+	errlog("Mesh codec: '%s' (%zu vertices, %zu indices, files in the page cache, best of %d)\n", filepath, raw.VertexCount(),
+		raw.IndexCount(), repetitions);
+	errlog("  format       size MB  vs OBJ   load s  GB/s 1 thr.  GB/s %2d thr.\n", threads);
+	errlog("  OBJ text    %8.1f  %6.2f  %7.3f\n", objBytes / 1048576.0, 1.0, objTime);
+	errlog("  raw cache   %8.1f  %6.2f  %7.3f  %11.2f  %12.2f\n", rawBytes / 1048576.0, double(rawBytes) / objBytes, rawTimeN,
+		outputGB / rawTime1, outputGB / rawTimeN);
+	errlog("  compressed  %8.1f  %6.2f  %7.3f  %11.2f  %12.2f\n", assetBytes / 1048576.0, double(assetBytes) / objBytes, assetTimeN,
+		outputGB / assetTime1, outputGB / assetTimeN);
+
+	//quantization error against the raw vertices
+	Vector3 lo(INFINITY, INFINITY, INFINITY), hi(-INFINITY, -INFINITY, -INFINITY);
+	for (const Vertex& v : rawVertices) {
+		for (int c = 0; c < 3; c++) {
+			lo.data[c] = std::min(lo.data[c], v.position.data[c]);
+			hi.data[c] = std::max(hi.data[c], v.position.data[c]);
+		}
+	}
+	double position = 0.0, uv = 0.0, color = 0.0, normal = 1.0, tangent = 1.0;
+	size_t wrong = 0;
+	for (size_t i = 0; i < rawVertices.size(); i++) {
+		const Vertex& a = rawVertices[i];
+		const Vertex& b = vertices[i];
+		for (int c = 0; c < 3; c++) {
+			position = std::max(position, double(std::fabs(a.position.data[c] - b.position.data[c])));
+			color = std::max(color, double(std::fabs(a.color.data[c] - b.color.data[c])));
+		}
+		uv = std::max(uv, double(std::max(std::fabs(a.texture_coords[0].u - b.texture_coords[0].u), std::fabs(a.texture_coords[0].v - b.texture_coords[0].v))));
+		if (a.normal.SqrL2Norm() > 0.0f)
+			normal = std::min(normal, double(a.normal.DotProduct(b.normal) / std::sqrt(a.normal.SqrL2Norm())));
+		tangent = std::min(tangent, double(a.tangent.DotProduct(b.tangent)));
+		wrong += (a.matIdx != b.matIdx);
+	}
+	for (size_t i = 0; i < rawIndices.size(); i++)
+		wrong += (rawIndices[i] != indices[i]);
+
+	const Vector3 extent = hi - lo;
+	const double maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+	const double rad2deg = 180.0 / M_PI;
+	errlog("  compressed: %.2fx smaller than the raw cache, max. error: position %.2e (%.2e of the extent), normal %.4f deg, "
+		"tangent %.4f deg, uv %.2e, color %.2e\n", double(rawBytes) / assetBytes, position, position / maxExtent,
+		std::acos(std::min(normal, 1.0)) * rad2deg, std::acos(std::min(tangent, 1.0)) * rad2deg, uv, color);
+
+	std::error_code ec;
+	fs::remove(assetPath, ec);
+
+	//positions stay within half a step of the 16 bit grid (with some float rounding), indices & materials are lossless
+	if (wrong > 0 || position > maxExtent / 65535.0) {
+		errlog("Benchmark: decoded geometry differs from the raw cache (%zu indices or materials)!\n", wrong);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+//================================= Synthetic models =================================
+
+std::string GenerateOBJ(const char* directory, size_t triangles, int groups, int materials, bool quads) {
+	namespace fs = std::filesystem;
+
+	char name[128];
+	snprintf(name, sizeof(name), "synth_%zu_g%d_m%d_%s", triangles, groups, materials, quads ? "quad" : "tri");
+	const fs::path obj = fs::path(directory) / (std::string(name) + ".obj");
+	const fs::path mtl = fs::path(directory) / (std::string(name) + ".mtl");
+
+	std::error_code ec;
+	if (fs::exists(obj, ec) && fs::exists(mtl, ec))
+		return obj.string();
+	fs::create_directories(directory, ec);
+
+	//flat colors only, decoding textures would dominate the measurement
+	FILE* file = fopen(mtl.string().c_str(), "wb");
+	if (file == NULL)
+		return std::string();
+	for (int m = 0; m < materials; m++) {
+		fprintf(file, "newmtl mat_%d\nKa 0 0 0\nKd %.3f %.3f %.3f\nKs 0.5 0.5 0.5\nNs 32\nillum 2\n\n", m,
+			(m % 7) / 6.0f, (m % 11) / 10.0f, (m % 13) / 12.0f);
+	}
+	const bool mtl_ok = ferror(file) == 0;
+	fclose(file);
+	if (!mtl_ok)
+		return std::string();
+
+	//written into a temporary file first, interrupted runs must not leave truncated models behind
+	const fs::path tmp = fs::path(obj).concat(".tmp");
+	file = fopen(tmp.string().c_str(), "wb");
+	if (file == NULL)
+		return std::string();
+	setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+	fprintf(file, "# synthetic model, %zu triangles\nmtllib %s.mtl\n", triangles, name);
+
+	const size_t face_triangles = quads ? 2 : 1;
+	const size_t faces = (triangles + face_triangles - 1) / face_triangles;
+	size_t base = 1;		//OBJ indices start at 1
+
+	for (int g = 0; g < groups; g++) {
+		const size_t group_faces = faces / groups + ((size_t(g) < faces % groups) ? 1 : 0);
+		if (group_faces == 0)
+			continue;
+
+		//every group is a grid patch of a wavy surface, a quad takes one cell, triangles two per cell
+		const size_t cells = quads ? group_faces : (group_faces + 1) / 2;
+		const size_t columns = std::max<size_t>(1, static_cast<size_t>(ceil(sqrt(double(cells)))));
+		const size_t rows = (cells + columns - 1) / columns;
+		const float ox = float((g % 32) * (columns + 1));
+		const float oz = float((g / 32) * (rows + 1));
+
+		fprintf(file, "g group_%d\nusemtl mat_%d\n", g, g % materials);
+
+		for (size_t r = 0; r <= rows; r++) {
+			for (size_t c = 0; c <= columns; c++) {
+				const float x = ox + c, z = oz + r;
+				const float y = 0.25f * sinf(0.3f * x) * cosf(0.3f * z);
+				fprintf(file, "v %.4f %.4f %.4f\n", x, y, z);
+			}
+		}
+		for (size_t r = 0; r <= rows; r++) {
+			for (size_t c = 0; c <= columns; c++) {
+				const float x = ox + c, z = oz + r;
+				const float dx = 0.075f * cosf(0.3f * x) * cosf(0.3f * z);
+				const float dz = -0.075f * sinf(0.3f * x) * sinf(0.3f * z);
+				const float inv = 1.0f / sqrtf(dx * dx + 1.0f + dz * dz);
+				fprintf(file, "vn %.4f %.4f %.4f\n", -dx * inv, inv, -dz * inv);
+			}
+		}
+
+		size_t written = 0;
+		for (size_t cell = 0; cell < cells; cell++, written++) {
+			const size_t a = base + (cell / columns) * (columns + 1) + cell % columns;
+			const size_t b = a + 1;
+			const size_t d = a + columns + 1;
+			const size_t e = d + 1;
+
+			if (quads) {
+				fprintf(file, "f %zu//%zu %zu//%zu %zu//%zu %zu//%zu\n", a, a, d, d, e, e, b, b);
+			}
+			else {
+				fprintf(file, "f %zu//%zu %zu//%zu %zu//%zu\n", a, a, d, d, e, e);
+				if (++written < group_faces)
+					fprintf(file, "f %zu//%zu %zu//%zu %zu//%zu\n", a, a, e, e, b, b);
+			}
+		}
+		base += (rows + 1) * (columns + 1);
+	}
+
+	const bool obj_ok = ferror(file) == 0;
+	fclose(file);
+	if (!obj_ok || (fs::rename(tmp, obj, ec), ec)) {
+		fs::remove(tmp, ec);
+		return std::string();
+	}
+	return obj.string();
+}
+
+//================================= Helpers =================================
+
+static double TimeLoader(LoaderFn loader, const char* filepath, int repetitions, int& no_triangles, unsigned long long& hash) {
+	double best = 1e30;
+
+	for (int i = 0; i < repetitions; i++) {
+		std::vector<Surface*> surfaces;
+		std::vector<Material*> materials;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		loader(filepath, surfaces, materials);
+		std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+		best = std::min(best, elapsed.count());
+
+		no_triangles = 0;
+		hash = 0;
+		for (Surface* s : surfaces) {
+			no_triangles += s->no_triangles();
+			hash = QuickHash(reinterpret_cast<const BYTE*>(s->get_triangles()), s->no_triangles() * sizeof(Triangle), hash);
+		}
+		SafeDeleteVectorItems(surfaces);
+		SafeDeleteVectorItems(materials);		//with the textures they own (see Material::set_texture)
+	}
+
+	return best;
+}
+
+static double TimeDecode(const GeometryCache& cache, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, int threads, int repetitions) {
+	//blocks of the same size as Scene writes into the GL buffers
+	const size_t block = size_t(1) << 16;
+	const int vertexBlocks = static_cast<int>((cache.VertexCount() + block - 1) / block);
+	const int indexBlocks = static_cast<int>((cache.IndexCount() + block - 1) / block);
+	const size_t indexSize = (cache.IndexType() == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+	char* indexData = reinterpret_cast<char*>(indices.data());
+
+	double best = 1e30;
+	for (int i = 0; i < repetitions; i++) {
+		const auto start = std::chrono::high_resolution_clock::now();
+		ParallelFor(vertexBlocks, threads, [&](int b) {
+			const size_t first = b * block;
+			cache.CopyVertices(first, std::min(block, cache.VertexCount() - first), vertices.data() + first);
+		});
+		ParallelFor(indexBlocks, threads, [&](int b) {
+			const size_t first = b * block;
+			cache.CopyIndices(first, std::min(block, cache.IndexCount() - first), indexData + first * indexSize);
+		});
+		std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+
+	//short indices are widened in place for the comparison
+	if (indexSize == sizeof(uint16_t)) {
+		const uint16_t* shorts = reinterpret_cast<const uint16_t*>(indexData);
+		for (size_t k = indices.size(); k-- > 0;)
+			indices[k] = shorts[k];
+	}
+	return best;
+}
+
+static size_t PeakMemoryUsage() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		return static_cast<size_t>(usage.ru_maxrss) * 1024;		//kilobytes on Linux
+	return 0;
+#endif
+}
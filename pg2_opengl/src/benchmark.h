@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+//Headless benchmarks, they don't need an OpenGL context and can be run before the Rasterizer is created.
+
+//Loads given OBJ file with the legacy (strtok/sscanf) and the current loader, prints throughput in MB/s.
+int BenchmarkOBJLoader(const char* filepath, int repetitions = 3);
+
+//Loads synthetic models of 10K up to maxTriangles triangles, prints MB/s, triangles/s, peak RSS and time of the loading phases.
+//Models too large for the in-memory loader are streamed (the same rule as in Scene), only their total time is known.
+//Generated files are stored in the temp directory and removed afterwards unless keepFiles is set (reruns reuse them then).
+int BenchmarkOBJSuite(size_t maxTriangles = 100'000'000, int repetitions = 1, bool keepFiles = false);
+
+//Loads synthetic models of a fixed triangle count with 100 up to 100K materials (one group per material), prints load time
+//per material. With hashed material and group lookups the time stays flat instead of growing with the material count.
+int BenchmarkMaterialScaling(size_t triangles = 200'000, int repetitions = 3, bool keepFiles = false);
+
+//Loads a synthetic model of many small groups & materials with load-time objects on the heap and in arenas (as Scene does),
+//prints load and free time, allocator calls and the fragmentation of the arenas.
+int BenchmarkArena(size_t triangles = 1'000'000, int groups = 20'000, int repetitions = 3, bool keepFiles = false);
+
+//Converts given OBJ file into the raw geometry cache and a compressed mesh asset, prints file sizes, decode speed
+//(vertices & indices into memory, 1 and all threads) and the quantization error of the asset.
+int BenchmarkMeshCodec(const char* filepath, int repetitions = 3);
+
+//Writes a synthetic model (grid patches of quads or triangles with v//vn faces, one usemtl per group) and its MTL file
+//into given directory. Quad models have the triangle count rounded up to even. Returns path of the OBJ file, empty on failure.
+std::string GenerateOBJ(const char* directory, size_t triangles, int groups, int materials, bool quads = true);
@@ -0,0 +1,821 @@
+#include "pch.h"
+#include "cook.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <set>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+#include "log.h"
+#include "parallel.h"
+#include "objloader.h"
+#include "material.h"
+#include "surface.h"
+#include "texture.h"
+#include "vector3.h"
+#include "arena.h"
+#include "geometrycache.h"
+#include "impostor.h"
+#include "instancing.h"
+#include "split.h"
+
+namespace fs = std::filesystem;
+
+//bump whenever cooked outputs change for the same inputs, all jobs are rebuilt then
+constexpr int COOK_VERSION = 8;
+constexpr const char* MANIFEST_NAME = "cook.manifest";
+
+constexpr float PI = 3.14159265358979f;
+
+//prefiltered environment levels as loaded by the application (roughness * 1000 is a part of the file name),
+//the first level is MAX_ENVIRONMENT_WIDTH texels wide, every next one half of the previous one
+constexpr float PREFILTER_ROUGHNESS[] = { 0.001f, 0.010f, 0.100f, 0.250f, 0.500f, 0.750f, 0.999f };
+constexpr int MAX_ENVIRONMENT_WIDTH = 2048;
+constexpr int PREFILTER_SAMPLES = 64;
+constexpr int IRRADIANCE_WIDTH = 64;
+constexpr int IRRADIANCE_SAMPLES = 1024;
+constexpr int BRDF_MAP_SIZE = 64;
+constexpr int BRDF_SAMPLES = 1024;
+
+constexpr const char* BRDF_MAP_NAME = "brdf_integration_map_ct_ggx.exr";
+constexpr const char* IRRADIANCE_SUFFIX = "_irradiance_map";
+constexpr const char* PREFILTERED_SUFFIX = "_prefiltered_env_map_";
+
+enum class JobType { Mesh, Texture, Environment, BRDF };
+
+struct CookJob {
+	JobType type;
+	std::string key;						//source file, or the output of generated data
+	std::vector<std::string> outputs;
+	std::vector<std::string> inputs;		//source & dependencies found while building, stamped in the manifest
+	uintmax_t size = 0;						//of the source, larger jobs start first
+	bool ok = false;
+};
+
+//Manifest record of a finished job, inputs as "path\tsize\ttime".
+struct ManifestEntry {
+	std::vector<std::string> inputs;
+	std::vector<std::string> outputs;
+};
+
+static std::string Stamp(const std::string& path);
+static std::map<std::string, ManifestEntry> ReadManifest(const fs::path& path);
+static bool WriteManifest(const fs::path& path, const std::map<std::string, ManifestEntry>& manifest);
+static bool IsUpToDate(const CookJob& job, const ManifestEntry& entry);
+
+static bool CookMesh(CookJob& job, const fs::path& sourceDir, const fs::path& outputDir, int threads);
+static bool CookTexture(CookJob& job);
+static bool CookEnvironment(CookJob& job, int threads);
+static bool CookBRDFMap(CookJob& job, int threads);
+
+//================================= Helpers =================================
+
+static std::string Lowercase(std::string s) {
+	std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return char(tolower(c)); });
+	return s;
+}
+
+static bool IsTextureExtension(const std::string& ext) {
+	static const std::set<std::string> extensions = { ".png", ".jpg", ".jpeg", ".tga", ".bmp", ".tif", ".tiff", ".gif" };
+	return extensions.count(ext) != 0;
+}
+
+static bool IsEnvironmentExtension(const std::string& ext) {
+	return ext == ".exr" || ext == ".hdr";
+}
+
+//IBL maps produced by the cooker (or shipped already cooked), not environments themselves.
+static bool IsIBLMap(const std::string& filename) {
+	return filename.find(IRRADIANCE_SUFFIX) != std::string::npos || filename.find(PREFILTERED_SUFFIX) != std::string::npos
+		|| filename.rfind("brdf_integration_map", 0) == 0;
+}
+
+//Relative path of file inside directory, empty when it lies outside.
+static fs::path RelativeTo(const fs::path& file, const fs::path& directory) {
+	const fs::path relative = file.lexically_normal().lexically_relative(directory);
+	if (relative.empty() || *relative.begin() == "..")
+		return fs::path();
+	return relative;
+}
+
+static bool RemoveFile(const fs::path& path) {
+	std::error_code ec;
+	fs::remove(path, ec);
+	return !fs::exists(path, ec);
+}
+
+//Size & modification time, files are considered unchanged as long as both are the same.
+static std::string Stamp(const std::string& path) {
+	std::error_code ec;
+	const uintmax_t size = fs::file_size(path, ec);
+	if (ec)
+		return path + "\tmissing";
+	const auto time = fs::last_write_time(path, ec).time_since_epoch().count();
+	return path + "\t" + std::to_string(size) + "\t" + std::to_string(static_cast<long long>(time));
+}
+
+//================================= Manifest =================================
+
+//Text file, the first line holds the version, then every job is a "job <key>" line followed by "in" & "out" lines (tab separated).
+static std::map<std::string, ManifestEntry> ReadManifest(const fs::path& path) {
+	std::map<std::string, ManifestEntry> manifest;
+	std::ifstream file(path);
+	std::string line;
+	if (!std::getline(file, line) || line != "pg2cook\t" + std::to_string(COOK_VERSION))
+		return manifest;
+
+	ManifestEntry* entry = nullptr;
+	while (std::getline(file, line)) {
+		const size_t tab = line.find('\t');
+		if (tab == std::string::npos)
+			continue;
+		const std::string tag = line.substr(0, tab);
+		const std::string value = line.substr(tab + 1);
+		if (tag == "job")
+			entry = &manifest[value];
+		else if (entry && tag == "in")
+			entry->inputs.push_back(value);
+		else if (entry && tag == "out")
+			entry->outputs.push_back(value);
+	}
+	return manifest;
+}
+
+static bool WriteManifest(const fs::path& path, const std::map<std::string, ManifestEntry>& manifest) {
+	const fs::path tmpPath = path.string() + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::trunc);
+		file << "pg2cook\t" << COOK_VERSION << "\n";
+		for (const auto& [key, entry] : manifest) {
+			file << "job\t" << key << "\n";
+			for (const std::string& input : entry.inputs)
+				file << "in\t" << input << "\n";
+			for (const std::string& output : entry.outputs)
+				file << "out\t" << output << "\n";
+		}
+		if (!file.good())
+			return false;
+	}
+	std::error_code ec;
+	fs::rename(tmpPath, path, ec);
+	return !ec;
+}
+
+static bool IsUpToDate(const CookJob& job, const ManifestEntry& entry) {
+	if (entry.outputs != job.outputs)
+		return false;
+	for (const std::string& output : entry.outputs)
+		if (!fs::exists(output))
+			return false;
+	for (const std::string& input : entry.inputs)
+		if (Stamp(input.substr(0, input.find('\t'))) != input)
+			return false;
+	return true;
+}
+
+//================================= CookAssets =================================
+
+int CookAssets(const char* sourceDir_, const char* outputDir_, int no_threads, bool force) {
+	const auto t0 = std::chrono::high_resolution_clock::now();
+	const fs::path sourceDir = fs::path(sourceDir_).lexically_normal();
+	const fs::path outputDir = fs::path(outputDir_).lexically_normal();
+	if (!fs::is_directory(sourceDir)) {
+		errlog("Cook: source directory '%s' not found.\n", sourceDir_);
+		return 1;
+	}
+
+	//jobs of all sources, the output directory itself is skipped when it lies inside the source one
+	std::vector<CookJob> jobs;
+	std::set<std::string> outputs;
+	bool hasEnvironment = false;
+	const auto addJob = [&](JobType type, const std::string& key, std::vector<std::string> jobOutputs, uintmax_t size) {
+		for (const std::string& output : jobOutputs)
+			if (!outputs.insert(output).second) {
+				warnlog("Cook: '%s' skipped, output '%s' is produced by another source.\n", key.c_str(), output.c_str());
+				return;
+			}
+		jobs.push_back(CookJob{ type, key, std::move(jobOutputs), {}, size, false });
+	};
+
+	std::error_code ec;
+	for (fs::recursive_directory_iterator it(sourceDir, ec), end; it != end; it.increment(ec)) {
+		const fs::path path = it->path().lexically_normal();
+		if (it->is_directory() && path == outputDir) {
+			it.disable_recursion_pending();
+			continue;
+		}
+		if (!it->is_regular_file())
+			continue;
+
+		const std::string ext = Lowercase(path.extension().string());
+		const fs::path cooked = outputDir / RelativeTo(path, sourceDir);
+		const uintmax_t size = it->file_size(ec);
+		if (ext == ".obj") {
+			addJob(JobType::Mesh, path.generic_string(), { fs::path(cooked).replace_extension(MESH_ASSET_EXTENSION).generic_string(),
+														   fs::path(cooked).replace_extension(IMPOSTOR_EXTENSION).generic_string() }, size);
+		}
+		else if (IsTextureExtension(ext)) {
+			addJob(JobType::Texture, path.generic_string(), { fs::path(cooked).replace_extension(".dds").generic_string() }, size);
+		}
+		else if (IsEnvironmentExtension(ext) && !IsIBLMap(path.filename().string())) {
+			const std::string stem = (cooked.parent_path() / cooked.stem()).generic_string();
+			std::vector<std::string> maps = { stem + IRRADIANCE_SUFFIX + ".exr" };
+			for (size_t level = 0; level < std::size(PREFILTER_ROUGHNESS); level++) {
+				char name[64];
+				snprintf(name, sizeof(name), "%s%03d_%d.exr", PREFILTERED_SUFFIX, int(PREFILTER_ROUGHNESS[level] * 1000.0f + 0.5f),
+						 MAX_ENVIRONMENT_WIDTH >> level);
+				maps.push_back(stem + name);
+			}
+			addJob(JobType::Environment, path.generic_string(), std::move(maps), size);
+			hasEnvironment = true;
+		}
+	}
+	if (hasEnvironment) {
+		const std::string brdfMap = (outputDir / BRDF_MAP_NAME).generic_string();
+		addJob(JobType::BRDF, brdfMap, { brdfMap }, 0);
+	}
+
+	//jobs with changed inputs
+	std::map<std::string, ManifestEntry> manifest = force ? std::map<std::string, ManifestEntry>() : ReadManifest(outputDir / MANIFEST_NAME);
+	std::vector<CookJob*> pending;
+	for (CookJob& job : jobs) {
+		const auto entry = manifest.find(job.key);
+		job.ok = entry != manifest.end() && IsUpToDate(job, entry->second);
+		if (!job.ok) {
+			pending.push_back(&job);
+			for (const std::string& output : job.outputs)
+				fs::create_directories(fs::path(output).parent_path(), ec);
+		}
+	}
+	std::stable_sort(pending.begin(), pending.end(), [](const CookJob* a, const CookJob* b) { return a->size > b->size; });
+
+	//jobs of removed sources
+	std::set<std::string> keys;
+	for (const CookJob& job : jobs)
+		keys.insert(job.key);
+	for (auto entry = manifest.begin(); entry != manifest.end();) {
+		if (keys.count(entry->first) == 0) {
+			for (const std::string& output : entry->second.outputs)
+				if (outputs.count(output) == 0 && RemoveFile(output))
+					errlog("Cook: removed '%s' (source deleted).\n", output.c_str());
+			entry = manifest.erase(entry);
+		}
+		else
+			entry++;
+	}
+
+	const int threads = ResolveThreadCount(no_threads);
+	errlog("Cooking '%s' into '%s': %zu of %zu job(s) out of date (%d thread(s)).\n", sourceDir.string().c_str(),
+		   outputDir.string().c_str(), pending.size(), jobs.size(), threads);
+
+	//a lone job parallelizes itself instead
+	const int jobThreads = pending.size() > 1 ? 1 : threads;
+	ParallelFor(int(pending.size()), threads, [&](int i) {
+		CookJob& job = *pending[i];
+		const auto start = std::chrono::high_resolution_clock::now();
+		job.inputs = { job.key };
+		switch (job.type) {
+			case JobType::Mesh: job.ok = CookMesh(job, sourceDir, outputDir, jobThreads); break;
+			case JobType::Texture: job.ok = CookTexture(job); break;
+			case JobType::Environment: job.ok = CookEnvironment(job, jobThreads); break;
+			case JobType::BRDF: job.inputs.clear(); job.ok = CookBRDFMap(job, jobThreads); break;
+		}
+		const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+		if (job.ok)
+			errlog("Cook: '%s' done in %.2f s.\n", job.key.c_str(), elapsed.count());
+		else
+			errlog("Cook: '%s' failed.\n", job.key.c_str());
+	});
+
+	//stamps are taken after the build, failed jobs are left out and run again next time
+	int failed = 0;
+	for (CookJob* job : pending) {
+		manifest.erase(job->key);
+		if (!job->ok) {
+			failed++;
+			continue;
+		}
+		ManifestEntry& entry = manifest[job->key];
+		for (const std::string& input : job->inputs)
+			entry.inputs.push_back(Stamp(input));
+		entry.outputs = job->outputs;
+	}
+	if (!WriteManifest(outputDir / MANIFEST_NAME, manifest))
+		errlog("Cook: failed to write the manifest, everything will be rebuilt next time.\n");
+
+	const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - t0;
+	errlog("Cooking finished in %.2f s: %zu built, %zu up to date, %d failed.\n", elapsed.count(), pending.size() - failed,
+		   jobs.size() - pending.size(), failed);
+	return failed;
+}
+
+//================================= Meshes =================================
+
+static bool CookMesh(CookJob& job, const fs::path& sourceDir, const fs::path& outputDir, int threads) {
+	Arena materialArena;
+	Arena surfaceArena;
+	std::vector<Surface*> surfaces;
+	std::vector<Material*> materials;
+	std::vector<std::string> libraries;
+	std::vector<Texture3u*> textures;	//decoded for the impostors only
+	if (LoadOBJ(job.key.c_str(), surfaces, materials, false, Vector3(0.5f, 0.5f, 0.5f), threads, &libraries, &textures,
+				nullptr, &materialArena, &surfaceArena) < 0)
+		return false;
+	job.inputs.insert(job.inputs.end(), libraries.begin(), libraries.end());
+
+	//repeated objects are stored once & large surfaces are split (as Scene::LoadSource does), the impostors are baked for the meshes left
+	std::vector<int> copies;
+	std::vector<InstanceTransform> instances;
+	FindInstances(surfaces, copies, instances, threads);
+	SplitSurfaces(surfaces, copies, &surfaceArena, SPLIT_TRIANGLES, threads);
+
+	//impostors are baked from the source textures, before the materials are switched to the cooked ones (so they are inputs too)
+	for (Texture3u* texture : textures)
+		job.inputs.push_back(texture->file_name());
+	ParallelFor(int(textures.size()), threads, [&](int i) { textures[i]->Load(); });
+	if (!WriteImpostors(job.outputs[1].c_str(), BakeImpostors(surfaces, threads)))
+		return false;
+
+	//textures cooked by the texture jobs (the ones outside of the source directory stay where they are)
+	std::map<Texture3u*, Texture3u*> cooked;
+	for (Texture3u* texture : textures) {
+		const fs::path path = fs::path(texture->file_name()).lexically_normal();
+		const fs::path relative = RelativeTo(path, sourceDir);
+		if (!relative.empty() && IsTextureExtension(Lowercase(path.extension().string())))
+			cooked[texture] = materialArena.New<Texture3u>((outputDir / relative).replace_extension(".dds").generic_string(), true);
+	}
+	for (Material* material : materials)
+		for (int slot = 0; slot < NO_TEXTURES; slot++) {
+			const auto texture = cooked.find(material->texture(slot));
+			if (texture != cooked.end())
+				material->set_texture(slot, texture->second);
+		}
+
+	return WriteMeshAsset(job.outputs[0].c_str(), job.key.c_str(), libraries, surfaces, materials, copies, instances, threads);
+}
+
+//================================= Textures =================================
+
+//8-bit RGB image in the channel order of FreeImage (see FI_RGBA_RED).
+struct Image {
+	int width = 0;
+	int height = 0;
+	std::vector<Color3u> pixels;
+
+	inline const Color3u& at(int x, int y) const { return pixels[size_t(y) * size_t(width) + size_t(x)]; }
+};
+
+//Next mip level, box filtered (the last row & column of odd sizes are repeated).
+static Image Downsample(const Image& image) {
+	Image half;
+	half.width = std::max(image.width / 2, 1);
+	half.height = std::max(image.height / 2, 1);
+	half.pixels.resize(size_t(half.width) * size_t(half.height));
+	for (int y = 0; y < half.height; y++)
+		for (int x = 0; x < half.width; x++) {
+			const int x0 = std::min(2 * x, image.width - 1), x1 = std::min(2 * x + 1, image.width - 1);
+			const int y0 = std::min(2 * y, image.height - 1), y1 = std::min(2 * y + 1, image.height - 1);
+			Color3u& pixel = half.pixels[size_t(y) * size_t(half.width) + size_t(x)];
+			for (int c = 0; c < 3; c++)
+				pixel.data[c] = uint8_t((image.at(x0, y0).data[c] + image.at(x1, y0).data[c] + image.at(x0, y1).data[c] + image.at(x1, y1).data[c] + 2) / 4);
+		}
+	return half;
+}
+
+static uint16_t PackRGB565(const float rgb[3]) {
+	const int r = std::clamp(int(rgb[0] * (31.0f / 255.0f) + 0.5f), 0, 31);
+	const int g = std::clamp(int(rgb[1] * (63.0f / 255.0f) + 0.5f), 0, 63);
+	const int b = std::clamp(int(rgb[2] * (31.0f / 255.0f) + 0.5f), 0, 31);
+	return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(uint16_t c, float rgb[3]) {
+	const int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	rgb[0] = float((r << 3) | (r >> 2));
+	rgb[1] = float((g << 2) | (g >> 4));
+	rgb[2] = float((b << 3) | (b >> 2));
+}
+
+//Picks the closest of the 4 block colors for every pixel, returns the squared error.
+static float SelectBC1Indices(const float pixels[16][3], uint16_t c0, uint16_t c1, uint32_t& indices) {
+	float palette[4][3];
+	UnpackRGB565(c0, palette[0]);
+	UnpackRGB565(c1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+	}
+
+	float error = 0.0f;
+	indices = 0;
+	for (int i = 0; i < 16; i++) {
+		int best = 0;
+		float bestError = FLT_MAX;
+		for (int p = 0; p < (c0 == c1 ? 1 : 4); p++) {
+			float e = 0.0f;
+			for (int c = 0; c < 3; c++)
+				e += (pixels[i][c] - palette[p][c]) * (pixels[i][c] - palette[p][c]);
+			if (e < bestError) {
+				bestError = e;
+				best = p;
+			}
+		}
+		indices |= uint32_t(best) << (2 * i);
+		error += bestError;
+	}
+	return error;
+}
+
+//Ends of the block colors (4 color mode, c0 > c1) and their 2-bit indices.
+static void OrderBC1Endpoints(uint16_t& c0, uint16_t& c1, uint32_t& indices) {
+	if (c0 < c1) {
+		std::swap(c0, c1);
+		indices ^= 0x55555555;	//0 <-> 1, 2 <-> 3
+	}
+}
+
+//Encodes a 4x4 block (RGB order) as DXT1: endpoints along the principal axis of the colors, inset by 1/16 of their range,
+//then refitted once by least squares to the chosen indices.
+static void EncodeBC1Block(const float pixels[16][3], uint8_t block[8]) {
+	float mean[3] = {};
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++)
+			mean[c] += pixels[i][c] / 16.0f;
+
+	float cov[6] = {};	//rr rg rb gg gb bb
+	for (int i = 0; i < 16; i++) {
+		const float d[3] = { pixels[i][0] - mean[0], pixels[i][1] - mean[1], pixels[i][2] - mean[2] };
+		cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+		cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+	}
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++) {
+		const float a[3] = {
+			cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+			cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+			cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2] };
+		const float length = std::max({ fabsf(a[0]), fabsf(a[1]), fabsf(a[2]) });
+		if (length < 1e-6f)
+			break;
+		for (int c = 0; c < 3; c++)
+			axis[c] = a[c] / length;
+	}
+
+	float tMin = FLT_MAX, tMax = -FLT_MAX;
+	for (int i = 0; i < 16; i++) {
+		const float t = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] + (pixels[i][2] - mean[2]) * axis[2];
+		tMin = std::min(tMin, t);
+		tMax = std::max(tMax, t);
+	}
+	const float inset = (tMax - tMin) / 16.0f;
+	float e0[3], e1[3];
+	for (int c = 0; c < 3; c++) {
+		e0[c] = mean[c] + (tMax - inset) * axis[c];
+		e1[c] = mean[c] + (tMin + inset) * axis[c];
+	}
+	uint16_t c0 = PackRGB565(e0), c1 = PackRGB565(e1);
+	uint32_t indices;
+	if (c0 == c1) {
+		//(nearly) uniform block, c1 differs only so the 4 color mode applies
+		c1 = c0 > 0 ? c0 - 1 : 1;
+	}
+	float error = SelectBC1Indices(pixels, c0, c1, indices);
+
+	//least squares endpoints for the chosen indices
+	constexpr float WEIGHTS[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {}, bx[3] = {};
+	for (int i = 0; i < 16; i++) {
+		const float a = WEIGHTS[(indices >> (2 * i)) & 3], b = 1.0f - a;
+		aa += a * a; ab += a * b; bb += b * b;
+		for (int c = 0; c < 3; c++) {
+			ax[c] += a * pixels[i][c];
+			bx[c] += b * pixels[i][c];
+		}
+	}
+	const float det = aa * bb - ab * ab;
+	if (fabsf(det) > 1e-6f) {
+		for (int c = 0; c < 3; c++) {
+			e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+			e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+		}
+		const uint16_t r0 = PackRGB565(e0), r1 = PackRGB565(e1);
+		uint32_t refitted;
+		if (r0 != r1) {
+			const float refittedError = SelectBC1Indices(pixels, r0, r1, refitted);
+			if (refittedError < error) {
+				c0 = r0;
+				c1 = r1;
+				indices = refitted;
+			}
+		}
+	}
+	OrderBC1Endpoints(c0, c1, indices);
+
+	block[0] = uint8_t(c0); block[1] = uint8_t(c0 >> 8);
+	block[2] = uint8_t(c1); block[3] = uint8_t(c1 >> 8);
+	for (int i = 0; i < 4; i++)
+		block[4 + i] = uint8_t(indices >> (8 * i));
+}
+
+//DXT1 blocks of a mip level, pixels of partial blocks at the edges are repeated.
+static void EncodeBC1(const Image& image, std::vector<uint8_t>& out) {
+	const int bw = (image.width + 3) / 4, bh = (image.height + 3) / 4;
+	const size_t offset = out.size();
+	out.resize(offset + size_t(bw) * size_t(bh) * 8);
+	for (int by = 0; by < bh; by++)
+		for (int bx = 0; bx < bw; bx++) {
+			float pixels[16][3];
+			for (int i = 0; i < 16; i++) {
+				const Color3u& p = image.at(std::min(bx * 4 + i % 4, image.width - 1), std::min(by * 4 + i / 4, image.height - 1));
+				pixels[i][0] = p.data[FI_RGBA_RED];
+				pixels[i][1] = p.data[FI_RGBA_GREEN];
+				pixels[i][2] = p.data[FI_RGBA_BLUE];
+			}
+			EncodeBC1Block(pixels, &out[offset + (size_t(by) * size_t(bw) + size_t(bx)) * 8]);
+		}
+}
+
+//DDS file with a DXT1 mip chain down to 1x1, its blocks are uploaded as they are (see BlocksFromDDS).
+static bool WriteDDS(const std::string& path, Image image) {
+	std::vector<uint8_t> blocks;
+	int levels = 0;
+	const int width = image.width, height = image.height;
+	size_t firstLevelSize = 0;
+	for (;;) {
+		EncodeBC1(image, blocks);
+		if (levels++ == 0)
+			firstLevelSize = blocks.size();
+		if (image.width == 1 && image.height == 1)
+			break;
+		image = Downsample(image);
+	}
+
+	//DDS_HEADER, see the DirectX documentation
+	uint32_t header[32] = {};
+	header[0] = 0x20534444;									//"DDS "
+	header[1] = 124;										//dwSize
+	header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;	//caps, height, width, pixel format, mip map count, linear size
+	header[3] = uint32_t(height);
+	header[4] = uint32_t(width);
+	header[5] = uint32_t(firstLevelSize);
+	header[7] = uint32_t(levels);
+	header[19] = 32;										//ddspf.dwSize
+	header[20] = 0x4;										//DDPF_FOURCC
+	header[21] = 0x31545844;								//"DXT1"
+	header[27] = 0x1000 | 0x8 | 0x400000;					//texture, complex, mip map
+
+	const std::string tmpPath = path + ".tmp";
+	FILE* file = fopen(tmpPath.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+	const bool written = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(blocks.data(), blocks.size(), 1, file) == 1;
+	if (fclose(file) != 0 || !written) {
+		RemoveFile(tmpPath);
+		return false;
+	}
+	std::error_code ec;
+	fs::rename(tmpPath, path, ec);
+	return !ec;
+}
+
+static bool CookTexture(CookJob& job) {
+	Texture3u texture(job.key);
+	if (texture.width() <= 0 || texture.height() <= 0)
+		return false;
+
+	Image image;
+	image.width = texture.width();
+	image.height = texture.height();
+	image.pixels.assign(texture.data(), texture.data() + size_t(image.width) * size_t(image.height));
+	return WriteDDS(job.outputs[0], std::move(image));
+}
+
+//================================= IBL =================================
+
+//Equirectangular environment addressed as SphereCoords() of the shaders, with a box filtered mip chain.
+class EnvironmentMap {
+public:
+	explicit EnvironmentMap(Texture3f& texture) {
+		Level level{ texture.width(), texture.height(), {} };
+		level.texels.assign(texture.data(), texture.data() + size_t(level.width) * size_t(level.height));
+		levels.push_back(std::move(level));
+		while (levels.back().width > 1 || levels.back().height > 1) {
+			const Level& src = levels.back();
+			Level half{ std::max(src.width / 2, 1), std::max(src.height / 2, 1), {} };
+			half.texels.resize(size_t(half.width) * size_t(half.height));
+			for (int y = 0; y < half.height; y++)
+				for (int x = 0; x < half.width; x++) {
+					const int x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+					const int y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+					Color3f& texel = half.texels[size_t(y) * size_t(half.width) + size_t(x)];
+					for (int c = 0; c < 3; c++)
+						texel.data[c] = 0.25f * (src.at(x0, y0).data[c] + src.at(x1, y0).data[c] + src.at(x0, y1).data[c] + src.at(x1, y1).data[c]);
+				}
+			levels.push_back(std::move(half));
+		}
+	}
+
+	inline int Width() const { return levels[0].width; }
+	inline int Height() const { return levels[0].height; }
+
+	//Solid angle of a texel of the first level in direction d.
+	inline float TexelSolidAngle(const Vector3& d) const {
+		const float sinTheta = sqrtf(std::max(1.0f - d.z * d.z, 1e-4f));
+		return (2.0f * PI / Width()) * (PI / Height()) * sinTheta;
+	}
+
+	//Radiance from direction d (unit), trilinearly filtered at mip level lod.
+	Vector3 Sample(const Vector3& d, float lod) const {
+		const float u = (atan2f(d.y, d.x) + PI) / (2.0f * PI);
+		const float v = acosf(std::clamp(d.z, -1.0f, 1.0f)) / PI;
+		lod = std::clamp(lod, 0.0f, float(levels.size() - 1));
+		const int l0 = int(lod);
+		const int l1 = std::min(l0 + 1, int(levels.size()) - 1);
+		const float f = lod - l0;
+		return levels[l0].Bilinear(u, v) * (1.0f - f) + levels[l1].Bilinear(u, v) * f;
+	}
+
+	//Direction of the texel (x, y) of a map of given size, the inverse of SphereCoords().
+	static Vector3 Direction(int x, int y, int width, int height) {
+		const float phi = (x + 0.5f) / width * 2.0f * PI - PI;
+		const float theta = (y + 0.5f) / height * PI;
+		return Vector3(sinf(theta) * cosf(phi), sinf(theta) * sinf(phi), cosf(theta));
+	}
+private:
+	struct Level {
+		int width;
+		int height;
+		std::vector<Color3f> texels;
+
+		inline const Color3f& at(int x, int y) const { return texels[size_t(y) * size_t(width) + size_t(x)]; }
+
+		//wraps around in u, clamps in v
+		Vector3 Bilinear(float u, float v) const {
+			const float x = u * width - 0.5f, y = v * height - 0.5f;
+			const int ix = int(floorf(x)), iy = int(floorf(y));
+			const float fx = x - ix, fy = y - iy;
+			const int x0 = (ix % width + width) % width, x1 = (x0 + 1) % width;
+			const int y0 = std::clamp(iy, 0, height - 1), y1 = std::clamp(iy + 1, 0, height - 1);
+			Vector3 result;
+			const float w[4] = { (1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy };
+			const Color3f* t[4] = { &at(x0, y0), &at(x1, y0), &at(x0, y1), &at(x1, y1) };
+			for (int i = 0; i < 4; i++)
+				result += Vector3(t[i]->data[0], t[i]->data[1], t[i]->data[2]) * w[i];
+			return result;
+		}
+	};
+
+	std::vector<Level> levels;
+};
+
+//Low discrepancy point i of n in <0, 1)^2.
+static inline void Hammersley(int i, int n, float& u1, float& u2) {
+	uint32_t bits = uint32_t(i);
+	bits = (bits << 16) | (bits >> 16);
+	bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+	bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+	bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+	bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+	u1 = float(i) / float(n);
+	u2 = float(bits) * 2.3283064365386963e-10f;
+}
+
+//Half vector of GGX (alpha as DistributionGGX in the shaders) around +z.
+static inline Vector3 SampleGGX(float u1, float u2, float alpha) {
+	const float phi = 2.0f * PI * u1;
+	const float cosTheta = sqrtf((1.0f - u2) / (1.0f + (alpha * alpha - 1.0f) * u2));
+	const float sinTheta = sqrtf(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+	return Vector3(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+}
+
+static inline float DistributionGGX(float cosThetaN, float alpha) {
+	const float denom = cosThetaN * cosThetaN * (alpha * alpha - 1.0f) + 1.0f;
+	return (alpha * alpha) / (PI * denom * denom);
+}
+
+//Sample directions around +z with weights & probability densities, the same for every texel (n = v = r).
+struct LobeSample {
+	Vector3 direction;
+	float weight;
+	float pdf;
+};
+
+//Map of given size where every texel integrates the lobe samples around its direction, sampling the environment
+//at the mip level matching the solid angle of each sample (filtered importance sampling) or of the texel when larger.
+static void Convolve(const EnvironmentMap& environment, const std::vector<LobeSample>& lobe, Texture3f& map, int threads) {
+	const int width = map.width(), height = map.height();
+	const float texelLod = std::max(log2f(float(environment.Width()) / width), 0.0f);
+	ParallelFor(height, threads, [&](int y) {
+		for (int x = 0; x < width; x++) {
+			const Vector3 n = EnvironmentMap::Direction(x, y, width, height);
+			const Vector3 up = fabsf(n.z) < 0.999f ? Vector3(0.0f, 0.0f, 1.0f) : Vector3(1.0f, 0.0f, 0.0f);
+			const Vector3 t = up.CrossProduct(n).Normalize();
+			const Vector3 b = n.CrossProduct(t);
+
+			Vector3 sum;
+			float weights = 0.0f;
+			for (const LobeSample& s : lobe) {
+				const Vector3 d = t * s.direction.x + b * s.direction.y + n * s.direction.z;
+				const float sampleAngle = 1.0f / (float(lobe.size()) * s.pdf);
+				const float lod = std::max(0.5f * log2f(sampleAngle / environment.TexelSolidAngle(d)) + 1.0f, texelLod);
+				sum += environment.Sample(d, lod) * s.weight;
+				weights += s.weight;
+			}
+			sum /= weights;
+			map.data()[size_t(y) * size_t(width) + size_t(x)] = Color3f({ sum.x, sum.y, sum.z });
+		}
+	});
+}
+
+//Cosine weighted hemisphere, the map holds irradiance / pi (the shaders multiply it by albedo only).
+static std::vector<LobeSample> IrradianceLobe() {
+	std::vector<LobeSample> lobe(IRRADIANCE_SAMPLES);
+	for (int i = 0; i < IRRADIANCE_SAMPLES; i++) {
+		float u1, u2;
+		Hammersley(i, IRRADIANCE_SAMPLES, u1, u2);
+		const float phi = 2.0f * PI * u1, cosTheta = sqrtf(1.0f - u2), sinTheta = sqrtf(u2);
+		lobe[i] = { Vector3(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta), 1.0f, std::max(cosTheta, 1e-3f) / PI };
+	}
+	return lobe;
+}
+
+//Reflected GGX lobe weighted by cos, a single sample (the mirror direction) for lobes narrower than a texel.
+static std::vector<LobeSample> PrefilterLobe(float alpha, int width) {
+	std::vector<LobeSample> lobe;
+	if (2.0f * alpha < 2.0f * PI / width)
+		return { { Vector3(0.0f, 0.0f, 1.0f), 1.0f, FLT_MAX } };
+	for (int i = 0; i < PREFILTER_SAMPLES; i++) {
+		float u1, u2;
+		Hammersley(i, PREFILTER_SAMPLES, u1, u2);
+		const Vector3 h = SampleGGX(u1, u2, alpha);
+		const Vector3 l = h * (2.0f * h.z) - Vector3(0.0f, 0.0f, 1.0f);
+		if (l.z > 0.0f)
+			lobe.push_back({ l, l.z, std::max(DistributionGGX(h.z, alpha) * 0.25f, 1e-6f) });	//pdf = D * cos(h) / (4 * cos(vh)), n = v
+	}
+	return lobe;
+}
+
+static bool SaveMap(const Texture3f& map, const std::string& path) {
+	if (!RemoveFile(path))
+		return false;
+	map.Save(path);
+	return fs::exists(path);
+}
+
+static bool CookEnvironment(CookJob& job, int threads) {
+	Texture3f texture(job.key);
+	if (texture.width() <= 0 || texture.height() <= 0)
+		return false;
+	const EnvironmentMap environment(texture);
+
+	Texture3f irradiance(IRRADIANCE_WIDTH, IRRADIANCE_WIDTH / 2);
+	Convolve(environment, IrradianceLobe(), irradiance, threads);
+	if (!SaveMap(irradiance, job.outputs[0]))
+		return false;
+
+	for (size_t level = 0; level < std::size(PREFILTER_ROUGHNESS); level++) {
+		const int width = MAX_ENVIRONMENT_WIDTH >> level;
+		Texture3f map(width, width / 2);
+		Convolve(environment, PrefilterLobe(PREFILTER_ROUGHNESS[level], width), map, threads);
+		if (!SaveMap(map, job.outputs[level + 1]))
+			return false;
+	}
+	return true;
+}
+
+//Split sum scale & bias of F0 (red, green) for cos(theta_o) along x and alpha along y, with the geometric term of the shaders.
+static bool CookBRDFMap(CookJob& job, int threads) {
+	Texture3f map(BRDF_MAP_SIZE, BRDF_MAP_SIZE);
+	ParallelFor(BRDF_MAP_SIZE, threads, [&](int y) {
+		const float alpha = (y + 0.5f) / BRDF_MAP_SIZE;
+		const float a2 = alpha * alpha;
+		for (int x = 0; x < BRDF_MAP_SIZE; x++) {
+			const float cosThetaO = (x + 0.5f) / BRDF_MAP_SIZE;
+			const Vector3 v(sqrtf(1.0f - cosThetaO * cosThetaO), 0.0f, cosThetaO);
+			float scale = 0.0f, bias = 0.0f;
+			for (int i = 0; i < BRDF_SAMPLES; i++) {
+				float u1, u2;
+				Hammersley(i, BRDF_SAMPLES, u1, u2);
+				const Vector3 h = SampleGGX(u1, u2, alpha);
+				const float vh = v.DotProduct(h);
+				const Vector3 l = h * (2.0f * vh) - v;
+				if (l.z <= 0.0f || vh <= 0.0f)
+					continue;
+				const float cosThetaI = l.z;
+				const float g = (2.0f * cosThetaO * cosThetaI) / (cosThetaO * sqrtf(a2 + (1.0f - a2) * cosThetaI * cosThetaI) +
+																  cosThetaI * sqrtf(a2 + (1.0f - a2) * cosThetaO * cosThetaO));
+				const float visibility = g * vh / (h.z * cosThetaO);
+				const float fresnel = powf(1.0f - vh, 5.0f);
+				scale += (1.0f - fresnel) * visibility;
+				bias += fresnel * visibility;
+			}
+			map.data()[size_t(y) * BRDF_MAP_SIZE + size_t(x)] = Color3f({ scale / BRDF_SAMPLES, bias / BRDF_SAMPLES, 0.0f });
+		}
+	});
+	return SaveMap(map, job.outputs[0]);
+}
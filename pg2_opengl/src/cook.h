@@ -0,0 +1,17 @@
+#pragma once
+
+//Offline asset cooker, converts source assets of a directory (recursively) into runtime artifacts under outputDir,
+//keeping their relative paths:
+//  *.obj                        -> *.pg2mesh mesh assets (welded geometry with tangents, repeated objects instanced, large surfaces
+//                                  split, compressed), their materials refer to the cooked textures, and *.pg2impostor atlases of
+//                                  their meshes (see BakeImpostors),
+//  *.png, *.jpg, *.tga, ...     -> *.dds textures (DXT1) with full mip chains, uploaded compressed,
+//  *.exr, *.hdr                 -> IBL maps of equirectangular environments named as the maps in res/maps
+//                                  (<name>_irradiance_map.exr, <name>_prefiltered_env_map_<roughness>_<width>.exr)
+//                                  and one brdf_integration_map_ct_ggx.exr.
+//Sources are loaded by the runtime loaders (LoadOBJ, Texture), so the cooked data match what the application builds itself.
+//Inputs of every job (incl. material libraries found while loading) are stamped in outputDir/cook.manifest,
+//only jobs with changed inputs or missing outputs are rebuilt (all of them when force is set). Jobs run in parallel.
+//Paths stored in the artifacts are relative to the working directory, the cooker has to run from the one of the application.
+//Returns the number of failed jobs.
+int CookAssets(const char* sourceDir, const char* outputDir, int no_threads = 0, bool force = false);
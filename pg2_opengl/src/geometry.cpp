@@ -0,0 +1,217 @@
+#include "pch.h"
+#include "geometry.h"
+
+#include "parallel.h"
+
+static inline uint64_t HashVertex(const Vertex& v);
+//Tangents of vertexCount vertices, vertexAt(i) returns i-th vertex and store(i, tangent) receives the result (Tangent).
+template<typename VertexAt, typename StoreTangent>
+static void ComputeTangents(size_t vertexCount, const uint32_t* indices, size_t indexCount, int no_threads, VertexAt vertexAt, StoreTangent store);
+
+//triangles (vertices) handed to a thread at once
+constexpr size_t TANGENT_BLOCK = 4096;
+
+//================================= IndexedGeometry =================================
+
+GLenum IndexedGeometry::IndexType() const {
+	return (sources.size() <= 0xFFFF) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+size_t IndexedGeometry::IndexSize() const {
+	return (IndexType() == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+void IndexedGeometry::CopyVertices(size_t first, size_t count, Vertex* destination) const {
+	for (size_t i = 0; i < count; i++) {
+		//assembled first, destination is written at once
+		Vertex v = *sources[first + i];
+		if (!tangents.empty()) {
+			v.tangent = tangents[first + i].direction;
+			v.handedness = tangents[first + i].handedness;
+		}
+		destination[i] = v;
+	}
+}
+
+void IndexedGeometry::CopyIndices(size_t first, size_t count, void* destination) const {
+	if (IndexType() == GL_UNSIGNED_SHORT)
+		std::copy(indices.begin() + first, indices.begin() + first + count, static_cast<uint16_t*>(destination));
+	else
+		memcpy(destination, indices.data() + first, count * sizeof(uint32_t));
+}
+
+//================================= Welding =================================
+
+IndexedGeometry WeldVertices(const std::vector<VertexSpan>& soups) {
+	size_t count = 0;
+	for (const VertexSpan& soup : soups)
+		count += soup.count;
+
+	IndexedGeometry geometry;
+	geometry.indices.resize(count);
+
+	//open addressing hash table of indices into geometry.sources, load factor <= 0.5
+	size_t capacity = 16;
+	while (capacity < count * 2)
+		capacity <<= 1;
+	const size_t mask = capacity - 1;
+	std::vector<uint32_t> table(capacity, UINT32_MAX);
+
+	size_t i = 0;
+	for (const VertexSpan& soup : soups) {
+		for (size_t k = 0; k < soup.count; k++, i++) {
+			const Vertex& v = soup.vertices[k];
+
+			size_t slot = HashVertex(v) & mask;
+			while (true) {
+				const uint32_t idx = table[slot];
+				if (idx == UINT32_MAX) {
+					table[slot] = static_cast<uint32_t>(geometry.sources.size());
+					geometry.indices[i] = table[slot];
+					geometry.sources.push_back(&v);
+					break;
+				}
+				if (memcmp(geometry.sources[idx], &v, sizeof(Vertex)) == 0) {
+					geometry.indices[i] = idx;
+					break;
+				}
+				slot = (slot + 1) & mask;
+			}
+		}
+	}
+
+	geometry.sources.shrink_to_fit();
+	return geometry;
+}
+
+//================================= Tangents =================================
+
+void GenerateTangents(Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount, int no_threads) {
+	ComputeTangents(vertexCount, indices, indexCount, no_threads,
+		[vertices](size_t v) -> const Vertex& { return vertices[v]; },
+		[vertices](size_t v, const Tangent& tangent) { vertices[v].tangent = tangent.direction; vertices[v].handedness = tangent.handedness; });
+}
+
+void GenerateTangents(IndexedGeometry& geometry, int no_threads) {
+	geometry.tangents.resize(geometry.VertexCount());
+	ComputeTangents(geometry.VertexCount(), geometry.indices.data(), geometry.indices.size(), no_threads,
+		[&geometry](size_t v) -> const Vertex& { return *geometry.sources[v]; },
+		[&geometry](size_t v, const Tangent& tangent) { geometry.tangents[v] = tangent; });
+}
+
+//================================= Helpers =================================
+
+template<typename VertexAt, typename StoreTangent>
+static void ComputeTangents(size_t vertexCount, const uint32_t* indices, size_t indexCount, int no_threads, VertexAt vertexAt, StoreTangent store) {
+	const size_t triangleCount = (indices ? indexCount : vertexCount) / 3;
+	auto Index = [indices](size_t i) { return indices ? indices[i] : static_cast<uint32_t>(i); };
+
+	// --- area weighted tangent & bitangent of every triangle ---
+	std::vector<Vector3> faceTangents(triangleCount);
+	std::vector<Vector3> faceBitangents(triangleCount);
+
+	ParallelFor(static_cast<int>((triangleCount + TANGENT_BLOCK - 1) / TANGENT_BLOCK), no_threads, [&](int block) {
+		const size_t end = std::min(triangleCount, (block + 1) * TANGENT_BLOCK);
+		for (size_t t = block * TANGENT_BLOCK; t < end; t++) {
+			const Vertex& v0 = vertexAt(Index(t * 3));
+			const Vertex& v1 = vertexAt(Index(t * 3 + 1));
+			const Vertex& v2 = vertexAt(Index(t * 3 + 2));
+
+			const Vector3 e1 = v1.position - v0.position;
+			const Vector3 e2 = v2.position - v0.position;
+			const Coord2f dt1 = v1.texture_coords[0] - v0.texture_coords[0];
+			const Coord2f dt2 = v2.texture_coords[0] - v0.texture_coords[0];
+
+			//missing or collapsed texture coordinates - no tangent direction is defined
+			const float det = dt1.u * dt2.v - dt2.u * dt1.v;
+			if (!(fabsf(det) > 1e-12f))
+				continue;
+
+			Vector3 tangent = (dt2.v * e1 - dt1.v * e2) / det;
+			Vector3 bitangent = (dt1.u * e2 - dt2.u * e1) / det;
+			const float area = 0.5f * e1.CrossProduct(e2).L2Norm();
+			if (tangent.SqrL2Norm() > 0.0f)
+				faceTangents[t] = tangent.Normalize() * area;
+			if (bitangent.SqrL2Norm() > 0.0f)
+				faceBitangents[t] = bitangent.Normalize() * area;
+		}
+	});
+
+	// --- triangles around every vertex, in triangle order so the sums are deterministic ---
+	std::vector<uint32_t> adjacencyOffsets;
+	std::vector<uint32_t> adjacency;
+	if (indices) {
+		adjacencyOffsets.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			adjacencyOffsets[indices[i] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+		adjacency.resize(triangleCount * 3);
+		std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	// --- per vertex tangents ---
+	ParallelFor(static_cast<int>((vertexCount + TANGENT_BLOCK - 1) / TANGENT_BLOCK), no_threads, [&](int block) {
+		const size_t end = std::min(vertexCount, (block + 1) * TANGENT_BLOCK);
+		for (size_t v = block * TANGENT_BLOCK; v < end; v++) {
+			Vector3 tangent, bitangent;
+			if (indices) {
+				for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; a++) {
+					tangent += faceTangents[adjacency[a]];
+					bitangent += faceBitangents[adjacency[a]];
+				}
+			}
+			else if (v / 3 < triangleCount) {
+				tangent = faceTangents[v / 3];
+				bitangent = faceBitangents[v / 3];
+			}
+
+			const Vector3& normal = vertexAt(v).normal;
+			const Vector3 direction = OrthogonalTangent(tangent, bitangent, normal);
+			store(v, Tangent{ direction, TangentHandedness(direction, bitangent, normal) });
+		}
+	});
+}
+
+Vector3 OrthogonalTangent(const Vector3& t, const Vector3& b, const Vector3& n) {
+	Vector3 normal = n;
+	if (normal.SqrL2Norm() > 0.0f)
+		normal.Normalize();
+
+	//what is left after the projection has to be well above the rounding errors of t (b), otherwise it has no direction
+	Vector3 tangent = t - t.DotProduct(normal) * normal;
+	if (tangent.SqrL2Norm() > std::max(1e-20f, 1e-8f * t.SqrL2Norm()))
+		return tangent.Normalize();
+
+	//the tangents cancelled out or lie along the normal (or there were none), try the bitangent
+	tangent = b.CrossProduct(normal);
+	if (tangent.SqrL2Norm() > std::max(1e-20f, 1e-8f * b.SqrL2Norm()))
+		return tangent.Normalize();
+
+	//no texture mapping at all - any direction perpendicular to the normal
+	const Vector3 axis = (fabsf(normal.x) < 0.9f) ? Vector3(1.0f, 0.0f, 0.0f) : Vector3(0.0f, 1.0f, 0.0f);
+	tangent = axis - axis.DotProduct(normal) * normal;
+	return tangent.Normalize();
+}
+
+float TangentHandedness(const Vector3& t, const Vector3& b, const Vector3& n) {
+	return (n.CrossProduct(t).DotProduct(b) < 0.0f) ? -1.0f : 1.0f;
+}
+
+static inline uint64_t HashVertex(const Vertex& v) {
+	static_assert(sizeof(Vertex) % sizeof(uint64_t) == 0, "Vertex size must be a multiple of 8 bytes.");
+
+	uint64_t words[sizeof(Vertex) / sizeof(uint64_t)];
+	memcpy(words, &v, sizeof(Vertex));
+
+	uint64_t h = 0x9E3779B97F4A7C15ull;
+	for (uint64_t w : words) {
+		h ^= w;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 32;
+	}
+	return h;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "vertex.h"
+
+//Unit tangent of a vertex & the orientation of its bitangent (see Vertex::handedness).
+struct Tangent {
+	Vector3 direction;
+	float handedness = 1.0f;
+};
+
+//Contiguous vertices of a triangle soup (3 vertices per triangle).
+struct VertexSpan {
+	const Vertex* vertices;
+	size_t count;
+};
+
+//Indexed triangle geometry (unique vertices + 3 indices per triangle). Unique vertices are not copied, they refer to their
+//first occurrence in the welded soups (which have to outlive the geometry) and are produced by CopyVertices, so they can be
+//written straight into their final buffer.
+struct IndexedGeometry {
+	std::vector<const Vertex*> sources;		//first occurrence of every unique vertex
+	std::vector<Tangent> tangents;			//tangent of every unique vertex (see GenerateTangents), empty = taken from sources
+	std::vector<uint32_t> indices;
+
+	inline size_t VertexCount() const { return sources.size(); }
+	//Smallest GL index type able to address all vertices (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT).
+	GLenum IndexType() const;
+	//Size of a single index in bytes for IndexType().
+	size_t IndexSize() const;
+
+	//Writes unique vertices [first, first + count) into destination (meant for write-only mapped memory).
+	void CopyVertices(size_t first, size_t count, Vertex* destination) const;
+	//Writes indices [first, first + count) converted to IndexType() into destination.
+	void CopyIndices(size_t first, size_t count, void* destination) const;
+};
+
+//Merges bitwise identical vertices of triangle soups (concatenated in given order).
+//Order of first occurrences is kept, so the output is deterministic.
+IndexedGeometry WeldVertices(const std::vector<VertexSpan>& soups);
+
+//Computes tangents of all vertices from the triangles using them (indices == nullptr = triangle soup, 3 vertices per triangle).
+//Area weighted tangents of the triangles sharing a vertex are averaged and orthogonalized against its normal, triangles with
+//degenerate texture coordinates don't contribute. Vertices without a usable tangent get any direction perpendicular to the normal.
+//Handedness is -1 where the averaged bitangent points against N x T (mirrored texture mapping).
+//The result does not depend on no_threads (0 = all hardware threads).
+void GenerateTangents(Vertex* vertices, size_t vertexCount, const uint32_t* indices = nullptr, size_t indexCount = 0, int no_threads = 0);
+//Same for welded geometry, fills geometry.tangents and leaves the source vertices untouched.
+void GenerateTangents(IndexedGeometry& geometry, int no_threads = 0);
+//Unit tangent perpendicular to n, from the accumulated tangent t or bitangent b (the tangent taken from b has handedness 1).
+Vector3 OrthogonalTangent(const Vector3& t, const Vector3& b, const Vector3& n);
+//Handedness of the accumulated bitangent b against the (orthogonal) tangent t, 1 when b is zero.
+float TangentHandedness(const Vector3& t, const Vector3& b, const Vector3& n);
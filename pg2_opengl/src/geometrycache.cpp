@@ -0,0 +1,538 @@
+#include "pch.h"
+#include "geometrycache.h"
+
+#include <filesystem>
+#include <unordered_map>
+
+#include "log.h"
+#include "scene.h"
+#include "material.h"
+#include "objloader.h"
+#include "arena.h"
+#include "vertexcache.h"
+
+namespace fs = std::filesystem;
+
+//increment whenever the layout of the cache (or of Vertex/Material) or the geometry produced by the loaders changes
+constexpr uint32_t CACHE_VERSION = 11;
+constexpr char CACHE_MAGIC[8] = { 'P', 'G', '2', 'G', 'E', 'O', 'C', '\0' };
+constexpr size_t CACHE_ALIGNMENT = 64;
+//vertices & indices are stored as a single block of CompressedGeometry
+constexpr uint32_t CACHE_COMPRESSED = 1;
+
+//Identification of a source file the cache was built from.
+struct SourceStamp {
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	uint64_t hash = 0;
+};
+
+//Fixed header, buffers follow it (aligned) and variable-size tables are stored at the end,
+//so that vertices can be streamed into the file before the tables are known.
+struct CacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t vertexSize;
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	uint32_t indexType;
+	uint32_t flags;
+	uint64_t tableOffset;
+};
+
+static bool GetStamp(const std::string& path, SourceStamp& stamp, bool withHash);
+static uint64_t HashFile(const std::string& path);
+static bool Seek(FILE* f, uint64_t offset);
+static std::string StoredPath(const std::string& path, const fs::path& directory);
+static std::string ResolvedPath(const std::string& stored, const fs::path& directory);
+
+//Sequential reader of the cache records.
+class CacheReader {
+public:
+	CacheReader(const char* begin, const char* end) : p(begin), start(begin), end(end) {}
+	template<typename T> T Get() { T value = {}; Read(&value, sizeof(T)); return value; }
+	std::string GetString() { uint32_t n = Get<uint32_t>(); std::string s; if (Check(n)) { s.assign(p, n); p += n; } return s; }
+	void Read(void* data, size_t size) { if (Check(size)) { memcpy(data, p, size); p += size; } }
+	const char* Skip(size_t size) { const char* r = p; if (Check(size)) p += size; return ok ? r : nullptr; }
+	void Align() { Skip((CACHE_ALIGNMENT - (p - start) % CACHE_ALIGNMENT) % CACHE_ALIGNMENT); }
+	bool Check(size_t size) { ok &= (size_t(end - p) >= size); return ok; }
+public:
+	const char* p;
+	const char* start;
+	const char* end;
+	bool ok = true;
+};
+
+//================================= GeometryCache =================================
+
+std::string GeometryCache::CachePath(const char* sourcePath) {
+	return std::string(sourcePath) + ".geocache";
+}
+
+bool GeometryCache::IsAsset(const char* path) {
+	return fs::path(path).extension() == MESH_ASSET_EXTENSION;
+}
+
+bool GeometryCache::Open(const char* sourcePath) {
+	return OpenFile(CachePath(sourcePath).c_str(), sourcePath, true);
+}
+
+bool GeometryCache::OpenAsset(const char* assetPath) {
+	if (!OpenFile(assetPath, assetPath, false)) {
+		errlog("Failed to open mesh asset '%s'.\n", assetPath);
+		return false;
+	}
+	return true;
+}
+
+void GeometryCache::CopyVertices(size_t first, size_t count, Vertex* destination) const {
+	if (IsCompressed())
+		compressed.DecodeVertices(first, count, destination);
+	else
+		memcpy(destination, vertices + first, count * sizeof(Vertex));
+}
+
+void GeometryCache::CopyIndices(size_t first, size_t count, void* destination) const {
+	const size_t indexSize = (indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+	if (IsCompressed())
+		compressed.DecodeIndices(first, count, destination);
+	else
+		memcpy(destination, static_cast<const char*>(indices) + first * indexSize, count * indexSize);
+}
+
+bool GeometryCache::OpenFile(const char* path, const char* sourcePath, bool checkSources) {
+	file = MappedFile(path);
+	if (!file.IsOpen())
+		return false;
+	directory = fs::path(path).parent_path().generic_string();
+
+	CacheReader r(file.Data(), file.End());
+
+	CacheHeader header = r.Get<CacheHeader>();
+	if (!r.ok || memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION || header.vertexSize != sizeof(Vertex)) {
+		warnlog("Geometry cache of '%s' has incompatible format.\n", sourcePath);
+		return false;
+	}
+
+	vertexCount = header.vertexCount;
+	indexCount = header.indexCount;
+	indexType = header.indexType;
+	const size_t indexSize = (indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+
+	r.Align();
+	if (header.flags & CACHE_COMPRESSED) {
+		//the encoded block ends where the tables start
+		const size_t encodedSize = (header.tableOffset >= size_t(r.p - file.Data())) ? header.tableOffset - (r.p - file.Data()) : 0;
+		const char* encoded = r.Skip(encodedSize);
+		r.ok = r.ok && compressed.Open(encoded, encodedSize) && compressed.VertexCount() == vertexCount &&
+			compressed.IndexCount() == indexCount && compressed.IndexType() == indexType;
+		vertices = nullptr;
+		indices = nullptr;
+	}
+	else {
+		vertices = reinterpret_cast<const Vertex*>(r.Skip(vertexCount * sizeof(Vertex)));
+		r.Align();
+		indices = r.Skip(indexCount * indexSize);
+	}
+	isCompressed = (header.flags & CACHE_COMPRESSED) != 0;
+
+	//tables
+	if (header.tableOffset > file.Size())
+		r.ok = false;
+	else
+		r.p = file.Data() + header.tableOffset;
+
+	//sources - size & mtime are checked first, content hash only when those differ (e.g. fresh checkout),
+	//assets are self-contained and load without their sources
+	//sources whose content matched despite a different mtime get the new mtime stored, so the next start doesn't hash them again
+	std::vector<std::pair<size_t, int64_t>> touched;
+	uint32_t sourceCount = r.Get<uint32_t>();
+	for (uint32_t i = 0; i < sourceCount && r.ok; i++) {
+		std::string path = r.GetString();
+		const size_t stampOffset = r.p - file.Data();
+		SourceStamp cached = r.Get<SourceStamp>();
+		if (!checkSources)
+			continue;
+		SourceStamp current;
+		if (!GetStamp(path, current, false) || current.size != cached.size) {
+			warnlog("Geometry cache of '%s' is stale ('%s' changed).\n", sourcePath, path.c_str());
+			return false;
+		}
+		if (current.mtime != cached.mtime) {
+			if (HashFile(path) != cached.hash) {
+				warnlog("Geometry cache of '%s' is stale ('%s' changed).\n", sourcePath, path.c_str());
+				return false;
+			}
+			touched.emplace_back(stampOffset + offsetof(SourceStamp, mtime), current.mtime);
+		}
+	}
+
+	//material table & meshes are parsed on demand
+	materialCount = r.Get<int32_t>();
+	materialData = r.p;
+	for (int i = 0; i < materialCount && r.ok; i++) {
+		r.GetString();
+		r.Skip(sizeof(Color3f) * 4 + sizeof(float) * 5 + sizeof(char));
+		for (int t = 0; t < NO_TEXTURES; t++)
+			r.GetString();
+	}
+
+	meshCount = r.Get<int32_t>();
+	meshData = r.Skip(meshCount * (sizeof(int32_t) * 5 + sizeof(Vector3) * 2));
+
+	instanceCount = r.Get<int32_t>();
+	instanceData = r.Skip(instanceCount * sizeof(InstanceTransform));
+
+	if (!r.ok) {
+		warnlog("Geometry cache of '%s' is corrupted.\n", sourcePath);
+		return false;
+	}
+
+	//the mapping is read-only & exclusive, so the stamps are patched with the file closed and it is opened again
+	//(sources were just verified), a read-only cache simply keeps being hashed
+	if (!touched.empty()) {
+		file = MappedFile();
+		if (FILE* f = fopen(path, "r+b")) {
+			for (const auto& t : touched)
+				if (Seek(f, t.first))
+					fwrite(&t.second, sizeof(t.second), 1, f);
+			fclose(f);
+		}
+		return OpenFile(path, sourcePath, false);
+	}
+	return true;
+}
+
+void GeometryCache::LoadMaterials(std::vector<Material*>& materials, std::vector<Texture3u*>* pendingTextures, Arena* arena) const {
+	CacheReader r(materialData, file.End());
+	std::map<std::string, Texture3u*> already_loaded_textures;
+	std::vector<Texture3u*> deferred_textures;
+
+	for (int i = 0; i < materialCount; i++) {
+		Material* m = ArenaNew<Material>(arena);
+		m->set_name(r.GetString().c_str());
+		m->ambient_ = r.Get<Color3f>();
+		m->diffuse_ = r.Get<Color3f>();
+		m->specular_ = r.Get<Color3f>();
+		m->emission_ = r.Get<Color3f>();
+		m->shininess = r.Get<float>();
+		m->roughness_ = r.Get<float>();
+		m->metallicness = r.Get<float>();
+		m->reflectivity = r.Get<float>();
+		m->ior = r.Get<float>();
+		m->set_shader(Shader(r.Get<char>()));
+
+		for (int t = 0; t < NO_TEXTURES; t++) {
+			std::string textureName = r.GetString();
+			if (!textureName.empty())
+				m->set_texture(t, TextureProxy(ResolvedPath(textureName, directory), already_loaded_textures, -1, false, &deferred_textures, arena));
+		}
+
+		materials.push_back(m);
+	}
+
+	if (pendingTextures)
+		pendingTextures->insert(pendingTextures->end(), deferred_textures.begin(), deferred_textures.end());
+	else
+		LoadTextures(deferred_textures);
+}
+
+void GeometryCache::LoadMeshes(std::vector<Mesh>& meshes, const std::vector<Material*>& materials) const {
+	CacheReader r(meshData, file.End());
+
+	for (int i = 0; i < meshCount; i++) {
+		int32_t offset = r.Get<int32_t>();
+		int32_t count = r.Get<int32_t>();
+		int32_t material = r.Get<int32_t>();
+		meshes.push_back(Mesh(offset, count, (material >= 0) ? materials[material] : nullptr));
+		meshes.back().firstInstance = r.Get<int32_t>();
+		meshes.back().instanceCount = r.Get<int32_t>();
+		meshes.back().boxMin = r.Get<Vector3>();
+		meshes.back().boxMax = r.Get<Vector3>();
+	}
+}
+
+void GeometryCache::LoadInstances(std::vector<InstanceTransform>& instances) const {
+	instances.resize(instanceCount);
+	if (instanceCount > 0)
+		memcpy(instances.data(), instanceData, instanceCount * sizeof(InstanceTransform));
+}
+
+bool GeometryCache::Write(const char* sourcePath, const std::vector<std::string>& dependencies, const IndexedGeometry& geometry,
+						  const std::vector<Mesh>& meshes, const std::vector<Material*>& materials, const std::vector<InstanceTransform>& instances) {
+	GeometryCacheWriter writer(sourcePath);
+
+	//unique vertices are assembled in blocks, the whole vertex buffer never exists in memory
+	std::vector<Vertex> block(std::min(geometry.VertexCount(), size_t(1) << 16));
+	for (size_t first = 0; first < geometry.VertexCount(); first += block.size()) {
+		const size_t n = std::min(block.size(), geometry.VertexCount() - first);
+		geometry.CopyVertices(first, n, block.data());
+		writer.AppendVertices(block.data(), n);
+	}
+	return writer.Finish(&geometry.indices, dependencies, meshes, materials, instances);
+}
+
+bool GeometryCache::WriteAsset(const char* assetPath, const char* sourcePath, const std::vector<std::string>& dependencies,
+							   const IndexedGeometry& geometry, const std::vector<Mesh>& meshes, const std::vector<Material*>& materials,
+							   const std::vector<InstanceTransform>& instances, int no_threads) {
+	GeometryCacheWriter writer(sourcePath, assetPath);
+	writer.AppendCompressed(CompressedGeometry::Encode(geometry, no_threads), geometry.VertexCount(), geometry.indices.size());
+	return writer.Finish(nullptr, dependencies, meshes, materials, instances);
+}
+
+bool WriteMeshAsset(const char* assetPath, const char* sourcePath, const std::vector<std::string>& dependencies,
+					std::vector<Surface*>& surfaces, const std::vector<Material*>& materials,
+					const std::vector<int>& copies, const std::vector<InstanceTransform>& instances, int no_threads) {
+	//the same geometry as the scene builds on a cold start
+	std::vector<Mesh> meshes;
+	IndexedGeometry geometry = WeldVertices(MergeSurfaces(surfaces, materials, meshes));
+	AssignInstances(meshes, copies);
+	GenerateTangents(geometry, no_threads);
+	OptimizeGeometry(geometry, meshes, no_threads);
+	return GeometryCache::WriteAsset(assetPath, sourcePath, dependencies, geometry, meshes, materials, instances, no_threads);
+}
+
+//================================= GeometryCacheWriter =================================
+
+GeometryCacheWriter::GeometryCacheWriter(const char* sourcePath_, const char* outputPath) : sourcePath(sourcePath_) {
+	cachePath = outputPath ? std::string(outputPath) : GeometryCache::CachePath(sourcePath_);
+	tmpPath = cachePath + ".tmp";
+
+	file = fopen(tmpPath.c_str(), "wb");
+	if (file == nullptr) {
+		warnlog("Failed to write geometry cache '%s'.\n", cachePath.c_str());
+		return;
+	}
+
+	//placeholder, rewritten by Finish()
+	Put(CacheHeader{});
+	Align();
+}
+
+GeometryCacheWriter::~GeometryCacheWriter() {
+	Discard();
+}
+
+void GeometryCacheWriter::AppendVertices(const Vertex* vertices, size_t count) {
+	Write(vertices, count * sizeof(Vertex));
+	vertexCount += count;
+}
+
+void GeometryCacheWriter::AppendCompressed(const std::vector<char>& encoded, size_t vertexCount_, size_t indexCount_) {
+	Write(encoded.data(), encoded.size());
+	vertexCount = vertexCount_;
+	compressedIndexCount = indexCount_;
+	compressed = true;
+}
+
+bool GeometryCacheWriter::Finish(const std::vector<uint32_t>* indices, const std::vector<std::string>& dependencies,
+								 const std::vector<Mesh>& meshes, const std::vector<Material*>& materials,
+								 const std::vector<InstanceTransform>& instances) {
+	if (file == nullptr)
+		return false;
+
+	CacheHeader header = {};
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.vertexSize = sizeof(Vertex);
+	header.vertexCount = vertexCount;
+	header.indexCount = compressed ? compressedIndexCount : indices ? indices->size() : vertexCount;
+	header.indexType = (vertexCount <= 0xFFFF) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	header.flags = compressed ? CACHE_COMPRESSED : 0;
+
+	if (vertexCount > UINT32_MAX) {
+		warnlog("Geometry cache '%s' not written, too many vertices.\n", cachePath.c_str());
+		Discard();
+		return false;
+	}
+
+	//index buffer, exactly as it is uploaded to GL (compressed indices are already written)
+	Align();
+	const size_t block = 1 << 16;
+	std::vector<uint32_t> sequential;
+	std::vector<uint16_t> shortIndices;
+	for (size_t first = 0; first < header.indexCount && !compressed; first += block) {
+		const size_t n = std::min(block, size_t(header.indexCount - first));
+
+		const uint32_t* data;
+		if (indices) {
+			data = indices->data() + first;
+		}
+		else {
+			sequential.resize(n);
+			for (size_t i = 0; i < n; i++)
+				sequential[i] = uint32_t(first + i);
+			data = sequential.data();
+		}
+
+		if (header.indexType == GL_UNSIGNED_SHORT) {
+			shortIndices.assign(data, data + n);
+			Write(shortIndices.data(), n * sizeof(uint16_t));
+		}
+		else {
+			Write(data, n * sizeof(uint32_t));
+		}
+	}
+
+	Align();
+	header.tableOffset = offset;
+
+	//sources
+	std::vector<std::string> sources = { sourcePath };
+	sources.insert(sources.end(), dependencies.begin(), dependencies.end());
+	Put(uint32_t(sources.size()));
+	for (const std::string& path : sources) {
+		SourceStamp stamp;
+		GetStamp(path, stamp, true);
+		PutString(path);
+		Put(stamp);
+	}
+
+	//material table, texture paths relative to the cache (it can be moved together with the textures, e.g. cooked assets)
+	const fs::path cacheDirectory = fs::path(cachePath).parent_path();
+	Put(int32_t(materials.size()));
+	for (const Material* m : materials) {
+		PutString(m->name());
+		Put(m->ambient_);
+		Put(m->diffuse_);
+		Put(m->specular_);
+		Put(m->emission_);
+		Put(m->shininess);
+		Put(m->roughness_);
+		Put(m->metallicness);
+		Put(m->reflectivity);
+		Put(m->ior);
+		Put(char(m->shader()));
+		for (int t = 0; t < NO_TEXTURES; t++) {
+			const Texture3u* texture = m->texture(t);
+			PutString(texture ? StoredPath(texture->file_name(), cacheDirectory) : std::string());
+		}
+	}
+
+	//meshes
+	std::unordered_map<const Material*, int32_t> materialIndices(materials.size());
+	for (size_t i = 0; i < materials.size(); i++)
+		materialIndices.emplace(materials[i], int32_t(i));
+
+	Put(int32_t(meshes.size()));
+	for (const Mesh& mesh : meshes) {
+		const auto material = materialIndices.find(mesh.material);
+		Put(int32_t(mesh.offset));
+		Put(int32_t(mesh.count));
+		Put((material != materialIndices.end()) ? material->second : -1);
+		Put(int32_t(mesh.firstInstance));
+		Put(int32_t(mesh.instanceCount));
+		Put(mesh.boxMin);
+		Put(mesh.boxMax);
+	}
+
+	//transforms of the copies
+	Put(int32_t(instances.size()));
+	Write(instances.data(), instances.size() * sizeof(InstanceTransform));
+
+	//final header
+	ok &= (fseek(file, 0, SEEK_SET) == 0);
+	Put(header);
+
+	ok &= (fclose(file) == 0);
+	file = nullptr;
+
+	std::error_code ec;
+	if (ok)
+		fs::rename(tmpPath, cachePath, ec);
+	if (!ok || ec) {
+		Discard();
+		warnlog("Failed to write geometry cache '%s'.\n", cachePath.c_str());
+		return false;
+	}
+	return true;
+}
+
+void GeometryCacheWriter::PutString(const std::string& s) {
+	Put(uint32_t(s.size()));
+	Write(s.data(), s.size());
+}
+
+void GeometryCacheWriter::Write(const void* data, size_t size) {
+	if (file)
+		ok &= (fwrite(data, 1, size, file) == size);
+	offset += size;
+}
+
+void GeometryCacheWriter::Align() {
+	static const char zeros[CACHE_ALIGNMENT] = {};
+	Write(zeros, (CACHE_ALIGNMENT - offset % CACHE_ALIGNMENT) % CACHE_ALIGNMENT);
+}
+
+void GeometryCacheWriter::Discard() {
+	if (file) {
+		fclose(file);
+		file = nullptr;
+	}
+
+	std::error_code ec;
+	if (fs::exists(tmpPath, ec))
+		fs::remove(tmpPath, ec);
+}
+
+//================================= Helpers =================================
+
+static bool GetStamp(const std::string& path, SourceStamp& stamp, bool withHash) {
+	std::error_code ec;
+	stamp.size = fs::file_size(path, ec);
+	if (ec)
+		return false;
+	stamp.mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+	if (ec)
+		return false;
+	stamp.hash = withHash ? HashFile(path) : 0;
+	return true;
+}
+
+static uint64_t HashFile(const std::string& path) {
+	MappedFile f = MappedFile(path.c_str());
+	if (!f.IsOpen())
+		return 0;
+
+	//64-bit multiply-xorshift over 8 byte words
+	uint64_t h = 0x9E3779B97F4A7C15ull ^ f.Size();
+	const char* p = f.Data();
+	size_t n = f.Size() / sizeof(uint64_t);
+	for (size_t i = 0; i < n; i++, p += sizeof(uint64_t)) {
+		uint64_t w;
+		memcpy(&w, p, sizeof(w));
+		h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+		h ^= h >> 29;
+	}
+
+	uint64_t tail = 0;
+	if (f.Size() % sizeof(uint64_t))
+		memcpy(&tail, p, f.Size() % sizeof(uint64_t));
+	h = (h ^ tail) * 0xC4CEB9FE1A85EC53ull;
+	return h ^ (h >> 32);
+}
+
+static bool Seek(FILE* f, uint64_t offset) {
+	//tables of large caches lie beyond 2 GB
+#ifdef _WIN32
+	return _fseeki64(f, int64_t(offset), SEEK_SET) == 0;
+#else
+	return fseeko(f, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+static std::string StoredPath(const std::string& path, const fs::path& directory) {
+	if (fs::path(path).is_absolute())
+		return path;
+	std::error_code ec;
+	const fs::path file = fs::absolute(path, ec).lexically_normal();
+	const fs::path base = fs::absolute(directory.empty() ? fs::path(".") : directory, ec).lexically_normal();
+	const fs::path relative = file.lexically_relative(base);
+	//e.g. another drive
+	return relative.empty() ? file.generic_string() : relative.generic_string();
+}
+
+static std::string ResolvedPath(const std::string& stored, const fs::path& directory) {
+	const fs::path path(stored);
+	return path.is_absolute() ? stored : (directory / path).lexically_normal().generic_string();
+}
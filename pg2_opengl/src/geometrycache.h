@@ -0,0 +1,130 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "mappedfile.h"
+#include "geometry.h"
+#include "texture.h"
+#include "meshcodec.h"
+#include "instancing.h"
+
+class Mesh;
+class Material;
+class Surface;
+class Arena;
+
+//extension of mesh assets (compressed caches loaded directly, see GeometryCache::OpenAsset)
+constexpr const char* MESH_ASSET_EXTENSION = ".pg2mesh";
+
+//Binary cache of a loaded scene (final vertex/index buffers, mesh ranges & bounding boxes, material table and the transforms of instanced meshes),
+//stored next to the source file as "<file>.geocache".
+//The same layout with compressed geometry (see CompressedGeometry) is a mesh asset, which is loaded instead of the source file.
+class GeometryCache {
+public:
+	//Maps the cache of given source file, fails when it is missing, corrupted or any of its sources changed.
+	bool Open(const char* sourcePath);
+	//Maps a mesh asset, its sources are not needed.
+	bool OpenAsset(const char* assetPath);
+	static bool IsAsset(const char* path);
+
+	//Final buffers, nullptr when compressed (see CopyVertices & CopyIndices).
+	inline const Vertex* Vertices() const { return vertices; }
+	inline size_t VertexCount() const { return vertexCount; }
+
+	//Index data is stored already in the GL index type.
+	inline const void* Indices() const { return indices; }
+	inline size_t IndexCount() const { return indexCount; }
+	inline GLenum IndexType() const { return indexType; }
+
+	inline bool IsCompressed() const { return isCompressed; }
+	//Writes vertices (indices in IndexType()) [first, first + count) into destination, decoded when compressed.
+	void CopyVertices(size_t first, size_t count, Vertex* destination) const;
+	void CopyIndices(size_t first, size_t count, void* destination) const;
+
+	//Recreates materials (textures are loaded from their original files) and mesh ranges.
+	//Textures are decoded right away unless pendingTextures is given (see LoadTextures).
+	//Materials & textures are created in arena when given, otherwise the caller owns them.
+	void LoadMaterials(std::vector<Material*>& materials, std::vector<Texture3u*>* pendingTextures = nullptr, Arena* arena = nullptr) const;
+	void LoadMeshes(std::vector<Mesh>& meshes, const std::vector<Material*>& materials) const;
+	//Transforms of the copies of the meshes (see Mesh::firstInstance).
+	void LoadInstances(std::vector<InstanceTransform>& instances) const;
+
+	//Writes the cache for given source file at once, dependencies are additional source files (e.g. material libraries).
+	static bool Write(const char* sourcePath, const std::vector<std::string>& dependencies, const IndexedGeometry& geometry,
+					  const std::vector<Mesh>& meshes, const std::vector<Material*>& materials, const std::vector<InstanceTransform>& instances = {});
+	//Writes a mesh asset of given geometry (compressed) at assetPath, sources are recorded but not needed for loading.
+	static bool WriteAsset(const char* assetPath, const char* sourcePath, const std::vector<std::string>& dependencies,
+						   const IndexedGeometry& geometry, const std::vector<Mesh>& meshes, const std::vector<Material*>& materials,
+						   const std::vector<InstanceTransform>& instances = {}, int no_threads = 0);
+
+	static std::string CachePath(const char* sourcePath);
+private:
+	bool OpenFile(const char* path, const char* sourcePath, bool checkSources);
+private:
+	MappedFile file;
+	std::string directory;		//of the file, stored texture paths are relative to it
+	CompressedGeometry compressed;
+	bool isCompressed = false;
+
+	const char* materialData = nullptr;
+	const char* meshData = nullptr;
+	int materialCount = 0;
+	int meshCount = 0;
+	const char* instanceData = nullptr;
+	int instanceCount = 0;
+
+	const Vertex* vertices = nullptr;
+	size_t vertexCount = 0;
+	const void* indices = nullptr;
+	size_t indexCount = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+};
+
+//Writes the cache incrementally - vertices are appended as they are produced, the rest is written by Finish().
+//The previous cache is replaced only after a successful Finish().
+class GeometryCacheWriter {
+public:
+	//Writes the cache of sourcePath, or the file outputPath when given.
+	GeometryCacheWriter(const char* sourcePath, const char* outputPath = nullptr);
+	~GeometryCacheWriter();
+
+	//copy deleted
+	GeometryCacheWriter(const GeometryCacheWriter&) = delete;
+	GeometryCacheWriter& operator=(const GeometryCacheWriter&) = delete;
+
+	inline bool IsOpen() const { return file != nullptr; }
+
+	void AppendVertices(const Vertex* vertices, size_t count);
+	//Writes all vertices & indices at once as CompressedGeometry::Encode data (instead of AppendVertices).
+	void AppendCompressed(const std::vector<char>& encoded, size_t vertexCount, size_t indexCount);
+	inline size_t VertexCount() const { return vertexCount; }
+
+	//Writes index data and tables, indices == nullptr stores sequential indices (non-indexed triangle list),
+	//compressed caches already contain their indices.
+	bool Finish(const std::vector<uint32_t>* indices, const std::vector<std::string>& dependencies,
+				const std::vector<Mesh>& meshes, const std::vector<Material*>& materials, const std::vector<InstanceTransform>& instances = {});
+private:
+	template<typename T> void Put(const T& value) { Write(&value, sizeof(T)); }
+	void PutString(const std::string& s);
+	void Write(const void* data, size_t size);
+	void Align();
+	void Discard();
+private:
+	std::string sourcePath;
+	std::string cachePath;
+	std::string tmpPath;
+
+	FILE* file = nullptr;
+	uint64_t offset = 0;
+	size_t vertexCount = 0;
+	size_t compressedIndexCount = 0;
+	bool compressed = false;
+	bool ok = true;
+};
+
+//Builds the scene geometry of loaded surfaces (as a cold start of Scene does) and writes it as a mesh asset.
+//Copies & instances are the result of FindInstances on the surfaces, if it was called. Uses no_threads threads (0 = all).
+bool WriteMeshAsset(const char* assetPath, const char* sourcePath, const std::vector<std::string>& dependencies,
+					std::vector<Surface*>& surfaces, const std::vector<Material*>& materials,
+					const std::vector<int>& copies = {}, const std::vector<InstanceTransform>& instances = {}, int no_threads = 0);
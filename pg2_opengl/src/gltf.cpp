@@ -0,0 +1,965 @@
+#include "pch.h"
+#include "gltf.h"
+
+#include <cstring>
+#include <filesystem>
+
+#include "log.h"
+#include "arena.h"
+#include "vertex.h"
+#include "material.h"
+#include "objloader.h"
+#include "geometry.h"
+#include "scene.h"
+
+//nesting of JSON values & nodes, deeper files are rejected (cycles of nodes)
+constexpr int MAX_DEPTH = 64;
+
+constexpr uint32_t GLB_MAGIC = 0x46546C67;		//"glTF"
+constexpr uint32_t CHUNK_JSON = 0x4E4F534A;		//"JSON"
+constexpr uint32_t CHUNK_BIN = 0x004E4942;		//"BIN\0"
+constexpr int MODE_TRIANGLES = 4;
+
+static inline uint32_t Read32(const char* p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+//================================= Json =================================
+
+//JSON document of the model, parsed at once into a tree.
+class GLBModel::Json {
+public:
+	enum Type { NONE, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+	//Parses the value at p (surrounding whitespace included), false on syntax errors.
+	static bool Parse(const char*& p, const char* end, Json& value, int depth = 0);
+
+	inline Type type() const { return type_; }
+	inline size_t size() const { return items.size(); }
+	//Member of an object (element of an array), an empty value when there is none.
+	const Json& operator[](const char* key) const;
+	const Json& operator[](size_t i) const { return i < items.size() ? items[i] : empty; }
+	const Json& operator[](int i) const { return i >= 0 ? (*this)[size_t(i)] : empty; }
+
+	inline double Number(double fallback) const { return type_ == NUMBER ? number : fallback; }
+	inline int Int(int fallback = -1) const { return type_ == NUMBER ? int(number) : fallback; }
+	inline bool Bool() const { return type_ == BOOLEAN && number != 0.0; }
+	inline const std::string& String() const { return string; }
+private:
+	static bool ParseString(const char*& p, const char* end, std::string& s);
+private:
+	Type type_ = NONE;
+	double number = 0.0;
+	std::string string;
+	std::vector<Json> items;			//elements of arrays, values of objects
+	std::vector<std::string> keys;		//of the object values
+
+	static const Json empty;
+};
+
+const GLBModel::Json GLBModel::Json::empty;
+
+static inline const char* SkipSpace(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+		p++;
+	return p;
+}
+
+const GLBModel::Json& GLBModel::Json::operator[](const char* key) const {
+	for (size_t i = 0; i < keys.size(); i++)
+		if (keys[i] == key)
+			return items[i];
+	return empty;
+}
+
+bool GLBModel::Json::ParseString(const char*& p, const char* end, std::string& s) {
+	p++;	//"
+	while (p < end && *p != '"') {
+		if (*p != '\\') {
+			s += *p++;
+			continue;
+		}
+		if (++p >= end)
+			return false;
+		switch (*p++) {
+			case '"': s += '"'; break;
+			case '\\': s += '\\'; break;
+			case '/': s += '/'; break;
+			case 'b': s += '\b'; break;
+			case 'f': s += '\f'; break;
+			case 'n': s += '\n'; break;
+			case 'r': s += '\r'; break;
+			case 't': s += '\t'; break;
+			case 'u': {
+				//code point as UTF-8, surrogate pairs combined
+				const auto hex = [&](uint32_t& c) {
+					if (end - p < 4)
+						return false;
+					c = uint32_t(strtoul(std::string(p, 4).c_str(), nullptr, 16));
+					p += 4;
+					return true;
+				};
+				uint32_t c;
+				if (!hex(c))
+					return false;
+				if (c >= 0xD800 && c < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+					p += 2;
+					uint32_t low;
+					if (!hex(low))
+						return false;
+					c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+				}
+				if (c < 0x80) {
+					s += char(c);
+				}
+				else if (c < 0x800) {
+					s += char(0xC0 | (c >> 6));
+					s += char(0x80 | (c & 0x3F));
+				}
+				else if (c < 0x10000) {
+					s += char(0xE0 | (c >> 12));
+					s += char(0x80 | ((c >> 6) & 0x3F));
+					s += char(0x80 | (c & 0x3F));
+				}
+				else {
+					s += char(0xF0 | (c >> 18));
+					s += char(0x80 | ((c >> 12) & 0x3F));
+					s += char(0x80 | ((c >> 6) & 0x3F));
+					s += char(0x80 | (c & 0x3F));
+				}
+				break;
+			}
+			default: return false;
+		}
+	}
+	if (p >= end)
+		return false;
+	p++;	//"
+	return true;
+}
+
+bool GLBModel::Json::Parse(const char*& p, const char* end, Json& value, int depth) {
+	p = SkipSpace(p, end);
+	if (p >= end || depth > MAX_DEPTH)
+		return false;
+
+	switch (*p) {
+		case '{':
+		case '[': {
+			const bool object = (*p == '{');
+			const char close = object ? '}' : ']';
+			value.type_ = object ? OBJECT : ARRAY;
+			p = SkipSpace(p + 1, end);
+			if (p < end && *p == close) {
+				p++;
+				break;
+			}
+			for (;;) {
+				if (object) {
+					p = SkipSpace(p, end);
+					if (p >= end || *p != '"')
+						return false;
+					value.keys.emplace_back();
+					if (!ParseString(p, end, value.keys.back()))
+						return false;
+					p = SkipSpace(p, end);
+					if (p >= end || *p++ != ':')
+						return false;
+				}
+				value.items.emplace_back();
+				if (!Parse(p, end, value.items.back(), depth + 1))
+					return false;
+				if (p >= end)
+					return false;
+				if (*p == ',') {
+					p++;
+					continue;
+				}
+				if (*p++ != close)
+					return false;
+				break;
+			}
+			break;
+		}
+		case '"':
+			value.type_ = STRING;
+			if (!ParseString(p, end, value.string))
+				return false;
+			break;
+		case 't':
+		case 'f':
+		case 'n': {
+			const char* word = (*p == 't') ? "true" : (*p == 'f') ? "false" : "null";
+			const size_t length = strlen(word);
+			if (size_t(end - p) < length || strncmp(p, word, length) != 0)
+				return false;
+			value.type_ = (*p == 'n') ? NONE : BOOLEAN;
+			value.number = (*p == 't') ? 1.0 : 0.0;
+			p += length;
+			break;
+		}
+		default: {
+			//the chunk is not terminated, the number is copied first
+			const char* begin = p;
+			while (p < end && (isdigit((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+				p++;
+			if (p == begin)
+				return false;
+			value.type_ = NUMBER;
+			value.number = strtod(std::string(begin, p).c_str(), nullptr);
+			break;
+		}
+	}
+	p = SkipSpace(p, end);
+	return true;
+}
+
+//================================= Model parts =================================
+
+//Typed view of an accessor inside the binary chunk.
+struct GLBModel::Accessor {
+	const char* data = nullptr;		//first element
+	size_t stride = 0;
+	size_t count = 0;				//0 = attribute not present
+	int componentType = 0;			//GL type
+	int components = 0;
+	bool normalized = false;
+
+	//Element i converted to floats (normalized integers are mapped to <0, 1> or <-1, 1>).
+	void Read(size_t i, float* out) const {
+		const char* p = data + i * stride;
+		if (componentType == GL_FLOAT) {
+			memcpy(out, p, components * sizeof(float));
+			return;
+		}
+		for (int c = 0; c < components; c++) {
+			switch (componentType) {
+				case GL_UNSIGNED_BYTE: out[c] = normalized ? reinterpret_cast<const uint8_t*>(p)[c] / 255.0f : reinterpret_cast<const uint8_t*>(p)[c]; break;
+				case GL_BYTE: out[c] = normalized ? std::max(reinterpret_cast<const int8_t*>(p)[c] / 127.0f, -1.0f) : reinterpret_cast<const int8_t*>(p)[c]; break;
+				case GL_UNSIGNED_SHORT: {
+					uint16_t v;
+					memcpy(&v, p + c * sizeof(v), sizeof(v));
+					out[c] = normalized ? v / 65535.0f : v;
+					break;
+				}
+				case GL_SHORT: {
+					int16_t v;
+					memcpy(&v, p + c * sizeof(v), sizeof(v));
+					out[c] = normalized ? std::max(v / 32767.0f, -1.0f) : v;
+					break;
+				}
+				default: {
+					uint32_t v;
+					memcpy(&v, p + c * sizeof(v), sizeof(v));
+					out[c] = float(v);
+					break;
+				}
+			}
+		}
+	}
+
+	//Element i of an index accessor.
+	uint32_t Index(size_t i) const {
+		const char* p = data + i * stride;
+		switch (componentType) {
+			case GL_UNSIGNED_BYTE: return *reinterpret_cast<const uint8_t*>(p);
+			case GL_UNSIGNED_SHORT: {
+				uint16_t v;
+				memcpy(&v, p, sizeof(v));
+				return v;
+			}
+			default: return Read32(p);
+		}
+	}
+};
+
+struct GLBModel::Primitive {
+	Accessor positions;
+	Accessor normals;
+	Accessor uvs;
+	Accessor colors;
+	Accessor tangents;
+	Accessor indices;			//count 0 = non-indexed
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	int material = -1;			//-1 = default material
+	std::vector<Vector3> generatedNormals;		//when the file has none
+	std::vector<Tangent> generatedTangents;
+};
+
+//Primitive placed by a node, its vertices & indices follow the ones of the previous instance.
+struct GLBModel::Instance {
+	size_t primitive;
+	int material;				//index into the loaded materials
+	Vector3 axes[3];			//node transform (columns of the linear part) and translation
+	Vector3 translation;
+	Vector3 normalAxes[3];		//inverse transpose of the linear part (up to scale)
+	bool identity;
+	bool mirrored;				//negative determinant, winding of the triangles is reversed
+	size_t firstVertex;
+	size_t firstIndex;
+};
+
+struct GLBModel::MaterialDesc {
+	std::string name;
+	float baseColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	float metallic = 1.0f;
+	float roughness = 1.0f;
+	float ior = 1.5f;
+	float occlusionStrength = 1.0f;
+	int baseColorTexture = -1;
+	int metallicRoughnessTexture = -1;
+	int normalTexture = -1;
+	int occlusionTexture = -1;
+};
+
+//================================= GLBModel =================================
+
+GLBModel::GLBModel() {}
+
+GLBModel::~GLBModel() {}
+
+bool GLBModel::IsGLB(const char* path) {
+	std::string ext = std::filesystem::path(path).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return char(tolower(c)); });
+	return ext == GLB_EXTENSION;
+}
+
+GLenum GLBModel::IndexType() const {
+	return (vertexCount <= 0xFFFF) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+bool GLBModel::Open(const char* filepath) {
+	file = std::make_shared<MappedFile>(filepath);
+	if (!file->IsOpen()) {
+		errlog("glTF '%s' not found.\n", filepath);
+		return false;
+	}
+	name = filepath;
+	directory = std::filesystem::path(filepath).parent_path().string();
+
+	//header (magic, version, length) followed by chunks (length, type, data padded to 4 bytes)
+	const char* data = file->Data();
+	const size_t size = file->Size();
+	if (size < 12 || Read32(data) != GLB_MAGIC || Read32(data + 4) != 2) {
+		errlog("'%s' is not a glTF 2.0 binary.\n", filepath);
+		return false;
+	}
+	const char* json = nullptr;
+	size_t jsonSize = 0;
+	for (size_t offset = 12; offset + 8 <= size;) {
+		const size_t length = Read32(data + offset);
+		const uint32_t type = Read32(data + offset + 4);
+		if (length > size - offset - 8)
+			break;
+		if (type == CHUNK_JSON && json == nullptr) {
+			json = data + offset + 8;
+			jsonSize = length;
+		}
+		else if (type == CHUNK_BIN && bin == nullptr) {
+			bin = data + offset + 8;
+			binSize = length;
+		}
+		offset += 8 + ((length + 3) & ~size_t(3));
+	}
+
+	Json root;
+	const char* p = json;
+	if (json == nullptr || !Json::Parse(p, json + jsonSize, root) || root.type() != Json::OBJECT) {
+		errlog("glTF '%s' has no valid JSON chunk.\n", filepath);
+		return false;
+	}
+	if (root["asset"]["version"].String().compare(0, 1, "2") != 0) {
+		errlog("glTF '%s' is not version 2.\n", filepath);
+		return false;
+	}
+
+	//images & textures
+	const Json& images = root["images"];
+	imageUris.assign(images.size(), std::string());
+	imageViews.assign(images.size(), { 0, 0 });
+	for (size_t i = 0; i < images.size(); i++) {
+		const std::string& uri = images[i]["uri"].String();
+		const Json& view = root["bufferViews"][size_t(images[i]["bufferView"].Int())];
+		if (!uri.empty() && uri.compare(0, 5, "data:") != 0) {
+			//percent encoded relative path
+			std::string path;
+			for (size_t c = 0; c < uri.size(); c++) {
+				if (uri[c] == '%' && c + 2 < uri.size()) {
+					path += char(strtol(uri.substr(c + 1, 2).c_str(), nullptr, 16));
+					c += 2;
+				}
+				else
+					path += uri[c];
+			}
+			imageUris[i] = (std::filesystem::path(directory) / std::filesystem::u8path(path)).string();
+		}
+		else if (view.type() == Json::OBJECT && view["buffer"].Int(0) == 0 && bin != nullptr) {
+			const size_t offset = size_t(view["byteOffset"].Number(0.0)), length = size_t(view["byteLength"].Number(0.0));
+			if (offset <= binSize && length <= binSize - offset)
+				imageViews[i] = { offset, length };
+		}
+		else {
+			warnlog("glTF '%s': image %zu is not supported (embedded as data URI).\n", filepath, i);
+		}
+	}
+	const Json& textures = root["textures"];
+	textureImages.assign(textures.size(), -1);
+	for (size_t i = 0; i < textures.size(); i++) {
+		const int image = textures[i]["source"].Int();
+		if (image >= 0 && size_t(image) < images.size())
+			textureImages[i] = image;
+	}
+
+	ReadMaterials(root);
+
+	//triangle primitives of all meshes
+	const Json& meshes = root["meshes"];
+	meshPrimitives.assign(meshes.size(), std::vector<int>());
+	size_t skipped = 0;
+	for (size_t m = 0; m < meshes.size(); m++) {
+		const Json& list = meshes[m]["primitives"];
+		for (size_t i = 0; i < list.size(); i++) {
+			const Json& attributes = list[i]["attributes"];
+			Primitive primitive;
+			if (list[i]["mode"].Int(MODE_TRIANGLES) != MODE_TRIANGLES || !ReadAccessor(root, attributes["POSITION"].Int(), primitive.positions)
+				|| primitive.positions.componentType != GL_FLOAT || primitive.positions.components != 3) {
+				skipped++;
+				continue;
+			}
+			primitive.vertexCount = primitive.positions.count;
+
+			//optional attributes with unexpected layouts are ignored
+			const auto optional = [&](const char* attribute, Accessor& accessor, int minComponents, bool floatOnly) {
+				if (!ReadAccessor(root, attributes[attribute].Int(), accessor) || accessor.count != primitive.vertexCount
+					|| accessor.components < minComponents || (floatOnly && accessor.componentType != GL_FLOAT)
+					|| (accessor.componentType != GL_FLOAT && !accessor.normalized))
+					accessor = Accessor();
+			};
+			optional("NORMAL", primitive.normals, 3, true);
+			optional("TANGENT", primitive.tangents, 4, true);
+			optional("TEXCOORD_0", primitive.uvs, 2, false);
+			optional("COLOR_0", primitive.colors, 3, false);
+			primitive.normals.components = std::min(primitive.normals.components, 3);
+			primitive.tangents.components = std::min(primitive.tangents.components, 4);		//w is the handedness of the bitangent
+			primitive.uvs.components = std::min(primitive.uvs.components, 2);
+			primitive.colors.components = std::min(primitive.colors.components, 3);		//alpha is not used
+
+			if (list[i]["indices"].type() != Json::NONE) {
+				if (!ReadAccessor(root, list[i]["indices"].Int(), primitive.indices) || primitive.indices.components != 1
+					|| (primitive.indices.componentType != GL_UNSIGNED_BYTE && primitive.indices.componentType != GL_UNSIGNED_SHORT
+						&& primitive.indices.componentType != GL_UNSIGNED_INT)) {
+					skipped++;
+					continue;
+				}
+				primitive.indexCount = primitive.indices.count;
+			}
+			else {
+				primitive.indexCount = primitive.vertexCount;
+			}
+			primitive.indexCount -= primitive.indexCount % 3;
+			if (primitive.vertexCount == 0 || primitive.indexCount == 0)
+				continue;
+
+			const int material = list[i]["material"].Int();
+			primitive.material = (material >= 0 && size_t(material) < materials.size()) ? material : -1;
+			if (primitive.normals.count == 0 || primitive.tangents.count == 0)
+				GenerateAttributes(primitive);
+
+			meshPrimitives[m].push_back(int(primitives.size()));
+			primitives.push_back(std::move(primitive));
+		}
+	}
+	if (skipped > 0)
+		warnlog("glTF '%s': %zu primitive(s) skipped (not triangles, sparse or external buffers).\n", filepath, skipped);
+
+	//nodes of the default scene, or all root nodes (all meshes) when the file has none
+	const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	const Json& nodes = root["nodes"];
+	const Json& scene = root["scenes"][size_t(root["scene"].Int(0))];
+	if (scene.type() == Json::OBJECT) {
+		for (size_t i = 0; i < scene["nodes"].size(); i++)
+			ReadNode(root, scene["nodes"][i].Int(), identity, 0);
+	}
+	else if (nodes.size() > 0) {
+		std::vector<bool> isChild(nodes.size(), false);
+		for (size_t n = 0; n < nodes.size(); n++)
+			for (size_t c = 0; c < nodes[n]["children"].size(); c++) {
+				const int child = nodes[n]["children"][c].Int();
+				if (child >= 0 && size_t(child) < nodes.size())
+					isChild[child] = true;
+			}
+		for (size_t n = 0; n < nodes.size(); n++)
+			if (!isChild[n])
+				ReadNode(root, int(n), identity, 0);
+	}
+	else {
+		Json node;
+		for (size_t m = 0; m < meshes.size(); m++) {
+			const std::string text = "{\"nodes\":[{\"mesh\":" + std::to_string(m) + "}]}";
+			const char* q = text.c_str();
+			if (Json::Parse(q, q + text.size(), node))
+				ReadNode(node, 0, identity, 0);
+			node = Json();
+		}
+	}
+	meshPrimitives.clear();
+
+	if (vertexCount > INT32_MAX || indexCount > INT32_MAX) {
+		errlog("glTF '%s' is too large (more than %d vertices or indices).\n", filepath, INT32_MAX);
+		return false;
+	}
+	errlog("glTF '%s': %zu primitive(s) in %zu instance(s), %zu vertices, %zu indices, %zu material(s), %zu image(s).\n", filepath,
+		   primitives.size(), instances.size(), vertexCount, indexCount, materials.size(), images.size());
+	return !instances.empty();
+}
+
+bool GLBModel::ReadAccessor(const Json& json, int index, Accessor& accessor) const {
+	const Json& a = json["accessors"][size_t(index)];
+	if (index < 0 || a.type() != Json::OBJECT || a["sparse"].type() != Json::NONE)
+		return false;
+	const Json& view = json["bufferViews"][size_t(a["bufferView"].Int())];
+	const Json& buffer = json["buffers"][size_t(view["buffer"].Int())];
+	if (view.type() != Json::OBJECT || view["buffer"].Int() != 0 || buffer["uri"].type() != Json::NONE || bin == nullptr)
+		return false;
+
+	static const std::pair<const char*, int> TYPES[] = { { "SCALAR", 1 }, { "VEC2", 2 }, { "VEC3", 3 }, { "VEC4", 4 } };
+	accessor.components = 0;
+	for (const auto& type : TYPES)
+		if (a["type"].String() == type.first)
+			accessor.components = type.second;
+	accessor.componentType = a["componentType"].Int(0);
+	size_t componentSize = 0;
+	switch (accessor.componentType) {
+		case GL_BYTE: case GL_UNSIGNED_BYTE: componentSize = 1; break;
+		case GL_SHORT: case GL_UNSIGNED_SHORT: componentSize = 2; break;
+		case GL_UNSIGNED_INT: case GL_FLOAT: componentSize = 4; break;
+	}
+	if (accessor.components == 0 || componentSize == 0)
+		return false;
+
+	//the whole accessor has to lie inside its view & the binary chunk
+	const size_t elementSize = componentSize * accessor.components;
+	const size_t viewOffset = size_t(view["byteOffset"].Number(0.0));
+	const size_t viewLength = size_t(view["byteLength"].Number(0.0));
+	const size_t offset = size_t(a["byteOffset"].Number(0.0));
+	accessor.count = size_t(a["count"].Number(0.0));
+	accessor.stride = size_t(view["byteStride"].Number(0.0));
+	if (accessor.stride == 0)
+		accessor.stride = elementSize;
+	accessor.normalized = a["normalized"].Bool();
+	if (viewOffset > binSize || viewLength > binSize - viewOffset || offset > viewLength || accessor.stride < elementSize
+		|| (accessor.count > 0 && (accessor.count - 1 > (viewLength - offset) / accessor.stride
+								   || (accessor.count - 1) * accessor.stride + elementSize > viewLength - offset)))
+		return false;
+	accessor.data = bin + viewOffset + offset;
+	return true;
+}
+
+bool GLBModel::ReadMaterials(const Json& json) {
+	const Json& list = json["materials"];
+	materials.assign(list.size(), MaterialDesc());
+	for (size_t i = 0; i < list.size(); i++) {
+		const Json& m = list[i];
+		const Json& pbr = m["pbrMetallicRoughness"];
+		MaterialDesc& desc = materials[i];
+		desc.name = m["name"].String().empty() ? "material_" + std::to_string(i) : m["name"].String();
+		for (int c = 0; c < 4; c++)
+			desc.baseColor[c] = float(pbr["baseColorFactor"][c].Number(1.0));
+		desc.metallic = float(pbr["metallicFactor"].Number(1.0));
+		desc.roughness = float(pbr["roughnessFactor"].Number(1.0));
+		desc.ior = float(m["extensions"]["KHR_materials_ior"]["ior"].Number(1.5));
+		desc.occlusionStrength = float(m["occlusionTexture"]["strength"].Number(1.0));
+		desc.baseColorTexture = pbr["baseColorTexture"]["index"].Int();
+		desc.metallicRoughnessTexture = pbr["metallicRoughnessTexture"]["index"].Int();
+		desc.normalTexture = m["normalTexture"]["index"].Int();
+		desc.occlusionTexture = m["occlusionTexture"]["index"].Int();
+	}
+	return true;
+}
+
+//Column major 4x4 matrices as stored in the file.
+static void MultiplyMatrices(const float* a, const float* b, float* result) {
+	for (int c = 0; c < 4; c++)
+		for (int r = 0; r < 4; r++) {
+			float sum = 0.0f;
+			for (int k = 0; k < 4; k++)
+				sum += a[k * 4 + r] * b[c * 4 + k];
+			result[c * 4 + r] = sum;
+		}
+}
+
+void GLBModel::ReadNode(const Json& json, int index, const float* parent, int depth) {
+	const Json& node = json["nodes"][size_t(index)];
+	if (index < 0 || node.type() != Json::OBJECT || depth > MAX_DEPTH)
+		return;
+
+	//local transform as a matrix, or translation * rotation * scale
+	float local[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	if (node["matrix"].size() == 16) {
+		for (int i = 0; i < 16; i++)
+			local[i] = float(node["matrix"][i].Number(0.0));
+	}
+	else {
+		const Json& t = node["translation"];
+		const Json& r = node["rotation"];
+		const Json& s = node["scale"];
+		const float x = float(r[0].Number(0.0)), y = float(r[1].Number(0.0)), z = float(r[2].Number(0.0)), w = float(r[3].Number(1.0));
+		const float rotation[9] = {
+			1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w),
+			2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+			2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y) };
+		for (int c = 0; c < 3; c++) {
+			const float scale = float(s[c].Number(1.0));
+			for (int row = 0; row < 3; row++)
+				local[c * 4 + row] = rotation[c * 3 + row] * scale;
+			local[12 + c] = float(t[c].Number(0.0));
+		}
+	}
+	float world[16];
+	MultiplyMatrices(parent, local, world);
+
+	const int mesh = node["mesh"].Int();
+	if (mesh >= 0 && size_t(mesh) < meshPrimitives.size()) {
+		Instance instance;
+		for (int c = 0; c < 3; c++)
+			instance.axes[c] = Vector3(world[c * 4], world[c * 4 + 1], world[c * 4 + 2]);
+		instance.translation = Vector3(world[12], world[13], world[14]);
+		const float det = instance.axes[0].DotProduct(instance.axes[1].CrossProduct(instance.axes[2]));
+		const float sign = det < 0.0f ? -1.0f : 1.0f;
+		instance.normalAxes[0] = instance.axes[1].CrossProduct(instance.axes[2]) * sign;
+		instance.normalAxes[1] = instance.axes[2].CrossProduct(instance.axes[0]) * sign;
+		instance.normalAxes[2] = instance.axes[0].CrossProduct(instance.axes[1]) * sign;
+		instance.identity = true;
+		for (int i = 0; i < 16; i++)
+			instance.identity = instance.identity && world[i] == ((i % 5 == 0) ? 1.0f : 0.0f);
+		instance.mirrored = det < 0.0f;
+
+		for (int p : meshPrimitives[mesh]) {
+			const Primitive& primitive = primitives[p];
+			instance.primitive = size_t(p);
+			instance.material = primitive.material >= 0 ? primitive.material : int(materials.size());
+			needsDefaultMaterial = needsDefaultMaterial || primitive.material < 0;
+			instance.firstVertex = vertexCount;
+			instance.firstIndex = indexCount;
+			instances.push_back(instance);
+			vertexCount += primitive.vertexCount;
+			indexCount += primitive.indexCount;
+		}
+	}
+
+	for (size_t c = 0; c < node["children"].size(); c++)
+		ReadNode(json, node["children"][c].Int(), world, depth + 1);
+}
+
+void GLBModel::GenerateAttributes(Primitive& primitive) const {
+	const size_t n = primitive.vertexCount;
+	std::vector<uint32_t> indices(primitive.indexCount);
+	for (size_t i = 0; i < indices.size(); i++)
+		indices[i] = primitive.indices.count ? std::min<uint32_t>(primitive.indices.Index(i), uint32_t(n - 1)) : uint32_t(i);
+
+	std::vector<Vertex> vertices(n);
+	for (size_t i = 0; i < n; i++) {
+		float v[3] = { 0.0f, 0.0f, 0.0f };
+		primitive.positions.Read(i, v);
+		vertices[i].position = Vector3(v);
+		v[0] = v[1] = 0.0f;
+		if (primitive.uvs.count)
+			primitive.uvs.Read(i, v);
+		vertices[i].texture_coords[0] = { v[0], 1.0f - v[1] };		//as in CopyVertices, before the tangents are generated
+		if (primitive.normals.count) {
+			primitive.normals.Read(i, v);
+			vertices[i].normal = Vector3(v);
+		}
+	}
+
+	//area weighted normals of the triangles sharing a vertex
+	if (primitive.normals.count == 0) {
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			Vertex& a = vertices[indices[i]];
+			Vertex& b = vertices[indices[i + 1]];
+			Vertex& c = vertices[indices[i + 2]];
+			const Vector3 normal = (b.position - a.position).CrossProduct(c.position - a.position);
+			a.normal += normal;
+			b.normal += normal;
+			c.normal += normal;
+		}
+		primitive.generatedNormals.resize(n);
+		for (size_t i = 0; i < n; i++) {
+			if (vertices[i].normal.SqrL2Norm() == 0.0f)
+				vertices[i].normal = Vector3(0.0f, 0.0f, 1.0f);
+			primitive.generatedNormals[i] = vertices[i].normal.Normalize();
+		}
+	}
+
+	if (primitive.tangents.count == 0) {
+		GenerateTangents(vertices.data(), n, indices.data(), indices.size());
+		primitive.generatedTangents.resize(n);
+		for (size_t i = 0; i < n; i++)
+			primitive.generatedTangents[i] = Tangent{ vertices[i].tangent, vertices[i].handedness };
+	}
+}
+
+//================================= Materials =================================
+
+static FIBITMAP* ConvertTo24(FIBITMAP* dib) {
+	if (dib == nullptr)
+		return nullptr;
+	FIBITMAP* converted = FreeImage_ConvertTo24Bits(dib);
+	FreeImage_Unload(dib);
+	return converted;
+}
+
+static inline BYTE ToByte(float value) {
+	return BYTE(std::min(std::max(value, 0.0f), 255.0f) + 0.5f);
+}
+
+std::function<FIBITMAP*(int&, int&)> GLBModel::ImageSource(int texture) const {
+	if (texture < 0 || size_t(texture) >= textureImages.size() || textureImages[texture] < 0)
+		return nullptr;
+	const int image = textureImages[texture];
+	if (!imageUris[image].empty()) {
+		const std::string path = imageUris[image];
+		return [path](int& width, int& height) { return BitmapFromFile(path.c_str(), width, height); };
+	}
+	if (imageViews[image].second == 0)
+		return nullptr;
+	//the mapping lives as long as the texture isn't loaded
+	const std::shared_ptr<MappedFile> mapping = file;
+	const char* data = bin + imageViews[image].first;
+	const size_t size = imageViews[image].second;
+	return [mapping, data, size](int& width, int& height) { return BitmapFromMemory(data, size, width, height); };
+}
+
+//Base color image multiplied by the factor of the material (the shaders use the texture alone).
+static FIBITMAP* TintedImage(const std::function<FIBITMAP*(int&, int&)>& source, const float* factor, int& width, int& height) {
+	FIBITMAP* dib = ConvertTo24(source(width, height));
+	if (dib == nullptr)
+		return nullptr;
+	for (int y = 0; y < height; y++) {
+		BYTE* row = FreeImage_GetScanLine(dib, y);
+		for (int x = 0; x < width; x++) {
+			row[3 * x + FI_RGBA_RED] = ToByte(row[3 * x + FI_RGBA_RED] * factor[0]);
+			row[3 * x + FI_RGBA_GREEN] = ToByte(row[3 * x + FI_RGBA_GREEN] * factor[1]);
+			row[3 * x + FI_RGBA_BLUE] = ToByte(row[3 * x + FI_RGBA_BLUE] * factor[2]);
+		}
+	}
+	return dib;
+}
+
+//RMA map of GLMaterial (roughness, metalness, ambient occlusion) made of the glTF metallic-roughness image (roughness in green,
+//metalness in blue, occlusion in red when packed together) and the occlusion image (red), with the factors of the material.
+static FIBITMAP* ComposeRMA(const std::function<FIBITMAP*(int&, int&)>& metallicRoughnessSource,
+							const std::function<FIBITMAP*(int&, int&)>& occlusionSource, bool packedOcclusion,
+							float roughness, float metallic, float occlusionStrength, int& width, int& height) {
+	int w = 0, h = 0;
+	FIBITMAP* mr = metallicRoughnessSource ? ConvertTo24(metallicRoughnessSource(width, height)) : nullptr;
+	FIBITMAP* occlusion = occlusionSource ? ConvertTo24(occlusionSource(w, h)) : nullptr;
+	if (mr == nullptr && occlusion == nullptr)
+		return nullptr;
+	if (mr == nullptr) {
+		width = w;
+		height = h;
+	}
+	else if (occlusion && (w != width || h != height)) {
+		FIBITMAP* scaled = FreeImage_Rescale(occlusion, width, height, FILTER_BILINEAR);
+		FreeImage_Unload(occlusion);
+		occlusion = scaled;
+	}
+
+	FIBITMAP* rma = FreeImage_Allocate(width, height, 24);
+	for (int y = 0; y < height && rma; y++) {
+		BYTE* out = FreeImage_GetScanLine(rma, y);
+		const BYTE* m = mr ? FreeImage_GetScanLine(mr, y) : nullptr;
+		const BYTE* o = occlusion ? FreeImage_GetScanLine(occlusion, y) : nullptr;
+		for (int x = 0; x < width; x++) {
+			const float ao = o ? o[3 * x + FI_RGBA_RED] : (m && packedOcclusion) ? m[3 * x + FI_RGBA_RED] : 255.0f;
+			out[3 * x + FI_RGBA_RED] = ToByte((m ? m[3 * x + FI_RGBA_GREEN] : 255.0f) * roughness);
+			out[3 * x + FI_RGBA_GREEN] = ToByte((m ? m[3 * x + FI_RGBA_BLUE] : 255.0f) * metallic);
+			out[3 * x + FI_RGBA_BLUE] = ToByte(255.0f + occlusionStrength * (ao - 255.0f));
+		}
+	}
+	if (mr)
+		FreeImage_Unload(mr);
+	if (occlusion)
+		FreeImage_Unload(occlusion);
+	return rma;
+}
+
+void GLBModel::LoadMaterials(std::vector<Material*>& result, std::vector<Texture3u*>* pendingTextures, Arena* arena) const {
+	//textures are shared by materials using the same images the same way
+	std::map<std::string, Texture3u*> created;
+	std::vector<Texture3u*> deferred;
+	const auto texture = [&](const std::string& key, std::function<FIBITMAP*(int&, int&)> source) -> Texture3u* {
+		const auto it = created.find(key);
+		if (it != created.end())
+			return it->second;
+		Texture3u* t = ArenaNew<Texture3u>(arena, name + "#" + key, std::move(source), true);
+		deferred.push_back(t);
+		created[key] = t;
+		return t;
+	};
+
+	for (const MaterialDesc& desc : materials) {
+		Material* material = ArenaNew<Material>(arena);
+		material->set_name(desc.name.c_str());
+		material->set_shader(Shader::PBR);
+		material->diffuse_ = Color3f({ desc.baseColor[0], desc.baseColor[1], desc.baseColor[2] });
+		material->roughness_ = desc.roughness;
+		material->metallicness = desc.metallic;
+		material->ior = desc.ior;
+
+		const auto baseColor = ImageSource(desc.baseColorTexture);
+		if (baseColor) {
+			const bool white = desc.baseColor[0] == 1.0f && desc.baseColor[1] == 1.0f && desc.baseColor[2] == 1.0f;
+			char key[96];
+			snprintf(key, sizeof(key), white ? "base%d" : "base%d*%g,%g,%g", desc.baseColorTexture, desc.baseColor[0], desc.baseColor[1], desc.baseColor[2]);
+			const float factor[3] = { desc.baseColor[0], desc.baseColor[1], desc.baseColor[2] };
+			material->set_texture(Material::kDiffuseMapSlot, white ? texture(key, baseColor) : texture(key, [=](int& width, int& height) {
+				return TintedImage(baseColor, factor, width, height);
+			}));
+		}
+
+		const bool packedOcclusion = desc.occlusionTexture >= 0 && desc.occlusionTexture == desc.metallicRoughnessTexture;
+		const auto metallicRoughness = ImageSource(desc.metallicRoughnessTexture);
+		const auto occlusion = packedOcclusion ? nullptr : ImageSource(desc.occlusionTexture);
+		if (metallicRoughness || occlusion) {
+			char key[128];
+			snprintf(key, sizeof(key), "rma%d,%d*%g,%g,%g%s", desc.metallicRoughnessTexture, desc.occlusionTexture, desc.roughness,
+					 desc.metallic, desc.occlusionStrength, packedOcclusion ? "p" : "");
+			const float roughness = desc.roughness, metallic = desc.metallic, strength = desc.occlusionStrength;
+			material->set_texture(Material::kRMAMapSlot, texture(key, [=](int& width, int& height) {
+				return ComposeRMA(metallicRoughness, occlusion, packedOcclusion, roughness, metallic, strength, width, height);
+			}));
+		}
+
+		const auto normal = ImageSource(desc.normalTexture);
+		if (normal)
+			material->set_texture(Material::kNormalMapSlot, texture("normal" + std::to_string(desc.normalTexture), normal));
+
+		result.push_back(material);
+	}
+
+	if (needsDefaultMaterial) {
+		Material* material = ArenaNew<Material>(arena);
+		material->set_shader(Shader::PBR);
+		material->ior = 1.5f;
+		result.push_back(material);
+	}
+
+	if (pendingTextures)
+		pendingTextures->insert(pendingTextures->end(), deferred.begin(), deferred.end());
+	else
+		LoadTextures(deferred);
+}
+
+void GLBModel::LoadMeshes(std::vector<Mesh>& meshes, const std::vector<Material*>& loaded) const {
+	for (const Instance& instance : instances) {
+		const Primitive& primitive = primitives[instance.primitive];
+		meshes.push_back(Mesh(int(instance.firstIndex), int(primitive.indexCount), loaded[instance.material]));
+
+		//positions as CopyVertices transforms them
+		Mesh& mesh = meshes.back();
+		const Vector3* a = instance.axes;
+		for (size_t v = 0; v < primitive.vertexCount; v++) {
+			float value[3] = { 0.0f, 0.0f, 0.0f };
+			primitive.positions.Read(v, value);
+			const Vector3 p(value);
+			mesh.Extend(instance.identity ? p : a[0] * p.x + a[1] * p.y + a[2] * p.z + instance.translation);
+		}
+	}
+}
+
+//================================= Buffers =================================
+
+void GLBModel::CopyVertices(size_t first, size_t count, Vertex* destination) const {
+	//instance containing the first vertex
+	auto instance = std::upper_bound(instances.begin(), instances.end(), first,
+									 [](size_t i, const Instance& instance) { return i < instance.firstVertex; }) - 1;
+
+	for (size_t i = first; i < first + count; instance++) {
+		const Primitive& primitive = primitives[instance->primitive];
+		const size_t begin = i - instance->firstVertex;
+		const size_t end = std::min(primitive.vertexCount, first + count - instance->firstVertex);
+
+		for (size_t v = begin; v < end; v++, i++) {
+			Vertex vertex;
+			float value[3] = { 0.0f, 0.0f, 0.0f };
+			primitive.positions.Read(v, value);
+			vertex.position = Vector3(value);
+
+			if (primitive.normals.count) {
+				primitive.normals.Read(v, value);
+				vertex.normal = Vector3(value);
+			}
+			else {
+				vertex.normal = primitive.generatedNormals[v];
+			}
+
+			if (primitive.tangents.count) {
+				float tangent[4];
+				primitive.tangents.Read(v, tangent);
+				vertex.tangent = Vector3(tangent);
+				vertex.handedness = (tangent[3] < 0.0f) ? -1.0f : 1.0f;
+			}
+			else {
+				vertex.tangent = primitive.generatedTangents[v].direction;
+				vertex.handedness = primitive.generatedTangents[v].handedness;
+			}
+
+			//the origin of glTF texture coordinates is the top left corner, the shaders expect the bottom left one (as in OBJ)
+			value[0] = value[1] = 0.0f;
+			if (primitive.uvs.count)
+				primitive.uvs.Read(v, value);
+			vertex.texture_coords[0] = { value[0], 1.0f - value[1] };
+
+			//LoadOBJ's default color
+			value[0] = value[1] = value[2] = 0.5f;
+			if (primitive.colors.count)
+				primitive.colors.Read(v, value);
+			vertex.color = Vector3(value);
+
+			if (!instance->identity) {
+				const Vector3* a = instance->axes;
+				const Vector3* n = instance->normalAxes;
+				const Vector3 p = vertex.position, normal = vertex.normal, tangent = vertex.tangent;
+				vertex.position = a[0] * p.x + a[1] * p.y + a[2] * p.z + instance->translation;
+				vertex.normal = (n[0] * normal.x + n[1] * normal.y + n[2] * normal.z).Normalize();
+				vertex.tangent = (a[0] * tangent.x + a[1] * tangent.y + a[2] * tangent.z).Normalize();
+				//the transformed N x T turns around with the winding
+				if (instance->mirrored)
+					vertex.handedness = -vertex.handedness;
+			}
+			vertex.matIdx = instance->material;
+
+			destination[i - first] = vertex;
+		}
+	}
+}
+
+void GLBModel::CopyIndices(size_t first, size_t count, void* destination) const {
+	auto instance = std::upper_bound(instances.begin(), instances.end(), first,
+									 [](size_t i, const Instance& instance) { return i < instance.firstIndex; }) - 1;
+	const bool shortIndices = (IndexType() == GL_UNSIGNED_SHORT);
+
+	for (size_t i = first; i < first + count; instance++) {
+		const Primitive& primitive = primitives[instance->primitive];
+		const size_t begin = i - instance->firstIndex;
+		const size_t end = std::min(primitive.indexCount, first + count - instance->firstIndex);
+		const uint32_t last = uint32_t(primitive.vertexCount - 1);
+
+		for (size_t k = begin; k < end; k++, i++) {
+			//mirrored instances swap the last two corners of every triangle
+			const size_t corner = k % 3;
+			const size_t source = (instance->mirrored && corner != 0) ? k - corner + 3 - corner : k;
+			const uint32_t index = primitive.indices.count ? std::min(primitive.indices.Index(source), last) : uint32_t(source);
+			const uint32_t value = uint32_t(instance->firstVertex) + index;
+			if (shortIndices)
+				static_cast<uint16_t*>(destination)[i - first] = uint16_t(value);
+			else
+				static_cast<uint32_t*>(destination)[i - first] = value;
+		}
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "mappedfile.h"
+#include "texture.h"
+
+class Mesh;
+class Material;
+class Arena;
+struct Vertex;
+
+//extension of binary glTF models (see GLBModel)
+constexpr const char* GLB_EXTENSION = ".glb";
+
+//Binary glTF 2.0 model. Only the JSON chunk is parsed, vertex attributes & indices stay in the buffer views of the mapped
+//file and are converted straight into the final buffers (see CopyVertices & CopyIndices), like a mesh asset.
+//Every triangle primitive of every node of the default scene becomes one mesh with its own range of vertices (node transforms
+//are applied, meshes used by several nodes are repeated). Missing normals and tangents are generated per primitive, the w of
+//supplied tangents becomes Vertex::handedness. Texture coordinates are flipped to the bottom left origin of OBJ models.
+//Metallic-roughness materials are mapped onto Material: base color -> diffuse, metallic-roughness & occlusion -> RMA texture
+//(roughness, metalness, ao), normal texture -> normal map. Images are decoded from the buffer views or files next to the model.
+class GLBModel {
+public:
+	GLBModel();
+	~GLBModel();
+
+	//copy deleted
+	GLBModel(const GLBModel&) = delete;
+	GLBModel& operator=(const GLBModel&) = delete;
+
+	//Maps the file and reads its structure, fails on anything else than a valid glTF 2.0 binary.
+	bool Open(const char* filepath);
+	static bool IsGLB(const char* path);
+
+	inline size_t VertexCount() const { return vertexCount; }
+	inline size_t IndexCount() const { return indexCount; }
+	//Smallest GL index type able to address all vertices (as IndexedGeometry::IndexType).
+	GLenum IndexType() const;
+
+	//Creates the materials (plus a default one when a primitive has none), textures are decoded right away unless
+	//pendingTextures is given. Materials & textures are created in arena when given, otherwise the caller owns them.
+	//Deferred textures keep the file mapped until they are loaded.
+	void LoadMaterials(std::vector<Material*>& materials, std::vector<Texture3u*>* pendingTextures = nullptr, Arena* arena = nullptr) const;
+	void LoadMeshes(std::vector<Mesh>& meshes, const std::vector<Material*>& materials) const;
+
+	//Writes vertices [first, first + count) into destination (meant for write-only mapped memory).
+	void CopyVertices(size_t first, size_t count, Vertex* destination) const;
+	//Writes indices [first, first + count) in IndexType() into destination, out of range indices are clamped.
+	void CopyIndices(size_t first, size_t count, void* destination) const;
+private:
+	struct Accessor;
+	struct Primitive;
+	struct Instance;
+	struct MaterialDesc;
+	class Json;
+
+	bool ReadAccessor(const Json& json, int index, Accessor& accessor) const;
+	bool ReadMaterials(const Json& json);
+	void ReadNode(const Json& json, int node, const float* parent, int depth);
+	void GenerateAttributes(Primitive& primitive) const;
+	//Function decoding the image of given glTF texture, nullptr when it has none.
+	std::function<FIBITMAP*(int&, int&)> ImageSource(int texture) const;
+private:
+	std::shared_ptr<MappedFile> file;		//shared with the deferred textures
+	std::string directory;					//of the model, for external images
+	std::string name;
+	const char* bin = nullptr;				//binary chunk
+	size_t binSize = 0;
+
+	std::vector<Primitive> primitives;
+	std::vector<std::vector<int>> meshPrimitives;	//primitives of every glTF mesh
+	std::vector<Instance> instances;		//in scene order, consecutive vertex & index ranges
+	std::vector<MaterialDesc> materials;
+	std::vector<std::string> imageUris;		//empty for images in buffer views
+	std::vector<std::pair<size_t, size_t>> imageViews;	//offset & size in the binary chunk
+	std::vector<int> textureImages;			//image of every glTF texture, -1 = none
+
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	bool needsDefaultMaterial = false;
+};
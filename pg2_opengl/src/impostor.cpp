@@ -0,0 +1,302 @@
+#include "pch.h"
+#include "impostor.h"
+
+#include <filesystem>
+#include <cfloat>
+
+#include "log.h"
+#include "parallel.h"
+#include "surface.h"
+#include "mappedfile.h"
+
+namespace fs = std::filesystem;
+
+constexpr uint32_t IMPOSTOR_VERSION = 1;
+constexpr char IMPOSTOR_MAGIC[4] = { 'P', 'G', '2', 'I' };
+//largest atlas side, meshes which don't fit get no impostor
+constexpr int MAX_ATLAS_SIZE = 16384;
+//passes repeating covered texels into their empty neighbors
+constexpr int DILATION_PASSES = 2;
+
+struct ImpostorHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t grid;
+	uint32_t cellSize;
+	uint32_t meshCount;
+	uint32_t tilesPerRow;
+	uint32_t width;
+	uint32_t height;
+};
+
+static void RenderView(Surface* surface, const ImpostorBounds& bounds, const Vector3& direction, int cellSize,
+					   uint32_t* albedo, uint32_t* normalDepth, int stride);
+static void Dilate(uint32_t* albedo, uint32_t* normalDepth, int cellSize, int stride);
+
+static inline uint32_t PackRGBA(float r, float g, float b, float a) {
+	auto byte = [](float x) { return uint32_t(std::clamp(x, 0.0f, 1.0f) * 255.0f + 0.5f); };
+	return byte(r) | (byte(g) << 8) | (byte(b) << 16) | (byte(a) << 24);
+}
+
+//================================= Octahedral map =================================
+
+Coord2f OctahedronEncode(const Vector3& d) {
+	const float sum = fabsf(d.x) + fabsf(d.y) + fabsf(d.z);
+	float u = d.x / sum, v = d.y / sum;
+	if (d.z < 0.0f) {
+		const float fu = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		const float fv = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = fu;
+		v = fv;
+	}
+	return { u * 0.5f + 0.5f, v * 0.5f + 0.5f };
+}
+
+Vector3 OctahedronDecode(const Coord2f& e) {
+	const float u = e.u * 2.0f - 1.0f, v = e.v * 2.0f - 1.0f;
+	Vector3 d(u, v, 1.0f - fabsf(u) - fabsf(v));
+	if (d.z < 0.0f) {
+		d.x = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		d.y = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+	}
+	return d.normalized();
+}
+
+void ImpostorBasis(const Vector3& direction, Vector3& right, Vector3& up) {
+	const Vector3 reference = (fabsf(direction.z) < 0.999f) ? Vector3(0.0f, 0.0f, 1.0f) : Vector3(0.0f, 1.0f, 0.0f);
+	right = reference.CrossProduct(direction).normalized();
+	up = direction.CrossProduct(right);
+}
+
+//================================= Baking =================================
+
+ImpostorAtlas BakeImpostors(const std::vector<Surface*>& surfaces, int no_threads) {
+	ImpostorAtlas atlas;
+	const int tile = atlas.TileSize();
+	const int meshCount = int(surfaces.size());
+	const int maxTilesPerRow = MAX_ATLAS_SIZE / tile;
+	atlas.tilesPerRow = std::clamp(int(ceilf(sqrtf(float(meshCount)))), 1, maxTilesPerRow);
+	const int rows = std::min((meshCount + atlas.tilesPerRow - 1) / atlas.tilesPerRow, maxTilesPerRow);
+	atlas.width = atlas.tilesPerRow * tile;
+	atlas.height = std::max(rows, 1) * tile;
+	if (meshCount > atlas.tilesPerRow * rows)
+		warnlog("Impostors: %d of %d meshes don't fit the atlas.\n", meshCount - atlas.tilesPerRow * rows, meshCount);
+
+	//bounding spheres around the centers of the bounding boxes
+	atlas.meshes.resize(meshCount);
+	for (int m = 0; m < meshCount; m++) {
+		ImpostorBounds& bounds = atlas.meshes[m];
+		bounds = {};
+		Surface* surface = surfaces[m];
+		if (m >= atlas.tilesPerRow * rows || surface->no_triangles() == 0)
+			continue;
+		Vector3 lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (int t = 0; t < surface->no_triangles(); t++)
+			for (int c = 0; c < 3; c++) {
+				const Vector3& p = surface->get_triangle(t)[c].position;
+				lo = Vector3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+				hi = Vector3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+			}
+		const Vector3 center = (lo + hi) * 0.5f;
+		float radius = 0.0f;
+		for (int t = 0; t < surface->no_triangles(); t++)
+			for (int c = 0; c < 3; c++)
+				radius = std::max(radius, (surface->get_triangle(t)[c].position - center).L2Norm());
+		bounds = { { center.x, center.y, center.z }, radius };
+	}
+
+	//every view is a job of its own, views write disjoint cells
+	atlas.albedo.assign(size_t(atlas.width) * atlas.height, 0);
+	atlas.normalDepth.assign(size_t(atlas.width) * atlas.height, 0);
+	const int views = atlas.grid * atlas.grid;
+	ParallelFor(meshCount * views, no_threads, [&](int job) {
+		const int m = job / views, cell = job % views;
+		const ImpostorBounds& bounds = atlas.meshes[m];
+		if (!(bounds.radius > 0.0f))
+			return;
+		const int cx = cell % atlas.grid, cy = cell / atlas.grid;
+		const Vector3 direction = OctahedronDecode({ (cx + 0.5f) / atlas.grid, (cy + 0.5f) / atlas.grid });
+		const size_t x = size_t(m % atlas.tilesPerRow) * tile + size_t(cx) * atlas.cellSize;
+		const size_t y = size_t(m / atlas.tilesPerRow) * tile + size_t(cy) * atlas.cellSize;
+		const size_t origin = y * atlas.width + x;
+		RenderView(surfaces[m], bounds, direction, atlas.cellSize, &atlas.albedo[origin], &atlas.normalDepth[origin], atlas.width);
+		Dilate(&atlas.albedo[origin], &atlas.normalDepth[origin], atlas.cellSize, atlas.width);
+	});
+	return atlas;
+}
+
+//Orthographic view of the surface against direction, the nearest fragment of every texel center wins (both sides are drawn).
+static void RenderView(Surface* surface, const ImpostorBounds& bounds, const Vector3& direction, int cellSize,
+					   uint32_t* albedo, uint32_t* normalDepth, int stride) {
+	const Material* material = surface->get_material();
+	const Texture3u* texture = material ? material->texture(Material::kDiffuseMapSlot) : nullptr;
+	if (texture && (texture->width() == 0 || texture->height() == 0))
+		texture = nullptr;
+	const Vector3 center(bounds.center);
+	Vector3 right, up;
+	ImpostorBasis(direction, right, up);
+
+	std::vector<float> depth(size_t(cellSize) * cellSize, -FLT_MAX);
+	for (int t = 0; t < surface->no_triangles(); t++) {
+		const Triangle& triangle = surface->get_triangle(t);
+		//texel coordinates & depth of the corners
+		float x[3], y[3], z[3];
+		for (int c = 0; c < 3; c++) {
+			const Vector3 p = triangle[c].position - center;
+			x[c] = (p.DotProduct(right) / bounds.radius + 1.0f) * 0.5f * cellSize;
+			y[c] = (p.DotProduct(up) / bounds.radius + 1.0f) * 0.5f * cellSize;
+			z[c] = p.DotProduct(direction) / bounds.radius;
+		}
+		const float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (fabsf(area) < 1e-12f)
+			continue;
+		const int x0 = std::max(int(floorf(std::min({ x[0], x[1], x[2] }))), 0), x1 = std::min(int(ceilf(std::max({ x[0], x[1], x[2] }))), cellSize - 1);
+		const int y0 = std::max(int(floorf(std::min({ y[0], y[1], y[2] }))), 0), y1 = std::min(int(ceilf(std::max({ y[0], y[1], y[2] }))), cellSize - 1);
+
+		for (int py = y0; py <= y1; py++)
+			for (int px = x0; px <= x1; px++) {
+				//barycentric coordinates of the texel center, the same sign as the area inside
+				const float sx = px + 0.5f, sy = py + 0.5f;
+				const float w0 = ((x[1] - sx) * (y[2] - sy) - (x[2] - sx) * (y[1] - sy)) / area;
+				const float w1 = ((x[2] - sx) * (y[0] - sy) - (x[0] - sx) * (y[2] - sy)) / area;
+				const float w2 = 1.0f - w0 - w1;
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+					continue;
+				const float d = w0 * z[0] + w1 * z[1] + w2 * z[2];
+				float& nearest = depth[size_t(py) * cellSize + px];
+				if (d <= nearest)
+					continue;
+				nearest = d;
+
+				//as ct_shader - diffuse texture (v flipped) or the flat color
+				Vector3 color = material ? Vector3(material->diffuse_.data.data()) : Vector3(0.5f, 0.5f, 0.5f);
+				if (texture) {
+					const float u = w0 * triangle[0].texture_coords[0].u + w1 * triangle[1].texture_coords[0].u + w2 * triangle[2].texture_coords[0].u;
+					const float v = 1.0f - (w0 * triangle[0].texture_coords[0].v + w1 * triangle[1].texture_coords[0].v + w2 * triangle[2].texture_coords[0].v);
+					const int tx = std::clamp(int((u - floorf(u)) * texture->width()), 0, texture->width() - 1);
+					const int ty = std::clamp(int((v - floorf(v)) * texture->height()), 0, texture->height() - 1);
+					const Color3u texel = texture->pixel(tx, ty);
+					color = Vector3(texel.data[2], texel.data[1], texel.data[0]) / 255.0f;		//BGR
+				}
+				Vector3 normal = triangle[0].normal * w0 + triangle[1].normal * w1 + triangle[2].normal * w2;
+				if (normal.SqrL2Norm() > 0.0f)
+					normal.Normalize();
+				if (normal.DotProduct(direction) < 0.0f)
+					normal = normal * -1.0f;
+
+				albedo[size_t(py) * stride + px] = PackRGBA(color.x, color.y, color.z, 1.0f);
+				normalDepth[size_t(py) * stride + px] = PackRGBA(normal.x * 0.5f + 0.5f, normal.y * 0.5f + 0.5f, normal.z * 0.5f + 0.5f, d * 0.5f + 0.5f);
+			}
+	}
+}
+
+//Empty texels take the mean of their covered (or already filled) neighbors, coverage stays 0.
+static void Dilate(uint32_t* albedo, uint32_t* normalDepth, int cellSize, int stride) {
+	std::vector<uint8_t> filled(size_t(cellSize) * cellSize);
+	for (int y = 0; y < cellSize; y++)
+		for (int x = 0; x < cellSize; x++)
+			filled[size_t(y) * cellSize + x] = (albedo[size_t(y) * stride + x] >> 24) != 0;
+
+	std::vector<uint8_t> next;
+	for (int pass = 0; pass < DILATION_PASSES; pass++) {
+		next = filled;
+		for (int y = 0; y < cellSize; y++)
+			for (int x = 0; x < cellSize; x++) {
+				if (filled[size_t(y) * cellSize + x])
+					continue;
+				uint32_t sum[2][4] = {};
+				uint32_t count = 0;
+				for (const auto& [dx, dy] : { std::pair{ -1, 0 }, std::pair{ 1, 0 }, std::pair{ 0, -1 }, std::pair{ 0, 1 } }) {
+					const int nx = x + dx, ny = y + dy;
+					if (nx < 0 || ny < 0 || nx >= cellSize || ny >= cellSize || !filled[size_t(ny) * cellSize + nx])
+						continue;
+					const uint32_t texels[2] = { albedo[size_t(ny) * stride + nx], normalDepth[size_t(ny) * stride + nx] };
+					for (int t = 0; t < 2; t++)
+						for (int c = 0; c < 4; c++)
+							sum[t][c] += (texels[t] >> (8 * c)) & 0xFF;
+					count++;
+				}
+				if (count == 0)
+					continue;
+				uint32_t texels[2] = {};
+				for (int t = 0; t < 2; t++)
+					for (int c = 0; c < 4; c++)
+						texels[t] |= ((sum[t][c] + count / 2) / count) << (8 * c);
+				albedo[size_t(y) * stride + x] = texels[0] & 0x00FFFFFFu;
+				normalDepth[size_t(y) * stride + x] = texels[1];
+				next[size_t(y) * cellSize + x] = 1;
+			}
+		filled.swap(next);
+	}
+}
+
+//================================= Files =================================
+
+std::string ImpostorPath(const char* scenePath) {
+	return fs::path(scenePath).replace_extension(IMPOSTOR_EXTENSION).string();
+}
+
+//Header, bounds of the meshes, albedo & normal-depth texels.
+bool WriteImpostors(const char* path, const ImpostorAtlas& atlas) {
+	const std::string tmpPath = std::string(path) + ".tmp";
+	FILE* file = fopen(tmpPath.c_str(), "wb");
+	if (file == nullptr) {
+		warnlog("Failed to write impostors '%s'.\n", path);
+		return false;
+	}
+
+	ImpostorHeader header = {};
+	memcpy(header.magic, IMPOSTOR_MAGIC, sizeof(IMPOSTOR_MAGIC));
+	header.version = IMPOSTOR_VERSION;
+	header.grid = atlas.grid;
+	header.cellSize = atlas.cellSize;
+	header.meshCount = uint32_t(atlas.meshes.size());
+	header.tilesPerRow = atlas.tilesPerRow;
+	header.width = atlas.width;
+	header.height = atlas.height;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(atlas.meshes.data(), sizeof(ImpostorBounds), atlas.meshes.size(), file) == atlas.meshes.size();
+	ok = ok && fwrite(atlas.albedo.data(), sizeof(uint32_t), atlas.albedo.size(), file) == atlas.albedo.size();
+	ok = ok && fwrite(atlas.normalDepth.data(), sizeof(uint32_t), atlas.normalDepth.size(), file) == atlas.normalDepth.size();
+	ok = (fclose(file) == 0) && ok;
+
+	std::error_code ec;
+	if (ok)
+		fs::rename(tmpPath, path, ec);
+	if (!ok || ec) {
+		fs::remove(tmpPath, ec);
+		warnlog("Failed to write impostors '%s'.\n", path);
+		return false;
+	}
+	return true;
+}
+
+bool ReadImpostors(const char* path, ImpostorAtlas& atlas) {
+	std::error_code ec;
+	if (!fs::exists(path, ec))
+		return false;
+	MappedFile file(path);
+	const ImpostorHeader* header = reinterpret_cast<const ImpostorHeader*>(file.Data());
+	if (!file.IsOpen() || file.Size() < sizeof(ImpostorHeader) || memcmp(header->magic, IMPOSTOR_MAGIC, sizeof(IMPOSTOR_MAGIC)) != 0
+		|| header->version != IMPOSTOR_VERSION) {
+		warnlog("Impostors '%s' are not valid, rebake them.\n", path);
+		return false;
+	}
+	const size_t texels = size_t(header->width) * header->height;
+	if (file.Size() != sizeof(ImpostorHeader) + header->meshCount * sizeof(ImpostorBounds) + 2 * texels * sizeof(uint32_t)) {
+		warnlog("Impostors '%s' are truncated.\n", path);
+		return false;
+	}
+
+	atlas.grid = int(header->grid);
+	atlas.cellSize = int(header->cellSize);
+	atlas.tilesPerRow = int(header->tilesPerRow);
+	atlas.width = int(header->width);
+	atlas.height = int(header->height);
+	const ImpostorBounds* bounds = reinterpret_cast<const ImpostorBounds*>(header + 1);
+	atlas.meshes.assign(bounds, bounds + header->meshCount);
+	const uint32_t* albedo = reinterpret_cast<const uint32_t*>(bounds + header->meshCount);
+	atlas.albedo.assign(albedo, albedo + texels);
+	atlas.normalDepth.assign(albedo + texels, albedo + 2 * texels);
+	return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "vector3.h"
+#include "structs.h"
+
+class Surface;
+
+//impostor atlas of a scene, next to the model (see ImpostorPath)
+constexpr const char* IMPOSTOR_EXTENSION = ".pg2impostor";
+//views of a mesh per side of the octahedral map
+constexpr int IMPOSTOR_GRID = 8;
+//texels of a view per side
+constexpr int IMPOSTOR_CELL = 64;
+//meshes smaller on screen (diameter of the bounding sphere, px) are drawn as impostors, their views are not magnified then
+constexpr float IMPOSTOR_PIXELS = float(IMPOSTOR_CELL);
+
+//Octahedral map of the unit sphere onto [0, 1]^2, as OctEncode of impostor.frag.
+Coord2f OctahedronEncode(const Vector3& direction);
+Vector3 OctahedronDecode(const Coord2f& e);
+//Axes of the view looking at the mesh against direction (as Basis of the impostor shaders), right x up x direction is right-handed.
+void ImpostorBasis(const Vector3& direction, Vector3& right, Vector3& up);
+
+//Bounding sphere of a mesh in object space, radius 0 = no impostor.
+struct ImpostorBounds {
+	float center[3];
+	float radius;
+};
+
+//Views of every mesh (one tile of IMPOSTOR_GRID x IMPOSTOR_GRID cells each, tilesPerRow per row) from the directions of the
+//octahedral map at the cell centers, rendered orthographically onto the plane through the center of the bounding sphere.
+//Texels are RGBA8 - albedo & coverage, object space normal (* 0.5 + 0.5, facing the view) & depth towards the view
+//(0.5 = the plane, 1 = the radius). Empty texels repeat their covered neighbors, so bilinear filtering doesn't darken edges.
+struct ImpostorAtlas {
+	int grid = IMPOSTOR_GRID;
+	int cellSize = IMPOSTOR_CELL;
+	int tilesPerRow = 0;
+	int width = 0;
+	int height = 0;
+	std::vector<ImpostorBounds> meshes;
+	std::vector<uint32_t> albedo;
+	std::vector<uint32_t> normalDepth;
+
+	inline int TileSize() const { return grid * cellSize; }
+};
+
+//Mesh drawn as an impostor (SSBO binding 4 of impostor.vert, std430).
+struct ImpostorInstance {
+	float sphere[4];		//bounding sphere in object space
+	float tile[4];			//origin & size of the tile of the mesh in the atlas (texture coordinates)
+};
+
+//Renders the surfaces (meshes of the scene in the same order, see MergeSurfaces) on the CPU, so baking needs no GL.
+//Textures of the materials have to be decoded.
+ImpostorAtlas BakeImpostors(const std::vector<Surface*>& surfaces, int no_threads = 0);
+
+std::string ImpostorPath(const char* scenePath);
+bool WriteImpostors(const char* path, const ImpostorAtlas& atlas);
+//Fails quietly when there is no atlas.
+bool ReadImpostors(const char* path, ImpostorAtlas& atlas);
@@ -0,0 +1,244 @@
+#include "pch.h"
+#include "instancing.h"
+
+#include <chrono>
+#include <cmath>
+#include <unordered_map>
+
+#include "log.h"
+#include "parallel.h"
+#include "surface.h"
+#include "mymath.h"
+
+//vertices spanning the frame are the first ones at least this far from the centroid (the x axis) or from the x axis (the y axis),
+//relative to the farthest ones, so small errors of the positions barely turn the frame
+constexpr double FRAME_LEVER = 0.5;
+//smallest cosine between a normal of a copy and the rotated one of the original
+constexpr double NORMAL_TOLERANCE = 0.999;
+
+//Orthonormal frame of a surface, vertices are compared in its coordinates (axes^T * (position - origin)).
+struct SurfaceFrame {
+	double origin[3];
+	double axes[3][3];		//x, y, z
+	double radius = 0.0;	//farthest vertex from the origin, 0 = no frame (empty, flat or a line)
+	uint64_t hash = 0;		//of the attributes a rigid transform keeps
+};
+
+static SurfaceFrame ComputeFrame(Surface* surface);
+static bool IsCopy(Surface* original, const SurfaceFrame& o, Surface* copy, const SurfaceFrame& c);
+static InstanceTransform CopyTransform(const SurfaceFrame& original, const SurfaceFrame& copy);
+
+static inline void Sub(const Vector3& p, const double origin[3], double d[3]) {
+	d[0] = p.x - origin[0];
+	d[1] = p.y - origin[1];
+	d[2] = p.z - origin[2];
+}
+
+static inline double Dot(const double a[3], const double b[3]) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void Canonical(const SurfaceFrame& f, const double d[3], double c[3]) {
+	for (int k = 0; k < 3; k++)
+		c[k] = Dot(f.axes[k], d);
+}
+
+size_t FindInstances(std::vector<Surface*>& surfaces, std::vector<int>& copies, std::vector<InstanceTransform>& transforms, int no_threads) {
+	auto start = std::chrono::high_resolution_clock::now();
+	const int n = static_cast<int>(surfaces.size());
+
+	std::vector<SurfaceFrame> frames(n);
+	ParallelFor(n, no_threads, [&](int i) { frames[i] = ComputeFrame(surfaces[i]); });
+
+	//candidates share the hash, they are compared in surface order, so the first one of every shape stays
+	std::unordered_map<uint64_t, std::vector<int>> buckets;
+	for (int i = 0; i < n; i++)
+		if (frames[i].radius > 0.0)
+			buckets[frames[i].hash].push_back(i);
+	std::vector<const std::vector<int>*> groups;
+	for (const auto& bucket : buckets)
+		if (bucket.second.size() > 1)
+			groups.push_back(&bucket.second);
+
+	std::vector<int> original(n, -1);
+	ParallelFor(static_cast<int>(groups.size()), no_threads, [&](int g) {
+		std::vector<int> originals;
+		for (int i : *groups[g]) {
+			for (int o : originals)
+				if (IsCopy(surfaces[o], frames[o], surfaces[i], frames[i])) {
+					original[i] = o;
+					break;
+				}
+			if (original[i] < 0)
+				originals.push_back(i);
+		}
+	});
+
+	std::vector<std::vector<int>> copyLists(n);
+	for (int i = 0; i < n; i++)
+		if (original[i] >= 0)
+			copyLists[original[i]].push_back(i);
+
+	std::vector<Surface*> kept;
+	size_t instanced = 0;
+	copies.clear();
+	transforms.clear();
+	for (int i = 0; i < n; i++) {
+		if (original[i] >= 0)
+			continue;
+		kept.push_back(surfaces[i]);
+		copies.push_back(static_cast<int>(copyLists[i].size()));
+		instanced += !copyLists[i].empty();
+		for (int c : copyLists[i])
+			transforms.push_back(CopyTransform(frames[i], frames[c]));
+	}
+	const size_t removed = surfaces.size() - kept.size();
+	surfaces.swap(kept);
+
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	errlog("Instancing: %zu of %d surfaces are copies of %zu others, %.3f s.\n", removed, n, instanced, elapsed.count());
+	return removed;
+}
+
+static SurfaceFrame ComputeFrame(Surface* surface) {
+	SurfaceFrame f = {};
+	const int count = surface->no_triangles();
+	const Triangle* triangles = surface->get_triangles();
+	if (count == 0)
+		return f;
+
+	//centroid of the vertices, it doesn't depend on the order of the triangles
+	double sum[3] = { 0.0, 0.0, 0.0 };
+	for (int t = 0; t < count; t++)
+		for (int v = 0; v < 3; v++) {
+			const Vector3& p = triangles[t][v].position;
+			sum[0] += p.x;
+			sum[1] += p.y;
+			sum[2] += p.z;
+		}
+	for (int k = 0; k < 3; k++)
+		f.origin[k] = sum[k] / (3.0 * count);
+
+	double d[3], farthest = 0.0;
+	for (int t = 0; t < count; t++)
+		for (int v = 0; v < 3; v++) {
+			Sub(triangles[t][v].position, f.origin, d);
+			farthest = std::max(farthest, Dot(d, d));
+		}
+	if (farthest <= 0.0)
+		return f;
+
+	//x towards the first vertex far from the centroid
+	double* x = f.axes[0];
+	for (int i = 0; i < 3 * count; i++) {
+		Sub(triangles[i / 3][i % 3].position, f.origin, d);
+		if (Dot(d, d) >= FRAME_LEVER * FRAME_LEVER * farthest) {
+			const double length = sqrt(Dot(d, d));
+			for (int k = 0; k < 3; k++)
+				x[k] = d[k] / length;
+			break;
+		}
+	}
+
+	//y towards the first vertex far from the x axis
+	double widest = 0.0;
+	for (int i = 0; i < 3 * count; i++) {
+		Sub(triangles[i / 3][i % 3].position, f.origin, d);
+		widest = std::max(widest, Dot(d, d) - Dot(d, x) * Dot(d, x));
+	}
+	if (widest <= 1e-12 * farthest)
+		return f;
+	double* y = f.axes[1];
+	for (int i = 0; i < 3 * count; i++) {
+		Sub(triangles[i / 3][i % 3].position, f.origin, d);
+		const double along = Dot(d, x);
+		if (Dot(d, d) - along * along >= FRAME_LEVER * FRAME_LEVER * widest) {
+			for (int k = 0; k < 3; k++)
+				y[k] = d[k] - along * x[k];
+			const double length = sqrt(Dot(y, y));
+			for (int k = 0; k < 3; k++)
+				y[k] /= length;
+			break;
+		}
+	}
+	double* z = f.axes[2];
+	z[0] = x[1] * y[2] - x[2] * y[1];
+	z[1] = x[2] * y[0] - x[0] * y[2];
+	z[2] = x[0] * y[1] - x[1] * y[0];
+	f.radius = sqrt(farthest);
+
+	//positions & normals change with the transform, the rest must match exactly
+	std::vector<float> invariant;
+	invariant.reserve(size_t(count) * 3 * (2 * NO_TEXTURE_COORDS + 3));
+	for (int i = 0; i < 3 * count; i++) {
+		const Vertex& v = triangles[i / 3][i % 3];
+		for (int c = 0; c < NO_TEXTURE_COORDS; c++) {
+			invariant.push_back(v.texture_coords[c].u);
+			invariant.push_back(v.texture_coords[c].v);
+		}
+		invariant.push_back(v.color.x);
+		invariant.push_back(v.color.y);
+		invariant.push_back(v.color.z);
+	}
+	const uint64_t header[2] = { uint64_t(count), uint64_t(reinterpret_cast<uintptr_t>(surface->get_material())) };
+	f.hash = QuickHash(reinterpret_cast<const BYTE*>(header), sizeof(header));
+	f.hash = QuickHash(reinterpret_cast<const BYTE*>(invariant.data()), invariant.size() * sizeof(float), f.hash);
+	return f;
+}
+
+static bool IsCopy(Surface* original, const SurfaceFrame& o, Surface* copy, const SurfaceFrame& c) {
+	const int count = original->no_triangles();
+	if (copy->no_triangles() != count || copy->get_material() != original->get_material())
+		return false;
+	const double tolerance = INSTANCE_TOLERANCE * o.radius;
+	if (fabs(o.radius - c.radius) > tolerance)
+		return false;
+
+	const Triangle* a = original->get_triangles();
+	const Triangle* b = copy->get_triangles();
+	double d[3], pa[3], pb[3], na[3], nb[3];
+	for (int i = 0; i < 3 * count; i++) {
+		const Vertex& va = a[i / 3][i % 3];
+		const Vertex& vb = b[i / 3][i % 3];
+		Sub(va.position, o.origin, d);
+		Canonical(o, d, pa);
+		Sub(vb.position, c.origin, d);
+		Canonical(c, d, pb);
+		const double e[3] = { pa[0] - pb[0], pa[1] - pb[1], pa[2] - pb[2] };
+		if (Dot(e, e) > tolerance * tolerance)
+			return false;
+
+		//normals in the frames, zero ones (not given) must stay zero
+		const double ma[3] = { va.normal.x, va.normal.y, va.normal.z };
+		const double mb[3] = { vb.normal.x, vb.normal.y, vb.normal.z };
+		Canonical(o, ma, na);
+		Canonical(c, mb, nb);
+		const double lengths = sqrt(Dot(na, na) * Dot(nb, nb));
+		if (lengths == 0.0 ? Dot(na, na) != Dot(nb, nb) : Dot(na, nb) < NORMAL_TOLERANCE * lengths)
+			return false;
+
+		for (int t = 0; t < NO_TEXTURE_COORDS; t++)
+			if (va.texture_coords[t].u != vb.texture_coords[t].u || va.texture_coords[t].v != vb.texture_coords[t].v)
+				return false;
+		if (va.color.x != vb.color.x || va.color.y != vb.color.y || va.color.z != vb.color.z)
+			return false;
+	}
+	return true;
+}
+
+static InstanceTransform CopyTransform(const SurfaceFrame& original, const SurfaceFrame& copy) {
+	//copy = R_c * R_o^T * (original - origin_o) + origin_c, the axes are the rows of R^T
+	InstanceTransform transform;
+	for (int r = 0; r < 3; r++) {
+		double translation = copy.origin[r];
+		for (int k = 0; k < 3; k++) {
+			double rotation = 0.0;
+			for (int a = 0; a < 3; a++)
+				rotation += copy.axes[a][r] * original.axes[a][k];
+			transform.rows[r][k] = float(rotation);
+			translation -= rotation * original.origin[k];
+		}
+		transform.rows[r][3] = float(translation);
+	}
+	return transform;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+
+class Surface;
+
+//largest distance of a copy's vertex from the transformed original, relative to the radius of the surface
+constexpr float INSTANCE_TOLERANCE = 1e-3f;
+
+//Rigid transform of a copy of a mesh, rows of a 3x4 matrix (std430 vec4[3], SSBO binding 5 of the vertex shaders).
+struct InstanceTransform {
+	float rows[3][4];
+};
+
+//Removes surfaces which repeat an earlier one up to a rigid transform (the same material, triangles in the same order,
+//texture coordinates & colors, positions & normals within INSTANCE_TOLERANCE), as exporters write repeated objects with
+//their world positions baked in. Candidates are found by a hash of the invariant attributes (QuickHash), positions are compared
+//in a frame of every surface anchored at its centroid & two of its vertices. Removed surfaces are not freed (they live in arenas).
+//copies gets the copy count of every remaining surface, transforms their transforms grouped by the surfaces in order.
+//Returns the surfaces removed.
+size_t FindInstances(std::vector<Surface*>& surfaces, std::vector<int>& copies, std::vector<InstanceTransform>& transforms, int no_threads = 0);
@@ -0,0 +1,258 @@
+#include "pch.h"
+#include "mappedfile.h"
+
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//================================= MappedFile =================================
+
+MappedFile::MappedFile(const char* filepath) {
+#ifdef _WIN32
+	HANDLE f = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (f == INVALID_HANDLE_VALUE)
+		return;
+	file = f;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(f, &fileSize)) {
+		Close();
+		return;
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+
+	//empty files cannot be mapped, but are still valid
+	if (size > 0) {
+		mapping = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr) {
+			Close();
+			return;
+		}
+
+		data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (data == nullptr) {
+			Close();
+			return;
+		}
+	}
+#else
+	fd = ::open(filepath, O_RDONLY);
+	if (fd < 0)
+		return;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		Close();
+		return;
+	}
+	size = static_cast<size_t>(st.st_size);
+
+	if (size > 0) {
+		void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr == MAP_FAILED) {
+			Close();
+			return;
+		}
+		madvise(ptr, size, MADV_SEQUENTIAL);
+		data = static_cast<const char*>(ptr);
+	}
+#endif
+
+	open = true;
+}
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+MappedFile::MappedFile(MappedFile&& m) noexcept : data(m.data), size(m.size), open(m.open) {
+#ifdef _WIN32
+	file = m.file;
+	mapping = m.mapping;
+	m.file = m.mapping = nullptr;
+#else
+	fd = m.fd;
+	m.fd = -1;
+#endif
+	m.data = nullptr;
+	m.size = 0;
+	m.open = false;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& m) noexcept {
+	Close();
+
+	data = m.data;
+	size = m.size;
+	open = m.open;
+#ifdef _WIN32
+	file = m.file;
+	mapping = m.mapping;
+	m.file = m.mapping = nullptr;
+#else
+	fd = m.fd;
+	m.fd = -1;
+#endif
+	m.data = nullptr;
+	m.size = 0;
+	m.open = false;
+
+	return *this;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+	file = mapping = nullptr;
+#else
+	if (data)
+		munmap(const_cast<char*>(data), size);
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+#endif
+	data = nullptr;
+	size = 0;
+	open = false;
+}
+
+//================================= SpillBuffer =================================
+
+SpillBuffer::~SpillBuffer() {
+	Close();
+}
+
+bool SpillBuffer::Append(const void* bytes, size_t count) {
+	if (size + count > capacity && !Grow(size + count))
+		return false;
+
+	if (count > 0)
+		memcpy(data + size, bytes, count);
+	size += count;
+	return true;
+}
+
+bool SpillBuffer::Grow(size_t required) {
+	size_t newCapacity = std::max(required, capacity * 2);
+
+	if (!spilled && newCapacity <= memoryLimit) {
+		char* ptr = static_cast<char*>(realloc(data, newCapacity));
+		if (ptr == nullptr)
+			return false;
+		data = ptr;
+		capacity = newCapacity;
+		return true;
+	}
+
+	//whole pages, the file grows by doubling as well
+	const size_t page = 1 << 16;
+	newCapacity = (newCapacity + page - 1) / page * page;
+
+	if (!spilled) {
+		char* memory = data;
+		data = nullptr;
+		if (!MapSpillFile(newCapacity)) {
+			data = memory;
+			return false;
+		}
+		if (size > 0)
+			memcpy(data, memory, size);
+		free(memory);
+		spilled = true;
+		return true;
+	}
+
+	return MapSpillFile(newCapacity);
+}
+
+bool SpillBuffer::MapSpillFile(size_t newCapacity) {
+#ifdef _WIN32
+	if (file == nullptr) {
+		char path[MAX_PATH];
+		if (!GetTempFileNameA(std::filesystem::temp_directory_path().string().c_str(), "pg2", 0, path))
+			return false;
+		HANDLE f = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+		if (f == INVALID_HANDLE_VALUE)
+			return false;
+		file = f;
+	}
+
+	//mapping of a bigger size extends the file
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	data = nullptr;
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, DWORD(uint64_t(newCapacity) >> 32), DWORD(newCapacity), nullptr);
+	if (mapping == nullptr)
+		return false;
+	data = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+	if (data == nullptr)
+		return false;
+#else
+	if (fd < 0) {
+		std::string path = (std::filesystem::temp_directory_path() / "pg2spillXXXXXX").string();
+		fd = mkstemp(&path[0]);
+		if (fd < 0)
+			return false;
+		unlink(path.c_str());
+	}
+
+	if (data)
+		munmap(data, capacity);
+	data = nullptr;
+
+	if (ftruncate(fd, static_cast<off_t>(newCapacity)) != 0)
+		return false;
+	void* ptr = mmap(nullptr, newCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED)
+		return false;
+	data = static_cast<char*>(ptr);
+#endif
+
+	capacity = newCapacity;
+	return true;
+}
+
+void SpillBuffer::Close() {
+	if (!spilled) {
+		free(data);
+	}
+	else {
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+#else
+		if (data)
+			munmap(data, capacity);
+#endif
+	}
+
+#ifdef _WIN32
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+	file = mapping = nullptr;
+#else
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+#endif
+	data = nullptr;
+	size = capacity = 0;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+
+//Read-only view of a whole file mapped into memory (no copy is made).
+class MappedFile {
+public:
+	//invalid ctor
+	MappedFile() {}
+	MappedFile(const char* filepath);
+	~MappedFile();
+
+	//copy deleted
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	//move enabled
+	MappedFile(MappedFile&&) noexcept;
+	MappedFile& operator=(MappedFile&&) noexcept;
+
+	inline bool IsOpen() const { return open; }
+
+	inline const char* Data() const { return data; }
+	inline const char* End() const { return data + size; }
+	inline size_t Size() const { return size; }
+private:
+	void Close();
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+	bool open = false;
+
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+};
+
+//Growable byte buffer kept in memory up to given limit, then moved into a temporary file mapped read-write,
+//so the OS can page it out instead of running out of memory.
+class SpillBuffer {
+public:
+	SpillBuffer(size_t memoryLimit) : memoryLimit(memoryLimit) {}
+	~SpillBuffer();
+
+	//copy & move deleted
+	SpillBuffer(const SpillBuffer&) = delete;
+	SpillBuffer& operator=(const SpillBuffer&) = delete;
+
+	//Returns false when the buffer cannot grow (out of memory or temporary disk space).
+	bool Append(const void* bytes, size_t count);
+
+	inline const char* Data() const { return data; }
+	inline size_t Size() const { return size; }
+	inline bool Spilled() const { return spilled; }
+private:
+	bool Grow(size_t required);
+	bool MapSpillFile(size_t newCapacity);
+	void Close();
+private:
+	char* data = nullptr;
+	size_t size = 0;
+	size_t capacity = 0;
+	size_t memoryLimit;
+	bool spilled = false;
+
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+};
+
+//Typed view of a SpillBuffer, elements are only appended.
+template<typename T>
+class SpillArray {
+public:
+	SpillArray(size_t memoryLimit) : buffer(memoryLimit) {}
+
+	inline bool Append(const T* values, size_t count) { return buffer.Append(values, count * sizeof(T)); }
+
+	inline const T& operator[](size_t i) const { return reinterpret_cast<const T*>(buffer.Data())[i]; }
+	inline size_t size() const { return buffer.Size() / sizeof(T); }
+	inline bool Spilled() const { return buffer.Spilled(); }
+private:
+	SpillBuffer buffer;
+};
@@ -0,0 +1,531 @@
+#include "pch.h"
+#include "meshcodec.h"
+
+#include <cstring>
+#include <cmath>
+
+#include "parallel.h"
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESHCODEC_SSE
+#include <emmintrin.h>
+#endif
+
+//increment whenever the encoding changes
+constexpr uint32_t CODEC_VERSION = 2;
+constexpr char CODEC_MAGIC[4] = { 'P', 'G', '2', 'Z' };
+
+//streams of a vertex block besides positions, normals & tangents (omitted when constant over the block)
+constexpr uint32_t UV_STREAM = 1;
+constexpr uint32_t COLOR_STREAM = 2;
+constexpr uint32_t HANDEDNESS_STREAM = 4;		//1 = mirrored, blocks of one handedness store it in VertexBlock::handedness
+
+//vertices decoded at once
+constexpr size_t GROUP = 4;
+
+//decoding writes whole vertices as 16 floats
+static_assert(sizeof(Vertex) == 16 * sizeof(float), "Vertex layout changed");
+static_assert(sizeof(Coord2f) == 2 * sizeof(float) && NO_TEXTURE_COORDS == 1, "Vertex layout changed");
+
+struct CompressedGeometry::Header {
+	char magic[4];
+	uint32_t version;
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	float positionOffset[3];		//grid of all positions
+	float positionScale[3];
+	uint32_t materialRunCount;
+	uint32_t reserved;
+};
+
+struct CompressedGeometry::VertexBlock {
+	uint64_t offset;				//of the streams, from the beginning of the data
+	float uvOffset[2];
+	float uvScale[2];
+	float colorOffset[3];
+	float colorScale[3];
+	uint32_t streams;
+	float handedness;				//of all vertices, without HANDEDNESS_STREAM
+};
+
+struct CompressedGeometry::IndexBlock {
+	uint64_t offset;				//of the varints, from the beginning of the data
+	uint32_t previous;				//index preceding the block
+	uint32_t next;					//first vertex not used before the block
+};
+
+struct CompressedGeometry::MaterialRun {
+	uint32_t end;					//vertices [end of the previous run, end) have matIdx
+	int32_t matIdx;
+};
+
+//==== Quantization ====
+
+static inline void Bounds(float minimum, float maximum, float& offset, float& scale) {
+	offset = minimum;
+	scale = (maximum > minimum) ? (maximum - minimum) / 65535.0f : 0.0f;
+}
+
+static inline uint16_t Quantize(float x, float offset, float scale) {
+	if (scale == 0.0f)
+		return 0;
+	const long q = lrintf((x - offset) / scale);
+	return static_cast<uint16_t>(std::min(std::max(q, 0L), 65535L));
+}
+
+static inline float Dequantize(float q, float offset, float scale) {
+	return q * scale + offset;
+}
+
+//number of 16-bit streams of a vertex block
+static inline size_t StreamCount(uint32_t streams) {
+	return 7 + ((streams & UV_STREAM) ? 2 : 0) + ((streams & COLOR_STREAM) ? 3 : 0) + ((streams & HANDEDNESS_STREAM) ? 1 : 0);
+}
+
+//Octahedral unit vector (a, b) in snorm16 -> (x, y, z), exactly as the SSE decoder computes it.
+static inline Vector3 OctDecode(int16_t a, int16_t b) {
+	float x = float(a) * (1.0f / 32767.0f);
+	float y = float(b) * (1.0f / 32767.0f);
+	const float z = (1.0f - std::fabs(x)) - std::fabs(y);
+	const float t = std::max(0.0f - z, 0.0f);
+	x = x - std::copysign(t, x);
+	y = y - std::copysign(t, y);
+	const float length = std::sqrt((x * x + y * y) + z * z);
+	return Vector3(x / length, y / length, z / length);
+}
+
+//Closest of the four roundings of the octahedral projection of n.
+static inline void OctEncode(const Vector3& n, uint16_t& a, uint16_t& b) {
+	const float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+	float x = (l1 > 0.0f) ? n.x / l1 : 0.0f;
+	float y = (l1 > 0.0f) ? n.y / l1 : 0.0f;
+	if (n.z < 0.0f) {
+		const float folded_x = (1.0f - std::fabs(y)) * std::copysign(1.0f, x);
+		y = (1.0f - std::fabs(x)) * std::copysign(1.0f, y);
+		x = folded_x;
+	}
+
+	const float u = std::min(std::max(x, -1.0f), 1.0f) * 32767.0f;
+	const float v = std::min(std::max(y, -1.0f), 1.0f) * 32767.0f;
+	const Vector3 unit = (l1 > 0.0f) ? n / std::sqrt(n.SqrL2Norm()) : Vector3(0.0f, 0.0f, 1.0f);
+	float best = -2.0f;
+	for (const float qu : { std::floor(u), std::ceil(u) }) {
+		for (const float qv : { std::floor(v), std::ceil(v) }) {
+			const Vector3 d = OctDecode(int16_t(qu), int16_t(qv));
+			const float dot = d.DotProduct(unit);
+			if (dot > best) {
+				best = dot;
+				a = uint16_t(int16_t(qu));
+				b = uint16_t(int16_t(qv));
+			}
+		}
+	}
+}
+
+//==== Varints ====
+
+static inline void PutVarint(std::vector<char>& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(char(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(char(value));
+}
+
+static inline uint64_t GetVarint(const uint8_t*& p, const uint8_t* end) {
+	uint64_t value = *p++;
+	if (value < 0x80)
+		return value;
+
+	value &= 0x7F;
+	for (int shift = 7; p < end && shift < 64; shift += 7) {
+		const uint8_t byte = *p++;
+		value |= uint64_t(byte & 0x7F) << shift;
+		if (byte < 0x80)
+			break;
+	}
+	return value;
+}
+
+//==== Decoding of a group of GROUP vertices, SSE when available ====
+
+//Streams of a vertex block, count values each (padded to whole groups).
+struct Streams {
+	const uint16_t* position[3];
+	const uint16_t* normal[2];
+	const uint16_t* tangent[2];
+	const uint16_t* uv[2];			//nullptr when constant
+	const uint16_t* color[3];		//nullptr when constant
+	const uint16_t* handedness;		//nullptr when constant
+};
+
+#ifdef MESHCODEC_SSE
+static inline __m128 LoadUnsigned(const uint16_t* p) {
+	const __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+}
+
+static inline __m128 LoadSigned(const uint16_t* p) {
+	const __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+	return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+
+static inline __m128 Dequantize(const uint16_t* p, float offset, float scale) {
+	if (p == nullptr)
+		return _mm_set1_ps(offset);
+	return _mm_add_ps(_mm_mul_ps(LoadUnsigned(p), _mm_set1_ps(scale)), _mm_set1_ps(offset));
+}
+
+static inline void OctDecode(const uint16_t* pa, const uint16_t* pb, __m128& x, __m128& y, __m128& z) {
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 zero = _mm_setzero_ps();
+	x = _mm_mul_ps(LoadSigned(pa), _mm_set1_ps(1.0f / 32767.0f));
+	y = _mm_mul_ps(LoadSigned(pb), _mm_set1_ps(1.0f / 32767.0f));
+	z = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_andnot_ps(sign, x)), _mm_andnot_ps(sign, y));
+	const __m128 t = _mm_max_ps(_mm_sub_ps(zero, z), zero);
+	x = _mm_sub_ps(x, _mm_or_ps(t, _mm_and_ps(x, sign)));
+	y = _mm_sub_ps(y, _mm_or_ps(t, _mm_and_ps(y, sign)));
+	const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+	x = _mm_div_ps(x, length);
+	y = _mm_div_ps(y, length);
+	z = _mm_div_ps(z, length);
+}
+
+//Vertices k..k+3 of the streams -> 4 whole vertices at destination.
+static inline void DecodeGroup(const Streams& s, size_t k, const float* positionOffset, const float* positionScale,
+							   const float* uvOffset, const float* uvScale, const float* colorOffset, const float* colorScale,
+							   float handedness, const int32_t* matIdx, Vertex* destination) {
+	__m128 px = Dequantize(s.position[0] + k, positionOffset[0], positionScale[0]);
+	__m128 py = Dequantize(s.position[1] + k, positionOffset[1], positionScale[1]);
+	__m128 pz = Dequantize(s.position[2] + k, positionOffset[2], positionScale[2]);
+	__m128 nx, ny, nz, tx, ty, tz;
+	OctDecode(s.normal[0] + k, s.normal[1] + k, nx, ny, nz);
+	OctDecode(s.tangent[0] + k, s.tangent[1] + k, tx, ty, tz);
+	__m128 u = Dequantize(s.uv[0] ? s.uv[0] + k : nullptr, uvOffset[0], uvScale[0]);
+	__m128 v = Dequantize(s.uv[1] ? s.uv[1] + k : nullptr, uvOffset[1], uvScale[1]);
+	__m128 cr = Dequantize(s.color[0] ? s.color[0] + k : nullptr, colorOffset[0], colorScale[0]);
+	__m128 cg = Dequantize(s.color[1] ? s.color[1] + k : nullptr, colorOffset[1], colorScale[1]);
+	__m128 cb = Dequantize(s.color[2] ? s.color[2] + k : nullptr, colorOffset[2], colorScale[2]);
+	__m128 mat = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(matIdx)));
+	__m128 w = s.handedness ? Dequantize(s.handedness + k, 1.0f, -2.0f) : _mm_set1_ps(handedness);
+
+	//SoA -> 4 quads of every vertex: position & normal.x | normal.yz & color.rg | color.b & uv & tangent.x | tangent.yz & matIdx & handedness
+	_MM_TRANSPOSE4_PS(px, py, pz, nx);
+	_MM_TRANSPOSE4_PS(ny, nz, cr, cg);
+	_MM_TRANSPOSE4_PS(cb, u, v, tx);
+	_MM_TRANSPOSE4_PS(ty, tz, mat, w);
+	const __m128 quads[4][4] = { { px, ny, cb, ty }, { py, nz, u, tz }, { pz, cr, v, mat }, { nx, cg, tx, w } };
+	for (int i = 0; i < 4; i++) {
+		float* out = reinterpret_cast<float*>(destination + i);
+		_mm_storeu_ps(out, quads[i][0]);
+		_mm_storeu_ps(out + 4, quads[i][1]);
+		_mm_storeu_ps(out + 8, quads[i][2]);
+		_mm_storeu_ps(out + 12, quads[i][3]);
+	}
+}
+#else
+static inline float Dequantize(const uint16_t* p, size_t k, float offset, float scale) {
+	return p ? Dequantize(float(p[k]), offset, scale) : offset;
+}
+
+//same operations as the SSE version, so both give identical vertices
+static inline void DecodeGroup(const Streams& s, size_t k, const float* positionOffset, const float* positionScale,
+							   const float* uvOffset, const float* uvScale, const float* colorOffset, const float* colorScale,
+							   float handedness, const int32_t* matIdx, Vertex* destination) {
+	for (size_t i = 0; i < GROUP; i++) {
+		Vertex v;
+		v.position = Vector3(Dequantize(s.position[0], k + i, positionOffset[0], positionScale[0]),
+			Dequantize(s.position[1], k + i, positionOffset[1], positionScale[1]),
+			Dequantize(s.position[2], k + i, positionOffset[2], positionScale[2]));
+		v.normal = OctDecode(int16_t(s.normal[0][k + i]), int16_t(s.normal[1][k + i]));
+		v.color = Vector3(Dequantize(s.color[0], k + i, colorOffset[0], colorScale[0]),
+			Dequantize(s.color[1], k + i, colorOffset[1], colorScale[1]),
+			Dequantize(s.color[2], k + i, colorOffset[2], colorScale[2]));
+		v.texture_coords[0] = { Dequantize(s.uv[0], k + i, uvOffset[0], uvScale[0]), Dequantize(s.uv[1], k + i, uvOffset[1], uvScale[1]) };
+		v.tangent = OctDecode(int16_t(s.tangent[0][k + i]), int16_t(s.tangent[1][k + i]));
+		v.matIdx = matIdx[i];
+		v.handedness = s.handedness ? Dequantize(s.handedness, k + i, 1.0f, -2.0f) : handedness;
+		destination[i] = v;
+	}
+}
+#endif
+
+//================================= Encoding =================================
+
+std::vector<char> CompressedGeometry::Encode(const IndexedGeometry& geometry, int no_threads) {
+	const size_t vertexCount = geometry.VertexCount();
+	const size_t indexCount = geometry.indices.size();
+	const size_t vertexBlockCount = (vertexCount + VERTEX_BLOCK - 1) / VERTEX_BLOCK;
+	const size_t indexBlockCount = (indexCount + INDEX_BLOCK - 1) / INDEX_BLOCK;
+
+	Header header = {};
+	memcpy(header.magic, CODEC_MAGIC, sizeof(CODEC_MAGIC));
+	header.version = CODEC_VERSION;
+	header.vertexCount = vertexCount;
+	header.indexCount = indexCount;
+
+	//position grid & material runs
+	float minimum[3] = { INFINITY, INFINITY, INFINITY }, maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+	std::vector<MaterialRun> runs;
+	for (size_t i = 0; i < vertexCount; i++) {
+		const Vertex& v = *geometry.sources[i];
+		for (int c = 0; c < 3; c++) {
+			minimum[c] = std::min(minimum[c], v.position.data[c]);
+			maximum[c] = std::max(maximum[c], v.position.data[c]);
+		}
+		if (runs.empty() || runs.back().matIdx != v.matIdx)
+			runs.push_back({ 0, v.matIdx });
+		runs.back().end = uint32_t(i + 1);
+	}
+	for (int c = 0; c < 3 && vertexCount > 0; c++)
+		Bounds(minimum[c], maximum[c], header.positionOffset[c], header.positionScale[c]);
+	header.materialRunCount = uint32_t(runs.size());
+
+	//vertex blocks are encoded independently
+	std::vector<VertexBlock> vertexBlocks(vertexBlockCount);
+	std::vector<std::vector<uint16_t>> blockStreams(vertexBlockCount);
+	ParallelFor(static_cast<int>(vertexBlockCount), no_threads, [&](int b) {
+		const size_t first = size_t(b) * VERTEX_BLOCK;
+		const size_t n = std::min(VERTEX_BLOCK, vertexCount - first);
+		const size_t padded = (n + GROUP - 1) / GROUP * GROUP;
+		std::vector<Vertex> vertices(n);
+		geometry.CopyVertices(first, n, vertices.data());
+
+		VertexBlock& block = vertexBlocks[b];
+		float uvMin[2] = { INFINITY, INFINITY }, uvMax[2] = { -INFINITY, -INFINITY };
+		float colorMin[3] = { INFINITY, INFINITY, INFINITY }, colorMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+		for (const Vertex& v : vertices) {
+			const float uv[2] = { v.texture_coords[0].u, v.texture_coords[0].v };
+			for (int c = 0; c < 2; c++) {
+				uvMin[c] = std::min(uvMin[c], uv[c]);
+				uvMax[c] = std::max(uvMax[c], uv[c]);
+			}
+			for (int c = 0; c < 3; c++) {
+				colorMin[c] = std::min(colorMin[c], v.color.data[c]);
+				colorMax[c] = std::max(colorMax[c], v.color.data[c]);
+			}
+		}
+		for (int c = 0; c < 2; c++)
+			Bounds(uvMin[c], uvMax[c], block.uvOffset[c], block.uvScale[c]);
+		for (int c = 0; c < 3; c++)
+			Bounds(colorMin[c], colorMax[c], block.colorOffset[c], block.colorScale[c]);
+		if (block.uvScale[0] != 0.0f || block.uvScale[1] != 0.0f)
+			block.streams |= UV_STREAM;
+		if (block.colorScale[0] != 0.0f || block.colorScale[1] != 0.0f || block.colorScale[2] != 0.0f)
+			block.streams |= COLOR_STREAM;
+		block.handedness = vertices[0].handedness;
+		for (const Vertex& v : vertices)
+			if (v.handedness != block.handedness)
+				block.streams |= HANDEDNESS_STREAM;
+
+		const size_t streamCount = StreamCount(block.streams);
+		std::vector<uint16_t>& streams = blockStreams[b];
+		streams.assign(streamCount * padded, 0);
+		for (size_t i = 0; i < n; i++) {
+			const Vertex& v = vertices[i];
+			size_t s = 0;
+			for (int c = 0; c < 3; c++)
+				streams[s++ * padded + i] = Quantize(v.position.data[c], header.positionOffset[c], header.positionScale[c]);
+			OctEncode(v.normal, streams[s * padded + i], streams[(s + 1) * padded + i]);
+			s += 2;
+			OctEncode(v.tangent, streams[s * padded + i], streams[(s + 1) * padded + i]);
+			s += 2;
+			if (block.streams & UV_STREAM) {
+				streams[s++ * padded + i] = Quantize(v.texture_coords[0].u, block.uvOffset[0], block.uvScale[0]);
+				streams[s++ * padded + i] = Quantize(v.texture_coords[0].v, block.uvOffset[1], block.uvScale[1]);
+			}
+			if (block.streams & COLOR_STREAM) {
+				for (int c = 0; c < 3; c++)
+					streams[s++ * padded + i] = Quantize(v.color.data[c], block.colorOffset[c], block.colorScale[c]);
+			}
+			if (block.streams & HANDEDNESS_STREAM)
+				streams[s++ * padded + i] = (v.handedness < 0.0f) ? 1 : 0;
+		}
+	});
+
+	//index blocks restart from the state at their beginning
+	std::vector<IndexBlock> indexBlocks(indexBlockCount);
+	std::vector<char> indexData;
+	indexData.reserve(indexCount + indexCount / 4);
+	uint32_t previous = 0, next = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		if (i % INDEX_BLOCK == 0)
+			indexBlocks[i / INDEX_BLOCK] = { uint64_t(indexData.size()), previous, next };
+
+		const uint32_t index = geometry.indices[i];
+		if (index == next) {
+			PutVarint(indexData, 0);
+			next++;
+		}
+		else {
+			const int32_t delta = int32_t(index - previous);
+			const uint32_t zigzag = (uint32_t(delta) << 1) ^ uint32_t(delta >> 31);
+			PutVarint(indexData, uint64_t(zigzag) + 1);
+		}
+		previous = index;
+	}
+
+	//header | tables | vertex streams | varints
+	const size_t tableBytes = sizeof(Header) + vertexBlockCount * sizeof(VertexBlock) + indexBlockCount * sizeof(IndexBlock) +
+		runs.size() * sizeof(MaterialRun);
+	size_t offset = tableBytes;
+	for (size_t b = 0; b < vertexBlockCount; b++) {
+		vertexBlocks[b].offset = offset;
+		offset += blockStreams[b].size() * sizeof(uint16_t);
+	}
+	for (IndexBlock& block : indexBlocks)
+		block.offset += offset;
+
+	std::vector<char> out(offset + indexData.size());
+	char* p = out.data();
+	auto Put = [&p](const void* data, size_t size) { if (size > 0) memcpy(p, data, size); p += size; };
+	Put(&header, sizeof(Header));
+	Put(vertexBlocks.data(), vertexBlocks.size() * sizeof(VertexBlock));
+	Put(indexBlocks.data(), indexBlocks.size() * sizeof(IndexBlock));
+	Put(runs.data(), runs.size() * sizeof(MaterialRun));
+	for (const std::vector<uint16_t>& streams : blockStreams)
+		Put(streams.data(), streams.size() * sizeof(uint16_t));
+	Put(indexData.data(), indexData.size());
+	return out;
+}
+
+//================================= Decoding =================================
+
+bool CompressedGeometry::Open(const char* data_, size_t size_) {
+	data = data_;
+	size = size_;
+	header = reinterpret_cast<const Header*>(data);
+	if (size < sizeof(Header) || memcmp(header->magic, CODEC_MAGIC, sizeof(CODEC_MAGIC)) != 0 || header->version != CODEC_VERSION)
+		return false;
+
+	vertexCount = header->vertexCount;
+	indexCount = header->indexCount;
+	materialRunCount = header->materialRunCount;
+	const size_t vertexBlockCount = (vertexCount + VERTEX_BLOCK - 1) / VERTEX_BLOCK;
+	const size_t indexBlockCount = (indexCount + INDEX_BLOCK - 1) / INDEX_BLOCK;
+	if (vertexCount > UINT32_MAX || indexCount > size * 8 || materialRunCount > vertexCount)
+		return false;
+
+	const size_t tableBytes = sizeof(Header) + vertexBlockCount * sizeof(VertexBlock) + indexBlockCount * sizeof(IndexBlock) +
+		materialRunCount * sizeof(MaterialRun);
+	if (tableBytes > size)
+		return false;
+	vertexBlocks = reinterpret_cast<const VertexBlock*>(data + sizeof(Header));
+	indexBlocks = reinterpret_cast<const IndexBlock*>(vertexBlocks + vertexBlockCount);
+	materialRuns = reinterpret_cast<const MaterialRun*>(indexBlocks + indexBlockCount);
+
+	//streams of every block & varints have to lie in the data
+	for (size_t b = 0; b < vertexBlockCount; b++) {
+		const size_t n = std::min(VERTEX_BLOCK, vertexCount - b * VERTEX_BLOCK);
+		const size_t padded = (n + GROUP - 1) / GROUP * GROUP;
+		const uint32_t streams = vertexBlocks[b].streams;
+		const size_t streamCount = StreamCount(streams);
+		if (vertexBlocks[b].offset < tableBytes || vertexBlocks[b].offset > size || streamCount * padded * sizeof(uint16_t) > size - vertexBlocks[b].offset)
+			return false;
+	}
+	for (size_t b = 0; b < indexBlockCount; b++) {
+		if (indexBlocks[b].offset < tableBytes || indexBlocks[b].offset > size || (b > 0 && indexBlocks[b].offset < indexBlocks[b - 1].offset))
+			return false;
+	}
+	return true;
+}
+
+GLenum CompressedGeometry::IndexType() const {
+	return (vertexCount <= 0xFFFF) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+void CompressedGeometry::DecodeVertices(size_t first, size_t count, Vertex* destination) const {
+	const size_t end = first + count;
+	for (size_t b = first / VERTEX_BLOCK; b * VERTEX_BLOCK < end; b++) {
+		const size_t begin = std::max(first, b * VERTEX_BLOCK);
+		const size_t n = std::min(end, (b + 1) * VERTEX_BLOCK) - begin;
+		DecodeBlock(b, begin - b * VERTEX_BLOCK, n, destination + (begin - first));
+	}
+}
+
+void CompressedGeometry::DecodeIndices(size_t first, size_t count, void* destination) const {
+	const size_t end = first + count;
+	for (size_t b = first / INDEX_BLOCK; b * INDEX_BLOCK < end; b++) {
+		const size_t begin = std::max(first, b * INDEX_BLOCK);
+		const size_t n = std::min(end, (b + 1) * INDEX_BLOCK) - begin;
+		if (IndexType() == GL_UNSIGNED_SHORT)
+			DecodeIndexBlock(b, begin - b * INDEX_BLOCK, n, static_cast<uint16_t*>(destination) + (begin - first));
+		else
+			DecodeIndexBlock(b, begin - b * INDEX_BLOCK, n, static_cast<uint32_t*>(destination) + (begin - first));
+	}
+}
+
+void CompressedGeometry::DecodeBlock(size_t b, size_t first, size_t count, Vertex* destination) const {
+	const VertexBlock& block = vertexBlocks[b];
+	const size_t blockFirst = b * VERTEX_BLOCK;
+	const size_t n = std::min(VERTEX_BLOCK, vertexCount - blockFirst);
+	const size_t padded = (n + GROUP - 1) / GROUP * GROUP;
+
+	const uint16_t* p = reinterpret_cast<const uint16_t*>(data + block.offset);
+	Streams s = {};
+	for (int c = 0; c < 3; c++, p += padded)
+		s.position[c] = p;
+	for (int c = 0; c < 2; c++, p += padded)
+		s.normal[c] = p;
+	for (int c = 0; c < 2; c++, p += padded)
+		s.tangent[c] = p;
+	for (int c = 0; c < 2 && (block.streams & UV_STREAM); c++, p += padded)
+		s.uv[c] = p;
+	for (int c = 0; c < 3 && (block.streams & COLOR_STREAM); c++, p += padded)
+		s.color[c] = p;
+	if (block.streams & HANDEDNESS_STREAM)
+		s.handedness = p;
+
+	//run of the first vertex
+	const MaterialRun* run = std::upper_bound(materialRuns, materialRuns + materialRunCount, uint32_t(blockFirst + first),
+		[](uint32_t v, const MaterialRun& r) { return v < r.end; });
+	const MaterialRun* runsEnd = materialRuns + materialRunCount;
+
+	const size_t end = first + count;
+	for (size_t k = first / GROUP * GROUP; k < end; k += GROUP) {
+		int32_t matIdx[GROUP];
+		for (size_t i = 0; i < GROUP; i++) {
+			while (run != runsEnd && run->end <= blockFirst + k + i)
+				run++;
+			matIdx[i] = (run != runsEnd) ? run->matIdx : 0;
+		}
+
+		//partial groups at the ends of the range are decoded aside
+		if (k >= first && k + GROUP <= end) {
+			DecodeGroup(s, k, header->positionOffset, header->positionScale, block.uvOffset, block.uvScale,
+				block.colorOffset, block.colorScale, block.handedness, matIdx, destination + (k - first));
+		}
+		else {
+			Vertex group[GROUP];
+			DecodeGroup(s, k, header->positionOffset, header->positionScale, block.uvOffset, block.uvScale,
+				block.colorOffset, block.colorScale, block.handedness, matIdx, group);
+			const size_t begin = std::max(k, first);
+			const size_t stop = std::min(k + GROUP, end);
+			memcpy(destination + (begin - first), group + (begin - k), (stop - begin) * sizeof(Vertex));
+		}
+	}
+}
+
+template<typename T>
+void CompressedGeometry::DecodeIndexBlock(size_t b, size_t first, size_t count, T* destination) const {
+	const IndexBlock& block = indexBlocks[b];
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(data + block.offset);
+	const uint8_t* end = reinterpret_cast<const uint8_t*>((b + 1 < (indexCount + INDEX_BLOCK - 1) / INDEX_BLOCK) ? data + indexBlocks[b + 1].offset : data + size);
+
+	//indices before first only advance the state
+	uint32_t previous = block.previous, next = block.next;
+	for (size_t i = 0; i < first + count; i++) {
+		const uint64_t token = (p < end) ? GetVarint(p, end) : 0;
+		uint32_t index;
+		if (token == 0) {
+			index = next++;
+		}
+		else {
+			const uint32_t zigzag = uint32_t(token - 1);
+			index = previous + ((zigzag >> 1) ^ (0u - (zigzag & 1)));
+		}
+		previous = index;
+		if (i >= first)
+			destination[i - first] = T(index);
+	}
+}
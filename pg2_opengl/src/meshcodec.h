@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "geometry.h"
+
+//Compressed welded geometry, decoded straight into the final vertex & index buffers.
+//Vertices are quantized to 16 bits per component and stored per block of VERTEX_BLOCK vertices as separate streams:
+//positions on one grid spanning the whole geometry (so coincident vertices stay coincident), texture coordinates & colors
+//relative to the bounds of the block, normals & tangents octahedrally, handedness only in blocks mixing both.
+//Material indices are run-length coded.
+//Indices are coded as 0 for the next not yet used vertex, otherwise as the zigzag delta to the previous index + 1,
+//in LEB128 varints, and restart every INDEX_BLOCK indices. Blocks decode independently of each other.
+class CompressedGeometry {
+public:
+	static constexpr size_t VERTEX_BLOCK = 4096;
+	static constexpr size_t INDEX_BLOCK = 8192;
+
+	//Encodes the geometry (tangents included) using no_threads threads (0 = all), the result is read by Open().
+	static std::vector<char> Encode(const IndexedGeometry& geometry, int no_threads = 0);
+
+	//Reads encoded geometry from [data, data + size), which has to outlive the object (e.g. a mapped file).
+	bool Open(const char* data, size_t size);
+
+	inline size_t VertexCount() const { return vertexCount; }
+	inline size_t IndexCount() const { return indexCount; }
+	//Smallest GL index type able to address all vertices (as IndexedGeometry::IndexType).
+	GLenum IndexType() const;
+
+	//Writes vertices [first, first + count) into destination (meant for write-only mapped memory).
+	void DecodeVertices(size_t first, size_t count, Vertex* destination) const;
+	//Writes indices [first, first + count) in IndexType() into destination.
+	void DecodeIndices(size_t first, size_t count, void* destination) const;
+private:
+	struct Header;
+	struct VertexBlock;
+	struct IndexBlock;
+	struct MaterialRun;
+
+	void DecodeBlock(size_t block, size_t first, size_t count, Vertex* destination) const;
+	template<typename T> void DecodeIndexBlock(size_t block, size_t first, size_t count, T* destination) const;
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	const Header* header = nullptr;
+	const VertexBlock* vertexBlocks = nullptr;
+	const IndexBlock* indexBlocks = nullptr;
+	const MaterialRun* materialRuns = nullptr;
+	size_t materialRunCount = 0;
+};
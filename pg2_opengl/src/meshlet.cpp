@@ -0,0 +1,164 @@
+#include "pch.h"
+#include "meshlet.h"
+
+#include <algorithm>
+#include <cfloat>
+
+static Meshlet MakeMeshlet(const uint32_t* indices, size_t indexCount, size_t firstIndex, const Vector3* positions);
+
+//================================= Culling =================================
+
+CullingView MakeCullingView(const mat4f& mvp, const Vector3& eye, bool coneCulling) {
+	CullingView view = {};
+
+	//Gribb & Hartmann - clip space -w <= x, y, z <= w as rows of mvp
+	for (int p = 0; p < 6; p++) {
+		const int row = p / 2;
+		const float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+		Vector3 n(mvp.get(3, 0) + sign * mvp.get(row, 0), mvp.get(3, 1) + sign * mvp.get(row, 1), mvp.get(3, 2) + sign * mvp.get(row, 2));
+		float d = mvp.get(3, 3) + sign * mvp.get(row, 3);
+		const float length = n.L2Norm();
+		if (length > 0.0f) {
+			n = n / length;
+			d /= length;
+		}
+		view.planes[p][0] = n.x;
+		view.planes[p][1] = n.y;
+		view.planes[p][2] = n.z;
+		view.planes[p][3] = d;
+	}
+	view.eye[0] = eye.x;
+	view.eye[1] = eye.y;
+	view.eye[2] = eye.z;
+	view.eye[3] = 1.0f;
+	view.coneCulling = coneCulling ? 1 : 0;
+	return view;
+}
+
+bool IsMeshletVisible(const Meshlet& meshlet, const CullingView& view) {
+	//bounding sphere outside of a frustum plane
+	for (int p = 0; p < 6; p++) {
+		const float* plane = view.planes[p];
+		if (plane[0] * meshlet.center[0] + plane[1] * meshlet.center[1] + plane[2] * meshlet.center[2] + plane[3] < -meshlet.radius)
+			return false;
+	}
+
+	//all triangles facing away
+	if (view.coneCulling && meshlet.coneCutoff <= 1.0f) {
+		const Vector3 d(meshlet.coneApex[0] - view.eye[0], meshlet.coneApex[1] - view.eye[1], meshlet.coneApex[2] - view.eye[2]);
+		const float length = d.L2Norm();
+		if (length > 0.0f && d.DotProduct(Vector3(meshlet.coneAxis)) >= meshlet.coneCutoff * length)
+			return false;
+	}
+	return true;
+}
+
+size_t CullMeshlets(const Meshlet* meshlets, size_t count, const CullingView& view, DrawElementsIndirectCommand* commands) {
+	size_t visible = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (IsMeshletVisible(meshlets[i], view))
+			commands[visible++] = { meshlets[i].indexCount, 1, meshlets[i].firstIndex, 0, 0 };
+	}
+	return visible;
+}
+
+//================================= Building =================================
+
+void BuildMeshlets(const uint32_t* indices, size_t firstIndex, size_t indexCount, const Vector3* positions, std::vector<Meshlet>& meshlets) {
+	uint32_t vertices[MESHLET_VERTICES];
+	size_t vertexCount = 0;
+	size_t start = 0;
+	indexCount -= indexCount % 3;
+
+	for (size_t i = 0; i < indexCount; i += 3) {
+		//vertices of the triangle missing in the meshlet
+		uint32_t added[3];
+		size_t addedCount = 0;
+		auto findAdded = [&]() {
+			addedCount = 0;
+			for (int c = 0; c < 3; c++) {
+				const uint32_t v = indices[i + c];
+				if (std::find(vertices, vertices + vertexCount, v) == vertices + vertexCount && std::find(added, added + addedCount, v) == added + addedCount)
+					added[addedCount++] = v;
+			}
+		};
+		findAdded();
+
+		if (vertexCount + addedCount > MESHLET_VERTICES || (i - start) / 3 + 1 > MESHLET_TRIANGLES) {
+			meshlets.push_back(MakeMeshlet(indices + start, i - start, firstIndex + start, positions));
+			start = i;
+			vertexCount = 0;
+			findAdded();
+		}
+		std::copy(added, added + addedCount, vertices + vertexCount);
+		vertexCount += addedCount;
+	}
+	if (indexCount > start)
+		meshlets.push_back(MakeMeshlet(indices + start, indexCount - start, firstIndex + start, positions));
+}
+
+static Meshlet MakeMeshlet(const uint32_t* indices, size_t indexCount, size_t firstIndex, const Vector3* positions) {
+	Meshlet meshlet = {};
+	meshlet.firstIndex = uint32_t(firstIndex);
+	meshlet.indexCount = uint32_t(indexCount);
+
+	//sphere around the center of the bounding box
+	Vector3 lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (size_t i = 0; i < indexCount; i++) {
+		const Vector3& p = positions[indices[i]];
+		lo = Vector3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+		hi = Vector3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+	}
+	const Vector3 center = (lo + hi) * 0.5f;
+	float radius = 0.0f;
+	for (size_t i = 0; i < indexCount; i++)
+		radius = std::max(radius, (positions[indices[i]] - center).L2Norm());
+
+	//normal cone of the triangles (by winding, as GL_CULL_FACE sees them), degenerate ones don't count
+	Vector3 normals[MESHLET_TRIANGLES];
+	const Vector3* corners[MESHLET_TRIANGLES];
+	size_t normalCount = 0;
+	Vector3 axis;
+	for (size_t i = 0; i + 2 < indexCount && normalCount < MESHLET_TRIANGLES; i += 3) {
+		const Vector3& a = positions[indices[i]];
+		Vector3 n = (positions[indices[i + 1]] - a).CrossProduct(positions[indices[i + 2]] - a);
+		const float length = n.L2Norm();
+		if (!(length > 0.0f))
+			continue;
+		n = n / length;
+		corners[normalCount] = &a;
+		normals[normalCount++] = n;
+		axis += n;
+	}
+	axis.Normalize();
+	float minDot = 1.0f;
+	for (size_t t = 0; t < normalCount; t++)
+		minDot = std::min(minDot, axis.DotProduct(normals[t]));
+
+	meshlet.center[0] = center.x;
+	meshlet.center[1] = center.y;
+	meshlet.center[2] = center.z;
+	meshlet.radius = radius;
+	meshlet.coneAxis[0] = axis.x;
+	meshlet.coneAxis[1] = axis.y;
+	meshlet.coneAxis[2] = axis.z;
+	if (normalCount == 0 || !(minDot > 0.0f)) {
+		//cone wider than a hemisphere, some triangle always faces the eye
+		meshlet.coneCutoff = 2.0f;
+		meshlet.coneApex[0] = center.x;
+		meshlet.coneApex[1] = center.y;
+		meshlet.coneApex[2] = center.z;
+		return meshlet;
+	}
+	meshlet.coneCutoff = sqrtf(std::max(0.0f, 1.0f - minDot * minDot));
+
+	//apex on the axis behind the planes of all triangles, so back-facing from it means back-facing from anywhere in the cone
+	float maxT = 0.0f;
+	for (size_t t = 0; t < normalCount; t++)
+		maxT = std::max(maxT, (center - *corners[t]).DotProduct(normals[t]) / axis.DotProduct(normals[t]));
+	const Vector3 apex = center - axis * maxT;
+	meshlet.coneApex[0] = apex.x;
+	meshlet.coneApex[1] = apex.y;
+	meshlet.coneApex[2] = apex.z;
+	return meshlet;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "vector3.h"
+#include "matrix4x4.h"
+
+//limits of a meshlet (as for mesh shaders)
+constexpr size_t MESHLET_VERTICES = 64;
+constexpr size_t MESHLET_TRIANGLES = 124;
+//triangles of a mesh handed to a thread at once, meshlets don't cross their boundaries
+constexpr size_t MESHLET_CHUNK = MESHLET_TRIANGLES * 512;
+
+//Cluster of consecutive triangles of the index buffer with its bounds (std430 layout of meshlet_cull.comp).
+//Triangles facing away from the apex side of the cone are all back-facing: dot(normalize(coneApex - eye), coneAxis) >= coneCutoff.
+struct Meshlet {
+	float center[3];
+	float radius;			//bounding sphere
+	float coneApex[3];
+	float coneCutoff;		//sin of the cone angle, > 1 = the meshlet can't be culled as back-facing
+	float coneAxis[3];
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t pad_[3];
+};
+static_assert(sizeof(Meshlet) == 64, "Meshlet has to match its std430 layout.");
+
+//Arguments of glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand {
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t baseInstance;
+};
+//commands follow the draw count in the command buffer, at the std430 alignment of meshlet_cull.comp
+constexpr size_t MESHLET_COMMANDS_OFFSET = 16;
+
+//View the meshlets are culled for, in the object space of the scene (std140 layout of meshlet_cull.comp).
+struct CullingView {
+	float planes[6][4];		//frustum planes, normalized, inside = dot(plane.xyz, p) + plane.w >= 0
+	float eye[4];
+	uint32_t meshletCount;
+	uint32_t coneCulling;	//back-facing meshlets are culled as well (only valid with GL_CULL_FACE)
+	uint32_t pad_[2];
+};
+
+//Frustum planes of mvp (row-major, GL clip space) & the eye in object space.
+CullingView MakeCullingView(const mat4f& mvp, const Vector3& eye, bool coneCulling);
+
+//Splits triangles [firstIndex, firstIndex + indexCount) of indices into meshlets of consecutive triangles (no reordering,
+//so cache optimized triangles give compact meshlets), positions are indexed by indices.
+void BuildMeshlets(const uint32_t* indices, size_t firstIndex, size_t indexCount, const Vector3* positions, std::vector<Meshlet>& meshlets);
+
+//CPU reference of meshlet_cull.comp.
+bool IsMeshletVisible(const Meshlet& meshlet, const CullingView& view);
+//Writes draw commands of the visible meshlets among count into commands, returns their number.
+size_t CullMeshlets(const Meshlet* meshlets, size_t count, const CullingView& view, DrawElementsIndirectCommand* commands);
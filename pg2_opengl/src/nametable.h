@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+//Interned strings - every distinct name gets an id (0, 1, 2, ... in order of addition), lookups are hash based.
+class NameTable {
+public:
+	//Id of given name, the name is added when it's not known yet.
+	inline int Intern(const std::string& name) {
+		auto [it, added] = ids.try_emplace(name, static_cast<int>(names.size()));
+		if (added)
+			names.push_back(&it->first);
+		return it->second;
+	}
+
+	//Id of given name, -1 when it's not known.
+	inline int Find(const std::string& name) const {
+		auto it = ids.find(name);
+		return (it != ids.end()) ? it->second : -1;
+	}
+
+	inline const std::string& Name(int id) const { return *names[id]; }
+	inline size_t size() const { return names.size(); }
+private:
+	std::unordered_map<std::string, int> ids;
+	std::vector<const std::string*> names;		//keys of ids (nodes of unordered_map don't move)
+};
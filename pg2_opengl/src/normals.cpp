@@ -0,0 +1,209 @@
+#include "pch.h"
+#include "normals.h"
+
+#include <cstring>
+
+#include "parallel.h"
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NORMALS_SSE
+#include <emmintrin.h>
+#endif
+
+//faces handed to a thread at once
+constexpr int FACE_BLOCK = 4096;
+
+//==== float4 - (x, y, z, 0) vector used for the accumulation, SSE when available ====
+//(kept in registers only, arrays hold Vector3 - vectors of __m128 drop its alignment attribute)
+
+#ifdef NORMALS_SSE
+using float4 = __m128;
+
+static inline float4 Load(const Vector3& v) { return _mm_setr_ps(v.x, v.y, v.z, 0.0f); }
+static inline float4 Zero() { return _mm_setzero_ps(); }
+static inline float4 Add(float4 a, float4 b) { return _mm_add_ps(a, b); }
+static inline float4 Sub(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+static inline float4 Scale(float4 a, float s) { return _mm_mul_ps(a, _mm_set1_ps(s)); }
+
+static inline float4 Cross(float4 a, float4 b) {
+	const float4 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	const float4 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	const float4 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+static inline float Dot(float4 a, float4 b) {
+	float4 m = _mm_mul_ps(a, b);
+	m = _mm_add_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(m);
+}
+
+static inline Vector3 Store(float4 a) {
+	alignas(16) float f[4];
+	_mm_store_ps(f, a);
+	return Vector3(f[0], f[1], f[2]);
+}
+#else
+struct float4 { float x, y, z, w; };
+
+static inline float4 Load(const Vector3& v) { return { v.x, v.y, v.z, 0.0f }; }
+static inline float4 Zero() { return { 0.0f, 0.0f, 0.0f, 0.0f }; }
+static inline float4 Add(float4 a, float4 b) { return { a.x + b.x, a.y + b.y, a.z + b.z, 0.0f }; }
+static inline float4 Sub(float4 a, float4 b) { return { a.x - b.x, a.y - b.y, a.z - b.z, 0.0f }; }
+static inline float4 Scale(float4 a, float s) { return { a.x * s, a.y * s, a.z * s, 0.0f }; }
+static inline float4 Cross(float4 a, float4 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x, 0.0f }; }
+//same order of additions as the SSE version, so both give identical results
+static inline float Dot(float4 a, float4 b) { return (a.x * b.x + a.z * b.z) + a.y * b.y; }
+static inline Vector3 Store(float4 a) { return Vector3(a.x, a.y, a.z); }
+#endif
+
+static inline float4 Normalized(float4 a) {
+	const float length2 = Dot(a, a);
+	return (length2 > 0.0f) ? Scale(a, 1.0f / sqrtf(length2)) : Zero();
+}
+
+//Sum of cross products of the triangle fan (= twice the area weighted normal), position(k) returns k-th corner.
+template<typename Fn>
+static inline float4 FanNormal(int no_corners, Fn position) {
+	if (no_corners < 3)
+		return Zero();
+
+	const float4 p0 = Load(position(0));
+	float4 e0 = Sub(Load(position(1)), p0);
+	float4 sum = Zero();
+	for (int k = 2; k < no_corners; k++) {
+		const float4 e1 = Sub(Load(position(k)), p0);
+		sum = Add(sum, Cross(e0, e1));
+		e0 = e1;
+	}
+	return sum;
+}
+
+//Index of the first bitwise identical position for every position.
+static std::vector<int> WeldPositions(const Vector3* positions, size_t count);
+
+//================================= Normals =================================
+
+std::vector<Vector3> GenerateNormals(const PolygonMesh& mesh, float crease_angle, int no_threads) {
+	const int no_faces = static_cast<int>(mesh.no_faces());
+	const int no_blocks = (no_faces + FACE_BLOCK - 1) / FACE_BLOCK;
+	const std::vector<int>& offsets = mesh.face_offsets;
+
+	std::vector<Vector3> normals(mesh.corners.size());
+	const std::vector<int> weld = WeldPositions(mesh.positions, mesh.no_positions);
+
+	// --- area weighted and unit face normals ---
+	std::vector<Vector3> face_normals(no_faces);
+	std::vector<Vector3> face_directions(no_faces);
+
+	ParallelFor(no_blocks, no_threads, [&](int b) {
+		const int end = std::min(no_faces, (b + 1) * FACE_BLOCK);
+		for (int f = b * FACE_BLOCK; f < end; f++) {
+			const int* corners = mesh.corners.data() + offsets[f];
+			const float4 n = FanNormal(offsets[f + 1] - offsets[f], [&](int k) { return mesh.positions[corners[k]]; });
+			face_normals[f] = Store(n);
+			face_directions[f] = Store(Normalized(n));
+		}
+	});
+
+	// --- smooth faces around every welded position, in face order so the sums are deterministic ---
+	std::vector<int> adjacency_offsets(mesh.no_positions + 1, 0);
+	for (int f = 0; f < no_faces; f++) {
+		if (mesh.smoothing_groups[f] != 0) {
+			for (int i = offsets[f]; i < offsets[f + 1]; i++)
+				adjacency_offsets[weld[mesh.corners[i]] + 1]++;
+		}
+	}
+	for (size_t p = 0; p < mesh.no_positions; p++)
+		adjacency_offsets[p + 1] += adjacency_offsets[p];
+
+	std::vector<int> adjacency(adjacency_offsets.back());
+	std::vector<int> cursor(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+	for (int f = 0; f < no_faces; f++) {
+		if (mesh.smoothing_groups[f] != 0) {
+			for (int i = offsets[f]; i < offsets[f + 1]; i++)
+				adjacency[cursor[weld[mesh.corners[i]]]++] = f;
+		}
+	}
+	cursor = std::vector<int>();
+
+	// --- corner normals ---
+	const float min_cos = cosf(crease_angle * float(M_PI) / 180.0f);
+
+	ParallelFor(no_blocks, no_threads, [&](int b) {
+		const int end = std::min(no_faces, (b + 1) * FACE_BLOCK);
+		for (int f = b * FACE_BLOCK; f < end; f++) {
+			const int group = mesh.smoothing_groups[f];
+			const float4 direction = Load(face_directions[f]);
+			const bool degenerate = Dot(direction, direction) == 0.0f;		//takes the normal of its neighbours
+
+			for (int i = offsets[f]; i < offsets[f + 1]; i++) {
+				if (group == 0) {
+					normals[i] = Store(direction);
+					continue;
+				}
+
+				const int p = weld[mesh.corners[i]];
+				float4 sum = Zero();
+				for (int a = adjacency_offsets[p]; a < adjacency_offsets[p + 1]; a++) {
+					const int g = adjacency[a];
+					if (mesh.smoothing_groups[g] == group && (degenerate || Dot(direction, Load(face_directions[g])) >= min_cos))
+						sum = Add(sum, Load(face_normals[g]));
+				}
+
+				const float4 n = Normalized(sum);
+				normals[i] = Store((Dot(n, n) > 0.0f) ? n : direction);
+			}
+		}
+	});
+
+	return normals;
+}
+
+//================================= Helpers =================================
+
+static inline uint64_t HashPosition(const Vector3& v) {
+	uint32_t words[3];
+	memcpy(words, v.data, sizeof(words));
+
+	uint64_t h = 0x9E3779B97F4A7C15ull;
+	for (uint32_t w : words) {
+		h ^= w;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+static std::vector<int> WeldPositions(const Vector3* positions, size_t count) {
+	std::vector<int> weld(count);
+
+	//open addressing hash table of first occurrences, load factor <= 0.5
+	size_t capacity = 16;
+	while (capacity < count * 2)
+		capacity <<= 1;
+	const size_t mask = capacity - 1;
+	std::vector<int> table(capacity, -1);
+
+	for (size_t i = 0; i < count; i++) {
+		const Vector3& v = positions[i];
+
+		size_t slot = HashPosition(v) & mask;
+		while (true) {
+			const int idx = table[slot];
+			if (idx < 0) {
+				table[slot] = static_cast<int>(i);
+				weld[i] = static_cast<int>(i);
+				break;
+			}
+			if (memcmp(positions[idx].data, v.data, sizeof(v.data)) == 0) {
+				weld[i] = idx;
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	return weld;
+}
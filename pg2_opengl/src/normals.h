@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+#include "vector3.h"
+
+//Faces meeting at a sharper angle keep a hard edge even within one smoothing group (degrees).
+constexpr float DEFAULT_CREASE_ANGLE = 60.0f;
+
+//Polygon faces referencing shared positions, input of GenerateNormals.
+struct PolygonMesh {
+	const Vector3* positions = nullptr;
+	size_t no_positions = 0;
+
+	std::vector<int> corners;			//position index of every face corner
+	std::vector<int> face_offsets;		//first corner of every face, one extra entry at the end (= corners.size())
+	std::vector<int> smoothing_groups;	//smoothing group of every face, 0 = flat face
+
+	inline size_t no_faces() const { return smoothing_groups.size(); }
+};
+
+//Computes a normal for every corner of the mesh. Positions are welded by value first, so split vertices of the same point
+//are smoothed as well. A corner gets the area weighted average of the faces around its position that share the smoothing
+//group and don't deviate from its face by more than crease_angle, corners of flat faces get the face normal.
+//The result does not depend on no_threads (0 = all hardware threads).
+std::vector<Vector3> GenerateNormals(const PolygonMesh& mesh, float crease_angle = DEFAULT_CREASE_ANGLE, int no_threads = 0);
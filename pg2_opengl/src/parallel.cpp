@@ -0,0 +1,76 @@
+#include "pch.h"
+#include "parallel.h"
+
+static thread_local bool inParallel = false;
+
+ThreadPool& ThreadPool::Instance() {
+	static ThreadPool pool;
+	return pool;
+}
+
+bool ThreadPool::InParallel() {
+	return inParallel;
+}
+
+ThreadPool::ThreadPool() {
+	const int workers = ResolveThreadCount(0) - 1;
+	threads.reserve(workers);
+	for (int t = 0; t < workers; t++)
+		threads.emplace_back([this]() { Work(); });
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wake.notify_all();
+	for (std::thread& t : threads)
+		t.join();
+}
+
+void ThreadPool::Run(int helpers, void (*task)(void*), void* data) {
+	Job job{ task, data, std::min(helpers, Workers()) };
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int h = 0; h < job.pending; h++)
+			queue.push_back(&job);
+	}
+	wake.notify_all();
+
+	const bool outer = inParallel;
+	inParallel = true;
+	task(data);
+	inParallel = outer;
+
+	//the work is handed out dynamically, so helpers still queued would find none left
+	std::unique_lock<std::mutex> lock(mutex);
+	for (auto it = queue.begin(); it != queue.end();) {
+		if (*it == &job) {
+			it = queue.erase(it);
+			job.pending--;
+		}
+		else
+			++it;
+	}
+	finished.wait(lock, [&]() { return job.pending == 0; });
+}
+
+void ThreadPool::Work() {
+	inParallel = true;
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		wake.wait(lock, [&]() { return stop || !queue.empty(); });
+		if (queue.empty())
+			return;
+		Job* job = queue.front();
+		queue.pop_front();
+
+		lock.unlock();
+		job->task(job->data);
+		lock.lock();
+
+		if (--job->pending == 0)
+			finished.notify_all();
+	}
+}
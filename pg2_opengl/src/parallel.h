@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+//Number of threads to use when 0 (= automatic) is requested.
+inline int ResolveThreadCount(int no_threads) {
+	if (no_threads > 0)
+		return no_threads;
+	int hw = static_cast<int>(std::thread::hardware_concurrency());
+	return (hw > 0) ? hw : 1;
+}
+
+//Persistent worker threads of ParallelFor (all hardware threads but one, started on first use), shared by all callers.
+class ThreadPool {
+public:
+	static ThreadPool& Instance();
+	//True on the workers & on threads inside Run, their ParallelFor calls run serially (nested calls don't multiply threads).
+	static bool InParallel();
+
+	//Runs task(data) on the calling thread and on up to helpers idle workers, returns once all of them have finished.
+	//Helpers which haven't started by the time the calling thread is done are withdrawn.
+	void Run(int helpers, void (*task)(void*), void* data);
+	inline int Workers() const { return int(threads.size()); }
+private:
+	struct Job {
+		void (*task)(void*);
+		void* data;
+		int pending;		//queued & running helpers
+	};
+
+	ThreadPool();
+	~ThreadPool();
+	void Work();
+private:
+	std::vector<std::thread> threads;
+	std::deque<Job*> queue;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	bool stop = false;
+};
+
+//Calls fn(i) for every i in <0, count) using up to no_threads threads (0 = all hardware threads), the calling thread plus ThreadPool workers.
+//More threads than the pool's workers + 1 are never used.
+//Items are handed out dynamically, the calling thread takes part in the work. Calls nested in another ParallelFor run serially.
+template<typename Fn>
+void ParallelFor(int count, int no_threads, Fn&& fn) {
+	const int workers = std::min(ResolveThreadCount(no_threads), count);
+	if (workers <= 1 || ThreadPool::InParallel()) {
+		for (int i = 0; i < count; i++)
+			fn(i);
+		return;
+	}
+
+	std::atomic<int> next = 0;
+	auto work = [&]() {
+		for (int i = next++; i < count; i = next++)
+			fn(i);
+	};
+	ThreadPool::Instance().Run(workers - 1, [](void* w) { (*static_cast<decltype(work)*>(w))(); }, &work);
+}
@@ -0,0 +1,517 @@
+#include "pch.h"
+#include "ply.h"
+
+#include <cstring>
+#include <memory>
+#include <filesystem>
+
+#include "log.h"
+#include "arena.h"
+#include "vertex.h"
+#include "material.h"
+#include "geometry.h"
+#include "parallel.h"
+#include "scene.h"
+
+//faces (vertices) handed to a thread at once
+constexpr size_t PLY_BLOCK = size_t(1) << 16;
+
+//scalar types of PLY properties
+enum PLYType { PLY_NONE, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+
+static const struct {
+	const char* name;
+	const char* alias;
+	PLYType type;
+	size_t size;
+} PLY_TYPES[] = {
+	{ "char", "int8", PLY_INT8, 1 }, { "uchar", "uint8", PLY_UINT8, 1 }, { "short", "int16", PLY_INT16, 2 },
+	{ "ushort", "uint16", PLY_UINT16, 2 }, { "int", "int32", PLY_INT32, 4 }, { "uint", "uint32", PLY_UINT32, 4 },
+	{ "float", "float32", PLY_FLOAT32, 4 }, { "double", "float64", PLY_FLOAT64, 8 } };
+
+static PLYType ParseType(const std::string& name) {
+	for (const auto& t : PLY_TYPES)
+		if (name == t.name || name == t.alias)
+			return t.type;
+	return PLY_NONE;
+}
+
+static inline size_t TypeSize(int type) {
+	return PLY_TYPES[type - 1].size;
+}
+
+//Little-endian scalar at p converted to double (exact for all PLY types).
+static inline double ReadScalar(const char* p, int type) {
+	switch (type) {
+		case PLY_INT8: return *reinterpret_cast<const int8_t*>(p);
+		case PLY_UINT8: return *reinterpret_cast<const uint8_t*>(p);
+		case PLY_INT16: { int16_t v; memcpy(&v, p, sizeof(v)); return v; }
+		case PLY_UINT16: { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+		case PLY_INT32: { int32_t v; memcpy(&v, p, sizeof(v)); return v; }
+		case PLY_UINT32: { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+		case PLY_FLOAT32: { float v; memcpy(&v, p, sizeof(v)); return v; }
+		default: { double v; memcpy(&v, p, sizeof(v)); return v; }
+	}
+}
+
+//Vertex index at p, negative ones become 0 (they are clamped anyway).
+static inline uint32_t ReadIndex(const char* p, int type) {
+	switch (type) {
+		case PLY_UINT8: return *reinterpret_cast<const uint8_t*>(p);
+		case PLY_UINT16: { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+		case PLY_INT32:
+		case PLY_UINT32: {
+			uint32_t v;
+			memcpy(&v, p, sizeof(v));
+			return (type == PLY_INT32 && int32_t(v) < 0) ? 0 : v;
+		}
+		default: {
+			const double v = ReadScalar(p, type);
+			return v > 0.0 ? uint32_t(std::min(v, 4294967295.0)) : 0;
+		}
+	}
+}
+
+//================================= PLYModel =================================
+
+bool PLYModel::IsPLY(const char* path) {
+	std::string ext = std::filesystem::path(path).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return char(tolower(c)); });
+	return ext == PLY_EXTENSION;
+}
+
+GLenum PLYModel::IndexType() const {
+	return (vertexCount <= 0xFFFF) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+bool PLYModel::Open(const char* filepath, int no_threads) {
+	file = MappedFile(filepath);
+	if (!file.IsOpen()) {
+		errlog("PLY '%s' not found.\n", filepath);
+		return false;
+	}
+	name = filepath;
+
+	std::vector<Element> elements;
+	const char* p = nullptr;
+	if (!ReadHeader(filepath, elements, p))
+		return false;
+
+	//element blocks follow each other, only the faces and lists of other elements need to be walked through
+	for (const Element& element : elements) {
+		if (element.name == "vertex" && vertexData == nullptr) {
+			vertexData = p;
+			if (!ReadVertices(element))
+				return false;
+			p += vertexStride * vertexCount;
+			continue;
+		}
+		if (element.name == "face" && faceData == nullptr) {
+			faceData = p;
+			faceProperties = element.properties;
+			p = ReadFaces(element, no_threads);
+			if (p == nullptr) {
+				errlog("PLY '%s': invalid faces.\n", filepath);
+				return false;
+			}
+			continue;
+		}
+		for (size_t i = 0; i < element.count && p; i++) {
+			for (const Property& property : element.properties) {
+				if (p > file.End() || size_t(file.End() - p) < TypeSize(property.countType ? property.countType : property.type)) {
+					p = nullptr;
+					break;
+				}
+				p += property.countType ? TypeSize(property.countType) + ReadIndex(p, property.countType) * TypeSize(property.type)
+										: TypeSize(property.type);
+			}
+		}
+		if (p == nullptr || p > file.End()) {
+			errlog("PLY '%s' is truncated.\n", filepath);
+			return false;
+		}
+	}
+	if (vertexData == nullptr || vertexCount == 0 || triangleCount == 0) {
+		errlog("PLY '%s' has no triangles.\n", filepath);
+		return false;
+	}
+	if (vertexCount > UINT32_MAX || triangleCount * 3 > INT32_MAX) {
+		errlog("PLY '%s' is too large (more than %d indices).\n", filepath, INT32_MAX);
+		return false;
+	}
+
+	GenerateAttributes(no_threads);
+
+	errlog("PLY '%s': %zu vertices, %zu triangles (%s), %s.\n", filepath, vertexCount, triangleCount,
+		   faceStride ? "read in place" : "triangulated", normal[0].offset < 0 ? "normals generated" : "with normals");
+	return true;
+}
+
+bool PLYModel::ReadHeader(const char* filepath, std::vector<Element>& elements, const char*& body) {
+	const char* p = file.Data();
+	const char* end = file.End();
+	bool binary = false;
+
+	for (int line = 0; p < end; line++) {
+		const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+		if (eol == nullptr)
+			break;
+		std::vector<std::string> tokens;
+		for (const char* t = p; t < eol;) {
+			while (t < eol && isspace((unsigned char)*t))
+				t++;
+			const char* begin = t;
+			while (t < eol && !isspace((unsigned char)*t))
+				t++;
+			if (t > begin)
+				tokens.emplace_back(begin, t);
+		}
+		p = eol + 1;
+
+		if (line == 0) {
+			if (tokens.size() != 1 || tokens[0] != "ply")
+				break;
+			continue;
+		}
+		if (tokens.empty() || tokens[0] == "comment" || tokens[0] == "obj_info")
+			continue;
+		if (tokens[0] == "end_header") {
+			if (!binary)
+				break;
+			body = p;
+			return true;
+		}
+		if (tokens[0] == "format" && tokens.size() >= 2) {
+			binary = (tokens[1] == "binary_little_endian");
+			if (!binary) {
+				errlog("PLY '%s': %s format is not supported, only binary_little_endian.\n", filepath, tokens[1].c_str());
+				return false;
+			}
+		}
+		else if (tokens[0] == "element" && tokens.size() == 3) {
+			elements.push_back({ tokens[1], size_t(strtoull(tokens[2].c_str(), nullptr, 10)), {} });
+		}
+		else if (tokens[0] == "property" && !elements.empty()) {
+			Property property{ tokens.back(), PLY_NONE, PLY_NONE };
+			if (tokens.size() == 5 && tokens[1] == "list") {
+				property.countType = ParseType(tokens[2]);
+				property.type = ParseType(tokens[3]);
+				if (property.countType == PLY_NONE || property.countType == PLY_FLOAT32 || property.countType == PLY_FLOAT64)
+					property.type = PLY_NONE;
+			}
+			else if (tokens.size() == 3) {
+				property.type = ParseType(tokens[1]);
+			}
+			if (property.type == PLY_NONE) {
+				errlog("PLY '%s': invalid property on line %d.\n", filepath, line + 1);
+				return false;
+			}
+			elements.back().properties.push_back(property);
+		}
+	}
+	errlog("PLY '%s' has no valid header.\n", filepath);
+	return false;
+}
+
+bool PLYModel::ReadVertices(const Element& element) {
+	static const char* NAMES[] = { "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue", "u", "v" };
+	static const char* UV_ALIASES[][2] = { { "s", "t" }, { "texture_u", "texture_v" }, { "texture_s", "texture_t" } };
+	Attribute* attributes[] = { &position[0], &position[1], &position[2], &normal[0], &normal[1], &normal[2],
+								&color[0], &color[1], &color[2], &uv[0], &uv[1] };
+
+	for (const Property& property : element.properties) {
+		if (property.countType) {
+			errlog("PLY '%s': list properties of vertices are not supported.\n", name.c_str());
+			return false;
+		}
+		for (int a = 0; a < 11; a++) {
+			bool match = (property.name == NAMES[a]);
+			for (const auto& alias : UV_ALIASES)
+				match = match || (a >= 9 && property.name == alias[a - 9]);
+			if (match && attributes[a]->offset < 0)
+				*attributes[a] = { int(vertexStride), property.type };
+		}
+		vertexStride += TypeSize(property.type);
+	}
+	vertexCount = element.count;
+
+	if (position[0].offset < 0 || position[1].offset < 0 || position[2].offset < 0) {
+		errlog("PLY '%s': vertices have no positions.\n", name.c_str());
+		return false;
+	}
+	//attributes are used only when complete
+	if (normal[0].offset < 0 || normal[1].offset < 0 || normal[2].offset < 0)
+		normal[0].offset = normal[1].offset = normal[2].offset = -1;
+	if (color[0].offset < 0 || color[1].offset < 0 || color[2].offset < 0)
+		color[0].offset = color[1].offset = color[2].offset = -1;
+	if (uv[0].offset < 0 || uv[1].offset < 0)
+		uv[0].offset = uv[1].offset = -1;
+	if (color[0].type == PLY_UINT8 || color[0].type == PLY_UINT16)
+		colorScale = 1.0f / float((color[0].type == PLY_UINT8) ? 0xFF : 0xFFFF);
+
+	if (vertexCount > size_t(file.End() - vertexData) / vertexStride) {
+		errlog("PLY '%s' is truncated.\n", name.c_str());
+		return false;
+	}
+	return true;
+}
+
+const char* PLYModel::ParseFace(const char* p, const char* end, const char*& indices, size_t& count) const {
+	indices = nullptr;
+	count = 0;
+	for (size_t i = 0; i < faceProperties.size(); i++) {
+		const Property& property = faceProperties[i];
+		if (!property.countType) {
+			p += TypeSize(property.type);
+			continue;
+		}
+		if (p > end || size_t(end - p) < TypeSize(property.countType))
+			return nullptr;
+		const size_t n = ReadIndex(p, property.countType);
+		p += TypeSize(property.countType);
+		if (int(i) == indicesProperty) {
+			indices = p;
+			count = n;
+		}
+		p += n * TypeSize(property.type);
+	}
+	return p <= end ? p : nullptr;
+}
+
+const char* PLYModel::ReadFaces(const Element& element, int no_threads) {
+	for (size_t i = 0; i < faceProperties.size(); i++)
+		if (faceProperties[i].countType && (faceProperties[i].name == "vertex_indices" || faceProperties[i].name == "vertex_index"))
+			indicesProperty = int(i);
+	if (indicesProperty < 0 || faceProperties[indicesProperty].type == PLY_FLOAT32 || faceProperties[indicesProperty].type == PLY_FLOAT64)
+		return nullptr;
+	const int type = faceProperties[indicesProperty].type;
+	const size_t faceCount = element.count;
+	if (faceCount == 0)
+		return faceData;
+
+	//uniform faces: the layout of the first face repeats, checked in parallel
+	const char* indices;
+	size_t corners;
+	const char* first = ParseFace(faceData, file.End(), indices, corners);
+	if (first == nullptr)
+		return nullptr;
+	const size_t stride = size_t(first - faceData);
+	bool uniform = corners >= 3 && faceCount <= size_t(file.End() - faceData) / stride;
+	if (uniform) {
+		std::atomic<bool> mismatch{ false };
+		ParallelFor(int((faceCount + PLY_BLOCK - 1) / PLY_BLOCK), no_threads, [&](int block) {
+			const size_t end = std::min(faceCount, (block + 1) * PLY_BLOCK);
+			for (size_t f = block * PLY_BLOCK; f < end && !mismatch.load(std::memory_order_relaxed); f++) {
+				const char* face = faceData + f * stride;
+				const char* faceIndices;
+				size_t n;
+				if (ParseFace(face, face + stride, faceIndices, n) != face + stride || n != corners) {
+					mismatch = true;
+					break;
+				}
+			}
+		});
+		uniform = !mismatch;
+	}
+	if (uniform) {
+		faceStride = stride;
+		faceIndexOffset = size_t(indices - faceData);
+		faceCorners = corners;
+		triangleCount = faceCount * (corners - 2);
+		return faceData + faceCount * stride;
+	}
+
+	//mixed polygons, triangulated as fans
+	const char* p = faceData;
+	triangles.reserve(std::min(faceCount, size_t(file.End() - faceData) / TypeSize(type)) * 3);
+	for (size_t f = 0; f < faceCount; f++) {
+		p = ParseFace(p, file.End(), indices, corners);
+		if (p == nullptr)
+			return nullptr;
+		const size_t size = TypeSize(type);
+		for (size_t c = 2; c < corners; c++) {
+			triangles.push_back(ReadIndex(indices, type));
+			triangles.push_back(ReadIndex(indices + (c - 1) * size, type));
+			triangles.push_back(ReadIndex(indices + c * size, type));
+		}
+	}
+	triangles.shrink_to_fit();
+	triangleCount = triangles.size() / 3;
+	return p;
+}
+
+uint32_t PLYModel::Corner(size_t t, int corner) const {
+	uint32_t index;
+	if (faceStride) {
+		//fan of a uniform face
+		const size_t fan = faceCorners - 2;
+		const size_t k = (corner == 0) ? 0 : t % fan + corner;
+		const int type = faceProperties[indicesProperty].type;
+		index = ReadIndex(faceData + (t / fan) * faceStride + faceIndexOffset + k * TypeSize(type), type);
+	}
+	else {
+		index = triangles[t * 3 + corner];
+	}
+	return std::min(index, uint32_t(vertexCount - 1));
+}
+
+float PLYModel::ReadAttribute(size_t vertex, const Attribute& attribute) const {
+	return float(ReadScalar(vertexData + vertex * vertexStride + attribute.offset, attribute.type));
+}
+
+Vector3 PLYModel::Position(size_t vertex) const {
+	return Vector3(ReadAttribute(vertex, position[0]), ReadAttribute(vertex, position[1]), ReadAttribute(vertex, position[2]));
+}
+
+void PLYModel::GenerateAttributes(int no_threads) {
+	const bool generateNormals = normal[0].offset < 0;
+	const bool generateTangents = uv[0].offset >= 0;		//otherwise any perpendicular direction, see CopyVertices
+	if (!generateNormals && !generateTangents)
+		return;
+	const int vertexBlocks = int((vertexCount + PLY_BLOCK - 1) / PLY_BLOCK);
+	const int triangleBlocks = int((triangleCount + PLY_BLOCK - 1) / PLY_BLOCK);
+
+	// --- triangles around every vertex, sorted so the sums don't depend on the threads ---
+	std::unique_ptr<std::atomic<uint32_t>[]> cursor(new std::atomic<uint32_t>[vertexCount + 1]);
+	ParallelFor(vertexBlocks, no_threads, [&](int block) {
+		const size_t end = std::min(vertexCount + 1, (block + 1) * PLY_BLOCK + 1);
+		for (size_t v = block * PLY_BLOCK; v < end; v++)
+			cursor[v].store(0, std::memory_order_relaxed);
+	});
+	ParallelFor(triangleBlocks, no_threads, [&](int block) {
+		const size_t end = std::min(triangleCount, (block + 1) * PLY_BLOCK);
+		for (size_t t = block * PLY_BLOCK; t < end; t++)
+			for (int c = 0; c < 3; c++)
+				cursor[Corner(t, c) + 1].fetch_add(1, std::memory_order_relaxed);
+	});
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) {
+		offsets[v + 1] = offsets[v] + cursor[v + 1].load(std::memory_order_relaxed);
+		cursor[v].store(offsets[v], std::memory_order_relaxed);
+	}
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	ParallelFor(triangleBlocks, no_threads, [&](int block) {
+		const size_t end = std::min(triangleCount, (block + 1) * PLY_BLOCK);
+		for (size_t t = block * PLY_BLOCK; t < end; t++)
+			for (int c = 0; c < 3; c++)
+				adjacency[cursor[Corner(t, c)].fetch_add(1, std::memory_order_relaxed)] = uint32_t(t);
+	});
+	cursor.reset();
+
+	// --- area weighted normals & tangents of the triangles around every vertex ---
+	if (generateNormals)
+		normals.resize(vertexCount);
+	if (generateTangents)
+		tangents.resize(vertexCount);
+	ParallelFor(vertexBlocks, no_threads, [&](int block) {
+		const size_t end = std::min(vertexCount, (block + 1) * PLY_BLOCK);
+		for (size_t v = block * PLY_BLOCK; v < end; v++) {
+			std::sort(adjacency.begin() + offsets[v], adjacency.begin() + offsets[v + 1]);
+
+			Vector3 n, tangent, bitangent;
+			for (uint32_t a = offsets[v]; a < offsets[v + 1]; a++) {
+				const size_t t = adjacency[a];
+				const uint32_t i0 = Corner(t, 0), i1 = Corner(t, 1), i2 = Corner(t, 2);
+				const Vector3 p0 = Position(i0);
+				const Vector3 e1 = Position(i1) - p0;
+				const Vector3 e2 = Position(i2) - p0;
+				const Vector3 cross = e1.CrossProduct(e2);
+				n += cross;
+				if (!generateTangents)
+					continue;
+
+				//as in GenerateTangents
+				const float u0 = ReadAttribute(i0, uv[0]), v0 = ReadAttribute(i0, uv[1]);
+				const float du1 = ReadAttribute(i1, uv[0]) - u0, dv1 = ReadAttribute(i1, uv[1]) - v0;
+				const float du2 = ReadAttribute(i2, uv[0]) - u0, dv2 = ReadAttribute(i2, uv[1]) - v0;
+				const float det = du1 * dv2 - du2 * dv1;
+				if (!(fabsf(det) > 1e-12f))
+					continue;
+				Vector3 ft = (dv2 * e1 - dv1 * e2) / det;
+				Vector3 fb = (du1 * e2 - du2 * e1) / det;
+				const float area = 0.5f * cross.L2Norm();
+				if (ft.SqrL2Norm() > 0.0f)
+					tangent += ft.Normalize() * area;
+				if (fb.SqrL2Norm() > 0.0f)
+					bitangent += fb.Normalize() * area;
+			}
+
+			if (generateNormals) {
+				normals[v] = (n.SqrL2Norm() > 0.0f) ? n.Normalize() : Vector3(0.0f, 0.0f, 1.0f);
+				n = normals[v];
+			}
+			else {
+				n = Vector3(ReadAttribute(v, normal[0]), ReadAttribute(v, normal[1]), ReadAttribute(v, normal[2]));
+			}
+			if (generateTangents) {
+				const Vector3 direction = OrthogonalTangent(tangent, bitangent, n);
+				tangents[v] = Tangent{ direction, TangentHandedness(direction, bitangent, n) };
+			}
+		}
+	});
+}
+
+void PLYModel::LoadMaterials(std::vector<Material*>& materials, Arena* arena) const {
+	Material* material = ArenaNew<Material>(arena);
+	material->set_name("default");
+	material->set_shader(Shader::PBR);
+	material->ior = 1.5f;
+	materials.push_back(material);
+}
+
+void PLYModel::LoadMeshes(std::vector<Mesh>& meshes, const std::vector<Material*>& materials) const {
+	const size_t first = meshes.size();
+	for (size_t t = 0; t < triangleCount; t += PLY_MESH_TRIANGLES)
+		meshes.push_back(Mesh(int(t * 3), int(std::min(PLY_MESH_TRIANGLES, triangleCount - t) * 3), materials[0]));
+
+	ParallelFor(static_cast<int>(meshes.size() - first), 0, [&](int m) {
+		Mesh& mesh = meshes[first + m];
+		for (size_t t = size_t(mesh.offset) / 3, end = t + size_t(mesh.count) / 3; t < end; t++)
+			for (int corner = 0; corner < 3; corner++)
+				mesh.Extend(Position(Corner(t, corner)));
+	});
+}
+
+//================================= Buffers =================================
+
+void PLYModel::CopyVertices(size_t first, size_t count, Vertex* destination) const {
+	for (size_t i = first; i < first + count; i++) {
+		Vertex vertex;
+		vertex.position = Position(i);
+		if (normals.empty())
+			vertex.normal = Vector3(ReadAttribute(i, normal[0]), ReadAttribute(i, normal[1]), ReadAttribute(i, normal[2])).Normalize();
+		else
+			vertex.normal = normals[i];
+
+		//LoadOBJ's default color
+		vertex.color = Vector3(0.5f, 0.5f, 0.5f);
+		if (color[0].offset >= 0)
+			vertex.color = Vector3(ReadAttribute(i, color[0]), ReadAttribute(i, color[1]), ReadAttribute(i, color[2])) * colorScale;
+
+		vertex.texture_coords[0] = { 0.0f, 0.0f };
+		if (uv[0].offset >= 0)
+			vertex.texture_coords[0] = { ReadAttribute(i, uv[0]), ReadAttribute(i, uv[1]) };
+
+		if (tangents.empty()) {
+			vertex.tangent = OrthogonalTangent(Vector3(), Vector3(), vertex.normal);
+		}
+		else {
+			vertex.tangent = tangents[i].direction;
+			vertex.handedness = tangents[i].handedness;
+		}
+		vertex.matIdx = 0;
+
+		destination[i - first] = vertex;
+	}
+}
+
+void PLYModel::CopyIndices(size_t first, size_t count, void* destination) const {
+	const bool shortIndices = (IndexType() == GL_UNSIGNED_SHORT);
+	for (size_t i = first; i < first + count; i++) {
+		const uint32_t index = Corner(i / 3, int(i % 3));
+		if (shortIndices)
+			static_cast<uint16_t*>(destination)[i - first] = uint16_t(index);
+		else
+			static_cast<uint32_t*>(destination)[i - first] = index;
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "mappedfile.h"
+#include "vector3.h"
+#include "geometry.h"
+
+class Mesh;
+class Material;
+class Arena;
+struct Vertex;
+
+//extension of PLY models (see PLYModel)
+constexpr const char* PLY_EXTENSION = ".ply";
+//triangles of one mesh of a PLY model, so huge scans appear progressively while they are uploaded
+constexpr size_t PLY_MESH_TRIANGLES = size_t(1) << 20;
+
+//Binary little-endian PLY model (scans, photogrammetry). Only the header is parsed, vertex and face element blocks stay in the
+//mapped file and are converted straight into the final buffers (see CopyVertices & CopyIndices), like a mesh asset.
+//Vertex properties x, y, z, nx, ny, nz, red, green, blue and u, v (s, t) of any scalar type are used, others are skipped.
+//Faces with the same layout (all triangles, the common case) are read in place, other polygons are triangulated as fans once.
+//Missing normals (area weighted) and tangents are generated in parallel. All faces use one default material.
+class PLYModel {
+public:
+	PLYModel() {}
+	~PLYModel() {}
+
+	//copy deleted
+	PLYModel(const PLYModel&) = delete;
+	PLYModel& operator=(const PLYModel&) = delete;
+
+	//Maps the file and reads its structure, no_threads check the faces & generate missing attributes (0 = all).
+	bool Open(const char* filepath, int no_threads = 0);
+	static bool IsPLY(const char* path);
+
+	inline size_t VertexCount() const { return vertexCount; }
+	inline size_t IndexCount() const { return triangleCount * 3; }
+	//Smallest GL index type able to address all vertices (as IndexedGeometry::IndexType).
+	GLenum IndexType() const;
+
+	//Creates the default material of the model.
+	void LoadMaterials(std::vector<Material*>& materials, Arena* arena = nullptr) const;
+	//Meshes of PLY_MESH_TRIANGLES triangles in file order (not split spatially, see SplitSurfaces) with their bounding boxes.
+	void LoadMeshes(std::vector<Mesh>& meshes, const std::vector<Material*>& materials) const;
+
+	//Writes vertices [first, first + count) into destination (meant for write-only mapped memory).
+	void CopyVertices(size_t first, size_t count, Vertex* destination) const;
+	//Writes indices [first, first + count) in IndexType() into destination, out of range indices are clamped.
+	void CopyIndices(size_t first, size_t count, void* destination) const;
+private:
+	//Property of an element record, vertex indices of faces are a list.
+	struct Property {
+		std::string name;
+		int type;			//PLY type (see ply.cpp), of list items
+		int countType;		//of lists, 0 = scalar
+	};
+	struct Element {
+		std::string name;
+		size_t count;
+		std::vector<Property> properties;
+	};
+	//Scalar property of the vertex element used by the renderer, offset -1 = not present.
+	struct Attribute {
+		int offset = -1;
+		int type = 0;
+	};
+
+	bool ReadHeader(const char* filepath, std::vector<Element>& elements, const char*& body);
+	bool ReadVertices(const Element& element);
+	//Finds the layout of the faces, returns the end of their block (nullptr on errors).
+	const char* ReadFaces(const Element& element, int no_threads);
+	void GenerateAttributes(int no_threads);
+
+	//Parses a face at p, returns its end (nullptr past end) and where its vertex indices are.
+	const char* ParseFace(const char* p, const char* end, const char*& indices, size_t& count) const;
+	//Vertex index of given corner of triangle t (clamped).
+	uint32_t Corner(size_t t, int corner) const;
+	float ReadAttribute(size_t vertex, const Attribute& attribute) const;
+	Vector3 Position(size_t vertex) const;
+private:
+	MappedFile file;
+	std::string name;
+
+	//vertex element block, fixed size records
+	const char* vertexData = nullptr;
+	size_t vertexStride = 0;
+	size_t vertexCount = 0;
+	Attribute position[3], normal[3], color[3], uv[2];
+	float colorScale = 1.0f;			//1 / 255 for integer colors
+
+	//face element block
+	const char* faceData = nullptr;
+	std::vector<Property> faceProperties;
+	int indicesProperty = -1;			//vertex_indices (vertex_index) in faceProperties
+	size_t faceStride = 0;				//of uniform faces (same layout & polygon size), 0 = triangles are stored
+	size_t faceIndexOffset = 0;			//offset of the first vertex index in a uniform face
+	size_t faceCorners = 0;				//polygon size of uniform faces
+	std::vector<uint32_t> triangles;	//fan triangulated polygons of faces which are not uniform
+	size_t triangleCount = 0;
+
+	//generated when missing, tangents only for models with texture coordinates
+	std::vector<Vector3> normals;
+	std::vector<Tangent> tangents;
+};
@@ -9,6 +9,13 @@
 
 double lastTime = 0.0;
 
+//frame time statistics, logged every FRAME_TIME_PERIOD seconds
+constexpr double FRAME_TIME_PERIOD = 5.0;
+double frameTimeSum = 0.0;
+int frameCount = 0;
+double drawnTriangleSum = 0.0;		//part of the triangles drawn with levels of detail & impostors, summed over the frames
+double impostorSum = 0.0;			//impostors drawn, summed over the frames
+
 InputButton wireframeToggle;
 bool wireframeState = false;
 
@@ -32,16 +39,47 @@ Rasterizer::Rasterizer(int width, int height, float fovY_deg, const vec3f& viewF
 	InitDevice();
 }
 
-void Rasterizer::LoadScene(const char* filepath) {
-	scene = Scene(filepath);
+void Rasterizer::LoadScene(const char* filepath, bool async, VertexFormat format, VertexStreams streams, bool meshlets, bool lods) {
+	scene = Scene(filepath, async, Scene::DEFAULT_MEMORY_LIMIT, format, streams, meshlets, lods);
 }
 
 void Rasterizer::LoadShader(const char* vShaderPath, const char* fShaderPath) {
 	shader = ShaderProgram(vShaderPath, fShaderPath);
 }
 
+void Rasterizer::LoadDepthShader(const char* vShaderPath, const char* fShaderPath) {
+	depthShader = ShaderProgram(vShaderPath, fShaderPath);
+	depthPrepass = true;
+}
+
+void Rasterizer::EnableMeshletCulling(bool backfaces, const char* cShaderPath) {
+	if (cShaderPath != nullptr) {
+		cullShader = ShaderProgram(cShaderPath);
+		gpuCulling = true;
+	}
+	meshletCulling = true;
+	backfaceCulling = backfaces;
+	if (backfaceCulling) {
+		//counter-clockwise front faces, glClipControl flips the sense together with the y axis
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_BACK);
+	}
+}
+
+void Rasterizer::LoadImpostorShader(const char* vShaderPath, const char* fShaderPath) {
+	impostorShader = ShaderProgram(vShaderPath, fShaderPath);
+	impostors = true;
+	//uniforms are uploaded into the bound program
+	shader.Bind();
+}
+
 void Rasterizer::LoadIrradianceMap(const char* filepath) {
 	tex_irrMap = Texture3f::LoadBindless(filepath);
+	if (impostors) {
+		impostorShader.Bind();
+		impostorShader.UploadARBHandle("tex_irradianceMap", tex_irrMap.handle);
+		shader.Bind();
+	}
 	shader.UploadARBHandle("tex_irradianceMap", tex_irrMap.handle);
 }
 
@@ -60,6 +98,12 @@ int Rasterizer::MainLoop() {
 	errlog("--------------------------------\n");
 
 	CameraController camCtrl = CameraController(camera, window);
+	if (impostors) {
+		impostorShader.Bind();
+		impostorShader.UploadFloat3("light_attenuation", light.attenuation.data);
+		impostorShader.UploadFloat3("light_color", light.color.data);
+		impostorShader.UploadFloat3("p_light", light.position.data);
+	}
 	shader.Bind();
 
 	//Upload light
@@ -123,7 +167,72 @@ int Rasterizer::MainLoop() {
 			N = mat4f::EuclideanInverse(M).transpose();
 		}
 
-		scene.Draw();
+		scene.Update();
+		//known once the geometry buffers of an async scene exist
+		const int packedVertices = scene.Format() == VertexFormat::PACKED;
+
+		//meshlets outside of the frustum are skipped by both passes, the eye is needed in object space for the normal cones & the levels of detail
+		const bool culled = meshletCulling && scene.HasMeshlets();
+		const bool selected = !culled && (scene.HasLODs() || (impostors && scene.HasImpostors()));
+		Vector3 eye;
+		if (culled || selected) {
+			const mat4f Minv = mat4f::EuclideanInverse(M);
+			const vec3f from = camera.ViewFrom();
+			for (int r = 0; r < 3; r++)
+				eye.data[r] = Minv.get(r, 0) * from.x + Minv.get(r, 1) * from.y + Minv.get(r, 2) * from.z + Minv.get(r, 3);
+		}
+		if (culled) {
+			scene.CullMeshlets(MakeCullingView(MVP, eye, backfaceCulling), gpuCulling ? &cullShader : nullptr);
+			shader.Bind();
+		}
+		else if (selected) {
+			//a unit at distance 1 covers |P(1, 1)| half-heights of the viewport
+			const float pixelsPerUnit = fabsf(camera.P.get(1, 1)) * camera.GetHeight() * 0.5f;
+			scene.SelectLODs(eye, pixelsPerUnit);
+			if (impostors)
+				impostorSum += double(scene.SelectImpostors(eye, pixelsPerUnit));
+			drawnTriangleSum += double(scene.SelectedTriangles()) / std::max<size_t>(scene.TriangleCount(), 1);
+		}
+
+		if (depthPrepass) {
+			//positions only, the shading pass keeps the depth buffer and shades the nearest fragments
+			depthShader.Bind();
+			depthShader.UploadMat4("MVP", MVP.data(), false);
+			depthShader.UploadInt("packedVertices", packedVertices, false);
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			if (culled)
+				scene.DrawMeshlets(true);
+			else
+				scene.DrawDepth();
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glDepthMask(GL_FALSE);
+			glDepthFunc(GL_LEQUAL);
+			shader.Bind();
+		}
+
+		shader.UploadInt("packedVertices", packedVertices, false);
+		if (culled)
+			scene.DrawMeshlets();
+		else
+			scene.Draw();
+
+		if (depthPrepass) {
+			//depth writes are needed by the clear of the next frame
+			glDepthMask(GL_TRUE);
+			glDepthFunc(GL_LESS);
+		}
+
+		if (selected && impostors) {
+			//after the prepass, impostors write their depth (reconstructed from the atlas) in the shading pass only
+			impostorShader.Bind();
+			impostorShader.UploadMat4("MVP", MVP.data(), false);
+			impostorShader.UploadMat4("M", M.data(), false);
+			impostorShader.UploadMat4("MN", N.data(), false);
+			impostorShader.UploadFloat3("eye", eye.data, false);
+			impostorShader.UploadInt("impostorGrid", scene.ImpostorGrid(), false);
+			scene.DrawImpostors();
+			shader.Bind();
+		}
 
 		//======================
 		glfwSwapBuffers(window);
@@ -168,6 +277,20 @@ void Rasterizer::UpdateDeltaTime() {
 	double currTime = glfwGetTime();
 	deltaTime = static_cast<float>(currTime - lastTime);
 	lastTime = currTime;
+
+	frameTimeSum += deltaTime;
+	frameCount++;
+	if (frameTimeSum >= FRAME_TIME_PERIOD) {
+		if (drawnTriangleSum > 0.0)
+			errlog("Average frame time %.3f ms (%d frames), %.1f%% of the triangles drawn, %.1f impostors.\n", 1000.0 * frameTimeSum / frameCount, frameCount,
+				   100.0 * drawnTriangleSum / frameCount, impostorSum / frameCount);
+		else
+			errlog("Average frame time %.3f ms (%d frames).\n", 1000.0 * frameTimeSum / frameCount, frameCount);
+		frameTimeSum = 0.0;
+		frameCount = 0;
+		drawnTriangleSum = 0.0;
+		impostorSum = 0.0;
+	}
 }
 
 
@@ -13,8 +13,21 @@ class Rasterizer {
 public:
 	Rasterizer(int width, int height, float fovY_deg, const vec3f& viewFrom, const vec3f& viewAt, float nearPlane, float farPlane);
 
-	void LoadScene(const char* filepath);
+	//Async scenes keep loading while MainLoop is already rendering.
+	//Packed vertices take 20 instead of 64 bytes each, they are decoded by the vertex shaders.
+	//Split streams keep the positions apart, the depth prepass reads only them.
+	//Meshlets are needed by EnableMeshletCulling.
+	//Levels of detail are selected every frame by their projected error (meshlets are always drawn in full detail).
+	void LoadScene(const char* filepath, bool async = false, VertexFormat format = VertexFormat::FULL,
+				   VertexStreams streams = VertexStreams::INTERLEAVED, bool meshlets = false, bool lods = false);
 	void LoadShader(const char* vShaderPath, const char* fShaderPath);
+	//Enables the depth prepass, the shading pass then runs once per visible fragment.
+	void LoadDepthShader(const char* vShaderPath, const char* fShaderPath);
+	//Only meshlets inside the view frustum are drawn, culled by the compute shader when given (on the CPU otherwise).
+	//Back-face culling enables GL_CULL_FACE (the scene is drawn double-sided otherwise) and skips meshlets facing away as well.
+	void EnableMeshletCulling(bool backfaceCulling, const char* cShaderPath = nullptr);
+	//Far meshes of scenes with an impostor atlas are drawn as impostors (without meshlet culling only).
+	void LoadImpostorShader(const char* vShaderPath, const char* fShaderPath);
 
 	void LoadIrradianceMap(const char* filepath);
 	void LoadPrefilteredEnvMap(const std::initializer_list<const char*>& filepaths);
@@ -34,6 +47,14 @@ public:
 	Camera camera;
 	Scene scene;
 	ShaderProgram shader;
+	ShaderProgram depthShader;
+	bool depthPrepass = false;
+	ShaderProgram cullShader;
+	bool meshletCulling = false;
+	bool gpuCulling = false;
+	bool backfaceCulling = false;
+	ShaderProgram impostorShader;
+	bool impostors = false;
 	Light light;
 
 	BindlessTexture tex_irrMap;
@@ -3,108 +3,1344 @@
 
 #include "log.h"
 #include "objloader.h"
+#include "geometry.h"
+#include "vertexcache.h"
+#include "geometrycache.h"
+#include "gltf.h"
+#include "ply.h"
+#include "material.h"
+#include "parallel.h"
+#include "shader.h"
+#include "simplify.h"
+#include "impostor.h"
+#include "instancing.h"
+#include "split.h"
+
+#include <chrono>
+#include <cfloat>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <condition_variable>
+#include <unordered_map>
 
-//Vytvori a naplni buffer s daty pro VBO.
-std::pair<int, float*> MergeSurfaces(std::vector<Surface*>& surfaces, std::vector<Mesh>& meshes);
 //Vytvori a naplni buffer obsahujici materialy.
 GLMaterial* ParseMaterials(std::vector<Material*>& materials);
+//Material with flat colors only, used until its textures are uploaded.
+GLMaterial PlaceholderMaterial(Material* material, GLuint64 whiteTexture);
+
+//bytes of textures uploaded to GL per frame while an async scene is loading
+constexpr size_t UPLOAD_BUDGET = size_t(32) << 20;
+//block of the arena of materials & textures, most scenes have only tens of materials
+constexpr size_t MATERIAL_BLOCK = size_t(64) << 10;
+//vertices (indices) written into the mapped buffers by one thread at once
+constexpr size_t WRITE_BLOCK = size_t(1) << 16;
+
+static inline size_t IndexSize(GLenum indexType) {
+	return (indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+//CPU side of a scene being loaded, filled without any GL calls (by a worker thread for async scenes).
+struct SceneData {
+	~SceneData();
+
+	std::vector<Material*> materials;
+	std::vector<Mesh> meshes;
+	Arena arena{ MATERIAL_BLOCK };				//materials & textures, handed over to the scene
+	Arena surfaceArena;							//surfaces & their triangles, released with the sources
+
+	//final buffers, welded from the loaded surfaces (geometry), mapped from the geometry cache or a mesh asset (cache)
+	//or read in place from a binary glTF (model) or PLY (scan)
+	enum Source { SURFACES, CACHE, GLB, PLY };
+	Source source = SURFACES;
+	GeometryCache cache;
+	GLBModel model;
+	PLYModel scan;
+	std::vector<Surface*> surfaces;
+	IndexedGeometry geometry;
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+	VertexFormat format = VertexFormat::FULL;
+	VertexStreams streams = VertexStreams::INTERLEAVED;
+	std::vector<QuantizationBox> boxes;			//of every material, packed format only
+	bool buildMeshlets = false;
+	std::vector<Meshlet> meshlets;				//of all meshes in their order
+	bool buildLODs = false;
+	std::vector<uint32_t> lodIndices;			//of all meshes in their order, written after the last mesh
+	std::vector<MeshLOD> lods;
+	ImpostorAtlas impostors;					//baked by the cooker, empty when there is none
+	std::vector<InstanceTransform> instances;	//of the copies of the meshes
+	const char* startType = "cold";
+	std::vector<size_t> meshVertexEnd;			//vertices needed to draw meshes [0, i]
+
+	//Writes vertices [first, first + count) of the final vertex buffer into destination.
+	void CopyVertices(size_t first, size_t count, Vertex* destination) const;
+	//Writes indices [first, first + count) of the final index buffer (in indexType) into destination.
+	void CopyIndices(size_t first, size_t count, void* destination) const;
+	void ComputeMeshVertexEnds();
+	//Bounds of the vertices of every material for the packed format (falls back to the full one when it can't be used).
+	void ComputeQuantizationBoxes();
+	//Meshlets of every mesh, from chunks of MESHLET_CHUNK triangles built by all threads (when requested).
+	void BuildMeshlets();
+	//Levels of detail & bounding spheres of every mesh, the meshes are simplified by all threads (when requested).
+	void BuildLODs();
+	//Reads the impostor atlas of the model, if the cooker has baked one.
+	void LoadImpostors(const char* filepath);
+	//Writes vertices & indices of meshes [writtenMeshes, end) into the mapped GL buffers.
+	void WriteMeshes(size_t end);
+	//Frees the surfaces and the welded geometry once they are in the GL buffers.
+	void ReleaseSources();
+
+	//==== GL buffers, persistently mapped for writing while the scene is loading ====
+	char* mappedVertices = nullptr;				//in format (positions of split streams), guarded by mutex until set
+	char* mappedAttributes = nullptr;			//split streams only
+	char* mappedIndices = nullptr;				//guarded by mutex until set
+	size_t writtenVertices = 0;
+	std::atomic<size_t> writtenMeshes{ 0 };
+
+	//textures recorded by the loaders, decoded after the geometry is ready
+	std::vector<Texture3u*> pendingTextures;
+
+	//==== async loading ====
+	enum State { LOADING, GEOMETRY_READY, FAILED };
+
+	std::string filepath;
+	std::chrono::high_resolution_clock::time_point start;
+	std::thread worker;
+	std::atomic<int> state{ LOADING };
+	std::atomic<bool> cancel{ false };
+
+	std::mutex mutex;
+	std::condition_variable buffersMapped;		//the worker waits for the main thread to create the GL buffers
+	std::deque<Texture3u*> decodedTextures;		//guarded by mutex
+	bool texturesDone = false;					//guarded by mutex
+
+	//main thread progress
+	bool uploadStarted = false;
+	GLuint64 placeholderHandle = 0;			//of Scene::placeholderTexture
+};
+
+SceneData::~SceneData() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cancel = true;
+	}
+	buffersMapped.notify_all();
+	if (worker.joinable())
+		worker.join();
+
+	ReleaseSources();
+}
+
+void SceneData::CopyVertices(size_t first, size_t count, Vertex* destination) const {
+	switch (source) {
+		case CACHE: cache.CopyVertices(first, count, destination); break;
+		case GLB: model.CopyVertices(first, count, destination); break;
+		case PLY: scan.CopyVertices(first, count, destination); break;
+		default: geometry.CopyVertices(first, count, destination); break;
+	}
+}
+
+void SceneData::CopyIndices(size_t first, size_t count, void* destination) const {
+	switch (source) {
+		case CACHE: cache.CopyIndices(first, count, destination); break;
+		case GLB: model.CopyIndices(first, count, destination); break;
+		case PLY: scan.CopyIndices(first, count, destination); break;
+		default: geometry.CopyIndices(first, count, destination); break;
+	}
+}
+
+void SceneData::ComputeMeshVertexEnds() {
+	//welded vertices are numbered in order of first use, so the range needed by first i meshes only grows
+	meshVertexEnd.resize(meshes.size());
+	size_t vertexEnd = 0;
+	std::vector<uint32_t> block(WRITE_BLOCK);
+	for (size_t i = 0; i < meshes.size(); i++) {
+		const Mesh& mesh = meshes[i];
+		//indices are read in blocks, they may have to be decoded
+		for (size_t first = mesh.offset; first < size_t(mesh.offset) + mesh.count; first += WRITE_BLOCK) {
+			const size_t n = std::min(WRITE_BLOCK, size_t(mesh.offset) + mesh.count - first);
+			CopyIndices(first, n, block.data());
+			if (indexType == GL_UNSIGNED_SHORT) {
+				const uint16_t* indices = reinterpret_cast<const uint16_t*>(block.data());
+				vertexEnd = std::max<size_t>(vertexEnd, *std::max_element(indices, indices + n) + size_t(1));
+			}
+			else {
+				vertexEnd = std::max<size_t>(vertexEnd, *std::max_element(block.data(), block.data() + n) + size_t(1));
+			}
+		}
+		meshVertexEnd[i] = vertexEnd;
+	}
+}
+
+void SceneData::ComputeQuantizationBoxes() {
+	if (format != VertexFormat::PACKED)
+		return;
+	if (materials.empty() || materials.size() > size_t(UINT16_MAX) + 1) {
+		warnlog("%zu materials can't be addressed by packed vertices, the full format is used.\n", materials.size());
+		format = VertexFormat::FULL;
+		return;
+	}
+	boxes = ::ComputeQuantizationBoxes(vertexCount, materials.size(), [this](size_t first, size_t count, Vertex* destination) {
+		CopyVertices(first, count, destination);
+	});
+}
+
+void SceneData::BuildMeshlets() {
+	if (!buildMeshlets)
+		return;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<Vector3> positions(vertexCount);
+	ParallelFor(static_cast<int>((vertexCount + WRITE_BLOCK - 1) / WRITE_BLOCK), 0, [&](int b) {
+		const size_t begin = b * WRITE_BLOCK;
+		const size_t n = std::min(WRITE_BLOCK, vertexCount - begin);
+		std::vector<Vertex> block(n);
+		CopyVertices(begin, n, block.data());
+		for (size_t i = 0; i < n; i++)
+			positions[begin + i] = block[i].position;
+	});
+
+	//index ranges of the chunks, meshlets never cross meshes
+	struct Chunk {
+		size_t mesh;
+		size_t first;
+		size_t count;
+	};
+	std::vector<Chunk> chunks;
+	for (size_t m = 0; m < meshes.size(); m++) {
+		const size_t end = size_t(meshes[m].offset) + meshes[m].count;
+		for (size_t first = meshes[m].offset; first < end; first += MESHLET_CHUNK * 3)
+			chunks.push_back({ m, first, std::min(MESHLET_CHUNK * 3, end - first) });
+	}
+
+	std::vector<std::vector<Meshlet>> built(chunks.size());
+	ParallelFor(static_cast<int>(chunks.size()), 0, [&](int c) {
+		const Chunk& chunk = chunks[c];
+		std::vector<uint32_t> indices(chunk.count);
+		CopyIndices(chunk.first, chunk.count, indices.data());
+		if (indexType == GL_UNSIGNED_SHORT) {
+			//widened in place from the back
+			const uint16_t* narrow = reinterpret_cast<const uint16_t*>(indices.data());
+			for (size_t i = chunk.count; i-- > 0;)
+				indices[i] = narrow[i];
+		}
+		::BuildMeshlets(indices.data(), chunk.first, chunk.count, positions.data(), built[c]);
+	});
+
+	meshlets.clear();
+	for (Mesh& mesh : meshes)
+		mesh.meshletCount = 0;
+	for (size_t c = 0; c < chunks.size(); c++) {
+		Mesh& mesh = meshes[chunks[c].mesh];
+		if (mesh.meshletCount == 0)
+			mesh.firstMeshlet = int(meshlets.size());
+		mesh.meshletCount += int(built[c].size());
+		meshlets.insert(meshlets.end(), built[c].begin(), built[c].end());
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	errlog("Meshlets: %zu (%.1f triangles on average), %.3f s.\n", meshlets.size(),
+		   meshlets.empty() ? 0.0 : indexCount / 3.0 / meshlets.size(), elapsed.count());
+}
+
+void SceneData::BuildLODs() {
+	if (!buildLODs)
+		return;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<Vertex> vertices(vertexCount);
+	ParallelFor(static_cast<int>((vertexCount + WRITE_BLOCK - 1) / WRITE_BLOCK), 0, [&](int b) {
+		const size_t begin = b * WRITE_BLOCK;
+		CopyVertices(begin, std::min(WRITE_BLOCK, vertexCount - begin), vertices.data() + begin);
+	});
+
+	std::vector<std::vector<uint32_t>> meshIndices(meshes.size());
+	std::vector<std::vector<MeshLOD>> meshLODs(meshes.size());
+	ParallelFor(static_cast<int>(meshes.size()), 0, [&](int m) {
+		Mesh& mesh = meshes[m];
+		std::vector<uint32_t> indices(mesh.count);
+		CopyIndices(mesh.offset, mesh.count, indices.data());
+		if (indexType == GL_UNSIGNED_SHORT) {
+			//widened in place from the back
+			const uint16_t* narrow = reinterpret_cast<const uint16_t*>(indices.data());
+			for (size_t i = indices.size(); i-- > 0;)
+				indices[i] = narrow[i];
+		}
+
+		//sphere around the center of the bounding box, the distance of the levels is measured from it
+		Vector3 lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (uint32_t i : indices) {
+			const Vector3& p = vertices[i].position;
+			lo = Vector3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+			hi = Vector3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+		}
+		mesh.center = indices.empty() ? Vector3() : (lo + hi) * 0.5f;
+		mesh.radius = 0.0f;
+		for (uint32_t i : indices)
+			mesh.radius = std::max(mesh.radius, (vertices[i].position - mesh.center).L2Norm());
+
+		GenerateLODs(indices.data(), indices.size(), vertices.data(), meshIndices[m], meshLODs[m]);
+	});
+
+	//the levels follow the full meshes in the index buffer
+	lodIndices.clear();
+	lods.clear();
+	for (size_t m = 0; m < meshes.size(); m++) {
+		meshes[m].firstLOD = int(lods.size());
+		meshes[m].lodCount = int(meshLODs[m].size());
+		const size_t base = indexCount + lodIndices.size();
+		for (MeshLOD lod : meshLODs[m]) {
+			lod.offset += int(base);
+			lods.push_back(lod);
+		}
+		lodIndices.insert(lodIndices.end(), meshIndices[m].begin(), meshIndices[m].end());
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	errlog("Levels of detail: %zu (%.1f%% more indices), %.3f s.\n", lods.size(),
+		   indexCount > 0 ? 100.0 * lodIndices.size() / indexCount : 0.0, elapsed.count());
+}
+
+void SceneData::WriteMeshes(size_t end) {
+	const size_t indexSize = IndexSize(indexType);
+
+	for (size_t i = writtenMeshes; i < end && !cancel; i++) {
+		const Mesh& mesh = meshes[i];
+
+		//vertices first used by this mesh, large ranges are written by all threads
+		const size_t first = writtenVertices;
+		const size_t count = meshVertexEnd[i] - std::min(meshVertexEnd[i], first);
+		ParallelFor(static_cast<int>((count + WRITE_BLOCK - 1) / WRITE_BLOCK), 0, [&](int b) {
+			const size_t begin = first + b * WRITE_BLOCK;
+			const size_t n = std::min(WRITE_BLOCK, first + count - begin);
+			if (format == VertexFormat::FULL && streams == VertexStreams::INTERLEAVED) {
+				CopyVertices(begin, n, reinterpret_cast<Vertex*>(mappedVertices) + begin);
+				return;
+			}
+			std::vector<Vertex> block(n);
+			CopyVertices(begin, n, block.data());
+			if (format == VertexFormat::FULL) {
+				SplitVertices(block.data(), n, format, mappedVertices + begin * PositionSize(format), mappedAttributes + begin * AttributeSize(format));
+			}
+			else if (streams == VertexStreams::INTERLEAVED) {
+				PackVertices(block.data(), n, boxes, reinterpret_cast<PackedVertex*>(mappedVertices) + begin);
+			}
+			else {
+				std::vector<PackedVertex> packed(n);
+				PackVertices(block.data(), n, boxes, packed.data());
+				SplitVertices(packed.data(), n, format, mappedVertices + begin * PositionSize(format), mappedAttributes + begin * AttributeSize(format));
+			}
+		});
+		writtenVertices += count;
+
+		ParallelFor(static_cast<int>((size_t(mesh.count) + WRITE_BLOCK - 1) / WRITE_BLOCK), 0, [&](int b) {
+			const size_t begin = size_t(mesh.offset) + b * WRITE_BLOCK;
+			CopyIndices(begin, std::min(WRITE_BLOCK, size_t(mesh.offset) + mesh.count - begin), mappedIndices + begin * indexSize);
+		});
+		if (i + 1 == meshes.size() && !lodIndices.empty()) {
+			//levels of detail index the same vertices, they fit the index type
+			if (indexType == GL_UNSIGNED_SHORT)
+				std::copy(lodIndices.begin(), lodIndices.end(), reinterpret_cast<uint16_t*>(mappedIndices) + indexCount);
+			else
+				std::copy(lodIndices.begin(), lodIndices.end(), reinterpret_cast<uint32_t*>(mappedIndices) + indexCount);
+		}
+
+		writtenMeshes.store(i + 1, std::memory_order_release);
+	}
+}
+
+void SceneData::ReleaseSources() {
+	geometry = IndexedGeometry();
+	surfaces.clear();
+	surfaceArena.Release();
+}
+
+void SceneData::LoadImpostors(const char* filepath) {
+	if (ReadImpostors(ImpostorPath(filepath).c_str(), impostors))
+		warnlog("Impostors: %zu meshes, %dx%d atlas.\n", impostors.meshes.size(), impostors.width, impostors.height);
+}
 
 //================================= Scene =================================
 
-Scene::Scene(const char* filepath) {
+Scene::Scene() {}
+
+Scene::Scene(const char* filepath, bool async, size_t memoryLimit, VertexFormat format, VertexStreams streams, bool meshlets, bool lods) {
 	if (strcmp(filepath, "default") == 0) {
 		LoadDefault();
 	}
-	else if (!Load(filepath)) {
+	else if (async) {
+		LoadAsync(filepath, memoryLimit, format, streams, meshlets, lods);
+	}
+	else if (!Load(filepath, memoryLimit, format, streams, meshlets, lods)) {
 		throw std::exception("Scene failed to load.");
 	}
 }
 
 Scene::~Scene() {
+	Release();
+}
+
+void Scene::Release() {
+	loading.reset();
+
 	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ebo);
 	glDeleteBuffers(1, &ssbo);
+	glDeleteBuffers(1, &boxes);
+	glDeleteBuffers(1, &meshletBuffer);
+	glDeleteBuffers(1, &viewBuffer);
+	glDeleteBuffers(1, &commandBuffer);
+	glDeleteBuffers(1, &impostorBuffer);
+	glDeleteBuffers(1, &instanceBuffer);
+	glDeleteBuffers(1, &instanceCommandBuffer);
+	glDeleteTextures(1, &impostorAlbedo);
+	glDeleteTextures(1, &impostorNormalDepth);
+	glDeleteTextures(1, &placeholderTexture);
 	glDeleteVertexArrays(1, &vao);
-	vao = vbo = ssbo = 0;
+	glDeleteVertexArrays(1, &depthVao);
+	glDeleteVertexArrays(1, &impostorVao);
+	vao = depthVao = vbo = ebo = ssbo = boxes = meshletBuffer = viewBuffer = commandBuffer = 0;
+	impostorBuffer = impostorAlbedo = impostorNormalDepth = impostorVao = instanceBuffer = instanceCommandBuffer = placeholderTexture = 0;
+
+	delete[] glMaterials;
+	glMaterials = nullptr;
 }
 
 Scene::Scene(Scene&& s) noexcept 
-	: vao(s.vao), vbo(s.vbo), ssbo(s.ssbo), meshes(s.meshes), materials(s.materials), vertexCount(s.vertexCount) {
-	s.vao = s.vbo = s.ssbo = 0;
+	: materials(s.materials), meshes(s.meshes), arena(std::move(s.arena)), indexCount(s.indexCount), indexType(s.indexType), vertexFormat(s.vertexFormat),
+	vertexStreams(s.vertexStreams), attributeOffset(s.attributeOffset), vao(s.vao), depthVao(s.depthVao), vbo(s.vbo), ebo(s.ebo), ssbo(s.ssbo), boxes(s.boxes),
+	meshlets(std::move(s.meshlets)), commands(std::move(s.commands)), culledMeshlets(s.culledMeshlets), meshletBuffer(s.meshletBuffer), viewBuffer(s.viewBuffer),
+	commandBuffer(s.commandBuffer), lods(std::move(s.lods)), drawCounts(std::move(s.drawCounts)), drawOffsets(std::move(s.drawOffsets)),
+	impostorTiles(std::move(s.impostorTiles)), impostors(std::move(s.impostors)), impostorGrid(s.impostorGrid), impostorAlbedo(s.impostorAlbedo),
+	impostorNormalDepth(s.impostorNormalDepth), impostorBuffer(s.impostorBuffer), impostorVao(s.impostorVao), instances(std::move(s.instances)),
+	instanceCommands(std::move(s.instanceCommands)), instancedMeshes(std::move(s.instancedMeshes)), instanceBuffer(s.instanceBuffer),
+	instanceCommandBuffer(s.instanceCommandBuffer), glMaterials(s.glMaterials), placeholderTexture(s.placeholderTexture), loading(std::move(s.loading)),
+	drawableMeshes(s.drawableMeshes) {
+	s.vao = s.depthVao = s.vbo = s.ebo = s.ssbo = s.boxes = s.meshletBuffer = s.viewBuffer = s.commandBuffer = 0;
+	s.impostorBuffer = s.impostorAlbedo = s.impostorNormalDepth = s.impostorVao = s.instanceBuffer = s.instanceCommandBuffer = s.placeholderTexture = 0;
 	s.meshes.clear();
 	s.materials.clear();
+	s.glMaterials = nullptr;
 }
 
 Scene& Scene::operator=(Scene&& s) noexcept {
+	if (this == &s)
+		return *this;
+	//GL objects & materials of the replaced scene
+	Release();
+
 	vao = s.vao;
+	depthVao = s.depthVao;
 	vbo = s.vbo;
+	ebo = s.ebo;
 	ssbo = s.ssbo;
+	boxes = s.boxes;
+	meshletBuffer = s.meshletBuffer;
+	viewBuffer = s.viewBuffer;
+	commandBuffer = s.commandBuffer;
+	meshlets = std::move(s.meshlets);
+	commands = std::move(s.commands);
+	culledMeshlets = s.culledMeshlets;
+	lods = std::move(s.lods);
+	drawCounts = std::move(s.drawCounts);
+	drawOffsets = std::move(s.drawOffsets);
+	impostorTiles = std::move(s.impostorTiles);
+	impostors = std::move(s.impostors);
+	impostorGrid = s.impostorGrid;
+	impostorAlbedo = s.impostorAlbedo;
+	impostorNormalDepth = s.impostorNormalDepth;
+	impostorBuffer = s.impostorBuffer;
+	impostorVao = s.impostorVao;
+	instances = std::move(s.instances);
+	instanceCommands = std::move(s.instanceCommands);
+	instancedMeshes = std::move(s.instancedMeshes);
+	instanceBuffer = s.instanceBuffer;
+	instanceCommandBuffer = s.instanceCommandBuffer;
 	meshes = s.meshes;
 	materials = s.materials;
-	vertexCount = s.vertexCount;
+	indexCount = s.indexCount;
+	indexType = s.indexType;
+	vertexFormat = s.vertexFormat;
+	vertexStreams = s.vertexStreams;
+	attributeOffset = s.attributeOffset;
+	glMaterials = s.glMaterials;
+	placeholderTexture = s.placeholderTexture;
+	loading = std::move(s.loading);
+	arena = std::move(s.arena);			//after the worker of the old scene is joined
+	drawableMeshes = s.drawableMeshes;
 
-	s.vao = s.vbo = s.ssbo = 0;
+	s.vao = s.depthVao = s.vbo = s.ebo = s.ssbo = s.boxes = s.meshletBuffer = s.viewBuffer = s.commandBuffer = 0;
+	s.impostorBuffer = s.impostorAlbedo = s.impostorNormalDepth = s.impostorVao = s.instanceBuffer = s.instanceCommandBuffer = s.placeholderTexture = 0;
 	s.meshes.clear();
 	s.materials.clear();
+	s.glMaterials = nullptr;
 
 	return *this;
 }
 
 void Scene::Draw() const {
-	glBindVertexArray(vao);
-	glDrawArrays(GL_TRIANGLES, 0, vertexCount);
-	/*for (auto& m : meshes)
-		m.Draw();*/
+	DrawMeshes(vao);
 }
 
-bool Scene::Load(const char* filepath) {
-	//load scene data from file
-	std::vector<Surface*> surfaces;
-	if (LoadOBJ(filepath, surfaces, materials, false) < 0) {
+void Scene::DrawDepth() const {
+	if (depthVao != 0)
+		DrawMeshes(depthVao);
+}
+
+void Scene::DrawMeshes(GLuint vertexArray) const {
+	glBindVertexArray(vertexArray);
+	if (loading) {
+		//only meshes uploaded so far
+		for (size_t i = 0; i < drawableMeshes; i++)
+			meshes[i].Draw(indexType, IndexSize(indexType));
+	}
+	else if (!drawCounts.empty()) {
+		//one draw of the selected level per mesh, empty for meshes drawn as impostors
+		glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(), GLsizei(drawCounts.size()));
+	}
+	else {
+		glDrawElements(GL_TRIANGLES, indexCount, indexType, nullptr);
+	}
+	DrawInstances();
+}
+
+void Scene::DrawInstances() const {
+	//commands are in mesh order, the drawable ones of an async scene are a prefix
+	size_t count = instanceCommands.size();
+	if (loading)
+		count = std::lower_bound(instancedMeshes.begin(), instancedMeshes.end(), int(drawableMeshes)) - instancedMeshes.begin();
+	if (count == 0)
+		return;
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, instanceBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, instanceCommandBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, nullptr, GLsizei(count), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+size_t Scene::SelectLODs(const Vector3& eye, float pixelsPerUnit, float threshold) {
+	//the levels are written after the last mesh
+	drawCounts.clear();
+	drawOffsets.clear();
+	if (loading || lods.empty())
+		return TriangleCount();
+
+	size_t triangles = 0;
+	const size_t indexSize = IndexSize(indexType);
+	for (const Mesh& mesh : meshes) {
+		//error of a level projects to error * pixelsPerUnit / distance pixels at the nearest point of the bounding sphere
+		float distance = std::max((mesh.center - eye).L2Norm() - mesh.radius, 0.0f);
+		for (int i = 0; i < mesh.instanceCount; i++) {
+			const InstanceTransform& t = instances[size_t(mesh.firstInstance) + i];
+			Vector3 center;
+			for (int r = 0; r < 3; r++)
+				center.data[r] = t.rows[r][0] * mesh.center.x + t.rows[r][1] * mesh.center.y + t.rows[r][2] * mesh.center.z + t.rows[r][3];
+			distance = std::min(distance, std::max((center - eye).L2Norm() - mesh.radius, 0.0f));
+		}
+		int offset = mesh.offset, count = mesh.count;
+		for (int l = 0; l < mesh.lodCount; l++) {
+			const MeshLOD& lod = lods[size_t(mesh.firstLOD) + l];
+			if (lod.error * pixelsPerUnit > threshold * distance)
+				break;
+			offset = lod.offset;
+			count = lod.count;
+		}
+		drawCounts.push_back(count);
+		drawOffsets.push_back((const void*)(offset * indexSize));
+		triangles += size_t(count) / 3;
+	}
+
+	//copies draw the level of their mesh
+	for (size_t c = 0; c < instanceCommands.size(); c++) {
+		const int m = instancedMeshes[c];
+		instanceCommands[c].count = uint32_t(drawCounts[m]);
+		instanceCommands[c].firstIndex = uint32_t(size_t(drawOffsets[m]) / indexSize);
+	}
+	if (!instanceCommands.empty())
+		glNamedBufferSubData(instanceCommandBuffer, 0, instanceCommands.size() * sizeof(DrawElementsIndirectCommand), instanceCommands.data());
+	return triangles;
+}
+
+size_t Scene::SelectImpostors(const Vector3& eye, float pixelsPerUnit, float pixels) {
+	impostors.clear();
+	if (loading || impostorTiles.empty())
+		return 0;
+
+	//full meshes unless SelectLODs has picked their levels
+	if (drawCounts.empty()) {
+		const size_t indexSize = IndexSize(indexType);
+		for (const Mesh& mesh : meshes) {
+			drawCounts.push_back(mesh.count);
+			drawOffsets.push_back((const void*)(mesh.offset * indexSize));
+		}
+	}
+
+	for (size_t m = 0; m < meshes.size(); m++) {
+		const ImpostorInstance& tile = impostorTiles[m];
+		const float radius = tile.sphere[3];
+		if (radius <= 0.0f || meshes[m].instanceCount > 0)
+			continue;
+		//the sphere spans 2 * radius * pixelsPerUnit / distance pixels, meshes around the eye are never swapped
+		const Vector3 center(tile.sphere[0], tile.sphere[1], tile.sphere[2]);
+		const float distance = (center - eye).L2Norm();
+		if (distance <= radius || 2.0f * radius * pixelsPerUnit > pixels * distance)
+			continue;
+		drawCounts[m] = 0;
+		impostors.push_back(tile);
+	}
+	if (!impostors.empty())
+		glNamedBufferSubData(impostorBuffer, 0, impostors.size() * sizeof(ImpostorInstance), impostors.data());
+	return impostors.size();
+}
+
+size_t Scene::SelectedTriangles() const {
+	if (loading || drawCounts.empty())
+		return TriangleCount();
+	size_t triangles = 0;
+	for (GLsizei count : drawCounts)
+		triangles += size_t(count) / 3;
+	return triangles;
+}
+
+void Scene::DrawImpostors() const {
+	if (impostors.empty())
+		return;
+	glBindVertexArray(impostorVao);
+	glBindTextureUnit(0, impostorAlbedo);
+	glBindTextureUnit(1, impostorNormalDepth);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, impostorBuffer);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(impostors.size()));
+}
+
+size_t Scene::CullMeshlets(CullingView view, const ShaderProgram* cullShader) {
+	//meshlets are in mesh order, the drawable ones of an async scene are a prefix
+	size_t count = meshlets.size();
+	if (loading)
+		count = (drawableMeshes > 0) ? size_t(meshes[drawableMeshes - 1].firstMeshlet) + meshes[drawableMeshes - 1].meshletCount : 0;
+	culledMeshlets = count;
+	view.meshletCount = uint32_t(count);
+
+	if (cullShader == nullptr) {
+		const uint32_t visible = uint32_t(::CullMeshlets(meshlets.data(), count, view, commands.data()));
+		glNamedBufferSubData(commandBuffer, 0, sizeof(uint32_t), &visible);
+		if (visible > 0)
+			glNamedBufferSubData(commandBuffer, MESHLET_COMMANDS_OFFSET, visible * sizeof(DrawElementsIndirectCommand), commands.data());
+		return count;
+	}
+
+	//one invocation per meshlet appends the command of a visible one
+	const uint32_t zero = 0;
+	glNamedBufferSubData(commandBuffer, 0, sizeof(uint32_t), &zero);
+	glNamedBufferSubData(viewBuffer, 0, sizeof(CullingView), &view);
+	cullShader->Bind();
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, viewBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, meshletBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, commandBuffer);
+	glDispatchCompute(GLuint((count + 63) / 64), 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+	return count;
+}
+
+void Scene::DrawMeshlets(bool depthOnly) const {
+	if (culledMeshlets == 0)
+		return;
+	glBindVertexArray(depthOnly ? depthVao : vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glBindBuffer(GL_PARAMETER_BUFFER, commandBuffer);
+	glMultiDrawElementsIndirectCount(GL_TRIANGLES, indexType, (void*)MESHLET_COMMANDS_OFFSET, 0, GLsizei(culledMeshlets), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindBuffer(GL_PARAMETER_BUFFER, 0);
+	//meshlets are culled in the space of the meshes only, copies are drawn whole
+	DrawInstances();
+}
+
+bool Scene::Load(const char* filepath, size_t memoryLimit, VertexFormat format, VertexStreams streams, bool buildMeshlets, bool buildLODs) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	SceneData data;
+	data.format = format;
+	data.streams = streams;
+	data.buildMeshlets = buildMeshlets;
+	data.buildLODs = buildLODs;
+	if (!Prepare(filepath, memoryLimit, data, false)) {
 		errlog("Failed to load scene '%s'.\n", filepath);
 		return false;
 	}
+	data.ComputeQuantizationBoxes();
+	data.BuildMeshlets();
+	data.BuildLODs();
+	data.LoadImpostors(filepath);
 
-	//merge surfaces into a single array of vertices
-	auto [vc, vertexData] = MergeSurfaces(surfaces, meshes);
-	vertexCount = vc;
+	materials = std::move(data.materials);
+	arena = std::move(data.arena);
+	meshes = data.meshes;
+	lods = data.lods;
+	indexCount = (int)data.indexCount;
+	indexType = data.indexType;
+
+	//final vertices & indices are written straight into the GL buffers
+	if (!CreateGeometryBuffers(data)) {
+		errlog("Failed to load scene '%s'.\n", filepath);
+		return false;
+	}
+	CreateMeshletBuffers(data);
+	CreateImpostorBuffers(data);
+	CreateInstanceBuffers(data);
+	data.WriteMeshes(data.meshes.size());
+	FlushGeometry(0, data.writtenVertices, 0, data.indexCount + data.lodIndices.size());
+	UnmapGeometry();
+	data.ReleaseSources();
 
 	//convert materials
 	glMaterials = ParseMaterials(materials);
 
+	//SSBO
+	glGenBuffers(1, &ssbo);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLMaterial) * materials.size(), (float*)glMaterials, GL_STATIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
+
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	errlog("Scene '%s' loaded in %.3f s (%s start).\n", filepath, elapsed.count(), data.startType);
+	return true;
+}
+
+void Scene::LoadAsync(const char* filepath, size_t memoryLimit, VertexFormat format, VertexStreams streams, bool buildMeshlets, bool buildLODs) {
+	errlog("Loading scene '%s' in the background.\n", filepath);
+
+	loading = std::make_unique<SceneData>();
+	SceneData* data = loading.get();
+	data->filepath = filepath;
+	data->format = format;
+	data->streams = streams;
+	data->buildMeshlets = buildMeshlets;
+	data->buildLODs = buildLODs;
+	data->start = std::chrono::high_resolution_clock::now();
+
+	data->worker = std::thread([data, memoryLimit]() {
+		try {
+			if (!Prepare(data->filepath.c_str(), memoryLimit, *data, true)) {
+				data->state = SceneData::FAILED;
+				return;
+			}
+			//the scene may be destroyed meanwhile, its destructor waits for the stage in progress only
+			data->ComputeQuantizationBoxes();
+			if (!data->cancel)
+				data->BuildMeshlets();
+			if (!data->cancel)
+				data->BuildLODs();
+			if (!data->cancel)
+				data->LoadImpostors(data->filepath.c_str());
+		}
+		catch (const std::exception&) {
+			data->state = SceneData::FAILED;
+			return;
+		}
+		data->state = SceneData::GEOMETRY_READY;
+
+		//the main thread creates the GL buffers, meshes become drawable as they are written into them
+		{
+			std::unique_lock<std::mutex> lock(data->mutex);
+			data->buffersMapped.wait(lock, [data]() { return data->mappedVertices != nullptr || data->cancel; });
+		}
+		data->WriteMeshes(data->meshes.size());
+		if (data->cancel)
+			return;
+		data->ReleaseSources();
+
+		//every decoded texture is handed over to the main thread right away
+		ParallelFor(static_cast<int>(data->pendingTextures.size()), 0, [data](int i) {
+			if (data->cancel)
+				return;
+			data->pendingTextures[i]->Load();
+			std::lock_guard<std::mutex> lock(data->mutex);
+			data->decodedTextures.push_back(data->pendingTextures[i]);
+		});
+
+		std::lock_guard<std::mutex> lock(data->mutex);
+		data->texturesDone = true;
+	});
+}
+
+void Scene::Update() {
+	if (!loading)
+		return;
+	SceneData& data = *loading;
+
+	if (!data.uploadStarted) {
+		const int state = data.state;
+		if (state == SceneData::LOADING)
+			return;
+		if (state == SceneData::FAILED) {
+			errlog("Failed to load scene '%s'.\n", data.filepath.c_str());
+			loading.reset();
+			return;
+		}
+		if (!BeginUpload()) {
+			errlog("Failed to load scene '%s'.\n", data.filepath.c_str());
+			loading.reset();
+			return;
+		}
+	}
+
+	//per frame budget keeps the frame rate steady (at least one texture is uploaded every frame)
+	FlushMeshes();
+	size_t budget = UPLOAD_BUDGET;
+	UploadTextures(budget);
+
+	bool done = (drawableMeshes == meshes.size());
+	{
+		std::lock_guard<std::mutex> lock(data.mutex);
+		done = done && data.texturesDone && data.decodedTextures.empty();
+	}
+	if (done)
+		FinishLoading();
+}
+
+bool Scene::BeginUpload() {
+	SceneData& data = *loading;
+
+	//the worker keeps its copy of the mesh ranges, decoded textures stay in the arena
+	materials = std::move(data.materials);
+	arena = std::move(data.arena);
+	meshes = data.meshes;
+	lods = data.lods;
+	indexCount = (int)data.indexCount;
+	indexType = data.indexType;
+	drawableMeshes = 0;
+
+	//buffers are only allocated, the worker writes the meshes into them over the following frames
+	if (!CreateGeometryBuffers(data))
+		return false;
+	data.buffersMapped.notify_all();
+	CreateMeshletBuffers(data);
+	CreateImpostorBuffers(data);
+	CreateInstanceBuffers(data);
+
+	//flat placeholder materials, textures are swapped in as they arrive
+	GLubyte white[] = { 255, 255, 255, 255 };
+	CreateBindlessTexture(placeholderTexture, data.placeholderHandle, 1, 1, white);
+
+	glMaterials = new GLMaterial[materials.size()];
+	for (size_t i = 0; i < materials.size(); i++)
+		glMaterials[i] = PlaceholderMaterial(materials[i], data.placeholderHandle);
+
+	glGenBuffers(1, &ssbo);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLMaterial) * materials.size(), (float*)glMaterials, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
+
+	data.uploadStarted = true;
+
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - data.start;
+	errlog("Scene '%s' geometry ready in %.3f s (%s start), uploading.\n", data.filepath.c_str(), elapsed.count(), data.startType);
+	return true;
+}
+
+void Scene::FlushMeshes() {
+	SceneData& data = *loading;
+
+	const size_t written = data.writtenMeshes.load(std::memory_order_acquire);
+	if (written == drawableMeshes)
+		return;
+
+	//vertices first used by the new meshes & their index ranges
+	const size_t vertexBegin = (drawableMeshes > 0) ? data.meshVertexEnd[drawableMeshes - 1] : 0;
+	size_t indexBegin = SIZE_MAX, indexEnd = 0;
+	for (size_t i = drawableMeshes; i < written; i++) {
+		indexBegin = std::min(indexBegin, size_t(meshes[i].offset));
+		indexEnd = std::max(indexEnd, size_t(meshes[i].offset) + meshes[i].count);
+	}
+	//levels of detail are written with the last mesh
+	if (written == meshes.size())
+		indexEnd = std::max(indexEnd, data.indexCount + data.lodIndices.size());
+	FlushGeometry(vertexBegin, data.meshVertexEnd[written - 1], indexBegin, indexEnd);
+
+	drawableMeshes = written;
+}
+
+void Scene::UploadTextures(size_t& budget) {
+	SceneData& data = *loading;
+
+	while (budget > 0) {
+		Texture3u* texture = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(data.mutex);
+			if (data.decodedTextures.empty())
+				break;
+			texture = data.decodedTextures.front();
+			data.decodedTextures.pop_front();
+		}
+
+		//failed decodes keep the placeholder
+		if (texture->width() == 0 || texture->height() == 0)
+			continue;
+
+		GLuint id = 0;
+		GLuint64 handle = 0;
+		texture->CreateBindless(id, handle);
+		budget -= std::min(budget, size_t(texture->width()) * size_t(texture->height()) * sizeof(Color3u));
+
+		//swap the handle into every material using the texture
+		for (size_t i = 0; i < materials.size(); i++) {
+			Material* m = materials[i];
+			GLMaterial& gm = glMaterials[i];
+			bool changed = false;
+
+			if (m->texture(Material::kDiffuseMapSlot) == texture) {
+				gm.texDiffuse = handle;
+				gm.diffuse = Color3f({ 1.f, 1.f, 1.f });
+				changed = true;
+			}
+			if (m->texture(Material::kRMAMapSlot) == texture) {
+				gm.texRMA = handle;
+				changed = true;
+			}
+			if (m->texture(Material::kNormalMapSlot) == texture) {
+				gm.texNormal = handle;
+				changed = true;
+			}
+
+			if (changed)
+				glNamedBufferSubData(ssbo, i * sizeof(GLMaterial), sizeof(GLMaterial), &gm);
+		}
+	}
+}
+
+void Scene::FinishLoading() {
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - loading->start;
+	errlog("Scene '%s' loaded in %.3f s (%s start, in the background).\n", loading->filepath.c_str(), elapsed.count(), loading->startType);
+
+	//all meshes are written, the worker doesn't touch the buffers anymore
+	UnmapGeometry();
+
+	//the placeholder is released once every material has its diffuse map, materials without one keep it until ~Scene
+	bool placeholderUsed = false;
+	for (size_t i = 0; i < materials.size(); i++)
+		placeholderUsed = placeholderUsed || glMaterials[i].texDiffuse == loading->placeholderHandle;
+	if (!placeholderUsed) {
+		glMakeTextureHandleNonResidentARB(loading->placeholderHandle);
+		glDeleteTextures(1, &placeholderTexture);
+		placeholderTexture = 0;
+	}
+	loading.reset();
+}
+
+bool Scene::Prepare(const char* filepath, size_t memoryLimit, SceneData& data, bool deferTextures) {
+	if (GLBModel::IsGLB(filepath)) {
+		//binary glTF - attributes go from the mapped buffer views straight to GL, the geometry cache isn't needed
+		GLBModel& model = data.model;
+		if (!model.Open(filepath))
+			return false;
+		model.LoadMaterials(data.materials, deferTextures ? &data.pendingTextures : nullptr, &data.arena);
+		model.LoadMeshes(data.meshes, data.materials);
+		data.source = SceneData::GLB;
+		data.vertexCount = model.VertexCount();
+		data.indexCount = model.IndexCount();
+		data.indexType = model.IndexType();
+		data.startType = "binary glTF";
+		if (data.arena.stats().objects > 0)
+			data.arena.Log("materials");
+		data.ComputeMeshVertexEnds();
+		return true;
+	}
+	if (PLYModel::IsPLY(filepath)) {
+		//binary PLY scan - vertex & face blocks go from the mapped file straight to GL
+		PLYModel& scan = data.scan;
+		if (!scan.Open(filepath))
+			return false;
+		scan.LoadMaterials(data.materials, &data.arena);
+		scan.LoadMeshes(data.meshes, data.materials);
+		data.source = SceneData::PLY;
+		data.vertexCount = scan.VertexCount();
+		data.indexCount = scan.IndexCount();
+		data.indexType = scan.IndexType();
+		data.startType = "binary PLY";
+		data.ComputeMeshVertexEnds();
+		return true;
+	}
+
+	GeometryCache& cache = data.cache;
+	const bool asset = GeometryCache::IsAsset(filepath);
+	const bool warm = asset ? cache.OpenAsset(filepath) : cache.Open(filepath);
+	bool streamed = false;
+	if (asset && !warm)
+		return false;
+
+	//in-memory loading peaks at several times the file size, large models are streamed into the cache instead
+	std::error_code ec;
+	if (!warm && std::filesystem::file_size(filepath, ec) * 8 > memoryLimit && !ec) {
+		if (!StreamSource(filepath, memoryLimit, data.cancel) || !cache.Open(filepath))
+			return false;
+		streamed = true;
+	}
+
+	if (!warm && !streamed) {
+		if (!LoadSource(filepath, data, deferTextures))
+			return false;
+	}
+	else {
+		//warm start - buffers go from the mapped cache straight to GL (decoded on the way when compressed)
+		cache.LoadMaterials(data.materials, deferTextures ? &data.pendingTextures : nullptr, &data.arena);
+		cache.LoadMeshes(data.meshes, data.materials);
+		cache.LoadInstances(data.instances);
+		data.source = SceneData::CACHE;
+		data.vertexCount = cache.VertexCount();
+		data.indexCount = cache.IndexCount();
+		data.indexType = cache.IndexType();
+		data.startType = asset ? "compressed asset" : warm ? "warm, from cache" : "cold, streamed";
+	}
+
+	//allocator calls & fragmentation of the load-time objects
+	if (data.arena.stats().objects > 0)
+		data.arena.Log("materials");
+	if (data.surfaceArena.stats().objects > 0)
+		data.surfaceArena.Log("surfaces");
+
+	data.ComputeMeshVertexEnds();
+	return true;
+}
+
+bool Scene::LoadSource(const char* filepath, SceneData& data, bool deferTextures) {
+	//load scene data from file
+	std::vector<std::string> materialLibraries;
+	if (LoadOBJ(filepath, data.surfaces, data.materials, false, Vector3(0.5f, 0.5f, 0.5f), 0, &materialLibraries,
+				deferTextures ? &data.pendingTextures : nullptr, nullptr, &data.arena, &data.surfaceArena, &data.cancel) < 0) {
+		return false;
+	}
+
+	//repeated objects are kept once, with the transforms of their copies
+	std::vector<int> copies;
+	FindInstances(data.surfaces, copies, data.instances);
+	//large surfaces become chunks with their own bounds
+	SplitSurfaces(data.surfaces, copies, &data.surfaceArena);
+	//a destroyed async scene stops between the stages
+	if (data.cancel)
+		return false;
+
+	//triangles of all surfaces in scene order, nothing is copied
+	const std::vector<VertexSpan> soups = MergeSurfaces(data.surfaces, data.materials, data.meshes);
+	AssignInstances(data.meshes, copies);
+
+	//weld identical vertices -> unique vertices + index buffer (mesh ranges stay the same), vertices stay in the surfaces
+	IndexedGeometry& geometry = data.geometry;
+	geometry = WeldVertices(soups);
+
+	//tangents are averaged over the welded vertices (triangles leave them empty, so they don't prevent welding)
+	GenerateTangents(geometry);
+	if (data.cancel)
+		return false;
+	//triangle & vertex order for the post-transform cache and early-Z, the cache keeps it
+	OptimizeGeometry(geometry, data.meshes);
+
+	const size_t soupBytes = geometry.indices.size() * sizeof(Vertex);
+	const size_t indexedBytes = geometry.VertexCount() * sizeof(Vertex) + geometry.indices.size() * geometry.IndexSize();
+	errlog("Vertex welding: %d -> %d vertices, %.1f KB -> %.1f KB (VBO + EBO, %.1f KB saved).\n",
+		(int)geometry.indices.size(), (int)geometry.VertexCount(), soupBytes / 1024.0, indexedBytes / 1024.0, ((double)soupBytes - indexedBytes) / 1024.0);
+
+	data.vertexCount = geometry.VertexCount();
+	data.indexCount = geometry.indices.size();
+	data.indexType = geometry.IndexType();
+	if (data.cancel)
+		return false;
+
+	//next start skips parsing entirely
+	GeometryCache::Write(filepath, materialLibraries, geometry, data.meshes, data.materials, data.instances);
+
+	return true;
+}
+//Appends streamed triangles to the cache as a non-indexed triangle list, one mesh per run of group & material. Runs handed over
+//at once are split into spatially compact meshes as large surfaces are (see SplitSurfaces), smaller ones continue the last mesh
+//while it stays within SPLIT_TRIANGLES.
+class CacheStreamSink : public OBJStreamSink {
+public:
+	CacheStreamSink(GeometryCacheWriter& writer, std::vector<Mesh>& meshes, const std::atomic<bool>& cancel) : writer(writer), meshes(meshes), cancel(cancel) {}
+
+	bool AddTriangles(const std::string& group, Material* material, const Triangle* triangles, size_t count) override {
+		//a scene destroyed while streaming stops the loader, the unfinished cache is removed
+		if (cancel)
+			return false;
+		int offset = int(writer.VertexCount());
+		if (writer.VertexCount() + count * 3 > INT32_MAX) {
+			errlog("Scene is too large (more than %d vertices).\n", INT32_MAX);
+			return false;
+		}
+
+		//streamed geometry is not welded, every triangle gets its own tangent (so the triangles can be reordered)
+		vertices.assign(reinterpret_cast<const Vertex*>(triangles), reinterpret_cast<const Vertex*>(triangles) + count * 3);
+		GenerateTangents(vertices.data(), vertices.size());
+
+		chunks.clear();
+		if (count > size_t(SPLIT_TRIANGLES))
+			SplitTriangles(reinterpret_cast<Triangle*>(vertices.data()), int(count), SPLIT_TRIANGLES, chunks);
+		else
+			chunks.push_back(int(count));
+
+		const Vertex* vertex = vertices.data();
+		for (int chunk : chunks) {
+			const bool continues = chunks.size() == 1 && !meshes.empty() && meshes.back().material == material && group == lastGroup &&
+				meshes.back().count / 3 + chunk <= SPLIT_TRIANGLES;
+			if (!continues)
+				meshes.push_back(Mesh(offset, 0, material));
+			Mesh& mesh = meshes.back();
+			mesh.count += chunk * 3;
+			for (int v = 0; v < chunk * 3; v++, vertex++)
+				mesh.Extend(vertex->position);
+			offset += chunk * 3;
+		}
+		lastGroup = group;
+
+		writer.AppendVertices(vertices.data(), vertices.size());
+		return true;
+	}
+private:
+	GeometryCacheWriter& writer;
+	std::vector<Mesh>& meshes;
+	const std::atomic<bool>& cancel;
+	std::string lastGroup;
+	std::vector<Vertex> vertices;
+	std::vector<int> chunks;
+};
+
+bool Scene::StreamSource(const char* filepath, size_t memoryLimit, const std::atomic<bool>& cancel) {
+	GeometryCacheWriter writer(filepath);
+	if (!writer.IsOpen())
+		return false;
+
+	//materials are recreated from the cache afterwards
+	std::vector<Material*> streamedMaterials;
+	std::vector<Mesh> streamedMeshes;
+	std::vector<std::string> materialLibraries;
+
+	//textures are not needed here, the cache only stores their file names
+	std::vector<Texture3u*> textures;
+	Arena materialArena;
+
+	CacheStreamSink sink(writer, streamedMeshes, cancel);
+	bool ok = LoadOBJStreaming(filepath, sink, streamedMaterials, memoryLimit, false, Vector3(0.5f, 0.5f, 0.5f), 0, &materialLibraries, &textures,
+							   &materialArena) >= 0;
+	ok = ok && writer.Finish(nullptr, materialLibraries, streamedMeshes, streamedMaterials);
+	return ok;
+}
+
+bool Scene::CreateGeometryBuffers(SceneData& data) {
+	//immutable storage mapped once for the whole loading, written ranges are flushed explicitly (GL doesn't allow empty storage)
+	const GLbitfield storageFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
+	const GLbitfield mapFlags = storageFlags | GL_MAP_FLUSH_EXPLICIT_BIT;
+	vertexFormat = data.format;
+	vertexStreams = data.streams;
+	//split streams share the buffer, attributes follow the positions
+	attributeOffset = (vertexStreams == VertexStreams::SPLIT) ? (data.vertexCount * PositionSize(vertexFormat) + 15) & ~size_t(15) : 0;
+	const size_t vertexBytes = std::max<size_t>((vertexStreams == VertexStreams::SPLIT) ? attributeOffset + data.vertexCount * AttributeSize(vertexFormat)
+																						 : data.vertexCount * VertexSize(vertexFormat), 1);
+	const size_t indexBytes = std::max<size_t>((data.indexCount + data.lodIndices.size()) * IndexSize(data.indexType), 1);
+
 	//generate VAO
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 
-	//generate & fill VBO
+	//generate & map VBO
 	glGenBuffers(1, &vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
-
-	//Setup vertex attributes
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, position)));
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, normal)));
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, color)));
-	glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, texture_coords)));
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, tangent)));
-	glVertexAttribIPointer(5, 1, GL_INT,			sizeof(Vertex), (void*)(offsetof(Vertex, matIdx)));
-	for (int i = 0; i < 6; i++)
-		glEnableVertexAttribArray(i);
+	glNamedBufferStorage(vbo, vertexBytes, nullptr, storageFlags);
+	char* vertices = static_cast<char*>(glMapNamedBufferRange(vbo, 0, vertexBytes, mapFlags));
 
-	//SSBO
-	glGenBuffers(1, &ssbo);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLMaterial) * materials.size(), (float*)glMaterials, GL_STATIC_DRAW);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
+	//generate & map EBO
+	glGenBuffers(1, &ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glNamedBufferStorage(ebo, indexBytes, nullptr, storageFlags);
+	char* indices = static_cast<char*>(glMapNamedBufferRange(ebo, 0, indexBytes, mapFlags));
 
-	//cleanup
-	for (Surface* s : surfaces)
-		delete s;
-	delete[] vertexData;
+	//Setup vertex attributes, the depth-only VAO shares the buffers
+	SetupVertexAttributes(false);
+	glGenVertexArrays(1, &depthVao);
+	glBindVertexArray(depthVao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	SetupVertexAttributes(true);
+	glBindVertexArray(vao);
 
-	errlog("Scene '%s' loaded.\n", filepath);
+	if (vertexFormat == VertexFormat::PACKED) {
+		glGenBuffers(1, &boxes);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, boxes);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(QuantizationBox) * data.boxes.size(), data.boxes.data(), GL_STATIC_DRAW);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, boxes);
+	}
+	errlog("Vertex buffer %.1f MB (%zu vertices, %s format, %zu B each, %zu B read by depth passes), index buffer %.1f MB.\n",
+		   vertexBytes / (1024.0 * 1024.0), data.vertexCount, vertexFormat == VertexFormat::PACKED ? "packed" : "full", VertexSize(vertexFormat),
+		   (vertexStreams == VertexStreams::SPLIT) ? PositionSize(vertexFormat) : VertexSize(vertexFormat), indexBytes / (1024.0 * 1024.0));
+
+	if (vertices == nullptr || indices == nullptr) {
+		errlog("Failed to map geometry buffers (%.1f MB).\n", (vertexBytes + indexBytes) / (1024.0 * 1024.0));
+		return false;
+	}
+
+	//published under the lock, the worker of an async scene waits for them
+	std::lock_guard<std::mutex> lock(data.mutex);
+	data.mappedVertices = vertices;
+	data.mappedAttributes = (vertexStreams == VertexStreams::SPLIT) ? vertices + attributeOffset : nullptr;
+	data.mappedIndices = indices;
 	return true;
 }
 
+void Scene::SetupVertexAttributes(bool depthOnly) const {
+	//field of a vertex (offset into Vertex or PackedVertex), split streams keep the fields of both parts in the same order
+	const size_t positionSize = PositionSize(vertexFormat);
+	auto attribute = [this, positionSize](GLuint location, GLint size, GLenum type, GLboolean normalized, bool integer, size_t offset) {
+		GLsizei stride = GLsizei(VertexSize(vertexFormat));
+		if (vertexStreams == VertexStreams::SPLIT && offset < positionSize) {
+			stride = GLsizei(positionSize);
+		}
+		else if (vertexStreams == VertexStreams::SPLIT) {
+			stride = GLsizei(AttributeSize(vertexFormat));
+			offset = attributeOffset + offset - positionSize;
+		}
+		if (integer)
+			glVertexAttribIPointer(location, size, type, stride, (void*)offset);
+		else
+			glVertexAttribPointer(location, size, type, normalized, stride, (void*)offset);
+		glEnableVertexAttribArray(location);
+	};
+
+	if (vertexFormat == VertexFormat::PACKED) {
+		//same locations, decoded by the shaders (positions are unit box coordinates, normal & tangent .xy octahedron coordinates)
+		attribute(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, false, offsetof(PackedVertex, position));
+		attribute(5, 1, GL_UNSIGNED_SHORT, GL_FALSE, true, offsetof(PackedVertex, matIdx));
+		if (depthOnly)
+			return;
+		attribute(1, 2, GL_SHORT, GL_TRUE, false, offsetof(PackedVertex, normal));
+		attribute(3, 2, GL_HALF_FLOAT, GL_FALSE, false, offsetof(PackedVertex, texture_coords));
+		attribute(4, 2, GL_SHORT, GL_TRUE, false, offsetof(PackedVertex, tangent));
+		//no color, LoadOBJ's default instead
+		glVertexAttrib3f(2, 0.5f, 0.5f, 0.5f);
+	}
+	else {
+		attribute(0, 3, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, position));
+		if (depthOnly)
+			return;
+		attribute(1, 3, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, normal));
+		attribute(2, 3, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, color));
+		attribute(3, 2, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, texture_coords));
+		attribute(4, 3, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, tangent));
+		attribute(5, 1, GL_INT, GL_FALSE, true, offsetof(Vertex, matIdx));
+		attribute(6, 1, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, handedness));
+	}
+}
+
+void Scene::FlushGeometry(size_t vertexBegin, size_t vertexEnd, size_t indexBegin, size_t indexEnd) {
+	const size_t indexSize = IndexSize(indexType);
+	if (vertexEnd > vertexBegin && vertexStreams == VertexStreams::SPLIT) {
+		const size_t positionSize = PositionSize(vertexFormat), attributeSize = AttributeSize(vertexFormat);
+		glFlushMappedNamedBufferRange(vbo, vertexBegin * positionSize, (vertexEnd - vertexBegin) * positionSize);
+		glFlushMappedNamedBufferRange(vbo, attributeOffset + vertexBegin * attributeSize, (vertexEnd - vertexBegin) * attributeSize);
+	}
+	else if (vertexEnd > vertexBegin) {
+		glFlushMappedNamedBufferRange(vbo, vertexBegin * VertexSize(vertexFormat), (vertexEnd - vertexBegin) * VertexSize(vertexFormat));
+	}
+	if (indexEnd > indexBegin)
+		glFlushMappedNamedBufferRange(ebo, indexBegin * indexSize, (indexEnd - indexBegin) * indexSize);
+}
+
+void Scene::UnmapGeometry() {
+	glUnmapNamedBuffer(vbo);
+	glUnmapNamedBuffer(ebo);
+}
+
+void Scene::CreateMeshletBuffers(SceneData& data) {
+	//the worker doesn't touch the meshlets once the geometry is ready
+	meshlets = std::move(data.meshlets);
+	if (meshlets.empty())
+		return;
+	commands.resize(meshlets.size());
+
+	glCreateBuffers(1, &meshletBuffer);
+	glNamedBufferStorage(meshletBuffer, meshlets.size() * sizeof(Meshlet), meshlets.data(), 0);
+	glCreateBuffers(1, &viewBuffer);
+	glNamedBufferStorage(viewBuffer, sizeof(CullingView), nullptr, GL_DYNAMIC_STORAGE_BIT);
+	glCreateBuffers(1, &commandBuffer);
+	glNamedBufferStorage(commandBuffer, MESHLET_COMMANDS_OFFSET + meshlets.size() * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	errlog("Meshlet buffers %.1f MB (%zu meshlets).\n",
+		   (meshlets.size() * (sizeof(Meshlet) + sizeof(DrawElementsIndirectCommand))) / (1024.0 * 1024.0), meshlets.size());
+}
+
+void Scene::CreateImpostorBuffers(SceneData& data) {
+	const ImpostorAtlas& atlas = data.impostors;
+	if (atlas.meshes.empty())
+		return;
+	if (atlas.meshes.size() != meshes.size()) {
+		warnlog("Impostor atlas of %zu meshes doesn't match the scene (%zu meshes), baked from another model.\n", atlas.meshes.size(), meshes.size());
+		data.impostors = ImpostorAtlas();
+		return;
+	}
+
+	//tiles in mesh order, row by row
+	const float tileWidth = float(atlas.TileSize()) / atlas.width;
+	const float tileHeight = float(atlas.TileSize()) / atlas.height;
+	impostorTiles.resize(meshes.size());
+	for (size_t m = 0; m < meshes.size(); m++) {
+		const ImpostorBounds& bounds = atlas.meshes[m];
+		ImpostorInstance& tile = impostorTiles[m];
+		tile.sphere[0] = bounds.center[0];
+		tile.sphere[1] = bounds.center[1];
+		tile.sphere[2] = bounds.center[2];
+		tile.sphere[3] = bounds.radius;
+		tile.tile[0] = (m % atlas.tilesPerRow) * tileWidth;
+		tile.tile[1] = (m / atlas.tilesPerRow) * tileHeight;
+		tile.tile[2] = tileWidth;
+		tile.tile[3] = tileHeight;
+	}
+	impostorGrid = atlas.grid;
+
+	//filtered across the views by impostor.frag, the views are dilated so their borders don't bleed
+	GLuint* textures[] = { &impostorAlbedo, &impostorNormalDepth };
+	const uint32_t* texels[] = { atlas.albedo.data(), atlas.normalDepth.data() };
+	for (int i = 0; i < 2; i++) {
+		glCreateTextures(GL_TEXTURE_2D, 1, textures[i]);
+		glTextureStorage2D(*textures[i], 1, GL_RGBA8, atlas.width, atlas.height);
+		glTextureSubImage2D(*textures[i], 0, 0, 0, atlas.width, atlas.height, GL_RGBA, GL_UNSIGNED_BYTE, texels[i]);
+		glTextureParameteri(*textures[i], GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(*textures[i], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(*textures[i], GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(*textures[i], GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	glCreateBuffers(1, &impostorBuffer);
+	glNamedBufferStorage(impostorBuffer, meshes.size() * sizeof(ImpostorInstance), nullptr, GL_DYNAMIC_STORAGE_BIT);
+	glCreateVertexArrays(1, &impostorVao);
+
+	errlog("Impostor buffers %.1f MB (%dx%d atlas).\n",
+		   (2.0 * atlas.width * atlas.height * sizeof(uint32_t) + meshes.size() * sizeof(ImpostorInstance)) / (1024.0 * 1024.0), atlas.width, atlas.height);
+	data.impostors = ImpostorAtlas();
+}
+
+void Scene::CreateInstanceBuffers(SceneData& data) {
+	instances = std::move(data.instances);
+	if (instances.empty())
+		return;
+
+	for (size_t m = 0; m < meshes.size(); m++) {
+		const Mesh& mesh = meshes[m];
+		if (mesh.instanceCount == 0)
+			continue;
+		instanceCommands.push_back({ uint32_t(mesh.count), uint32_t(mesh.instanceCount), uint32_t(mesh.offset), 0, uint32_t(mesh.firstInstance) + 1 });
+		instancedMeshes.push_back(int(m));
+	}
+
+	glCreateBuffers(1, &instanceBuffer);
+	glNamedBufferStorage(instanceBuffer, instances.size() * sizeof(InstanceTransform), instances.data(), 0);
+	glCreateBuffers(1, &instanceCommandBuffer);
+	glNamedBufferStorage(instanceCommandBuffer, instanceCommands.size() * sizeof(DrawElementsIndirectCommand), instanceCommands.data(), GL_DYNAMIC_STORAGE_BIT);
+
+	size_t copiedTriangles = 0;
+	for (const DrawElementsIndirectCommand& command : instanceCommands)
+		copiedTriangles += size_t(command.count / 3) * command.instanceCount;
+	errlog("Instances: %zu copies of %zu meshes (%zu triangles not stored), %.1f KB.\n", instances.size(), instanceCommands.size(), copiedTriangles,
+		   (instances.size() * sizeof(InstanceTransform) + instanceCommands.size() * sizeof(DrawElementsIndirectCommand)) / 1024.0);
+}
+
 void Scene::LoadDefault() {
 	errlog("Loading default scene.\n");
 
@@ -132,7 +1368,14 @@ void Scene::LoadDefault() {
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, vertex_stride, (void*)(sizeof(float) * 3));
 	glEnableVertexAttribArray(1);
 
-	vertexCount = no_vertices;
+	//EBO
+	GLushort indices[] = { 0, 1, 2 };
+	glGenBuffers(1, &ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+	indexCount = no_vertices;
+	indexType = GL_UNSIGNED_SHORT;
 
 	errlog("Default scene loaded.\n");
 }
@@ -141,8 +1384,8 @@ void Scene::LoadDefault() {
 
 Mesh::Mesh(int o, int c, Material* m) : offset(o), count(c), material(m) {}
 
-void Mesh::Draw() const {
-	glDrawArrays(GL_TRIANGLES, offset, count);
+void Mesh::Draw(GLenum indexType, size_t indexSize) const {
+	glDrawElements(GL_TRIANGLES, count, indexType, (void*)(offset * indexSize));
 }
 
 //================================= Parse methdos =================================
@@ -158,27 +1401,56 @@ GLMaterial* ParseMaterials(std::vector<Material*>& materials) {
 	return data;
 }
 
-std::pair<int, float*> MergeSurfaces(std::vector<Surface*>& surfaces, std::vector<Mesh>& meshes) {
-	//secte vsechny trojuhelniky ve scene
-	int totalTriangles = 0;
-	for (Surface* s : surfaces) {
-		s->setMaterialIdx();						//kazdemu vrcholu nastavi idx materialu
-		totalTriangles += s->no_triangles();
-	}
+GLMaterial PlaceholderMaterial(Material* material, GLuint64 whiteTexture) {
+	GLMaterial mat;
+
+	mat.normal = Color3f({ 0.f, 0.f, 1.f });
+	mat.rma = Color3f({ material->roughness_, material->metallicness, material->ior });
+	mat.diffuse = material->diffuse();
 
-	//alokace bufferu pro data sceny
-	Triangle* data = new Triangle[totalTriangles];
+	mat.texDiffuse = whiteTexture;
+	mat.texNormal = mat.texRMA = 0;
 
-	//kopirovani jednotlivych povrchu do bufferu
+	return mat;
+}
+
+std::vector<VertexSpan> MergeSurfaces(std::vector<Surface*>& surfaces, const std::vector<Material*>& materials, std::vector<Mesh>& meshes) {
+	std::unordered_map<const Material*, int> materialIndices(materials.size());
+	for (size_t i = 0; i < materials.size(); i++)
+		materialIndices.emplace(materials[i], int(i));		//first occurrence wins, as std::find did
+
+	std::vector<VertexSpan> soups;
+	soups.reserve(surfaces.size());
+
+	const size_t first = meshes.size();
 	int offset = 0;
 	for (Surface* s : surfaces) {
-		int no_triangles = s->copyTriangles(data, offset);
+		//kazdemu vrcholu nastavi idx materialu (= pozice v SSBO)
+		const auto mIdx = materialIndices.find(s->get_material());
+		s->setMaterialIdx(mIdx != materialIndices.end() ? mIdx->second : 0);
 
 		//mesh reprezentuje 1 povrch v ramci bufferu (offset a velikost, kterou v nem zabira + material)
+		const int no_triangles = s->no_triangles();
 		meshes.push_back(Mesh(offset * 3, no_triangles * 3, s->get_material()));
+		soups.push_back({ reinterpret_cast<const Vertex*>(s->get_triangles()), size_t(no_triangles) * 3 });
 
 		offset += no_triangles;
 	}
 
-	return { totalTriangles * 3, (float*)data };
+	ParallelFor(static_cast<int>(surfaces.size()), 0, [&](int i) {
+		Mesh& mesh = meshes[first + i];
+		for (const Vertex* v = soups[i].vertices, *end = v + soups[i].count; v < end; v++)
+			mesh.Extend(v->position);
+	});
+
+	return soups;
+}
+
+void AssignInstances(std::vector<Mesh>& meshes, const std::vector<int>& copies) {
+	int first = 0;
+	for (size_t m = 0; m < meshes.size() && m < copies.size(); m++) {
+		meshes[m].firstInstance = first;
+		meshes[m].instanceCount = copies[m];
+		first += copies[m];
+	}
 }
\ No newline at end of file
@@ -1,25 +1,76 @@
 #pragma once
 
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <cfloat>
+
+#include "arena.h"
+#include "vertexformat.h"
+#include "meshlet.h"
+#include "simplify.h"
+#include "impostor.h"
+#include "instancing.h"
 
 class Material;
+class ShaderProgram;
+class Surface;
 struct GLMaterial;
+struct Vertex;
+struct VertexSpan;
+struct SceneData;
 
 class Mesh {
 public:
 	Mesh(int offset, int count, Material* material);
 
-	void Draw() const;
+	void Draw(GLenum indexType, size_t indexSize) const;
+	inline void Extend(const Vector3& p) {
+		boxMin = Vector3(std::min(boxMin.x, p.x), std::min(boxMin.y, p.y), std::min(boxMin.z, p.z));
+		boxMax = Vector3(std::max(boxMax.x, p.x), std::max(boxMax.y, p.y), std::max(boxMax.z, p.z));
+	}
 public:
 	int offset;
 	int count;
 	Material* material;
+	//bounding box of the vertices of the mesh (without its copies), set by every loader & stored in the geometry cache
+	Vector3 boxMin = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vector3 boxMax = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	//range of the scene's meshlets, empty unless the scene builds them
+	int firstMeshlet = 0;
+	int meshletCount = 0;
+	//range of the scene's levels of detail (the simplified ones) & the bounding sphere they are selected by, empty unless the scene builds them
+	int firstLOD = 0;
+	int lodCount = 0;
+	Vector3 center;
+	float radius = 0.0f;
+	//range of the scene's instance transforms, the copies of the mesh drawn besides it (see FindInstances)
+	int firstInstance = 0;
+	int instanceCount = 0;
 };
 
+//Sets material indices of all vertices and returns triangles of the surfaces in scene order (pointing into the surfaces,
+//nothing is copied), meshes get one entry per surface (with its bounding box).
+std::vector<VertexSpan> MergeSurfaces(std::vector<Surface*>& surfaces, const std::vector<Material*>& materials, std::vector<Mesh>& meshes);
+//Sets the instance ranges of meshes of the surfaces left by FindInstances (copies of every one), transforms follow in mesh order.
+void AssignInstances(std::vector<Mesh>& meshes, const std::vector<int>& copies);
+
 class Scene {
 public:
-	Scene() {}			//invalid constructor
-	Scene(const char* filepath);
+	Scene();			//invalid constructor
+	//Async scenes are loaded by a worker thread and become visible progressively through Update().
+	//Models which the in-memory loader can't handle within memoryLimit are streamed into the geometry cache first.
+	//Mesh assets (MESH_ASSET_EXTENSION, see WriteMeshAsset) are decoded straight into the GL buffers.
+	//Binary glTF models (GLB_EXTENSION, see GLBModel) and PLY scans (PLY_EXTENSION, see PLYModel) are read in place the same way.
+	//Packed vertices (see PackedVertex) are quantized while they are written into the vertex buffer.
+	//Split streams keep the positions apart from the other attributes, so depth-only passes read PositionSize bytes per vertex.
+	//Meshlets (see BuildMeshlets) are built from the final index buffer on every load, for CullMeshlets & DrawMeshlets.
+	//Levels of detail (see GenerateLODs) are simplified on every load as well, their indices follow the full meshes in the index buffer.
+	//Impostors (see BakeImpostors) are loaded when the cooker has baked their atlas next to the model (see ImpostorPath).
+	//Repeated surfaces of OBJ models are stored once (see FindInstances), their copies are drawn instanced by every draw call.
+	//Large surfaces of OBJ models are split into spatially compact meshes (see SplitSurfaces), streamed ones within the windows of the loader.
+	Scene(const char* filepath, bool async = false, size_t memoryLimit = DEFAULT_MEMORY_LIMIT, VertexFormat format = VertexFormat::FULL,
+		  VertexStreams streams = VertexStreams::INTERLEAVED, bool meshlets = false, bool lods = false);
 	~Scene();
 
 	//copy deleted
@@ -31,18 +82,128 @@ public:
 	Scene& operator=(Scene&&) noexcept;
 
 	void Draw() const;
+	//Positions only (location 0, and 5 of packed vertices), for depth prepasses & shadow maps.
+	void DrawDepth() const;
+	//Layout of the vertex buffer, shaders decode packed vertices when their uniform packedVertices is set.
+	inline VertexFormat Format() const { return vertexFormat; }
+
+	inline bool HasMeshlets() const { return !meshlets.empty(); }
+	//Meshlets of the drawable meshes which pass view (in object space) become the draw commands of DrawMeshlets. They are culled
+	//by cullShader (meshlet_cull.comp, bound afterwards) when given, on the CPU otherwise. Returns the meshlets tested.
+	size_t CullMeshlets(CullingView view, const ShaderProgram* cullShader = nullptr);
+	//One multi-draw of the meshlets left by the last CullMeshlets, with the draw count read by GL from the command buffer.
+	void DrawMeshlets(bool depthOnly = false) const;
+
+	inline bool HasLODs() const { return !lods.empty(); }
+	//Picks the coarsest level of every mesh whose error projects to at most threshold pixels from eye (in object space), used by
+	//Draw & DrawDepth until the next call. pixelsPerUnit is the size of a unit at distance 1 (see Camera::P). Copies of instanced meshes
+	//share the level of the nearest one. Returns the triangles selected (of the meshes, without copies).
+	size_t SelectLODs(const Vector3& eye, float pixelsPerUnit, float threshold = LOD_THRESHOLD);
+	inline size_t TriangleCount() const { return size_t(indexCount) / 3; }
+
+	inline bool HasImpostors() const { return impostorAlbedo != 0; }
+	//Swaps meshes whose bounding sphere is smaller than pixels on screen for impostors, called after SelectLODs (which resets the
+	//selection) with the same eye & pixelsPerUnit. Instanced meshes are never swapped, the atlas has a view of the original only.
+	//Returns the impostors selected, drawn by DrawImpostors until the next call.
+	size_t SelectImpostors(const Vector3& eye, float pixelsPerUnit, float pixels = IMPOSTOR_PIXELS);
+	//One instanced draw of the selected impostors, impostor.vert & impostor.frag bound (texture units 0 & 1, SSBO binding 4).
+	void DrawImpostors() const;
+	//Views per side of the octahedral map of the atlas (uniform impostorGrid).
+	inline int ImpostorGrid() const { return impostorGrid; }
+	//Triangles of the selection of the last SelectLODs & SelectImpostors.
+	size_t SelectedTriangles() const;
+
+	//Uploads parts of an async scene finished since the last call, meant to be called once per frame.
+	void Update();
+	inline bool IsLoading() const { return loading != nullptr; }
+public:
+	static constexpr size_t DEFAULT_MEMORY_LIMIT = size_t(2) << 30;
 private:
-	bool Load(const char* filepath);
+	bool Load(const char* filepath, size_t memoryLimit, VertexFormat format, VertexStreams streams, bool buildMeshlets, bool buildLODs);
+	void LoadAsync(const char* filepath, size_t memoryLimit, VertexFormat format, VertexStreams streams, bool buildMeshlets, bool buildLODs);
 	void LoadDefault();
+
+	//CPU part of the loading (no GL calls), textures are only recorded when deferTextures is set.
+	static bool Prepare(const char* filepath, size_t memoryLimit, SceneData& data, bool deferTextures);
+	//Cold start - parses the source file and writes the geometry cache.
+	static bool LoadSource(const char* filepath, SceneData& data, bool deferTextures);
+	//Cold start of large models - streams the source file into the geometry cache with bounded memory.
+	static bool StreamSource(const char* filepath, size_t memoryLimit, const std::atomic<bool>& cancel);
+
+	//Creates VAO and immutable VBO & EBO for the final buffers of data, both persistently mapped for writing.
+	//Final vertices & indices are written straight into them (see SceneData::WriteMeshes), no copy is kept in host memory.
+	//Needs GL 4.4 or ARB_buffer_storage only (no window or bindless textures), so it runs under headless Mesa llvmpipe as well.
+	bool CreateGeometryBuffers(SceneData& data);
+	//Vertex attributes of the bound VAO, depth-only VAOs get the position stream only.
+	void SetupVertexAttributes(bool depthOnly) const;
+	void DrawMeshes(GLuint vertexArray) const;
+	//One multi-draw of the copies of the drawable instanced meshes into the bound VAO, their transforms are SSBO binding 5.
+	void DrawInstances() const;
+	//Makes written vertex & index ranges visible to GL.
+	void FlushGeometry(size_t vertexBegin, size_t vertexEnd, size_t indexBegin, size_t indexEnd);
+	void UnmapGeometry();
+	//Meshlet SSBO (binding 2), culling view UBO (binding 0) & the command buffer (SSBO binding 3) of DrawMeshlets.
+	void CreateMeshletBuffers(SceneData& data);
+	//Atlas textures & the instance SSBO of the impostors, none unless an atlas of the same meshes was loaded.
+	void CreateImpostorBuffers(SceneData& data);
+	//Transform SSBO (binding 5) & the command buffer of DrawInstances, none unless the scene has copies.
+	void CreateInstanceBuffers(SceneData& data);
+	//Async loading steps, executed on the main thread.
+	bool BeginUpload();
+	void FlushMeshes();
+	void UploadTextures(size_t& budget);
+	void FinishLoading();
+	//Deletes GL objects & materials of the scene (stops its loading first).
+	void Release();
 private:
 	std::vector<Material*> materials;
 	std::vector<Mesh> meshes;
+	Arena arena;			//owns materials & their textures
 
-	int vertexCount = 0;
+	int indexCount = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+	VertexFormat vertexFormat = VertexFormat::FULL;
+	VertexStreams vertexStreams = VertexStreams::INTERLEAVED;
+	size_t attributeOffset = 0;		//of the attribute stream in vbo (split streams)
 
 	GLuint vao  = 0;
+	GLuint depthVao = 0;
 	GLuint vbo  = 0;
+	GLuint ebo  = 0;
 	GLuint ssbo = 0;
+	GLuint boxes = 0;		//quantization boxes of packed vertices (SSBO binding 1)
+
+	std::vector<Meshlet> meshlets;
+	std::vector<DrawElementsIndirectCommand> commands;		//CPU culling only
+	size_t culledMeshlets = 0;		//meshlets tested by the last CullMeshlets, upper bound of the draw count
+	GLuint meshletBuffer = 0;
+	GLuint viewBuffer = 0;
+	GLuint commandBuffer = 0;		//draw count & MESHLET_COMMANDS_OFFSET padding, then the commands
+
+	std::vector<MeshLOD> lods;		//offsets into the index buffer
+	//selection of the last SelectLODs & SelectImpostors (one draw per mesh), the full index buffer is drawn at once when empty
+	std::vector<GLsizei> drawCounts;
+	std::vector<const void*> drawOffsets;
+
+	std::vector<ImpostorInstance> impostorTiles;		//of every mesh, radius 0 = none
+	std::vector<ImpostorInstance> impostors;			//selected by the last SelectImpostors
+	int impostorGrid = IMPOSTOR_GRID;
+	GLuint impostorAlbedo = 0;
+	GLuint impostorNormalDepth = 0;
+	GLuint impostorBuffer = 0;
+	GLuint impostorVao = 0;				//no attributes, the quads are built from gl_VertexID
+
+	std::vector<InstanceTransform> instances;
+	//one command per instanced mesh (in mesh order), copies are drawn with baseInstance 1 + their first transform
+	std::vector<DrawElementsIndirectCommand> instanceCommands;
+	std::vector<int> instancedMeshes;		//mesh of every command
+	GLuint instanceBuffer = 0;
+	GLuint instanceCommandBuffer = 0;
 
 	GLMaterial* glMaterials = nullptr;
+	GLuint placeholderTexture = 0;		//white texture of the materials of an async scene until their diffuse maps arrive
+
+	//async loading state, nullptr once the scene is complete
+	std::unique_ptr<SceneData> loading;
+	size_t drawableMeshes = 0;
 };
@@ -39,6 +39,24 @@ ShaderProgram::ShaderProgram(const char* vShaderPath, const char* fShaderPath) {
 	errlog("Shader compilation successful ('%s').\n", vShaderPath);
 }
 
+ShaderProgram::ShaderProgram(const char* cShaderPath) {
+	GLuint cShader;
+
+	if (!LoadAndCompileShader(cShaderPath, GL_COMPUTE_SHADER, cShader)) {
+		errlog("Shader failed to compile ('%s' - compute)\n", cShaderPath);
+		glDeleteShader(cShader);
+		throw std::exception("Shader program failed to compile.");
+	}
+
+	programID = glCreateProgram();
+	glAttachShader(programID, cShader);
+	glLinkProgram(programID);
+
+	glDeleteShader(cShader);
+
+	errlog("Shader compilation successful ('%s').\n", cShaderPath);
+}
+
 ShaderProgram::~ShaderProgram() {
 	glDeleteProgram(programID);
 	programID = 0;
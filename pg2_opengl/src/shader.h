@@ -5,6 +5,8 @@ public:
 	//invalid ctor
 	ShaderProgram() {}
 	ShaderProgram(const char* vShaderPath, const char* fShaderPath);
+	//compute program
+	explicit ShaderProgram(const char* cShaderPath);
 	~ShaderProgram();
 
 	//copy deleted
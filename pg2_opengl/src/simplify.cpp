@@ -0,0 +1,402 @@
+#include "pch.h"
+#include "simplify.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cfloat>
+
+#include "vertex.h"
+#include "vertexcache.h"
+
+//seam edges resist moving sideways this much more than the surfaces
+constexpr double SEAM_WEIGHT = 10.0;
+//cost of a collapse changing the normal from n to m is NORMAL_WEIGHT * |n - m|^2 * squared length of the collapsed edge
+constexpr double NORMAL_WEIGHT = 1.0;
+//collapses turning a triangle by more than ~75 degrees (or away from the shading normals of its corners) are rejected
+constexpr float FLIP_COSINE = 0.25f;
+//collapses of a pass may cost this much more than the cheapest ones needed to reach the target
+constexpr double PASS_ERROR_FACTOR = 1.5;
+//simplification stops this close to the target (part of the triangles), the last passes collapse a few edges only
+constexpr float TARGET_TOLERANCE = 0.05f;
+//levels removing less than this part of the triangles of the previous one end the chain
+constexpr float LOD_MIN_REDUCTION = 0.15f;
+
+//Squared distances to weighted planes (Garland & Heckbert 1997), symmetric 4x4 matrix.
+struct Quadric {
+	double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+	double b0 = 0, b1 = 0, b2 = 0;
+	double c = 0;
+	double w = 0;
+
+	void AddPlane(const Vector3& n, double d, double weight) {
+		a00 += weight * n.x * n.x; a11 += weight * n.y * n.y; a22 += weight * n.z * n.z;
+		a01 += weight * n.x * n.y; a02 += weight * n.x * n.z; a12 += weight * n.y * n.z;
+		b0 += weight * n.x * d; b1 += weight * n.y * d; b2 += weight * n.z * d;
+		c += weight * d * d;
+		w += weight;
+	}
+	void operator+=(const Quadric& q) {
+		a00 += q.a00; a11 += q.a11; a22 += q.a22; a01 += q.a01; a02 += q.a02; a12 += q.a12;
+		b0 += q.b0; b1 += q.b1; b2 += q.b2;
+		c += q.c;
+		w += q.w;
+	}
+	//weighted mean of the squared distances of p to the planes
+	double Error(const Vector3& p) const {
+		const double x = p.x, y = p.y, z = p.z;
+		const double e = a00 * x * x + a11 * y * y + a22 * z * z + 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+					   + 2 * (b0 * x + b1 * y + b2 * z) + c;
+		return (w > 0) ? fabs(e) / w : 0.0;
+	}
+};
+
+//MANIFOLD vertices collapse onto any neighbor, SEAM ones (one of two vertices at a position) along the seam, LOCKED ones never
+enum VertexKind : uint8_t { MANIFOLD, SEAM, LOCKED };
+
+struct Collapse {
+	uint32_t from;
+	uint32_t to;
+	uint32_t twinFrom;		//the other vertex of a seam, UINT32_MAX if none
+	uint32_t twinTo;
+	double cost;
+};
+
+//Triangles using every vertex of the current indices (compressed rows).
+struct Adjacency {
+	std::vector<uint32_t> offsets;		//vertexCount + 1
+	std::vector<uint32_t> triangles;
+};
+static Adjacency BuildAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount);
+//Vertices at the same position are linked in rings, returns the first vertex of the position of every vertex.
+static std::vector<uint32_t> GroupPositions(const Vertex* vertices, size_t vertexCount, std::vector<uint32_t>& ring);
+
+//================================= Simplification =================================
+
+float SimplifyMesh(std::vector<uint32_t>& indices, const Vertex* vertices, size_t vertexCount, size_t targetIndexCount) {
+	indices.resize(indices.size() - indices.size() % 3);
+	std::vector<uint32_t> ring;
+	const std::vector<uint32_t> group = GroupPositions(vertices, vertexCount, ring);
+
+	Adjacency adjacency = BuildAdjacency(indices, vertexCount);
+	//directed edge a -> b in the current triangles
+	auto hasEdge = [&](uint32_t a, uint32_t b) {
+		for (uint32_t k = adjacency.offsets[a]; k < adjacency.offsets[a + 1]; k++) {
+			const uint32_t* t = &indices[adjacency.triangles[k] * 3];
+			const int c = (t[0] == a) ? 0 : (t[1] == a) ? 1 : 2;
+			if (t[(c + 1) % 3] == b)
+				return true;
+		}
+		return false;
+	};
+	//directed edge between the positions of a & b (by any of their vertices)
+	auto hasPositionEdge = [&](uint32_t a, uint32_t b) {
+		uint32_t v = a;
+		do {
+			for (uint32_t k = adjacency.offsets[v]; k < adjacency.offsets[v + 1]; k++) {
+				const uint32_t* t = &indices[adjacency.triangles[k] * 3];
+				const int c = (t[0] == v) ? 0 : (t[1] == v) ? 1 : 2;
+				if (group[t[(c + 1) % 3]] == group[b])
+					return true;
+			}
+			v = ring[v];
+		} while (v != a);
+		return false;
+	};
+	auto isLive = [&](uint32_t v) { return adjacency.offsets[v + 1] > adjacency.offsets[v]; };
+
+	//quadrics of the positions (by their group), planes of the triangles weighted by area, planes along the seams keep their shape
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		const Vector3& p0 = vertices[indices[i]].position;
+		Vector3 n = (vertices[indices[i + 1]].position - p0).CrossProduct(vertices[indices[i + 2]].position - p0);
+		const float area = n.L2Norm();
+		if (!(area > 0.0f))
+			continue;
+		n = n / area;
+		for (int c = 0; c < 3; c++)
+			quadrics[group[indices[i + c]]].AddPlane(n, -n.DotProduct(p0), 0.5 * area);
+		for (int c = 0; c < 3; c++) {
+			const uint32_t a = indices[i + c], b = indices[i + (c + 1) % 3];
+			if (hasEdge(b, a))
+				continue;
+			const Vector3 edge = vertices[b].position - vertices[a].position;
+			Vector3 m = edge.CrossProduct(n);
+			const float length = m.L2Norm();
+			if (!(length > 0.0f))
+				continue;
+			m = m / length;
+			const double weight = SEAM_WEIGHT * edge.SqrL2Norm();
+			quadrics[group[a]].AddPlane(m, -m.DotProduct(vertices[a].position), weight);
+			quadrics[group[b]].AddPlane(m, -m.DotProduct(vertices[a].position), weight);
+		}
+	}
+
+	//moving from onto to turns a triangle of from over, by the last pass or by the original surface (the turns add up over passes)
+	auto flips = [&](uint32_t from, uint32_t to) {
+		for (uint32_t k = adjacency.offsets[from]; k < adjacency.offsets[from + 1]; k++) {
+			const uint32_t* t = &indices[adjacency.triangles[k] * 3];
+			if (t[0] == to || t[1] == to || t[2] == to)
+				continue;
+			Vector3 p[3], q[3];
+			for (int c = 0; c < 3; c++) {
+				p[c] = vertices[t[c]].position;
+				q[c] = vertices[t[c] == from ? to : t[c]].position;
+			}
+			const Vector3 before = (p[1] - p[0]).CrossProduct(p[2] - p[0]);
+			const Vector3 after = (q[1] - q[0]).CrossProduct(q[2] - q[0]);
+			const Vector3 shading = vertices[t[0]].normal + vertices[t[1]].normal + vertices[t[2]].normal;
+			const float lengths = before.L2Norm() * after.L2Norm();
+			if (!(after.SqrL2Norm() > 0.0f) || (before.SqrL2Norm() > 0.0f && before.DotProduct(after) <= FLIP_COSINE * lengths))
+				return true;
+			if (shading.SqrL2Norm() > 0.0f && shading.DotProduct(after) <= FLIP_COSINE * shading.L2Norm() * after.L2Norm())
+				return true;
+		}
+		return false;
+	};
+	//seam vertex of the position of to, joined to twinFrom by a seam edge
+	auto findTwinTarget = [&](uint32_t twinFrom, uint32_t to) {
+		for (uint32_t k = adjacency.offsets[twinFrom]; k < adjacency.offsets[twinFrom + 1]; k++) {
+			const uint32_t* t = &indices[adjacency.triangles[k] * 3];
+			const int c = (t[0] == twinFrom) ? 0 : (t[1] == twinFrom) ? 1 : 2;
+			const uint32_t next = t[(c + 1) % 3], prev = t[(c + 2) % 3];
+			if (group[next] == group[to] && !hasEdge(next, twinFrom))
+				return next;
+			if (group[prev] == group[to] && !hasEdge(twinFrom, prev))
+				return prev;
+		}
+		return UINT32_MAX;
+	};
+	auto normalCost = [&](uint32_t from, uint32_t to) {
+		return NORMAL_WEIGHT * (vertices[from].normal - vertices[to].normal).SqrL2Norm() * (vertices[from].position - vertices[to].position).SqrL2Norm();
+	};
+
+	std::vector<uint8_t> kinds(vertexCount);
+	std::vector<uint8_t> locked(vertexCount);
+	std::vector<uint32_t> remap(vertexCount);
+	std::iota(remap.begin(), remap.end(), 0);
+	std::vector<Collapse> best(vertexCount);
+	std::vector<Collapse> collapses;
+	double maxError = 0.0;
+
+	//passes of independent collapses (their neighborhoods don't overlap), triangles are rebuilt in between
+	const size_t tolerance = size_t(indices.size() / 3 * TARGET_TOLERANCE) * 3;
+	while (indices.size() > targetIndexCount + tolerance) {
+		//open edges (no opposite edge) at a single position are borders, open edges between two vertices of the same positions are seams
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			if (!isLive(v)) {
+				kinds[v] = LOCKED;
+				continue;
+			}
+			int wedges = 0;
+			uint32_t w = v;
+			do {
+				wedges += isLive(w);
+				w = ring[w];
+			} while (w != v);
+
+			int openOut = 0, openIn = 0;
+			bool border = false;
+			for (uint32_t k = adjacency.offsets[v]; k < adjacency.offsets[v + 1] && !border; k++) {
+				const uint32_t* t = &indices[adjacency.triangles[k] * 3];
+				const int c = (t[0] == v) ? 0 : (t[1] == v) ? 1 : 2;
+				const uint32_t next = t[(c + 1) % 3], prev = t[(c + 2) % 3];
+				if (!hasEdge(next, v)) {
+					openOut++;
+					border = !hasPositionEdge(next, v);
+				}
+				if (!hasEdge(v, prev)) {
+					openIn++;
+					border = border || !hasPositionEdge(v, prev);
+				}
+			}
+			if (border)
+				kinds[v] = LOCKED;
+			else if (wedges == 1)
+				kinds[v] = (openOut == 0 && openIn == 0) ? MANIFOLD : LOCKED;
+			else if (wedges == 2)
+				kinds[v] = (openOut == 1 && openIn == 1) ? SEAM : LOCKED;
+			else
+				kinds[v] = LOCKED;
+		}
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			if (kinds[v] != SEAM)
+				continue;
+			uint32_t twin = ring[v];
+			while (!isLive(twin))
+				twin = ring[twin];
+			if (kinds[twin] != SEAM)
+				kinds[v] = LOCKED;
+		}
+
+		//candidates - the cheapest collapse of every vertex
+		std::fill(best.begin(), best.end(), Collapse{ UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX, DBL_MAX });
+		for (size_t i = 0; i < indices.size(); i++) {
+			for (size_t d = 1; d <= 2; d++) {
+				const uint32_t from = indices[i], to = indices[i - i % 3 + (i + d) % 3];
+				if (kinds[from] == LOCKED)
+					continue;
+				Collapse collapse = { from, to, UINT32_MAX, UINT32_MAX, 0.0 };
+				if (kinds[from] == SEAM) {
+					//along the seam only, the twin follows
+					if ((hasEdge(from, to) && hasEdge(to, from)) || kinds[to] == MANIFOLD)
+						continue;
+					collapse.twinFrom = ring[from];
+					while (!isLive(collapse.twinFrom))
+						collapse.twinFrom = ring[collapse.twinFrom];
+					collapse.twinTo = findTwinTarget(collapse.twinFrom, to);
+					if (collapse.twinTo == UINT32_MAX)
+						continue;
+				}
+				Quadric q = quadrics[group[from]];
+				q += quadrics[group[to]];
+				collapse.cost = q.Error(vertices[to].position) + normalCost(from, to);
+				if (collapse.twinFrom != UINT32_MAX)
+					collapse.cost += normalCost(collapse.twinFrom, collapse.twinTo);
+				if (collapse.cost < best[from].cost)
+					best[from] = collapse;
+			}
+		}
+		collapses.clear();
+		for (const Collapse& collapse : best) {
+			if (collapse.from != UINT32_MAX)
+				collapses.push_back(collapse);
+		}
+		if (collapses.empty())
+			break;
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		//every collapse removes about two triangles, the ones much more expensive than needed wait for the next pass
+		const size_t goal = (indices.size() - targetIndexCount) / 3;
+		const double limit = PASS_ERROR_FACTOR * collapses[std::min(goal / 2, collapses.size() - 1)].cost;
+		std::fill(locked.begin(), locked.end(), uint8_t(0));
+		size_t removed = 0, applied = 0;
+		for (const Collapse& collapse : collapses) {
+			if (collapse.cost > limit || removed >= goal)
+				break;
+			const bool seam = collapse.twinFrom != UINT32_MAX;
+			if (locked[collapse.from] || locked[collapse.to] || (seam && (locked[collapse.twinFrom] || locked[collapse.twinTo])))
+				continue;
+			if (flips(collapse.from, collapse.to) || (seam && flips(collapse.twinFrom, collapse.twinTo)))
+				continue;
+
+			//triangles around the moved vertices change, their vertices wait for the next pass
+			for (uint32_t from : { collapse.from, collapse.twinFrom }) {
+				if (from == UINT32_MAX)
+					continue;
+				for (uint32_t k = adjacency.offsets[from]; k < adjacency.offsets[from + 1]; k++) {
+					const uint32_t* t = &indices[adjacency.triangles[k] * 3];
+					removed += (t[0] == collapse.to || t[1] == collapse.to || t[2] == collapse.to ||
+								(seam && (t[0] == collapse.twinTo || t[1] == collapse.twinTo || t[2] == collapse.twinTo)));
+					locked[t[0]] = locked[t[1]] = locked[t[2]] = 1;
+				}
+			}
+			remap[collapse.from] = collapse.to;
+			if (seam)
+				remap[collapse.twinFrom] = collapse.twinTo;
+			quadrics[group[collapse.to]] += quadrics[group[collapse.from]];
+			maxError = std::max(maxError, collapse.cost);
+			applied++;
+		}
+		if (applied == 0)
+			break;
+
+		//collapsed triangles are dropped
+		size_t write = 0;
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			const uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			indices[write++] = a;
+			indices[write++] = b;
+			indices[write++] = c;
+		}
+		indices.resize(write);
+		adjacency = BuildAdjacency(indices, vertexCount);
+	}
+
+	return float(sqrt(maxError));
+}
+
+size_t GenerateLODs(const uint32_t* indices, size_t indexCount, const Vertex* vertices, std::vector<uint32_t>& lodIndices, std::vector<MeshLOD>& lods) {
+	indexCount -= indexCount % 3;
+	if (indexCount / 3 < LOD_MIN_TRIANGLES)
+		return 0;
+
+	//meshes use a small part of the vertices only, they are numbered locally
+	std::vector<uint32_t> used(indices, indices + indexCount);
+	std::sort(used.begin(), used.end());
+	used.erase(std::unique(used.begin(), used.end()), used.end());
+	std::vector<uint32_t> current(indexCount);
+	for (size_t i = 0; i < indexCount; i++)
+		current[i] = uint32_t(std::lower_bound(used.begin(), used.end(), indices[i]) - used.begin());
+	std::vector<Vertex> local(used.size());
+	for (size_t i = 0; i < used.size(); i++)
+		local[i] = vertices[used[i]];
+
+	//every level simplifies the previous one, their errors add up
+	float error = 0.0f;
+	size_t added = 0;
+	for (int level = 1; level < MAX_LOD_LEVELS && current.size() / 3 >= LOD_MIN_TRIANGLES; level++) {
+		std::vector<uint32_t> next = current;
+		error += SimplifyMesh(next, local.data(), local.size(), size_t(current.size() / 3 * LOD_REDUCTION) * 3);
+		if (next.size() > current.size() * (1.0f - LOD_MIN_REDUCTION))
+			break;
+		OptimizeVertexCache(next.data(), next.size(), local.size());
+
+		lods.push_back({ int(lodIndices.size()), int(next.size()), error });
+		for (uint32_t i : next)
+			lodIndices.push_back(used[i]);
+		current.swap(next);
+		added++;
+	}
+	return added;
+}
+
+static Adjacency BuildAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount) {
+	Adjacency adjacency;
+	adjacency.offsets.assign(vertexCount + 1, 0);
+	for (uint32_t v : indices)
+		adjacency.offsets[v + 1]++;
+	std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(), adjacency.offsets.begin());
+
+	adjacency.triangles.resize(indices.size());
+	std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+		adjacency.triangles[fill[indices[i]]++] = uint32_t(i / 3);
+	return adjacency;
+}
+
+static std::vector<uint32_t> GroupPositions(const Vertex* vertices, size_t vertexCount, std::vector<uint32_t>& ring) {
+	std::vector<uint32_t> group(vertexCount);
+	ring.resize(vertexCount);
+
+	//open addressing hash table of the first vertex of every position, load factor <= 0.5
+	size_t capacity = 16;
+	while (capacity < vertexCount * 2)
+		capacity <<= 1;
+	const size_t mask = capacity - 1;
+	std::vector<uint32_t> table(capacity, UINT32_MAX);
+
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		uint32_t words[3];
+		memcpy(words, &vertices[v].position, sizeof(words));
+		size_t slot = ((words[0] * 73856093u) ^ (words[1] * 19349663u) ^ (words[2] * 83492791u)) & mask;
+		while (true) {
+			const uint32_t first = table[slot];
+			if (first == UINT32_MAX) {
+				table[slot] = v;
+				group[v] = v;
+				ring[v] = v;
+				break;
+			}
+			if (memcmp(&vertices[first].position, &vertices[v].position, sizeof(words)) == 0) {
+				group[v] = first;
+				ring[v] = ring[first];
+				ring[first] = v;
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+	return group;
+}
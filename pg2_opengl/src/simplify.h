@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "vector3.h"
+
+struct Vertex;
+
+//levels of detail of a mesh, the full mesh included
+constexpr int MAX_LOD_LEVELS = 5;
+//triangles of a level relative to the previous one
+constexpr float LOD_REDUCTION = 0.5f;
+//levels stop at meshes this small or when the simplification stalls
+constexpr size_t LOD_MIN_TRIANGLES = 256;
+//projected error of the levels drawn (px), the default of Scene::SelectLODs
+constexpr float LOD_THRESHOLD = 1.0f;
+
+//Simplified level of a mesh, error is the geometric error of the level (object space distance, estimated by the quadrics).
+struct MeshLOD {
+	int offset;			//first index
+	int count;
+	float error;
+};
+
+//Simplifies triangles (rewritten) by half-edge collapses in order of their quadric error (Garland & Heckbert 1997) until at most
+//targetIndexCount indices are left or no collapse is possible. Vertices are neither moved nor created, so the result indexes the same
+//vertex buffer. Open borders are kept (meshes drawn at different levels don't crack), attribute seams (vertices sharing their position)
+//collapse along the seam only, together with the twin vertex, and collapses changing normals cost more. Returns the error of the result.
+float SimplifyMesh(std::vector<uint32_t>& indices, const Vertex* vertices, size_t vertexCount, size_t targetIndexCount);
+
+//Appends simplified levels of the mesh (indices into vertices) to lodIndices, each one with LOD_REDUCTION of the triangles
+//of the previous one and optimized for the vertex cache, offsets of the levels are relative to lodIndices. Returns the levels added.
+size_t GenerateLODs(const uint32_t* indices, size_t indexCount, const Vertex* vertices, std::vector<uint32_t>& lodIndices, std::vector<MeshLOD>& lods);
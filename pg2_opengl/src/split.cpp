@@ -0,0 +1,117 @@
+#include "pch.h"
+#include "split.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <numeric>
+#include <string>
+
+#include "arena.h"
+#include "log.h"
+#include "parallel.h"
+#include "surface.h"
+
+size_t SplitSurfaces(std::vector<Surface*>& surfaces, std::vector<int>& copies, Arena* arena, int maxTriangles, int no_threads) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<int> large;
+	for (size_t i = 0; i < surfaces.size(); i++)
+		if (surfaces[i]->no_triangles() > maxTriangles && (i >= copies.size() || copies[i] == 0))
+			large.push_back(int(i));
+	if (large.empty())
+		return 0;
+
+	//chunk sizes of every large surface, in the order of its reordered triangles
+	std::vector<std::vector<int>> chunks(large.size());
+	ParallelFor(static_cast<int>(large.size()), no_threads, [&](int l) {
+		Surface* surface = surfaces[large[l]];
+		SplitTriangles(surface->get_triangles(), surface->no_triangles(), maxTriangles, chunks[l]);
+	});
+
+	std::vector<Surface*> split;
+	std::vector<int> splitCopies;
+	split.reserve(surfaces.size() + large.size());
+	size_t l = 0, added = 0;
+	for (size_t i = 0; i < surfaces.size(); i++) {
+		if (l < large.size() && large[l] == int(i)) {
+			Surface* surface = surfaces[i];
+			Triangle* triangles = surface->get_triangles();
+			const std::string name = surface->get_name();
+			int offset = 0;
+			for (size_t c = 0; c < chunks[l].size(); c++) {
+				Surface* chunk = ArenaNew<Surface>(arena, name + "#" + std::to_string(c), triangles + offset, chunks[l][c]);
+				chunk->set_material(surface->get_material());
+				split.push_back(chunk);
+				splitCopies.push_back(0);
+				offset += chunks[l][c];
+			}
+			added += chunks[l].size() - 1;
+			l++;
+			continue;
+		}
+		split.push_back(surfaces[i]);
+		splitCopies.push_back(i < copies.size() ? copies[i] : 0);
+	}
+	surfaces.swap(split);
+	if (!copies.empty())
+		copies.swap(splitCopies);
+
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	errlog("Surface splitting: %zu surfaces split into %zu chunks (at most %d triangles), %.3f s.\n", large.size(), added + large.size(), maxTriangles, elapsed.count());
+	return added;
+}
+
+void SplitTriangles(Triangle* triangles, int count, int maxTriangles, std::vector<int>& chunks) {
+	std::vector<Vector3> centroids(count);
+	for (int t = 0; t < count; t++)
+		centroids[t] = (triangles[t][0].position + triangles[t][1].position + triangles[t][2].position) * (1.0f / 3.0f);
+
+	//order[i] = source triangle of position i, ranges are split depth first so the chunks follow each other
+	std::vector<int> order(count);
+	std::iota(order.begin(), order.end(), 0);
+	std::vector<std::pair<int, int>> stack = { { 0, count } };
+	while (!stack.empty()) {
+		const auto [begin, end] = stack.back();
+		stack.pop_back();
+		if (end - begin <= maxTriangles) {
+			std::sort(order.begin() + begin, order.begin() + end);
+			chunks.push_back(end - begin);
+			continue;
+		}
+
+		Vector3 lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (int i = begin; i < end; i++) {
+			const Vector3& c = centroids[order[i]];
+			lo = Vector3(std::min(lo.x, c.x), std::min(lo.y, c.y), std::min(lo.z, c.z));
+			hi = Vector3(std::max(hi.x, c.x), std::max(hi.y, c.y), std::max(hi.z, c.z));
+		}
+		const Vector3 extent = hi - lo;
+		const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+		//ties are broken by the index, so the result doesn't depend on the standard library
+		const int middle = begin + (end - begin) / 2;
+		std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](int a, int b) {
+			const float ca = centroids[a].data[axis], cb = centroids[b].data[axis];
+			return ca < cb || (ca == cb && a < b);
+		});
+		stack.push_back({ middle, end });
+		stack.push_back({ begin, middle });
+	}
+
+	//permutation applied in place cycle by cycle, triangle i moves from order[i]
+	std::vector<bool> placed(count, false);
+	for (int i = 0; i < count; i++) {
+		if (placed[i] || order[i] == i)
+			continue;
+		const Triangle first = triangles[i];
+		int j = i;
+		while (order[j] != i) {
+			triangles[j] = triangles[order[j]];
+			placed[j] = true;
+			j = order[j];
+		}
+		triangles[j] = first;
+		placed[j] = true;
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+class Surface;
+class Arena;
+class Triangle;
+
+//surfaces with more triangles are split into chunks of SPLIT_TRIANGLES / 2 to SPLIT_TRIANGLES triangles
+constexpr int SPLIT_TRIANGLES = 16384;
+
+//Splits surfaces larger than maxTriangles (terrains, facades spanning the whole scene) into spatially compact chunks, so their
+//bounds (meshlets, levels of detail & impostors are chosen per mesh) cover a part of the scene only. Triangles are halved at the
+//median of their centroids along the longest axis of the centroid bounds until the chunks are small enough, then reordered in
+//place, chunks keep their original order inside. Chunks replace their surface (in scene order) with its material, they are views
+//of its triangles allocated in arena (the split surfaces stay there as their owners).
+//Surfaces with copies (see FindInstances) are kept whole, copies (when not empty) gets the zero copies of the new chunks.
+//Returns the chunks added.
+//PLY & binary glTF models are read in place and keep their meshes (see PLYModel & GLBModel).
+size_t SplitSurfaces(std::vector<Surface*>& surfaces, std::vector<int>& copies, Arena* arena, int maxTriangles = SPLIT_TRIANGLES, int no_threads = 0);
+//The split of one surface (or of a run of streamed triangles) - reorders count triangles in place and appends the sizes of
+//their chunks (in order) to chunks.
+void SplitTriangles(Triangle* triangles, int count, int maxTriangles, std::vector<int>& chunks);
@@ -0,0 +1,290 @@
+#include "pch.h"
+#include "vertexcache.h"
+
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <atomic>
+
+#include "geometry.h"
+#include "scene.h"
+#include "parallel.h"
+#include "log.h"
+
+//Triangles using every vertex (compressed rows, a triangle is listed once per its corner).
+struct VertexTriangles {
+	std::vector<uint32_t> offsets;		//vertexCount + 1
+	std::vector<uint32_t> triangles;
+};
+static VertexTriangles BuildVertexTriangles(const uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+//================================= Cache simulation =================================
+
+VertexCacheStats SimulateVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, int cacheSize) {
+	VertexCacheStats stats;
+	stats.triangles = indexCount / 3;
+
+	//time of the last miss of every vertex, FIFO hits while less than cacheSize misses happened since then
+	std::vector<size_t> stamps(vertexCount, 0);
+	size_t time = size_t(cacheSize) + 1;
+	for (size_t i = 0; i < stats.triangles * 3; i++) {
+		const uint32_t v = indices[i];
+		if (stamps[v] == 0)
+			stats.vertices++;
+		if (time - stamps[v] > size_t(cacheSize)) {
+			stamps[v] = time++;
+			stats.misses++;
+		}
+	}
+	return stats;
+}
+
+//================================= Tipsify =================================
+
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, int cacheSize) {
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+	const VertexTriangles adjacency = BuildVertexTriangles(indices, triangleCount * 3, vertexCount);
+	const size_t k = size_t(cacheSize);
+
+	std::vector<uint32_t> live(vertexCount);			//triangles of the vertex not emitted yet
+	for (size_t v = 0; v < vertexCount; v++)
+		live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+	std::vector<size_t> stamps(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnds;						//stack of the recently used vertices
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> result;
+	result.reserve(triangleCount * 3);
+	size_t time = k + 1;
+	size_t cursor = 0;									//vertices before it have no live triangles
+
+	int64_t fan = indices[0];
+	while (fan >= 0) {
+		//all remaining triangles around the fanning vertex
+		candidates.clear();
+		for (uint32_t a = adjacency.offsets[fan]; a < adjacency.offsets[fan + 1]; a++) {
+			const uint32_t t = adjacency.triangles[a];
+			if (emitted[t])
+				continue;
+			emitted[t] = true;
+			for (int c = 0; c < 3; c++) {
+				const uint32_t v = indices[t * 3 + c];
+				result.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - stamps[v] > k)
+					stamps[v] = time++;
+			}
+		}
+
+		//next fan around the oldest candidate whose live triangles still fit into the cache, any candidate with live triangles otherwise
+		int64_t next = -1, best = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0)
+				continue;
+			const int64_t priority = (time - stamps[v] + 2 * live[v] <= k) ? int64_t(time - stamps[v]) : 0;
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+		//dead end - the most recently used vertex with live triangles, the next one in the input order at last
+		while (next < 0 && !deadEnds.empty()) {
+			const uint32_t v = deadEnds.back();
+			deadEnds.pop_back();
+			if (live[v] > 0)
+				next = v;
+		}
+		while (next < 0 && cursor < vertexCount) {
+			if (live[cursor] > 0)
+				next = int64_t(cursor);
+			else
+				cursor++;
+		}
+		fan = next;
+	}
+
+	std::copy(result.begin(), result.end(), indices);
+}
+
+//================================= Overdraw =================================
+
+size_t OptimizeOverdraw(uint32_t* indices, size_t indexCount, const Vector3* positions, size_t vertexCount, float threshold, int cacheSize) {
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return 0;
+	const size_t k = size_t(cacheSize);
+
+	std::vector<size_t> stamps(vertexCount, 0);
+	size_t time = k + 1;
+	auto misses = [&](size_t t) {
+		size_t m = 0;
+		for (int c = 0; c < 3; c++) {
+			const uint32_t v = indices[t * 3 + c];
+			if (time - stamps[v] > k) {
+				stamps[v] = time++;
+				m++;
+			}
+		}
+		return m;
+	};
+
+	//runs of triangles between cache flushes (triangles missing all their vertices)
+	std::vector<size_t> runs;
+	std::vector<uint8_t> triangleMisses(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++) {
+		triangleMisses[t] = uint8_t(misses(t));
+		if (t == 0 || triangleMisses[t] == 3)
+			runs.push_back(t);
+	}
+	runs.push_back(triangleCount);
+
+	//runs are split where the ACMR of the cluster (starting with an empty cache, as after reordering) drops to threshold times the run's
+	std::vector<size_t> clusters;
+	for (size_t r = 0; r + 1 < runs.size(); r++) {
+		const size_t begin = runs[r], end = runs[r + 1];
+		size_t runMisses = 0;
+		for (size_t t = begin; t < end; t++)
+			runMisses += triangleMisses[t];
+		const double limit = threshold * double(runMisses) / double(end - begin);
+
+		time += k + 1;
+		size_t start = begin, clusterMisses = 0;
+		for (size_t t = begin; t < end; t++) {
+			clusterMisses += misses(t);
+			if (t + 1 < end && clusterMisses <= limit * double(t + 1 - start)) {
+				clusters.push_back(start);
+				start = t + 1;
+				clusterMisses = 0;
+				time += k + 1;
+			}
+		}
+		clusters.push_back(start);
+	}
+	const size_t clusterCount = clusters.size();
+	clusters.push_back(triangleCount);
+
+	//area weighted centroids & normals, clusters facing away from the centroid of the mesh are drawn first as they occlude the others
+	std::vector<Vector3> centroids(clusterCount), normals(clusterCount);
+	Vector3 meshCentroid;
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusterCount; c++) {
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			const Vector3& a = positions[indices[t * 3]];
+			const Vector3& b = positions[indices[t * 3 + 1]];
+			const Vector3& d = positions[indices[t * 3 + 2]];
+			const Vector3 n = (b - a).CrossProduct(d - a);
+			const float w = n.L2Norm();
+			centroids[c] += (a + b + d) * (w / 3.0f);
+			normals[c] += n;
+			area += w;
+		}
+		meshCentroid += centroids[c];
+		meshArea += area;
+		if (area > 0.0f)
+			centroids[c] = centroids[c] / area;
+	}
+	if (meshArea > 0.0f)
+		meshCentroid = meshCentroid / meshArea;
+
+	std::vector<float> keys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+		keys[c] = (centroids[c] - meshCentroid).DotProduct(normals[c].normalized());
+	std::vector<uint32_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(triangleCount * 3);
+	for (uint32_t c : order)
+		result.insert(result.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+	std::copy(result.begin(), result.end(), indices);
+	return clusterCount;
+}
+
+//================================= Vertex fetch =================================
+
+std::vector<uint32_t> OptimizeVertexFetch(uint32_t* indices, size_t indexCount, size_t vertexCount) {
+	std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+	uint32_t next = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		uint32_t& r = remap[indices[i]];
+		if (r == UINT32_MAX)
+			r = next++;
+		indices[i] = r;
+	}
+	for (uint32_t& r : remap) {
+		if (r == UINT32_MAX)
+			r = next++;
+	}
+	return remap;
+}
+
+//================================= Geometry =================================
+
+void OptimizeGeometry(IndexedGeometry& geometry, const std::vector<Mesh>& meshes, int no_threads) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	const size_t vertexCount = geometry.VertexCount();
+	std::vector<uint32_t>& indices = geometry.indices;
+	const VertexCacheStats before = SimulateVertexCache(indices.data(), indices.size(), vertexCount);
+
+	std::atomic<size_t> clusters{ 0 };
+	ParallelFor(static_cast<int>(meshes.size()), no_threads, [&](int m) {
+		uint32_t* mesh = indices.data() + meshes[m].offset;
+		const size_t count = size_t(meshes[m].count);
+
+		//meshes use a small part of the vertices only, they are numbered locally
+		std::vector<uint32_t> used(mesh, mesh + count);
+		std::sort(used.begin(), used.end());
+		used.erase(std::unique(used.begin(), used.end()), used.end());
+		std::vector<uint32_t> local(count);
+		for (size_t i = 0; i < count; i++)
+			local[i] = uint32_t(std::lower_bound(used.begin(), used.end(), mesh[i]) - used.begin());
+		std::vector<Vector3> positions(used.size());
+		for (size_t i = 0; i < used.size(); i++)
+			positions[i] = geometry.sources[used[i]]->position;
+
+		OptimizeVertexCache(local.data(), count, used.size());
+		clusters += OptimizeOverdraw(local.data(), count, positions.data(), used.size());
+
+		for (size_t i = 0; i < count; i++)
+			mesh[i] = used[local[i]];
+	});
+
+	//vertices in the order the new triangles fetch them
+	const std::vector<uint32_t> remap = OptimizeVertexFetch(indices.data(), indices.size(), vertexCount);
+	std::vector<const Vertex*> sources(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		sources[remap[v]] = geometry.sources[v];
+	geometry.sources.swap(sources);
+	if (!geometry.tangents.empty()) {
+		std::vector<Tangent> tangents(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+			tangents[remap[v]] = geometry.tangents[v];
+		geometry.tangents.swap(tangents);
+	}
+
+	const VertexCacheStats after = SimulateVertexCache(indices.data(), indices.size(), vertexCount);
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	errlog("Vertex cache optimization (%d entries): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %zu overdraw clusters, %.3f s.\n", VERTEX_CACHE_SIZE,
+		before.ACMR(), after.ACMR(), before.ATVR(), after.ATVR(), clusters.load(), elapsed.count());
+}
+
+static VertexTriangles BuildVertexTriangles(const uint32_t* indices, size_t indexCount, size_t vertexCount) {
+	VertexTriangles adjacency;
+	adjacency.offsets.assign(vertexCount + 1, 0);
+	for (size_t i = 0; i < indexCount; i++)
+		adjacency.offsets[indices[i] + 1]++;
+	std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(), adjacency.offsets.begin());
+
+	adjacency.triangles.resize(indexCount);
+	std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+	for (size_t i = 0; i < indexCount; i++)
+		adjacency.triangles[fill[indices[i]]++] = uint32_t(i / 3);
+	return adjacency;
+}
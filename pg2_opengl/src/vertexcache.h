@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "vector3.h"
+
+class Mesh;
+struct IndexedGeometry;
+
+//entries of the simulated post-transform vertex cache (FIFO, as on most GPUs)
+constexpr int VERTEX_CACHE_SIZE = 16;
+//overdraw clusters may raise the ACMR of their triangles by this factor at most
+constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+//Result of SimulateVertexCache.
+struct VertexCacheStats {
+	size_t triangles = 0;
+	size_t vertices = 0;		//distinct vertices referenced
+	size_t misses = 0;			//vertices transformed
+
+	//average cache miss ratio, transformed vertices per triangle (0.5 at best for large meshes, 3 at worst)
+	inline double ACMR() const { return triangles ? double(misses) / triangles : 0.0; }
+	//average transformed to vertex ratio (1 at best)
+	inline double ATVR() const { return vertices ? double(misses) / vertices : 0.0; }
+};
+
+//Runs the triangles of indices through a FIFO cache of cacheSize entries, all indices have to be < vertexCount.
+VertexCacheStats SimulateVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, int cacheSize = VERTEX_CACHE_SIZE);
+
+//Reorders triangles for vertex cache locality (Tipsify, Sander et al. 2007), triangles keep their winding.
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, int cacheSize = VERTEX_CACHE_SIZE);
+//Reorders clusters of cache optimized triangles so that the outer surfaces of the mesh are drawn first (view independent
+//overdraw reduction, Sander et al. 2007). Clusters end where the cache was flushed or where their ACMR drops to threshold times
+//the one of the flushed run, so the cache efficiency stays about the same. Returns the number of clusters.
+size_t OptimizeOverdraw(uint32_t* indices, size_t indexCount, const Vector3* positions, size_t vertexCount,
+						float threshold = OVERDRAW_THRESHOLD, int cacheSize = VERTEX_CACHE_SIZE);
+//Renumbers vertices in order of their first use by indices (rewritten), unused vertices go last. Returns remap[old] = new.
+std::vector<uint32_t> OptimizeVertexFetch(uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+//Optimizes welded geometry for the GPU: triangles of every mesh are reordered for the vertex cache and overdraw (meshes in parallel,
+//by no_threads threads, 0 = all), then vertices are renumbered in order of first use. Mesh ranges don't change.
+//ACMR & ATVR before and after are logged.
+void OptimizeGeometry(IndexedGeometry& geometry, const std::vector<Mesh>& meshes, int no_threads = 0);
@@ -0,0 +1,173 @@
+#include "pch.h"
+#include "vertexformat.h"
+
+#include <cstddef>
+#include <cstring>
+#include <cfloat>
+
+#include "vertex.h"
+#include "parallel.h"
+
+//vertices handed to a thread at once
+constexpr size_t BOX_BLOCK = size_t(1) << 16;
+
+size_t VertexSize(VertexFormat format) {
+	return (format == VertexFormat::PACKED) ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+size_t PositionSize(VertexFormat format) {
+	return (format == VertexFormat::PACKED) ? offsetof(PackedVertex, normal) : offsetof(Vertex, normal);
+}
+
+size_t AttributeSize(VertexFormat format) {
+	//without the padding of Vertex
+	return (format == VertexFormat::PACKED) ? sizeof(PackedVertex) - PositionSize(format) : offsetof(Vertex, matIdx) + sizeof(Vertex::matIdx) - PositionSize(format);
+}
+
+std::vector<QuantizationBox> ComputeQuantizationBoxes(size_t vertexCount, size_t materialCount,
+													  const std::function<void(size_t, size_t, Vertex*)>& copyVertices, int no_threads) {
+	struct Bounds {
+		int material;
+		Vector3 min, max;
+	};
+
+	//consecutive vertices mostly share a material, every block collects bounds of its runs
+	const int blocks = int((vertexCount + BOX_BLOCK - 1) / BOX_BLOCK);
+	std::vector<std::vector<Bounds>> runs(blocks);
+	ParallelFor(blocks, no_threads, [&](int block) {
+		const size_t first = block * BOX_BLOCK;
+		const size_t count = std::min(BOX_BLOCK, vertexCount - first);
+		std::vector<Vertex> vertices(count);
+		copyVertices(first, count, vertices.data());
+
+		std::vector<Bounds>& bounds = runs[block];
+		for (const Vertex& v : vertices) {
+			const int material = std::min(std::max(v.matIdx, 0), int(materialCount) - 1);
+			if (bounds.empty() || bounds.back().material != material)
+				bounds.push_back({ material, v.position, v.position });
+			Bounds& b = bounds.back();
+			b.min = Vector3(std::min(b.min.x, v.position.x), std::min(b.min.y, v.position.y), std::min(b.min.z, v.position.z));
+			b.max = Vector3(std::max(b.max.x, v.position.x), std::max(b.max.y, v.position.y), std::max(b.max.z, v.position.z));
+		}
+	});
+
+	std::vector<Vector3> min(materialCount, Vector3(FLT_MAX, FLT_MAX, FLT_MAX));
+	std::vector<Vector3> max(materialCount, Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+	for (const std::vector<Bounds>& block : runs) {
+		for (const Bounds& b : block) {
+			Vector3& lo = min[b.material];
+			Vector3& hi = max[b.material];
+			lo = Vector3(std::min(lo.x, b.min.x), std::min(lo.y, b.min.y), std::min(lo.z, b.min.z));
+			hi = Vector3(std::max(hi.x, b.max.x), std::max(hi.y, b.max.y), std::max(hi.z, b.max.z));
+		}
+	}
+
+	std::vector<QuantizationBox> boxes(materialCount);
+	for (size_t m = 0; m < materialCount; m++) {
+		QuantizationBox& box = boxes[m];
+		if (min[m].x > max[m].x) {
+			//material without vertices
+			box = { { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } };
+			continue;
+		}
+		box = { { min[m].x, min[m].y, min[m].z, 0.0f }, { max[m].x - min[m].x, max[m].y - min[m].y, max[m].z - min[m].z, 0.0f } };
+	}
+	return boxes;
+}
+
+static inline uint16_t QuantizeUnorm16(float value, float offset, float scale) {
+	if (!(scale > 0.0f))
+		return 0;
+	const float t = (value - offset) / scale;
+	return uint16_t(std::min(std::max(t, 0.0f), 1.0f) * 65535.0f + 0.5f);
+}
+
+void PackVertices(const Vertex* vertices, size_t count, const std::vector<QuantizationBox>& boxes, PackedVertex* destination) {
+	const int last = int(boxes.size()) - 1;
+	for (size_t i = 0; i < count; i++) {
+		const Vertex& v = vertices[i];
+		const int material = std::min(std::max(v.matIdx, 0), last);
+		const QuantizationBox& box = boxes[material];
+
+		//assembled first, destination is written at once
+		PackedVertex p;
+		p.position[0] = QuantizeUnorm16(v.position.x, box.offset[0], box.scale[0]);
+		p.position[1] = QuantizeUnorm16(v.position.y, box.offset[1], box.scale[1]);
+		p.position[2] = QuantizeUnorm16(v.position.z, box.offset[2], box.scale[2]);
+		p.matIdx = uint16_t(material);
+		OctEncode(v.normal.x, v.normal.y, v.normal.z, p.normal);
+		OctEncode(v.tangent.x, v.tangent.y, v.tangent.z, p.tangent);
+		//handedness in the low bit of tangent[1] (set = mirrored), moved by 1 / 32767 at most, never out of <-32767, 32767>
+		const int mirrored = (v.handedness < 0.0f) ? 1 : 0;
+		if ((p.tangent[1] & 1) != mirrored) {
+			if (mirrored)
+				p.tangent[1] += (p.tangent[1] >= 0) ? 1 : -1;
+			else
+				p.tangent[1] += (p.tangent[1] > 0) ? -1 : 1;
+		}
+		p.texture_coords[0] = FloatToHalf(v.texture_coords[0].u);
+		p.texture_coords[1] = FloatToHalf(v.texture_coords[0].v);
+		destination[i] = p;
+	}
+}
+
+void SplitVertices(const void* vertices, size_t count, VertexFormat format, char* positions, char* attributes) {
+	const size_t stride = VertexSize(format);
+	const size_t positionSize = PositionSize(format);
+	const size_t attributeSize = AttributeSize(format);
+	const char* source = static_cast<const char*>(vertices);
+	for (size_t i = 0; i < count; i++, source += stride) {
+		memcpy(positions + i * positionSize, source, positionSize);
+		memcpy(attributes + i * attributeSize, source + positionSize, attributeSize);
+	}
+}
+
+void OctEncode(float x, float y, float z, int16_t* encoded) {
+	const float length = fabsf(x) + fabsf(y) + fabsf(z);
+	if (!(length > 0.0f)) {
+		//zero vectors decode as +z
+		encoded[0] = encoded[1] = 0;
+		return;
+	}
+	float u = x / length, v = y / length;
+	if (z < 0.0f) {
+		//lower hemisphere folded over the diagonals
+		const float fu = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		const float fv = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = fu;
+		v = fv;
+	}
+	encoded[0] = int16_t(roundf(std::min(std::max(u, -1.0f), 1.0f) * 32767.0f));
+	encoded[1] = int16_t(roundf(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f));
+}
+
+uint16_t FloatToHalf(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+	const uint32_t magnitude = bits & 0x7FFFFFFF;
+
+	if (magnitude >= 0x7F800000)
+		return sign | ((magnitude > 0x7F800000) ? 0x7E00 : 0x7C00);	//NaN, infinity
+	if (magnitude >= 0x477FF000)
+		return sign | 0x7C00;		//rounds above the largest half
+	if (magnitude < 0x38800000) {
+		//subnormal half (or zero), shifted with the implicit bit, rounded to nearest even
+		if (magnitude < 0x33000000)
+			return sign;
+		const uint32_t mantissa = (magnitude & 0x007FFFFF) | 0x00800000;
+		const int shift = 126 - int(magnitude >> 23);
+		uint32_t half = mantissa >> shift;
+		const uint32_t rest = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return sign | uint16_t(half);
+	}
+	//normal half, rebiased exponent, the mantissa rounding may carry into the exponent
+	uint32_t half = ((magnitude - 0x38000000) >> 13);
+	const uint32_t rest = magnitude & 0x1FFF;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+	return sign | uint16_t(half);
+}
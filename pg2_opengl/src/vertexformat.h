@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+struct Vertex;
+
+//Layout of the vertex buffer of a scene.
+enum class VertexFormat {
+	FULL,		//Vertex, 64 B
+	PACKED		//PackedVertex, 20 B
+};
+
+//Arrangement of the vertex buffer of a scene.
+enum class VertexStreams {
+	INTERLEAVED,	//whole vertices
+	SPLIT			//positions in a tightly packed stream of their own for depth-only passes, the other attributes in a second one
+};
+
+//Compact vertex decoded by the vertex shaders (uniform packedVertices):
+//position as 16-bit unsigned normalized coordinates inside the quantization box of the vertex's material,
+//normal & tangent octahedron encoded into 2 x 16-bit signed normalized, texture coordinates as half floats, no color.
+//The low bit of tangent[1] holds the handedness (set = -1, see Vertex::handedness).
+//Materials are addressed by 16 bits, scenes with more materials keep the full format.
+struct PackedVertex {
+	uint16_t position[3];
+	uint16_t matIdx;
+	int16_t normal[2];
+	int16_t tangent[2];
+	uint16_t texture_coords[2];
+};
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex has to stay tightly packed.");
+
+//Dequantization box of one material as read by the shaders (std430, two vec4): position = offset + unorm16 * scale.
+struct QuantizationBox {
+	float offset[4];
+	float scale[4];
+};
+
+//Size of one vertex in the vertex buffer.
+size_t VertexSize(VertexFormat format);
+//Sizes of one vertex in the position & attribute streams of split buffers (the leading & following fields of the vertex).
+//Packed positions keep the material index, depth-only passes need it for the quantization box.
+size_t PositionSize(VertexFormat format);
+size_t AttributeSize(VertexFormat format);
+
+//Bounding boxes of the vertices of every material (materialCount boxes, matIdx out of range counts to the last one).
+//copyVertices(first, count, destination) produces the vertices in blocks, they are read by up to no_threads threads (0 = all).
+std::vector<QuantizationBox> ComputeQuantizationBoxes(size_t vertexCount, size_t materialCount,
+													  const std::function<void(size_t, size_t, Vertex*)>& copyVertices, int no_threads = 0);
+
+//Packs count vertices into destination (meant for write-only mapped memory).
+void PackVertices(const Vertex* vertices, size_t count, const std::vector<QuantizationBox>& boxes, PackedVertex* destination);
+
+//Scatters count interleaved vertices (Vertex or PackedVertex by format) into the position & attribute streams.
+void SplitVertices(const void* vertices, size_t count, VertexFormat format, char* positions, char* attributes);
+
+//Octahedron encoding of a unit vector as 2 x 16-bit signed normalized.
+void OctEncode(float x, float y, float z, int16_t* encoded);
+//IEEE 754 half float, rounded to nearest even.
+uint16_t FloatToHalf(float value);
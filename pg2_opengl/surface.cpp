@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "surface.h"
 
+#include "arena.h"
+
 Surface* BuildSurface(const std::string& name, std::vector<Vertex>& face_vertices) {
 	const int no_vertices = static_cast<int>(face_vertices.size());
 
@@ -24,17 +26,28 @@ Surface::Surface() {
 	triangles_ = NULL;
 }
 
-Surface::Surface(const std::string& name, const int n) {
+Surface::Surface(const std::string& name, const int n, Arena* arena) {
 	assert(n > 0);
 
 	name_ = name;
 
 	n_ = n;
-	triangles_ = new Triangle[n_];
+	owns_triangles_ = (arena == nullptr);
+	triangles_ = arena ? arena->NewArray<Triangle>(n_) : new Triangle[n_];
+}
+
+Surface::Surface(const std::string& name, Triangle* triangles, const int n) {
+	assert(n > 0);
+
+	name_ = name;
+
+	n_ = n;
+	owns_triangles_ = false;
+	triangles_ = triangles;
 }
 
 Surface::~Surface() {
-	if (triangles_) {
+	if (triangles_ && owns_triangles_) {
 		delete[] triangles_;
 		triangles_ = nullptr;
 	}
@@ -69,9 +82,7 @@ Material* Surface::get_material() const {
 	return material_;
 }
 
-void Surface::setMaterialIdx() {
-	int mIdx = material_->idx;
-
+void Surface::setMaterialIdx(const int mIdx) {
 	for (int i = 0; i < n_; i++) {
 		Triangle& t = triangles_[i];
 
@@ -5,6 +5,8 @@
 #include "material.h"
 #include "triangle.h"
 
+class Arena;
+
 /*! \class Surface
 \brief A class representing a triangular mesh.
 
@@ -26,8 +28,17 @@ public:
 
 	\param name nzev plochy.
 	\param n poet trojhelnk tvocch s.
+	\param arena when not NULL, the triangles are allocated in (and owned by) the arena.
+	*/
+	Surface(const std::string& name, const int n, Arena* arena = nullptr);
+
+	//! View of triangles owned elsewhere (a chunk of another surface), they have to outlive the surface.
+	/*!
+	\param name name of the surface.
+	\param triangles the first triangle.
+	\param n number of the triangles.
 	*/
-	Surface(const std::string& name, const int n);
+	Surface(const std::string& name, Triangle* triangles, const int n);
 
 	//! Destruktor.
 	/*!
@@ -84,13 +95,15 @@ public:
 	*/
 	Material* get_material() const;
 
-	void setMaterialIdx();
+	//! Stores index of the material (its position in the scene material buffer) into all vertices.
+	void setMaterialIdx(const int mIdx);
 
 	int copyTriangles(Triangle* buffer, int offset) const;
 protected:
 
 private:
 	int n_{ 0 }; /*!< Poet trojhelnk v sti. */
+	bool owns_triangles_{ true }; /*!< false when the triangles belong to an arena. */
 	Triangle* triangles_{ nullptr }; /*!< Trojhelnkov s. */
 
 	std::string name_{ "unknown" }; /*!< Nzev plochy. */
@@ -1,6 +1,10 @@
 #include "pch.h"
 #include "texture.h"
 
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0		//EXT_texture_compression_s3tc, supported by all desktop drivers
+#endif
+
 FIBITMAP* BitmapFromFile(const char* file_name, int& width, int& height) {
 	// image format
 	FREE_IMAGE_FORMAT fif = FIF_UNKNOWN;
@@ -38,6 +42,68 @@ FIBITMAP* BitmapFromFile(const char* file_name, int& width, int& height) {
 	return dib;
 }
 
+FIBITMAP* BitmapFromMemory(const void* data, const size_t size, int& width, int& height) {
+	FIMEMORY* memory = FreeImage_OpenMemory((BYTE*)data, DWORD(size));
+	FIBITMAP* dib = nullptr;
+
+	const FREE_IMAGE_FORMAT fif = FreeImage_GetFileTypeFromMemory(memory, 0);
+	if (fif != FIF_UNKNOWN && FreeImage_FIFSupportsReading(fif)) {
+		dib = FreeImage_LoadFromMemory(fif, memory);
+	}
+	FreeImage_CloseMemory(memory);
+
+	if (dib) {
+		width = int(FreeImage_GetWidth(dib));
+		height = int(FreeImage_GetHeight(dib));
+		if ((width == 0) || (height == 0)) {
+			FreeImage_Unload(dib);
+			dib = nullptr;
+		}
+	}
+
+	return dib;
+}
+
+bool BlocksFromDDS(const char* file_name, int& width, int& height, int& levels, std::vector<uint8_t>& blocks) {
+	std::string extension = std::string(file_name).substr(std::max<size_t>(strlen(file_name), 4) - 4);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(tolower(c)); });
+	if (extension != ".dds") {
+		return false;
+	}
+	FILE* file = fopen(file_name, "rb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	//DDS_HEADER, see WriteDDS of the cooker
+	uint32_t header[32] = {};
+	const bool dxt1 = fread(header, sizeof(header), 1, file) == 1 && header[0] == 0x20534444 && header[1] == 124 &&
+		(header[20] & 0x4) != 0 && header[21] == 0x31545844 && header[3] > 0 && header[4] > 0;
+	if (!dxt1) {
+		fclose(file);
+		return false;
+	}
+	const int w = int(header[4]), h = int(header[3]);
+	const int n = std::max(1, (header[2] & 0x20000) ? int(header[7]) : 1);
+
+	size_t size = 0;
+	for (int level = 0; level < n; level++) {
+		size += size_t((std::max(w >> level, 1) + 3) / 4) * size_t((std::max(h >> level, 1) + 3) / 4) * 8;
+	}
+	std::vector<uint8_t> data(size);
+	const bool read = fread(data.data(), size, 1, file) == 1;
+	fclose(file);
+	if (!read) {
+		return false;
+	}
+
+	width = w;
+	height = h;
+	levels = n;
+	blocks.swap(data);
+	return true;
+}
+
 FIBITMAP* Custom_FreeImage_ConvertToRGBF(FIBITMAP* dib) {
 	FIBITMAP* src = NULL;
 	FIBITMAP* dst = NULL;
@@ -492,6 +558,24 @@ void CreateBindlessTexture(GLuint& texture, GLuint64& handle, const int width, c
 	glMakeTextureHandleResidentARB(handle);
 }
 
+void CreateCompressedBindlessTexture(GLuint& texture, GLuint64& handle, const int width, const int height, const int levels, const uint8_t* blocks) {
+	glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);		//the cooked chain is complete
+	glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glTextureStorage2D(texture, levels, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, width, height);
+	for (int level = 0; level < levels; level++) {
+		const int w = std::max(width >> level, 1), h = std::max(height >> level, 1);
+		const GLsizei size = GLsizei(((w + 3) / 4) * ((h + 3) / 4) * 8);
+		glCompressedTextureSubImage2D(texture, level, 0, 0, w, h, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, size, blocks);
+		blocks += size;
+	}
+	handle = glGetTextureHandleARB(texture);
+	glMakeTextureHandleResidentARB(handle);
+}
+
 BindlessTexture LoadLODTextures(const std::initializer_list<const char*>& file_names) {
 	BindlessTexture res = {};
 
@@ -2,10 +2,16 @@
 #define TEXTURE_H_
 
 #include <vector>
+#include <functional>
+#include <cstdint>
 #include <freeimage.h>
 #include "color.h"
 
 FIBITMAP* BitmapFromFile(const char* file_name, int& width, int& height);
+// decodes an image file held in memory (e.g. embedded in a model), the data are not needed afterwards
+FIBITMAP* BitmapFromMemory(const void* data, const size_t size, int& width, int& height);
+// reads the DXT1 blocks of all mip levels of a .dds file (as written by CookAssets), false for other files and formats
+bool BlocksFromDDS(const char* file_name, int& width, int& height, int& levels, std::vector<uint8_t>& blocks);
 // Note that all float images in FreeImage are forced to have a range in <0, 1> after applying build-in conversions!!!
 // see https://sourceforge.net/p/freeimage/bugs/259/
 FIBITMAP* Custom_FreeImage_ConvertToRGBF(FIBITMAP* dib); // this fix removes clamp from conversion of float images
@@ -29,6 +35,8 @@ struct BindlessTexture {
 };
 
 void CreateBindlessTexture(GLuint& texture, GLuint64& handle, const int width, const int height, const GLvoid* data, GLenum dtype = GL_UNSIGNED_BYTE);
+// uploads DXT1 blocks of the whole mip chain as they are (see BlocksFromDDS), no mipmaps are generated
+void CreateCompressedBindlessTexture(GLuint& texture, GLuint64& handle, const int width, const int height, const int levels, const uint8_t* blocks);
 
 BindlessTexture LoadLODTextures(const std::initializer_list<const char*>& file_names);
 
@@ -44,8 +52,34 @@ public:
 		data_.resize(size_t(width) * size_t(height));
 	}
 
-	Texture(const std::string& file_name) {
-		FIBITMAP* dib = BitmapFromFile(file_name.c_str(), width_, height_);
+	//! Loads the texture from file, \a deferred only records the file name and decoding is left to \a Load.
+	Texture(const std::string& file_name, const bool deferred = false) : file_name_(file_name) {
+		if (!deferred) {
+			Load();
+		}
+	}
+
+	//! Decodes the bitmap produced by \a source (instead of a file) on \a Load, \a name is used in messages only.
+	/*!
+	The source is released once the texture is loaded.
+	*/
+	Texture(const std::string& name, std::function<FIBITMAP*(int&, int&)> source, const bool deferred = false)
+		: file_name_(name), source_(std::move(source)) {
+		if (!deferred) {
+			Load();
+		}
+	}
+
+	//! Decodes the source file into texture data, cooked .dds files are only read (see \a compressed).
+	void Load() {
+		const std::string& file_name = file_name_;
+		if (!source_ && BlocksFromDDS(file_name.c_str(), width_, height_, levels_, blocks_)) {
+			printf("Texture '%s' (%d x %d px, DXT1, %d levels, %0.1f MB) loaded.\n",
+				   file_name.c_str(), width_, height_, levels_, blocks_.size() / (1024.0f * 1024.0f));
+			return;
+		}
+		FIBITMAP* dib = source_ ? source_(width_, height_) : BitmapFromFile(file_name.c_str(), width_, height_);
+		source_ = nullptr;
 
 		if (dib) {
 			if (true) // always make sure that the loaded bitmap will fit the allocated data size
@@ -111,10 +145,30 @@ public:
 		return height_;
 	}
 
+	//! Source file of the texture (empty for textures created in memory).
+	const std::string& file_name() const {
+		return file_name_;
+	}
+
 	T* data() {
 		return data_.data();
 	}
 
+	//! Loaded from a cooked .dds file, the texture has DXT1 blocks of all its mip levels instead of pixel data.
+	bool compressed() const {
+		return !blocks_.empty();
+	}
+
+	//! Creates a resident bindless texture of the (8 bit) pixel data or of the compressed blocks.
+	void CreateBindless(GLuint& texture, GLuint64& handle) {
+		if (compressed()) {
+			CreateCompressedBindlessTexture(texture, handle, width_, height_, levels_, blocks_.data());
+		}
+		else {
+			CreateBindlessTexture(texture, handle, width_, height_, data_.data());
+		}
+	}
+
 	FIBITMAP* Convert(FIBITMAP* dib) {
 		throw "Convert method is defined only for particular Texture types";
 
@@ -161,9 +215,14 @@ public:
 	}
 private:
 	std::vector<T> data_;
+	std::vector<uint8_t> blocks_;		//of compressed textures
 
 	int width_{ 0 };
 	int height_{ 0 };
+	int levels_{ 0 };
+
+	std::string file_name_;
+	std::function<FIBITMAP*(int&, int&)> source_;
 };
 
 using Texture3f = Texture<Color3f, FIT_RGBF>;
@@ -28,6 +28,8 @@ public:
 	\param v1 druh vrchol trojhelnka.
 	\param v2 tet vrchol trojhelnka.
 	\param surface ukazatel na plochu, j je trojhelnk lenem.
+
+	Tangents of the vertices are kept as given, they are computed for whole meshes by GenerateTangents.
 	*/
 	Triangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, Surface* surface = NULL);
 
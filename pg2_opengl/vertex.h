@@ -26,9 +26,9 @@ public:
 	Coord2f texture_coords[NO_TEXTURE_COORDS]; /*!< Texturovac souadnice. */
 	Vector3 tangent; /*!< Prvn osa souadnho systmu tangenta-bitangenta-normla. */
 
-	int32_t matIdx;
+	int32_t matIdx{ 0 };
 
-	char pad_[4]; // doplnn na 64 byt, mlo by to mt alespo 4 byty, aby se sem veel 32-bitov ukazatel
+	float handedness{ 1.0f }; /*!< Orientation of the bitangent B = handedness * (N x T), -1 for mirrored texture mapping (also pads the vertex to 64 bytes). */
 
 	//! Vchoz konstruktor.
 	/*!